@@ -83,3 +83,21 @@ void board_deinit(void)
     USART_DeInit(USART3);
 }
 
+
+
+/**
+ * Start the application.
+ *
+ * \param  stack    initial stack pointer
+ * \param  entry    reset handler
+ */
+void board_jump(uint32_t stack, uint32_t entry)
+{
+    asm volatile(
+        "msr    msp, %0        \n\t"
+        "bx     %1             \n\t"
+        : : "r" (stack), "r" (entry)
+    );
+
+    __builtin_unreachable();
+}
@@ -7,8 +7,14 @@
 #define LED_RED         4
 #define LED_BLUE        8
 
+// Code that must keep running while the flash is busy. Calls from
+// flash to RAM are out of range for a normal branch.
+//
+#define RAMFUNC     __attribute__((section(".ramfunc"), noinline, long_call))
+
 extern volatile uint32_t tickcount;
 
 void  board_set_leds(int leds);
 void  board_init(void);
 void  board_deinit(void);
+void  board_jump(uint32_t stack, uint32_t entry) __attribute__((noreturn));
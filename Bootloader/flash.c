@@ -0,0 +1,144 @@
+/**
+ * \file
+ * Flash erase and programming
+ *
+ * The CPU stalls on every flash access while an erase or program
+ * operation is running, and a sector erase takes up to 2 seconds.
+ * To keep the link going, the operations are started and waited
+ * for in RAM with interrupts disabled, polling the UART meanwhile.
+ * Responses that were queued before still go out, and the host
+ * can send the next requests, which are buffered.
+ */
+#include "flash.h"
+#include "board.h"
+#include "uart.h"
+#include "stm32f4xx.h"
+#include "Shared/errors.h"
+
+#include <errno.h>
+
+
+#if FLASH_PSIZE == 3
+typedef uint64_t flash_word_t;
+#elif FLASH_PSIZE == 2
+typedef uint32_t flash_word_t;
+#elif FLASH_PSIZE == 1
+typedef uint16_t flash_word_t;
+#else
+typedef uint8_t  flash_word_t;
+#endif
+
+#define FLASH_CR_PSIZE_BITS     (FLASH_PSIZE << 8)
+
+#define FLASH_SR_ERRORS  \
+    (FLASH_FLAG_OPERR  | FLASH_FLAG_WRPERR | FLASH_FLAG_PGAERR | \
+     FLASH_FLAG_PGPERR | FLASH_FLAG_PGSERR)
+
+
+// Translate the status register, like FLASH_GetStatus()
+//
+static int status_to_errno(uint32_t sr)
+{
+    if (sr & FLASH_FLAG_WRPERR)
+        return FLASH_Status_TO_ERRNO(FLASH_ERROR_WRP);
+
+    if (sr & (FLASH_FLAG_PGAERR | FLASH_FLAG_PGPERR | FLASH_FLAG_PGSERR))
+        return FLASH_Status_TO_ERRNO(FLASH_ERROR_PROGRAM);
+
+    if (sr & FLASH_FLAG_OPERR)
+        return FLASH_Status_TO_ERRNO(FLASH_ERROR_OPERATION);
+
+    return 0;
+}
+
+
+RAMFUNC static uint32_t erase_wait(uint32_t cr)
+{
+    uint32_t sr;
+
+    FLASH->CR = cr;
+    FLASH->CR = cr | FLASH_CR_STRT;
+
+    while ((sr = FLASH->SR) & FLASH_SR_BSY)
+        uart_poll();
+
+    FLASH->CR = 0;
+    return sr;
+}
+
+
+RAMFUNC static uint32_t program_wait(
+    volatile flash_word_t *dst, const flash_word_t *src, size_t n)
+{
+    uint32_t sr = 0;
+
+    FLASH->CR = FLASH_CR_PSIZE_BITS | FLASH_CR_PG;
+
+    while (n--) {
+        *dst++ = *src++;
+
+        while ((sr = FLASH->SR) & FLASH_SR_BSY)
+            uart_poll();
+
+        if (sr & FLASH_SR_ERRORS)
+            break;
+    }
+
+    FLASH->CR = 0;
+    return sr;
+}
+
+
+static bool finish(uint32_t sr)
+{
+    FLASH->SR = FLASH_SR_ERRORS;    // write 1 to clear
+    FLASH_Lock();
+    __enable_irq();
+
+    errno = status_to_errno(sr);
+    return errno == 0;
+}
+
+
+bool flash_erase_sector(int sector)
+{
+    __disable_irq();
+    FLASH_Unlock();
+    FLASH->SR = FLASH_SR_ERRORS;
+
+    uint32_t sr = erase_wait(FLASH_CR_PSIZE_BITS | FLASH_CR_SER | (sector << 3));
+
+    // The data cache may still hold the old contents
+    //
+    if (FLASH->ACR & FLASH_ACR_DCEN) {
+        FLASH->ACR &= ~FLASH_ACR_DCEN;
+        FLASH->ACR |=  FLASH_ACR_DCRST;
+        FLASH->ACR &= ~FLASH_ACR_DCRST;
+        FLASH->ACR |=  FLASH_ACR_DCEN;
+    }
+
+    return finish(sr);
+}
+
+
+/**
+ * Program flash memory.
+ *
+ * \param  addr     destination, aligned to FLASH_WORD_SIZE
+ * \param  data     source, aligned to FLASH_WORD_SIZE
+ * \param  size     multiple of FLASH_WORD_SIZE
+ */
+bool flash_program(uint32_t addr, const void *data, size_t size)
+{
+    if ((addr | (uintptr_t)data | size) & (FLASH_WORD_SIZE - 1)) {
+        errno = EBOOT_RANGE;
+        return false;
+    }
+
+    __disable_irq();
+    FLASH_Unlock();
+    FLASH->SR = FLASH_SR_ERRORS;
+
+    uint32_t sr = program_wait((void*)addr, data, size / FLASH_WORD_SIZE);
+    return finish(sr);
+}
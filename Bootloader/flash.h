@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Program and erase parallelism, log2 of the bytes per write.
+// 2 (x32) is the widest without external Vpp (VoltageRange_3),
+// 3 (x64) needs VoltageRange_4.
+//
+#define FLASH_PSIZE     2
+
+#define FLASH_WORD_SIZE (1 << FLASH_PSIZE)
+
+bool flash_erase_sector(int sector);
+bool flash_program(uint32_t addr, const void *data, size_t size);
@@ -0,0 +1,84 @@
+/**
+ * \file
+ * Board support for the host build
+ *
+ * The systick runs in a thread. The application is replaced by a
+ * stand-in that only answers the reset hack of BootProtocol.
+ */
+#include "board.h"
+#include "host.h"
+#include "uart.h"
+#include "msg_packet.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+volatile uint32_t tickcount;
+
+
+int64_t host_time_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+
+static void *systick_thread(void *arg)
+{
+    int64_t t0 = host_time_us();
+
+    for (;;) {
+        tickcount = (host_time_us() - t0) / 1000;
+        usleep(500);
+    }
+
+    return NULL;
+}
+
+
+void board_set_leds(int leds)
+{
+}
+
+
+void board_init(void)
+{
+    pthread_t thread;
+    pthread_create(&thread, NULL, systick_thread, NULL);
+}
+
+
+void board_deinit(void)
+{
+}
+
+
+void board_jump(uint32_t stack, uint32_t entry)
+{
+    static struct msg_large msg;
+
+    const char *s = "Application running (emulated)\n";
+
+    struct msg_shell_to_pc *out = (void*)&msg;
+    out->h.id = MSG_ID_SHELL_TO_PC;
+    out->h.data_len = strlen(s);
+    memcpy(out->data, s, out->h.data_len);
+    msg_send(&out->h);
+
+    // See BootProtocol::bootResetHack()
+    //
+    for (;;) {
+        if (msg_recv(&msg.h) < 0 || msg.h.id != MSG_ID_SHELL_FROM_PC)
+            continue;
+
+        if (memmem(msg.data, msg.h.data_len, "reset", 5) != NULL) {
+            uart_flush();
+            exit(0);
+        }
+    }
+}
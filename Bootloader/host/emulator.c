@@ -0,0 +1,227 @@
+/**
+ * \file
+ * Bootloader emulator
+ *
+ * Runs Bootloader/main.c on a Linux host with emulated flash and UART,
+ * so QuadControl can flash it through wifly://localhost:<port> or
+ * serial://<pty>. Every reset starts the bootloader in a new process,
+ * which clears its state like the real one.
+ *
+ * Copyright (c)2015 Thomas Kindler <mail@t-kindler.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "host.h"
+#include "Shared/errors.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+
+int boot_main(void);    // Bootloader/main.c
+
+
+// newlib's strerror() knows the codes in Shared/errors.h, glibc's doesn't
+//
+char *__real_strerror(int errnum);
+
+char *__wrap_strerror(int errnum)
+{
+    if (errnum >= EUSER_BASE)
+        return (char*)_user_strerror(errnum);
+
+    return __real_strerror(errnum);
+}
+
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  -p <port>    TCP port to listen on (2000)\n"
+        "  -t           use a pseudo terminal instead\n"
+        "  -f <file>    flash image, created if missing\n"
+        "  -b <baud>    link speed, 0 for unlimited (115200)\n"
+        "  -l <ms>      link latency in each direction (0)\n"
+        "  -e <ms>      erase time of a 128 KB sector (1000)\n"
+        "  -w <us>      program time per word (16)\n",
+        name
+    );
+
+    exit(1);
+}
+
+
+static int open_pty(void)
+{
+    int fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (fd < 0 || grantpt(fd) < 0 || unlockpt(fd) < 0)
+        return -1;
+
+    // Keep the slave side open, so the master doesn't
+    // see a hangup when a client closes it
+    //
+    int slave = open(ptsname(fd), O_RDWR | O_NOCTTY);
+    if (slave < 0)
+        return -1;
+
+    struct termios tio;
+    tcgetattr(slave, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(slave, TCSANOW, &tio);
+
+    printf("Listening on %s\n", ptsname(fd));
+    return fd;
+}
+
+
+static int open_server(int port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port   = htons(port),
+        .sin_addr   = { .s_addr = htonl(INADDR_ANY) }
+    };
+
+    if (bind(fd, (void*)&addr, sizeof(addr)) < 0 || listen(fd, 1) < 0)
+        return -1;
+
+    return fd;
+}
+
+
+/**
+ * Run the bootloader until the host disconnects.
+ *
+ * \return  false on errors
+ */
+static bool run(int fd, int baudrate, int latency)
+{
+    for (;;) {
+        fflush(stdout);
+        pid_t pid = fork();
+
+        if (pid < 0)
+            return false;
+
+        if (pid == 0) {
+            host_uart_attach(fd, baudrate, latency);
+            boot_main();
+            exit(0);
+        }
+
+        int status;
+        if (waitpid(pid, &status, 0) < 0)
+            return false;
+
+        if (!WIFEXITED(status)) {
+            fprintf(stderr, "Bootloader crashed\n");
+            return false;
+        }
+
+        if (WEXITSTATUS(status) == HOST_EXIT_DISCONNECT)
+            return true;
+
+        printf("Reset\n");
+    }
+}
+
+
+int main(int argc, char *argv[])
+{
+    int port = 2000, baudrate = 115200, latency = 0;
+    int erase_ms = 1000, program_us = 16;
+    bool use_pty = false;
+    const char *file_name = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "p:tf:b:l:e:w:")) != -1) {
+        switch (opt) {
+        case 'p':   port = atoi(optarg);        break;
+        case 't':   use_pty = true;             break;
+        case 'f':   file_name = optarg;         break;
+        case 'b':   baudrate = atoi(optarg);    break;
+        case 'l':   latency = atoi(optarg);     break;
+        case 'e':   erase_ms = atoi(optarg);    break;
+        case 'w':   program_us = atoi(optarg);  break;
+        default:    usage(argv[0]);
+        }
+    }
+
+    if (optind != argc)
+        usage(argv[0]);
+
+    signal(SIGPIPE, SIG_IGN);
+
+    if (!host_flash_init(file_name)) {
+        perror("Can't map flash");
+        return 1;
+    }
+
+    host_flash_timing(erase_ms, program_us);
+
+    if (use_pty) {
+        int fd = open_pty();
+        if (fd < 0) {
+            perror("Can't open pty");
+            return 1;
+        }
+
+        return run(fd, baudrate, latency) ? 0 : 1;
+    }
+
+    int server = open_server(port);
+    if (server < 0) {
+        perror("Can't listen");
+        return 1;
+    }
+
+    for (;;) {
+        printf("Listening on port %d\n", port);
+        fflush(stdout);
+
+        int fd = accept(server, NULL, NULL);
+        if (fd < 0) {
+            perror("accept");
+            return 1;
+        }
+
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        printf("Connected\n");
+
+        bool ok = run(fd, baudrate, latency);
+        close(fd);
+
+        if (!ok)
+            return 1;
+    }
+}
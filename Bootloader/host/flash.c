@@ -0,0 +1,150 @@
+/**
+ * \file
+ * Emulated flash for the host build
+ *
+ * The 1 MB of the STM32F405 are mapped at their real address, so the
+ * bootloader can read them directly. The mapping is shared, so the
+ * contents survive a reset, and may be backed by an image file.
+ *
+ * Erase and program operations take the configured time, while the
+ * UART keeps running like in Bootloader/flash.c. Programming a bit
+ * from 0 to 1 fails, which the hardware would silently ignore.
+ */
+#include "flash.h"
+#include "host.h"
+#include "uart.h"
+#include "Shared/errors.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+static const struct { uint32_t addr, size; } flash_sectors[] = {
+    { 0x08000000, 0x4000  }, { 0x08004000, 0x4000  },
+    { 0x08008000, 0x4000  }, { 0x0800C000, 0x4000  },
+    { 0x08010000, 0x10000 }, { 0x08020000, 0x20000 },
+    { 0x08040000, 0x20000 }, { 0x08060000, 0x20000 },
+    { 0x08080000, 0x20000 }, { 0x080A0000, 0x20000 },
+    { 0x080C0000, 0x20000 }, { 0x080E0000, 0x20000 }
+};
+
+#define NUM_SECTORS     (sizeof(flash_sectors) / sizeof(flash_sectors[0]))
+
+// Typical values from the datasheet for x32 parallelism
+//
+static int erase_time  = 1000;      // per 128 KB [ms]
+static int program_time = 16;       // per word [us]
+
+
+void host_flash_timing(int erase_ms, int program_us)
+{
+    erase_time   = erase_ms;
+    program_time = program_us;
+}
+
+
+/**
+ * Map the flash memory.
+ *
+ * \param  file_name    image file, or NULL for erased flash
+ *                      that is lost on exit
+ */
+bool host_flash_init(const char *file_name)
+{
+    int fd = -1, flags = MAP_SHARED | MAP_FIXED;
+    bool fill = true;
+
+    if (file_name != NULL) {
+        if ((fd = open(file_name, O_RDWR | O_CREAT, 0644)) < 0)
+            return false;
+
+        struct stat st;
+        if (fstat(fd, &st) < 0 || ftruncate(fd, HOST_FLASH_SIZE) < 0) {
+            close(fd);
+            return false;
+        }
+
+        fill = (st.st_size == 0);
+    }
+    else {
+        flags |= MAP_ANONYMOUS;
+    }
+
+    void *mem = mmap((void*)HOST_FLASH_BASE, HOST_FLASH_SIZE,
+        PROT_READ | PROT_WRITE, flags, fd, 0);
+
+    if (fd >= 0)
+        close(fd);
+
+    if (mem == MAP_FAILED)
+        return false;
+
+    if (fill)
+        memset(mem, 0xFF, HOST_FLASH_SIZE);
+
+    return true;
+}
+
+
+// Keep the UART running, see Bootloader/flash.c
+//
+static void busy_wait(int64_t us)
+{
+    int64_t end = host_time_us() + us;
+
+    while (host_time_us() < end) {
+        uart_poll();
+        usleep(100);
+    }
+}
+
+
+bool flash_erase_sector(int sector)
+{
+    if (sector < 0 || sector >= NUM_SECTORS) {
+        errno = EFLASH_OPERATION;
+        return false;
+    }
+
+    uint32_t size = flash_sectors[sector].size;
+    busy_wait((int64_t)erase_time * 1000 * size / 0x20000);
+
+    memset((void*)(uintptr_t)flash_sectors[sector].addr, 0xFF, size);
+    return true;
+}
+
+
+bool flash_program(uint32_t addr, const void *data, size_t size)
+{
+    if ((addr | (uintptr_t)data | size) & (FLASH_WORD_SIZE - 1)) {
+        errno = EBOOT_RANGE;
+        return false;
+    }
+
+    if (addr < HOST_FLASH_BASE || addr + size > HOST_FLASH_BASE + HOST_FLASH_SIZE) {
+        errno = EFLASH_PROGRAM;
+        return false;
+    }
+
+    busy_wait((int64_t)program_time * size / FLASH_WORD_SIZE);
+
+    uint8_t *dst = (void*)(uintptr_t)addr;
+    const uint8_t *src = data;
+
+    for (size_t i=0; i < size; i++) {
+        if ((dst[i] & src[i]) != src[i]) {
+            fprintf(stderr, "flash: 0x%08lx not erased\n", (unsigned long)(addr + i));
+            errno = EFLASH_PROGRAM;
+            return false;
+        }
+
+        dst[i] = src[i];
+    }
+
+    return true;
+}
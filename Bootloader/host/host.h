@@ -0,0 +1,23 @@
+#pragma once
+
+/**
+ * \file
+ * Host build of the bootloader, see emulator.c
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define HOST_FLASH_BASE     0x08000000
+#define HOST_FLASH_SIZE     0x100000
+
+// Exit status of the bootloader process when the host disconnects
+//
+#define HOST_EXIT_DISCONNECT    2
+
+bool host_flash_init(const char *file_name);
+void host_flash_timing(int erase_ms, int program_us);
+
+void host_uart_attach(int fd, int baudrate, int latency_ms);
+
+int64_t host_time_us(void);
@@ -0,0 +1,17 @@
+#pragma once
+
+/**
+ * \file
+ * Stand-in for the device header in the host build, see emulator.c.
+ * Provides what the portable parts of the bootloader use.
+ */
+
+#include <stdlib.h>
+
+// Restart the bootloader in a fresh process
+//
+__attribute__((noreturn))
+static inline void NVIC_SystemReset(void)
+{
+    exit(0);
+}
@@ -0,0 +1,230 @@
+/**
+ * \file
+ * Emulated UART for the host build
+ *
+ * Each direction is a serial line: a byte takes 10 bit times at the
+ * emulated baud rate, and arrives after the link latency. The receive
+ * buffer has the size of the real one. When it is full, the socket is
+ * no longer read, which holds off the sender like RTS.
+ */
+#include "uart.h"
+#include "host.h"
+#include "ringbuf.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CHUNK_SIZE      64          // bytes per delivery
+
+struct chunk {
+    struct chunk    *next;
+    int64_t         due;            // [us]
+    size_t          len;
+    uint8_t         data[CHUNK_SIZE];
+};
+
+struct line {
+    struct chunk    *head, *tail;
+    int64_t         free_at;        // end of the last byte on the line [us]
+    size_t          queued;         // bytes not yet delivered
+};
+
+static int link_fd = -1;
+static int link_latency;            // [us]
+static int byte_time;               // [ns], 0 for unlimited
+
+static struct line rx_line, tx_line;
+
+static struct ringbuf rx_buf = RINGBUF( UART_RX_BUFFER_SIZE );
+
+#define TX_BUF_SIZE     4096
+#define RADIO_BUF_SIZE  4096
+
+
+void host_uart_attach(int fd, int baudrate, int latency_ms)
+{
+    link_fd = fd;
+    link_latency = latency_ms * 1000;
+    byte_time = baudrate ? 10 * 1000000000LL / baudrate : 0;
+}
+
+
+static void line_put(struct line *l, const uint8_t *data, size_t len)
+{
+    int64_t now = host_time_us();
+
+    while (len > 0) {
+        struct chunk *c = malloc(sizeof(*c));
+        c->next = NULL;
+        c->len  = len < CHUNK_SIZE ? len : CHUNK_SIZE;
+        memcpy(c->data, data, c->len);
+
+        if (l->free_at < now)
+            l->free_at = now;
+
+        l->free_at += c->len * byte_time / 1000;
+        c->due = l->free_at + link_latency;
+
+        if (l->tail)
+            l->tail->next = c;
+        else
+            l->head = c;
+
+        l->tail = c;
+        l->queued += c->len;
+
+        data += c->len;
+        len  -= c->len;
+    }
+}
+
+
+static struct chunk *line_get(struct line *l)
+{
+    struct chunk *c = l->head;
+    if (c == NULL || c->due > host_time_us())
+        return NULL;
+
+    return c;
+}
+
+
+static void line_pop(struct line *l)
+{
+    struct chunk *c = l->head;
+
+    l->head = c->next;
+    if (l->head == NULL)
+        l->tail = NULL;
+
+    l->queued -= c->len;
+    free(c);
+}
+
+
+/**
+ * Move data between the socket and the buffers.
+ *
+ * Exits with HOST_EXIT_DISCONNECT when the connection is closed.
+ */
+void uart_poll(void)
+{
+    struct chunk *c;
+
+    while ((c = line_get(&tx_line)) != NULL) {
+        if (write(link_fd, c->data, c->len) < 0 && errno != EINTR)
+            exit(HOST_EXIT_DISCONNECT);
+
+        line_pop(&tx_line);
+    }
+
+    while ((c = line_get(&rx_line)) != NULL && rb_bytes_free(&rx_buf) >= c->len) {
+        rb_write(&rx_buf, c->data, c->len);
+        line_pop(&rx_line);
+    }
+
+    // Accept what is on the line and a bit more, like the
+    // buffer of a radio module
+    //
+    while (rx_line.queued < rb_bytes_free(&rx_buf) + RADIO_BUF_SIZE) {
+        struct pollfd pfd = { .fd = link_fd, .events = POLLIN };
+        if (poll(&pfd, 1, 0) <= 0)
+            break;
+
+        uint8_t buf[1024];
+        ssize_t n = read(link_fd, buf, sizeof(buf));
+
+        if (n == 0 || (n < 0 && errno != EINTR && errno != EAGAIN))
+            exit(HOST_EXIT_DISCONNECT);
+
+        if (n > 0)
+            line_put(&rx_line, buf, n);
+    }
+}
+
+
+// Sleep until there is something to do, at most 1 ms
+//
+static void uart_wait(void)
+{
+    int64_t now = host_time_us();
+    int timeout = 1;
+
+    if (rx_line.head && rx_line.head->due <= now + 1000)
+        timeout = 0;
+
+    if (tx_line.head && tx_line.head->due <= now + 1000)
+        timeout = 0;
+
+    if (timeout) {
+        struct pollfd pfd = { .fd = link_fd, .events = POLLIN };
+        poll(&pfd, 1, timeout);
+    }
+}
+
+
+void uart_putc(char c)
+{
+    uart_write(&c, 1);
+}
+
+
+int uart_getc(void)
+{
+    // Service the link every 100 us, not on every byte
+    //
+    static int64_t t_poll;
+    int64_t now = host_time_us();
+
+    if (rb_bytes_used(&rx_buf) == 0 || now - t_poll > 100) {
+        uart_poll();
+        t_poll = now;
+    }
+
+    int c = rb_getchar(&rx_buf);
+    if (c < 0)
+        uart_wait();
+
+    return c;
+}
+
+
+void printf_putchar(char c)
+{
+    if (c == '\n')
+        uart_putc('\r');
+
+    uart_putc(c);
+}
+
+
+void uart_flush(void)
+{
+    while (tx_line.head != NULL) {
+        uart_poll();
+        uart_wait();
+    }
+}
+
+
+ssize_t uart_write(const void *buf, size_t len)
+{
+    // Block while the transmit buffer is full
+    //
+    while (tx_line.free_at - host_time_us() > (int64_t)TX_BUF_SIZE * byte_time / 1000) {
+        uart_poll();
+        uart_wait();
+    }
+
+    line_put(&tx_line, buf, len);
+    uart_poll();
+
+    return len;
+}
+
+
+void uart_init(int baudrate)
+{
+}
@@ -1,24 +1,35 @@
 #include "board.h"
 #include "uart.h"
 #include "msg_packet.h"
+#include "flash.h"
 #include "stm32f4xx.h"
 #include "version.h"
 #include "small_printf.h"
 
 #include "Shared/crc32_sm.h"
+#include "Shared/crc32_stm32.h"
+#include "Shared/lzss.h"
 #include "Shared/msg_structs.h"
 #include "Shared/errors.h"
+#include "Shared/rlink.h"
 
 #include <string.h>
 #include <stdio.h>
 #include <ctype.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <inttypes.h>
 
 
 #define XBEE_BAUDRATE       115200
 #define BOOT_TIMEOUT        2000        // [ms]
 
+#define RLINK_TX_SLOTS      8
+#define RLINK_RX_SLOTS      8
+#define RLINK_RTO           250         // [ms]
+
+#define BENCH_SOURCE_TIMEOUT    10000   // [ms]
+
 
 #define APP_START           0x08010000
 #define APP_END             0x08100000
@@ -36,10 +47,62 @@ static volatile const struct version_info *app_info =  \
     (void*)(APP_START + VERSION_INFO_OFFSET);
 
 
+// Written after the image, once its checksum has passed. The
+// next boots can skip the checksum. Any erase or write first
+// clears it to zero, which moves the marker to the next slot.
+//
+#define APP_MARKER_MAGIC    0x56414C44      // "VALD"
+#define APP_MARKER_SLOTS    16
+
+struct app_marker {
+    uint32_t    magic;
+    uint32_t    image_crc;      // same as in app_info
+};
+
+
+static const struct { uint32_t addr, size; } flash_sectors[] = {
+    { 0x08000000, 0x4000  }, { 0x08004000, 0x4000  },
+    { 0x08008000, 0x4000  }, { 0x0800C000, 0x4000  },
+    { 0x08010000, 0x10000 }, { 0x08020000, 0x20000 },
+    { 0x08040000, 0x20000 }, { 0x08060000, 0x20000 },
+    { 0x08080000, 0x20000 }, { 0x080A0000, 0x20000 },
+    { 0x080C0000, 0x20000 }, { 0x080E0000, 0x20000 }
+};
+
+
 #define DBG_PRINTF(...)
 // #define DBG_PRINTF  msg_printf
 
 
+// Reliable transport, see MSG_ID_LINK_SETUP. Responses go
+// back the same way the request came in.
+//
+static struct rlink boot_link;
+static bool reply_reliable;
+
+static uint8_t link_tx_buf[RLINK_TX_SLOTS][RLINK_SLOT_SIZE(MSG_MAX_DATA_SIZE)]
+    __attribute__((aligned(4)));
+
+static uint8_t link_rx_buf[RLINK_RX_SLOTS][RLINK_SLOT_SIZE(MSG_MAX_LINK_DATA_SIZE)]
+    __attribute__((aligned(4)));
+
+
+static int link_send(void *ctx, struct msg_header *msg)
+{
+    return msg_send(msg);
+}
+
+
+static void link_init(void)
+{
+    rlink_init(&boot_link, link_send, NULL,
+        link_tx_buf, sizeof(link_tx_buf[0]), RLINK_TX_SLOTS,
+        link_rx_buf, sizeof(link_rx_buf[0]), RLINK_RX_SLOTS,
+        RLINK_RTO
+    );
+}
+
+
 static int send_response(int error, const void *data, size_t len)
 {
     struct msg_boot_response msg;
@@ -52,7 +115,11 @@ static int send_response(int error, const void *data, size_t len)
     msg.error = error;
     memcpy(msg.data, data, len);
 
-    msg_send(&msg.h);
+    if (reply_reliable)
+        rlink_send(&boot_link, &msg.h, tickcount);
+    else
+        msg_send(&msg.h);
+
     return len;
 }
 
@@ -110,6 +177,31 @@ static bool check_empty(const void *mem, size_t size)
 {
     const uint8_t *c = mem;
 
+    while (size && ((uintptr_t)c & 3)) {
+        if (*c++ != 0xFF)
+            return false;
+        size--;
+    }
+
+    // Whole words, four at a time
+    //
+    const uint32_t *w = (const uint32_t *)c;
+
+    while (size >= 16) {
+        if ((w[0] & w[1] & w[2] & w[3]) != 0xFFFFFFFF)
+            return false;
+        w += 4;
+        size -= 16;
+    }
+
+    while (size >= 4) {
+        if (*w++ != 0xFFFFFFFF)
+            return false;
+        size -= 4;
+    }
+
+    c = (const uint8_t *)w;
+
     while (size--) {
         if (*c++ != 0xFF)
             return false;
@@ -151,6 +243,66 @@ static bool set_option_bytes(void)
 }
 
 
+/**
+ * Find the marker slot of the current image.
+ *
+ * Skips cleared slots and markers of other images.
+ *
+ * \return  the marker, a free slot, or NULL if there is none
+ */
+static volatile const struct app_marker *find_marker(void)
+{
+    if (!APP_RANGE_VALID(APP_START, app_info->image_size))
+        return NULL;
+
+    uint32_t addr = APP_START + app_info->image_size;
+
+    for (int i=0; i < APP_MARKER_SLOTS; i++) {
+        volatile const struct app_marker *m = (void*)(uintptr_t)addr;
+
+        if (addr + sizeof(*m) > APP_END)
+            return NULL;
+
+        bool cleared = (m->magic == 0 && m->image_crc == 0);
+        bool other   = (m->magic == APP_MARKER_MAGIC && m->image_crc != app_info->image_crc);
+
+        if (!cleared && !other) {
+            if (m->magic == APP_MARKER_MAGIC || check_empty((void*)m, sizeof(*m)))
+                return m;
+
+            return NULL;
+        }
+
+        addr += sizeof(*m);
+    }
+
+    return NULL;
+}
+
+
+/**
+ * Clear the marker before the first change to the flash.
+ *
+ */
+static bool invalidate_marker(void)
+{
+    static bool done;
+    if (done)
+        return true;
+
+    volatile const struct app_marker *m = find_marker();
+
+    if (m != NULL && m->magic == APP_MARKER_MAGIC) {
+        static const struct app_marker zero __attribute__((aligned(4)));
+        if (!flash_program((uintptr_t)m, &zero, sizeof(zero)))
+            return false;
+    }
+
+    done = true;
+    return true;
+}
+
+
 static bool check_app(void)
 {
     if (!APP_RANGE_VALID(APP_START, app_info->image_size)) {
@@ -158,8 +310,15 @@ static bool check_app(void)
         return false;
     }
 
+    volatile const struct app_marker *m = find_marker();
+
+    if (m != NULL && m->magic == APP_MARKER_MAGIC) {
+        msg_printf("  Image validated before\n");
+        return true;
+    }
+
     uint32_t crc = crc32_init();
-    crc = crc32_update(crc, (void*)APP_START, app_info->image_size);
+    crc = crc32_update_hw(crc, (void*)APP_START, app_info->image_size);
     crc = crc32_finalize(crc);
 
     if (crc != 0) {
@@ -167,6 +326,17 @@ static bool check_app(void)
         return false;
     }
 
+    // Failing to write the marker only costs time on the next boot
+    //
+    if (m != NULL) {
+        struct app_marker marker = {
+            .magic     = APP_MARKER_MAGIC,
+            .image_crc = app_info->image_crc
+        };
+
+        flash_program((uintptr_t)m, &marker, sizeof(marker));
+    }
+
     return true;
 }
 
@@ -179,9 +349,9 @@ static bool start_app(void)
     uint32_t  entry = ((const uint32_t *)APP_START)[1];
 
     msg_printf(
-        "  Initial stack: 0x%08lx\n"
-        "  Entry point  : 0x%08lx\n"
-        "  Image size   : %lu\n",
+        "  Initial stack: 0x%08" PRIx32 "\n"
+        "  Entry point  : 0x%08" PRIx32 "\n"
+        "  Image size   : %" PRIu32 "\n",
         stack, entry, app_info->image_size
     );
 
@@ -195,12 +365,7 @@ static bool start_app(void)
 
     board_set_leds(LED_RED | LED_GREEN);
     board_deinit();
-
-    asm volatile(
-        "msr    msp, %0        \n\t"
-        "bx     %1             \n\t"
-        : : "r" (stack), "r" (entry)
-    );
+    board_jump(stack, entry);
 
     return true;
 }
@@ -225,9 +390,25 @@ static int boot_exit;
 } while(0);
 
 
+// Sector erases are acknowledged before they run, so the host can
+// send the next requests meanwhile. A failure is reported with the
+// next request that depends on the flash contents.
+//
+static int flash_error;
+
+
+#define CHECK_FLASH_ERROR() do {        \
+    if (flash_error) {                  \
+        int err = flash_error;          \
+        flash_error = 0;                \
+        RETURN_ERROR(err);              \
+    }                                   \
+} while(0);
+
+
 static bool handle_boot_enter(const struct msg_boot_enter *msg)
 {
-    msg_printf("boot_enter(0x%08lx)\n", msg->magic);
+    msg_printf("boot_enter(0x%08" PRIx32 ")\n", msg->magic);
 
     if (msg->magic != BOOT_ENTER_MAGIC)
         RETURN_ERROR(EBOOT_MAGIC);
@@ -238,62 +419,177 @@ static bool handle_boot_enter(const struct msg_boot_enter *msg)
 }
 
 
+static bool handle_link_setup(const struct msg_link_setup *msg)
+{
+    msg_set_max_data_size(msg->max_data_size);
+
+    struct msg_link_setup res = {
+        .max_data_size  = msg_get_max_data_size(),
+        .flags          = msg->flags & LINK_FLAG_RLINK,
+        .rx_buffer_size = UART_RX_BUFFER_SIZE
+    };
+
+    // Start a new reliable session
+    //
+    link_init();
+
+    msg_printf("link_setup(%d, 0x%x): %d\n",
+        msg->max_data_size, msg->flags, res.max_data_size
+    );
+
+    RETURN_DATA(&res.max_data_size, 6);
+}
+
+
 static bool handle_boot_read_data(const struct msg_boot_read_data *msg)
 {
-    DBG_PRINTF("boot_read_data(%04lx, %d)\n",
+    DBG_PRINTF("boot_read_data(%04" PRIx32 ", %d)\n",
         msg->address, msg->length
     );
 
+    // Leave room for the rlink header
+    //
     int len = msg->length;
-    if (len > FIELD_SIZEOF(struct msg_boot_response, data))
-        len = FIELD_SIZEOF(struct msg_boot_response, data);
+    if (len > FIELD_SIZEOF(struct msg_boot_response, data) - RLINK_HEADER_SIZE)
+        len = FIELD_SIZEOF(struct msg_boot_response, data) - RLINK_HEADER_SIZE;
 
-    RETURN_DATA((void*)msg->address, len);
+    RETURN_DATA((void*)(uintptr_t)msg->address, len);
 }
 
 
 static bool handle_boot_verify(const struct msg_boot_verify *msg)
 {
-    msg_printf("boot_verify(0x%04lx, %lu): ",
+    msg_printf("boot_verify(0x%04" PRIx32 ", %" PRIu32 "): ",
         msg->address, msg->length
     );
 
+    CHECK_FLASH_ERROR();
+
     if (!APP_RANGE_VALID(msg->address, msg->length))
         RETURN_ERROR(EBOOT_RANGE);
 
     crc32_t crc = crc32_init();
-    crc = crc32_update(crc, (void*)msg->address, msg->length);
+    crc = crc32_update_hw(crc, (void*)(uintptr_t)msg->address, msg->length);
     crc = crc32_finalize(crc);
 
-    msg_printf("0x%08lx\n", crc);
+    msg_printf("0x%08" PRIx32 "\n", crc);
 
     RETURN_DATA(&crc, 4);
 }
 
 
+static bool program_flash(uint32_t addr, const void *data, uint32_t size)
+{
+    if (!APP_RANGE_VALID(addr, size)) {
+        errno = EBOOT_RANGE;
+        return false;
+    }
+
+    if (!invalidate_marker())
+        return false;
+
+    return flash_program(addr, data, size);
+}
+
+
 static bool handle_boot_write_data(const struct msg_boot_write_data *msg)
 {
     uint32_t addr = msg->address;
     uint32_t size = msg->h.data_len - 4;
 
-    DBG_PRINTF("boot_write_data(0x%08lx, %lu)\n", addr, size);
+    DBG_PRINTF("boot_write_data(0x%08" PRIx32 ", %" PRIu32 ")\n", addr, size);
 
-    if (!APP_RANGE_VALID(addr, size))
-        RETURN_ERROR(EBOOT_RANGE);
+    CHECK_FLASH_ERROR();
 
-    FLASH_Unlock();
+    if (!program_flash(addr, msg->data, size))
+        RETURN_ERROR(errno);
 
-    uint32_t *s = (uint32_t*)msg->data;
+    RETURN_DATA(NULL, 0);
+}
+
+
+// Compressed write stream, see struct msg_boot_write_lzss
+//
+static struct {
+    struct lzss_decoder dec;
+    uint32_t    address;        // start of the stream
+    uint32_t    offset;         // expected compressed offset
+    uint32_t    written;        // bytes programmed so far
+    bool        valid;
 
-    for (int i=0; i < size; i+=4) {
-        int res = FLASH_ProgramWord(addr + i, *s++);
-        if (res != FLASH_COMPLETE) {
-            FLASH_Lock();
-            RETURN_ERROR(FLASH_Status_TO_ERRNO(res));
+    uint8_t     buf[256] __attribute__((aligned(4)));
+    uint32_t    buf_len;        // decoded, not yet programmed
+} lzss_stream;
+
+
+static bool handle_boot_write_lzss(const struct msg_boot_write_lzss *msg)
+{
+    if (msg->h.data_len < 8)
+        RETURN_ERROR(EMSG_TOO_SHORT);
+
+    uint32_t size = msg->h.data_len - 8;
+
+    DBG_PRINTF("boot_write_lzss(0x%08" PRIx32 ", %" PRIu32 ", %" PRIu32 ")\n",
+        msg->address, msg->offset, size
+    );
+
+    CHECK_FLASH_ERROR();
+
+    if (msg->offset == 0) {
+        lzss_decoder_init(&lzss_stream.dec);
+        lzss_stream.address = msg->address;
+        lzss_stream.offset  = 0;
+        lzss_stream.written = 0;
+        lzss_stream.buf_len = 0;
+        lzss_stream.valid   = true;
+    }
+
+    if (!lzss_stream.valid ||
+        msg->address != lzss_stream.address ||
+        msg->offset  != lzss_stream.offset)
+    {
+        RETURN_ERROR(EBOOT_STREAM);
+    }
+
+    // Decode into the buffer and program all complete words.
+    // A partial word waits for the next message.
+    //
+    const uint8_t *src = msg->data;
+
+    for (;;) {
+        size_t consumed;
+        ssize_t n = lzss_decoder_feed(
+            &lzss_stream.dec,
+            &lzss_stream.buf[lzss_stream.buf_len],
+            sizeof(lzss_stream.buf) - lzss_stream.buf_len,
+            src, size, &consumed
+        );
+
+        if (n < 0) {
+            lzss_stream.valid = false;
+            RETURN_ERROR(errno);
+        }
+
+        src  += consumed;
+        size -= consumed;
+        lzss_stream.buf_len += n;
+
+        uint32_t words = lzss_stream.buf_len & ~3;
+        if (words == 0)
+            break;
+
+        if (!program_flash(lzss_stream.address + lzss_stream.written, lzss_stream.buf, words)) {
+            lzss_stream.valid = false;
+            RETURN_ERROR(errno);
         }
+
+        lzss_stream.written += words;
+        lzss_stream.buf_len -= words;
+        memmove(lzss_stream.buf, &lzss_stream.buf[words], lzss_stream.buf_len);
     }
 
-    FLASH_Lock();
+    lzss_stream.offset += msg->h.data_len - 8;
+
     RETURN_DATA(NULL, 0);
 }
 
@@ -302,36 +598,72 @@ static bool handle_boot_erase_sector(const struct msg_boot_erase_sector *msg)
 {
     msg_printf("boot_erase_sector(%d) ", msg->sector);
 
-    static const struct { uint32_t addr, size; } map[] = {
-        { 0x08000000, 0x4000  }, { 0x08004000, 0x4000  },
-        { 0x08008000, 0x4000  }, { 0x0800C000, 0x4000  },
-        { 0x08010000, 0x10000 }, { 0x08020000, 0x20000 },
-        { 0x08040000, 0x20000 }, { 0x08060000, 0x20000 },
-        { 0x08080000, 0x20000 }, { 0x080A0000, 0x20000 },
-        { 0x080C0000, 0x20000 }, { 0x080E0000, 0x20000 }
-    };
-
-    if (msg->sector >= ARRAY_SIZE(map))
+    if (msg->sector >= ARRAY_SIZE(flash_sectors))
         RETURN_ERROR(EBOOT_RANGE);
 
-    if (!APP_RANGE_VALID(map[msg->sector].addr, map[msg->sector].size))
+    uint32_t addr = flash_sectors[msg->sector].addr;
+    uint32_t size = flash_sectors[msg->sector].size;
+
+    if (!APP_RANGE_VALID(addr, size))
         RETURN_ERROR(EBOOT_RANGE);
 
-    if (check_empty((void*)map[msg->sector].addr, map[msg->sector].size)) {
+    CHECK_FLASH_ERROR();
+
+    if (check_empty((void*)(uintptr_t)addr, size)) {
         msg_printf("already empty\n");
+        RETURN_DATA(NULL, 0);
     }
-    else {
-        FLASH_Unlock();
-        int res = FLASH_EraseSector(msg->sector << 3, VoltageRange_3);
-        FLASH_Lock();
 
-        if (res != FLASH_COMPLETE)
-            RETURN_ERROR(FLASH_Status_TO_ERRNO(res));
+    if (!invalidate_marker())
+        RETURN_ERROR(errno);
+
+    // Respond first, the response goes out during the erase
+    //
+    msg_printf("started\n");
+    send_response(0, NULL, 0);
+
+    if (!flash_erase_sector(msg->sector))
+        flash_error = errno;
+
+    return true;
+}
+
+
+static bool handle_boot_checksums(const struct msg_boot_checksums *msg)
+{
+    DBG_PRINTF("boot_checksums(0x%08" PRIx32 ", %" PRIu32 ", %" PRIu32 ")\n",
+        msg->address, msg->length, msg->block_size
+    );
+
+    CHECK_FLASH_ERROR();
+
+    if (!APP_RANGE_VALID(msg->address, msg->length))
+        RETURN_ERROR(EBOOT_RANGE);
+
+    if (msg->block_size == 0 || (msg->block_size & 3))
+        RETURN_ERROR(EBOOT_RANGE);
+
+    // Leave room for the rlink header
+    //
+    crc32_t crcs[(FIELD_SIZEOF(struct msg_boot_response, data) - RLINK_HEADER_SIZE) / 4];
+
+    uint32_t addr = msg->address;
+    uint32_t end  = msg->address + msg->length;
+    int n = 0;
+
+    while (addr < end && n < ARRAY_SIZE(crcs)) {
+        uint32_t next = (addr / msg->block_size + 1) * msg->block_size;
+        if (next > end)
+            next = end;
+
+        crc32_t crc = crc32_init();
+        crc = crc32_update_hw(crc, (void*)(uintptr_t)addr, next - addr);
+        crcs[n++] = crc32_finalize(crc);
 
-        msg_printf("ok\n");
+        addr = next;
     }
 
-    RETURN_DATA(NULL, 0);
+    RETURN_DATA(crcs, n * 4);
 }
 
 
@@ -344,6 +676,81 @@ static bool handle_boot_exit(const struct msg_boot_exit *msg)
 }
 
 
+// Link benchmark, see struct msg_bench_ping. The replies bypass the
+// reliable transport, so they measure the raw link.
+//
+static struct {
+    uint32_t    rx_packets;
+    uint32_t    rx_bytes;
+} bench;
+
+static struct msg_large bench_buf __attribute__((aligned(4)));
+
+
+static bool handle_bench_ping(const struct msg_bench_ping *msg)
+{
+    struct msg_bench_ping *pong = (void*)&bench_buf;
+
+    if (msg->h.data_len < 20)
+        RETURN_ERROR(EMSG_TOO_SHORT);
+
+    if (msg->seq == 0)
+        memset(&bench, 0, sizeof(bench));
+
+    memcpy(pong, msg, sizeof(struct msg_header) + msg->h.data_len);
+
+    pong->h.id       = MSG_ID_BENCH_PONG;
+    pong->t_echo     = 0;       // no microsecond clock
+    pong->rx_packets = bench.rx_packets;
+    pong->rx_bytes   = bench.rx_bytes;
+
+    msg_send(&pong->h);
+    return true;
+}
+
+
+static bool handle_bench_data(const struct msg_bench_data *msg)
+{
+    bench.rx_packets++;
+    bench.rx_bytes += msg->h.data_len;
+    return true;
+}
+
+
+static bool handle_bench_source(const struct msg_bench_source *msg)
+{
+    struct msg_bench_data *data = (void*)&bench_buf;
+
+    int size = msg->size;
+    if (size < 4)
+        size = 4;
+    if (size > msg_get_max_data_size())
+        size = msg_get_max_data_size();
+
+    data->h.id       = MSG_ID_BENCH_DATA;
+    data->h.data_len = size;
+
+    uint8_t *payload = (uint8_t*)&data->seq;
+    for (int i=4; i<size; i++)
+        payload[i] = i;
+
+    // Blocks in uart_write() when the link is busy. The count
+    // comes from the host, so the stream is limited in time.
+    //
+    uint32_t t0 = tickcount;
+
+    for (uint32_t seq=0; seq < msg->count; seq++) {
+        if (tickcount - t0 > BENCH_SOURCE_TIMEOUT)
+            break;
+
+        data->seq = seq;
+        msg_send(&data->h);
+    }
+
+    return true;
+}
+
+
 static bool handle_boot_unknown(const struct msg_generic *msg)
 {
     msg_printf("unknown message(0x%04x, %d)\n", msg->h.id, msg->h.data_len);
@@ -357,6 +764,18 @@ static bool handle_message(const struct msg_generic *msg)
     if (msg->h.id == MSG_ID_BOOT_ENTER)
         return handle_boot_enter((void*)msg);
 
+    if (msg->h.id == MSG_ID_LINK_SETUP)
+        return handle_link_setup((void*)msg);
+
+    if (msg->h.id == MSG_ID_BENCH_PING)
+        return handle_bench_ping((void*)msg);
+
+    if (msg->h.id == MSG_ID_BENCH_DATA)
+        return handle_bench_data((void*)msg);
+
+    if (msg->h.id == MSG_ID_BENCH_SOURCE)
+        return handle_bench_source((void*)msg);
+
     if (!boot_active)
         RETURN_ERROR(EBOOT_INACTIVE);
 
@@ -364,7 +783,9 @@ static bool handle_message(const struct msg_generic *msg)
     case MSG_ID_BOOT_READ_DATA:     return handle_boot_read_data((void*)msg);
     case MSG_ID_BOOT_VERIFY:        return handle_boot_verify((void*)msg);
     case MSG_ID_BOOT_WRITE_DATA:    return handle_boot_write_data((void*)msg);
+    case MSG_ID_BOOT_WRITE_LZSS:    return handle_boot_write_lzss((void*)msg);
     case MSG_ID_BOOT_ERASE_SECTOR:  return handle_boot_erase_sector((void*)msg);
+    case MSG_ID_BOOT_CHECKSUMS:     return handle_boot_checksums((void*)msg);
     case MSG_IG_BOOT_EXIT:          return handle_boot_exit((void*)msg);
     default:                        return handle_boot_unknown((void*)msg);
     }
@@ -376,19 +797,27 @@ static void message_loop(void)
     msg_printf("Waiting for commands.. ");
     uint32_t t_last_msg = tickcount;
 
+    link_init();
+
     while (!boot_exit) {
         if (tickcount - t_last_msg > BOOT_TIMEOUT) {
             msg_printf("\n  Timed out\n");
             return;
         }
 
-        struct msg_generic msg;
+        // Large enough for any negotiated message size
+        //
+        static struct msg_large msg __attribute__((aligned(4)));
         int len = msg_recv(&msg.h);
 
         if (len >= 0) {
-            bool res = handle_message(&msg);
-            if (!res)
-                msg_printf("  %s\n", strerror(errno));
+            if (!rlink_input(&boot_link, &msg.h, tickcount)) {
+                reply_reliable = false;
+
+                bool res = handle_message((void*)&msg);
+                if (!res)
+                    msg_printf("  %s\n", strerror(errno));
+            }
 
             t_last_msg = tickcount;
         }
@@ -398,6 +827,20 @@ static void message_loop(void)
             else
                 msg_printf("  %s\n", strerror(errno));
         }
+
+        // Handle reliable requests in sequence, as long
+        // as there is room for the response
+        //
+        const struct msg_header *m;
+        while (rlink_tx_free(&boot_link) > 0 && (m = rlink_recv(&boot_link)) != NULL) {
+            reply_reliable = true;
+
+            bool res = handle_message((void*)m);
+            if (!res)
+                msg_printf("  %s\n", strerror(errno));
+        }
+
+        rlink_poll(&boot_link, tickcount);
     }
 }
 
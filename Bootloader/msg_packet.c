@@ -8,15 +8,46 @@
 
 #define PACKET_TIMEOUT  1000     // [ms]
 
-// COBSR(CRC + ID + MSG_MAX_DATA_SIZE) + End-of-packet
+// COBSR(CRC + ID + MSG_MAX_LINK_DATA_SIZE) + End-of-packet.
+// Replies may use the negotiated size, see MSG_ID_LINK_SETUP.
 //
 #define MAX_BUF_LENGTH  \
-    ( COBSR_ENCODE_DST_BUF_LEN_MAX(2 + 2 + MSG_MAX_DATA_SIZE) + 1 )
+    ( COBSR_ENCODE_DST_BUF_LEN_MAX(2 + 2 + MSG_MAX_LINK_DATA_SIZE) + 1 )
 
 
-static uint8_t rx_buf[MAX_BUF_LENGTH];
 static uint8_t tx_buf[MAX_BUF_LENGTH];
 
+// Received packets are decoded on the fly into the caller's message
+//
+static struct cobsr_decoder rx_dec;
+
+// Largest accepted payload, see MSG_ID_LINK_SETUP
+//
+static int max_data_size = MSG_MAX_DATA_SIZE;
+
+
+int msg_get_max_data_size(void)
+{
+    return max_data_size;
+}
+
+
+/**
+ * Set the largest accepted payload.
+ * msg_recv() buffers must hold at least this many data bytes.
+ *
+ */
+void msg_set_max_data_size(int size)
+{
+    if (size < MSG_MAX_DATA_SIZE)
+        size = MSG_MAX_DATA_SIZE;
+
+    if (size > MSG_MAX_LINK_DATA_SIZE)
+        size = MSG_MAX_LINK_DATA_SIZE;
+
+    max_data_size = size;
+}
+
 
 /**
  * Calculate CRC header field over ID and data
@@ -34,21 +65,37 @@ static crc16_t msg_calc_crc(const struct msg_header *msg)
 int msg_recv(struct msg_header *msg)
 {
     uint32_t t0 = tickcount;
-
     int rx_len = 0;
+    int too_long = 0;
+    int res;
+
+    cobsr_decoder_init(&rx_dec, &msg->crc, 2 + 2 + max_data_size);   // +CRC +ID
+
     for (;;) {
         int c = uart_getc();
 
-        if (c == 0) {
-            // end-of packet marker
+        if (c >= 0) {
+            uint8_t b = c;
+            size_t  consumed;
+
+            // decode COBS/R, the end-of-packet marker completes the packet
             //
-            break;
-        }
+            res = cobsr_decoder_feed(&rx_dec, &b, 1, &consumed);
+            if (res > 0)
+                break;
 
-        if (c >= 0) {
-            rx_buf[rx_len++] = c;
+            if (res < 0) {
+                // the decoder skips the rest of the packet
+                //
+                too_long = 1;
+            }
+
+            if (c == 0 && too_long) {
+                errno = EMSG_TOO_LONG;
+                return -1;
+            }
 
-            if (rx_len == 1) {
+            if (c != 0 && ++rx_len == 1) {
                 // Restart packet timeout after first received byte.
                 // This way, we won't interrupt a late arriving packet.
                 //
@@ -60,23 +107,8 @@ int msg_recv(struct msg_header *msg)
             errno = EMSG_TIMEOUT;
             return -1;
         }
-
-        if (rx_len >= MAX_BUF_LENGTH) {
-            errno = EMSG_TOO_LONG;
-            return -1;
-        }
     }
 
-    // decode COBS/R
-    //
-    int res = cobsr_decode(
-        &msg->crc, 2 + 2 + MSG_MAX_DATA_SIZE,   // +CRC +ID
-        rx_buf, rx_len
-    );
-
-    if (res < 0)
-        return -1;
-
     if (res < 2 + 2) {
         errno = EMSG_TOO_SHORT;
         return -1;
@@ -5,3 +5,6 @@
 
 int msg_recv(struct msg_header *msg);
 int msg_send(struct msg_header *msg);
+
+int msg_get_max_data_size(void);
+void msg_set_max_data_size(int size);
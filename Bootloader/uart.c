@@ -2,7 +2,7 @@
 #include "stm32f4xx.h"
 #include "ringbuf.h"
 
-static struct ringbuf rx_buf = RINGBUF( 4096 );
+static struct ringbuf rx_buf = RINGBUF( UART_RX_BUFFER_SIZE );
 static struct ringbuf tx_buf = RINGBUF( 4096 );
 
 
@@ -24,6 +24,39 @@ void USART3_IRQHandler(void)
 }
 
 
+/**
+ * Service the UART without interrupts, see flash.c.
+ *
+ * Runs from RAM, so it must not call anything in flash. A received
+ * byte stays in the data register while the buffer is full, which
+ * holds off the sender through RTS.
+ */
+RAMFUNC void uart_poll(void)
+{
+    uint32_t sr = USART3->SR;
+
+    if (sr & USART_SR_RXNE) {
+        unsigned pos = rx_buf.write_pos + 1;
+        if (pos >= rx_buf.buf_size)
+            pos = 0;
+
+        if (pos != rx_buf.read_pos) {
+            rx_buf.buf[rx_buf.write_pos] = USART3->DR;
+            rx_buf.write_pos = pos;
+        }
+    }
+
+    if ((sr & USART_SR_TXE) && tx_buf.read_pos != tx_buf.write_pos) {
+        unsigned pos = tx_buf.read_pos + 1;
+        if (pos >= tx_buf.buf_size)
+            pos = 0;
+
+        USART3->DR = tx_buf.buf[tx_buf.read_pos];
+        tx_buf.read_pos = pos;
+    }
+}
+
+
 void uart_putc(char c)
 {
     int ret = 0;
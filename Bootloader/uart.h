@@ -2,12 +2,18 @@
 
 #include <unistd.h>
 #include <stdio.h>
+#include "board.h"
+
+// Holds the data that arrives during a sector erase, see flash.c
+//
+#define UART_RX_BUFFER_SIZE     16384
 
 void printf_putchar(char c);
 
 void uart_putc(char c);
 int uart_getc(void);
 void uart_flush(void);
+void uart_poll(void);
 
 ssize_t uart_write(const void *buf, size_t len);
 
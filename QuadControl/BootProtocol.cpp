@@ -19,15 +19,49 @@
 #include "Shared/msg_structs.h"
 #include "Shared/errors.h"
 #include "Shared/crc32.h"
+#include "Shared/lzss.h"
 
 #include <QDebug>
 #include <QApplication>
 #include <QThread>
 #include <QTime>
-#include "IntelHexFile.h"
+#include <algorithm>
 #include "MainWindow.h"
 
 
+// Flash sectors of the STM32F405, see Bootloader/main.c
+//
+static const struct { uint addr, size; } flashSectors[] = {
+    { 0x08000000, 0x4000  }, { 0x08004000, 0x4000  },
+    { 0x08008000, 0x4000  }, { 0x0800C000, 0x4000  },
+    { 0x08010000, 0x10000 }, { 0x08020000, 0x20000 },
+    { 0x08040000, 0x20000 }, { 0x08060000, 0x20000 },
+    { 0x08080000, 0x20000 }, { 0x080A0000, 0x20000 },
+    { 0x080C0000, 0x20000 }, { 0x080E0000, 0x20000 }
+};
+
+static const int firstAppSector = 4;
+static const int numSectors = sizeof(flashSectors) / sizeof(flashSectors[0]);
+
+
+static int sectorOf(uint addr)
+{
+    for (int i=0; i<numSectors; i++) {
+        if (addr - flashSectors[i].addr < flashSectors[i].size)
+            return i;
+    }
+    return -1;
+}
+
+
+static uint32_t crc32(const char *data, int len)
+{
+    uint32_t crc = crc32_init();
+    crc = crc32_update(crc, (const uchar*)data, len);
+    return crc32_finalize(crc);
+}
+
+
 BootProtocol::BootProtocol(Connection &connection, QWidget *parent)
     : QObject(parent)
     , progressDialog(parent)
@@ -37,6 +71,7 @@ BootProtocol::BootProtocol(Connection &connection, QWidget *parent)
     progressDialog.setWindowTitle("Updating...");
 
     connect(&connection, &Connection::messageReceived, this, &BootProtocol::connection_messageReceived);
+    clock.start();
 }
 
 
@@ -45,9 +80,21 @@ BootProtocol::~BootProtocol()
 }
 
 
-void BootProtocol::connection_messageReceived(const msg_generic &msg)
+void BootProtocol::connection_messageReceived(const msg_header &msg)
 {
-    messageQueue.enqueue(msg);
+    qint64 now = clock.nsecsElapsed() / 1000;
+
+    if (reliable && rlink_input(&link, &msg, linkClock.elapsed())) {
+        const msg_header *m;
+        while ((m = rlink_recv(&link)) != NULL) {
+            messageQueue.enqueue(QByteArray((const char*)m, sizeof(*m) + m->data_len));
+            messageTimes.enqueue(now);
+        }
+        return;
+    }
+
+    messageQueue.enqueue(QByteArray((const char*)&msg, sizeof(msg) + msg.data_len));
+    messageTimes.enqueue(now);
 }
 
 
@@ -60,14 +107,71 @@ void BootProtocol::showProgress(int value, const QString &text)
 
 /********** Low level functions **********/
 
-bool BootProtocol::bootGetResponse(msg_boot_response *response, int timeout)
+static int linkSend(void *ctx, msg_header *msg)
+{
+    return ((Connection*)ctx)->sendMessage(msg) ? 0 : -1;
+}
+
+
+bool BootProtocol::sendRequest(msg_header *msg)
+{
+    if (!reliable)
+        return connection.sendMessage(msg);
+
+    // Wait for the bootloader to acknowledge earlier requests
+    //
+    QElapsedTimer t;
+    t.start();
+
+    while (rlink_tx_free(&link) == 0) {
+        if (rlink_poll(&link, linkClock.elapsed()) < 0) {
+            m_errorString = _user_strerror(errno);
+            return false;
+        }
+
+        if (t.hasExpired(10000)) {
+            m_errorString = _user_strerror(EMSG_TIMEOUT);
+            return false;
+        }
+
+        QApplication::processEvents();
+        QThread::msleep(1);
+    }
+
+    if (rlink_send(&link, msg, linkClock.elapsed()) < 0) {
+        m_errorString = _user_strerror(errno);
+        return false;
+    }
+
+    return true;
+}
+
+
+/**
+ * Wait for a response.
+ *
+ * \param  arrival  if not NULL, receives the arrival time [us],
+ *                  see clock
+ */
+bool BootProtocol::bootGetResponse(msg_boot_response *response, int timeout, qint64 *arrival)
 {
     while (timeout > 0) {
         while (!messageQueue.isEmpty()) {
             const auto msg = messageQueue.dequeue();
+            const auto time = messageTimes.dequeue();
+            const auto *h = (const msg_header*)msg.constData();
+
+            if (h->id == MSG_ID_BOOT_RESPONSE) {
+                if (arrival != NULL)
+                    *arrival = time;
+
+                // Larger responses are cut to the struct,
+                // e.g. bootChecksums() asks for the rest
+                //
+                msg_boot_response res = msg_boot_response();
+                memcpy(&res, h, qMin((size_t)msg.size(), sizeof(res)));
+                res.h.data_len = qMin(h->data_len, (int)(sizeof(res) - sizeof(msg_header)));
 
-            if (msg.h.id == MSG_ID_BOOT_RESPONSE) {
-                const auto res = (const msg_boot_response&)msg;
                 if (res.error != 0) {
                     m_errorString = _user_strerror(res.error);
                     return false;
@@ -79,9 +183,19 @@ bool BootProtocol::bootGetResponse(msg_boot_response *response, int timeout)
             }
         }
 
+        if (reliable && rlink_poll(&link, linkClock.elapsed()) < 0) {
+            m_errorString = _user_strerror(errno);
+            return false;
+        }
+
         QApplication::processEvents();
-        QThread::msleep(10);    // don't hog the cpu..
-        timeout -= 10;
+        QThread::msleep(1);     // don't hog the cpu..
+
+        // Lost requests are retransmitted by the link,
+        // which gives up on its own
+        //
+        if (!reliable || rlink_tx_pending(&link) == 0)
+            timeout -= 1;
     }
 
     m_errorString = _user_strerror(EMSG_TIMEOUT);
@@ -109,6 +223,7 @@ bool BootProtocol::bootResetHack()
 
 bool BootProtocol::bootEnter()
 {
+    reliable = false;
     bootResetHack();
 
     msg_boot_enter msg;
@@ -122,84 +237,347 @@ bool BootProtocol::bootEnter()
 }
 
 
+bool BootProtocol::bootLinkSetup()
+{
+    linkDataSize = MSG_MAX_DATA_SIZE;
+    bootRxBufferSize = 4096;
+    reliable = false;
+    window = WriteWindow();
+
+    msg_link_setup msg;
+    msg.h.id = MSG_ID_LINK_SETUP;
+    msg.h.data_len = 4;
+    msg.max_data_size = connection.maxDataSize();
+    msg.flags = LINK_FLAG_RLINK;
+
+    connection.sendMessage(&msg.h);
+
+    // Older bootloaders don't know the message
+    // and stay at MSG_MAX_DATA_SIZE
+    //
+    msg_boot_response res;
+    if (!bootGetResponse(&res, 500))
+        return false;
+
+    uint16_t size, flags;
+    memcpy(&size,  res.data, 2);
+    memcpy(&flags, res.data + 2, 2);
+
+    linkDataSize = qBound(MSG_MAX_DATA_SIZE, (int)size, connection.maxDataSize());
+
+    if (res.h.data_len >= 4 + 6) {
+        uint16_t rx_buffer_size;
+        memcpy(&rx_buffer_size, res.data + 4, 2);
+        bootRxBufferSize = rx_buffer_size;
+    }
+
+    if (flags & LINK_FLAG_RLINK) {
+        // The timeout must cover a full window of messages
+        // at 115200 baud
+        //
+        const int slots = 16;
+        int rto = 200 + slots * (linkDataSize + 8) * 10 * 1000 / 115200;
+
+        linkTxBuf.resize(slots * RLINK_SLOT_SIZE(MSG_MAX_LINK_DATA_SIZE));
+        linkRxBuf.resize(slots * RLINK_SLOT_SIZE(MSG_MAX_DATA_SIZE));
+
+        rlink_init(&link, linkSend, &connection,
+            linkTxBuf.data(), RLINK_SLOT_SIZE(MSG_MAX_LINK_DATA_SIZE), slots,
+            linkRxBuf.data(), RLINK_SLOT_SIZE(MSG_MAX_DATA_SIZE), slots,
+            rto
+        );
+
+        linkClock.start();
+        reliable = true;
+    }
+
+    return true;
+}
+
+
 bool BootProtocol::bootExit()
 {
     msg_boot_exit msg;
     msg.h.id = MSG_IG_BOOT_EXIT;
     msg.h.data_len = 0;
 
-    connection.sendMessage(&msg.h);
+    if (!sendRequest(&msg.h))
+        return false;
 
     return bootGetResponse(NULL);
 }
 
 
-bool BootProtocol::bootEraseSector(uint sector)
+bool BootProtocol::bootEraseSectorAsync(uint sector)
 {
     msg_boot_erase_sector msg;
     msg.h.id = MSG_ID_BOOT_ERASE_SECTOR;
     msg.h.data_len = 4;
     msg.sector = sector;
 
-    connection.sendMessage(&msg.h);
+    return sendRequest(&msg.h);
+}
 
-    return bootGetResponse(NULL);
+
+bool BootProtocol::bootEraseSector(uint sector)
+{
+    if (!bootEraseSectorAsync(sector))
+        return false;
+
+    // The bootloader may still be busy with an earlier erase
+    //
+    return bootGetResponse(NULL, 5000);
 }
 
 
 bool BootProtocol::bootWriteDataAsync(uint addr, const QByteArray &data)
 {
-    assert((uint)data.length() <= sizeof(msg_boot_write_data::data));
+    assert(4 + data.length() <= linkDataSize);
 
-    msg_boot_write_data msg;
+    // msg_boot_write_data with up to linkDataSize bytes
+    //
+    msg_large buf;
+    auto &msg = (msg_boot_write_data&)buf;
     msg.h.id = MSG_ID_BOOT_WRITE_DATA;
     msg.h.data_len = 4 + data.length();
     msg.address = addr;
 
-    memcpy(msg.data, data.constData(), data.length());
+    memcpy(buf.data + 4, data.constData(), data.length());
 
-    connection.sendMessage(&msg.h);
+    if (!sendRequest(&msg.h))
+        return false;
 
     return true;
 }
 
 
-bool BootProtocol::bootWriteData(uint addr, const QByteArray &data, int ack_window)
+bool BootProtocol::bootWriteLzssAsync(uint addr, uint offset, const QByteArray &data)
 {
-    static const int chunk_size = sizeof(msg_boot_write_data::data);
+    assert(8 + data.length() <= linkDataSize);
 
-    int chunks = (data.length() + chunk_size - 1) / chunk_size;
-    int offset = 0;
+    // msg_boot_write_lzss with up to linkDataSize bytes
+    //
+    msg_large buf;
+    auto &msg = (msg_boot_write_lzss&)buf;
+    msg.h.id = MSG_ID_BOOT_WRITE_LZSS;
+    msg.h.data_len = 8 + data.length();
+    msg.address = addr;
+    msg.offset = offset;
 
-    if (ack_window > chunks)
-        ack_window = chunks;
+    memcpy(buf.data + 8, data.constData(), data.length());
 
-    for (int i=0; i < chunks + ack_window; i++) {
-        // send data
-        //
-        if (i < chunks) {
-            showProgress(
-                offset * 100 / data.length(),
-                QString().sprintf("Writing 0x%08x", addr + offset)
-            );
+    if (!sendRequest(&msg.h))
+        return false;
+
+    return true;
+}
 
-            bootWriteDataAsync(addr + offset, data.mid(offset, chunk_size) );
-            offset += chunk_size;
 
-            if (progressDialog.wasCanceled())
+/**
+ * Write data to flash.
+ *
+ * If compress is set, the data is sent as one LZSS stream,
+ * unless that does not make it smaller.
+ *
+ * Sectors in erase are erased right before the first write
+ * into them, and removed from the list. The bootloader starts
+ * each erase after its response, so the following data is on
+ * the link while the flash is busy.
+ *
+ * The number of requests in flight adapts to the link, see
+ * updateWindow().
+ */
+bool BootProtocol::bootWriteData(uint addr, const QByteArray &data, QList<int> *erase, bool compress)
+{
+    QByteArray stream = data;
+
+    if (compress && data.length() % 4 == 0) {
+        QByteArray buf(LZSS_ENCODE_DST_BUF_LEN_MAX(data.length()), 0);
+        auto len = lzss_encode(buf.data(), buf.length(), data.constData(), data.length());
+
+        compress = len > 0 && len < data.length();
+        if (compress) {
+            stream = buf.left(len);
+            qDebug("  LZSS:   %d -> %d bytes", data.length(), stream.length());
+        }
+    }
+    else {
+        compress = false;
+    }
+
+    // -address/offset -rlink header, whole words
+    //
+    const int header = compress ? 8 : 4;
+    const int chunk_size = (linkDataSize - header - (reliable ? RLINK_HEADER_SIZE : 0)) & ~3;
+
+    // Decode along, to know how far each chunk writes
+    //
+    lzss_decoder dec;
+    lzss_decoder_init(&dec);
+    uint pos = 0;
+
+    // Requests without response. The response to an erase comes
+    // before the erase, so the one to the next write marks its end.
+    // Until then, the window grows to what the bootloader buffers.
+    //
+    QQueue<Request> pending;
+    bool erasing = false;
+    const int max_window = qMax(1, bootRxBufferSize / (linkDataSize + 8));
+
+    auto erasePending = [&]() {
+        for (const auto &r: pending) {
+            if (r.erase)
                 return true;
         }
+        return false;
+    };
+
+    auto takeResponse = [&]() {
+        qint64 arrival;
+        if (!bootGetResponse(NULL, 5000, &arrival))
+            return false;
+
+        updateWindow(pending.dequeue(), arrival, max_window);
+        return true;
+    };
+
+    qint64 t_start = clock.nsecsElapsed() / 1000;
+
+    for (int offset=0; offset < stream.length(); offset += chunk_size) {
+        auto chunk = stream.mid(offset, chunk_size);
+        uint start = pos;
+
+        if (compress) {
+            char buf[256];
+            size_t used = 0;
+
+            for (;;) {
+                size_t consumed;
+                auto n = lzss_decoder_feed(&dec, buf, sizeof(buf),
+                    chunk.constData() + used, chunk.length() - used, &consumed);
+
+                if (n <= 0)
+                    break;
+
+                used += consumed;
+                pos  += n;
+            }
+        }
+        else {
+            pos += chunk.length();
+        }
+
+        while (erase != NULL && !erase->isEmpty() &&
+               flashSectors[erase->first()].addr < addr + pos)
+        {
+            int sector = erase->takeFirst();
+            showProgress(
+                start * 100 / data.length(),
+                QString().sprintf("Erasing sector %d...", sector)
+            );
+
+            if (!bootEraseSectorAsync(sector))
+                return false;
+            pending.enqueue(Request { true, true, clock.nsecsElapsed() / 1000 });
+            erasing = true;
+        }
+
+        showProgress(
+            start * 100 / data.length(),
+            QString().sprintf("Writing 0x%08x", addr + start)
+        );
+
+        bool ok = compress
+            ? bootWriteLzssAsync(addr, offset, chunk)
+            : bootWriteDataAsync(addr + offset, chunk);
+
+        if (!ok)
+            return false;
+
+        bool delayed = erasing || erasePending();
+        pending.enqueue(Request { erasing, delayed, clock.nsecsElapsed() / 1000 });
+        erasing = false;
+
+        if (progressDialog.wasCanceled())
+            return true;
 
-        // check responses later to mask the connection latency
+        // Check responses later to mask the connection latency.
+        // An erase may hold up the responses for a while.
         //
-        if (i >= ack_window && !bootGetResponse(NULL))
+        while (pending.size() > (erasePending() ? max_window : (int)window.size)) {
+            if (!takeResponse())
+                return false;
+        }
+    }
+
+    while (!pending.isEmpty()) {
+        if (!takeResponse())
             return false;
     }
 
+    qint64 t_end = clock.nsecsElapsed() / 1000;
+    if (t_end > t_start) {
+        qDebug("  Window: %.1f of %d messages, RTT %.1f ms, %.0f bytes/s",
+            window.size, max_window, window.rttMin / 1000.0,
+            stream.length() * 1e6 / (t_end - t_start)
+        );
+    }
+
     return true;
 }
 
 
+/**
+ * Adapt the write window to a response.
+ *
+ * Like TCP Vegas, the messages queued in the link are estimated
+ * from how far the round trip time exceeds the minimum. With less
+ * than one queued, the window grows: by one message per response
+ * up to the threshold, then by one per round trip. With more than
+ * three, it shrinks by one. Retransmits of the reliable link halve
+ * it. The window shrinks at most once per round trip.
+ *
+ * The window never exceeds what the bootloader can buffer, so
+ * stalls can't overrun it.
+ */
+void BootProtocol::updateWindow(const Request &request, qint64 arrival, int max_window)
+{
+    bool retransmits = reliable && link.stats.tx_retransmits != window.retransmits;
+    window.retransmits = link.stats.tx_retransmits;
+
+    // Responses held up by an erase say nothing about the link
+    //
+    qint64 rtt = arrival - request.sent;
+    if (request.delayed || rtt <= 0)
+        return;
+
+    if (window.rttMin == 0 || rtt < window.rttMin)
+        window.rttMin = rtt;
+
+    // Allow for the timer resolution
+    //
+    qint64 excess = qMax<qint64>(0, rtt - window.rttMin - 2000);
+    double queued = window.size * excess / rtt;
+
+    if (retransmits || queued > 3) {
+        if (arrival - window.lastDecrease > rtt) {
+            window.size = retransmits ? window.size / 2 : window.size - 1;
+            window.size = qMax(1.0, window.size);
+            window.threshold = window.size;
+            window.lastDecrease = arrival;
+        }
+    }
+    else if (queued < 1) {
+        if (window.size < window.threshold)
+            window.size += 1;
+        else
+            window.size += 1 / window.size;
+    }
+
+    window.size = qMin(window.size, (double)max_window);
+}
+
+
 bool BootProtocol::bootVerifyData(uint addr, const QByteArray &data)
 {
     msg_boot_verify msg;
@@ -208,7 +586,8 @@ bool BootProtocol::bootVerifyData(uint addr, const QByteArray &data)
     msg.address = addr;
     msg.length  = data.length();
 
-    connection.sendMessage(&msg.h);
+    if (!sendRequest(&msg.h))
+        return false;
 
     msg_boot_response res;
     if (!bootGetResponse(&res))
@@ -217,9 +596,7 @@ bool BootProtocol::bootVerifyData(uint addr, const QByteArray &data)
     uint32_t remote_crc;
     memcpy(&remote_crc, res.data, 4);
 
-    uint32_t local_crc = crc32_init();
-    local_crc = crc32_update(local_crc, (const uchar*)data.constData(), data.length());
-    local_crc = crc32_finalize(local_crc);
+    uint32_t local_crc = crc32(data.constData(), data.length());
 
     if  (remote_crc != local_crc) {
         m_errorString = QString("CRC failure. Expected %1, got %2")
@@ -232,6 +609,160 @@ bool BootProtocol::bootVerifyData(uint addr, const QByteArray &data)
 }
 
 
+bool BootProtocol::bootChecksums(uint addr, uint length, uint blockSize, QVector<uint32_t> *crcs)
+{
+    crcs->clear();
+
+    // The bootloader returns as many blocks as fit into
+    // a response, continue at the next one
+    //
+    uint end = addr + length;
+
+    while (addr < end) {
+        msg_boot_checksums msg;
+        msg.h.id = MSG_ID_BOOT_CHECKSUMS;
+        msg.h.data_len = 12;
+        msg.address = addr;
+        msg.length = end - addr;
+        msg.block_size = blockSize;
+
+        if (!sendRequest(&msg.h))
+            return false;
+
+        msg_boot_response res;
+        if (!bootGetResponse(&res))
+            return false;
+
+        int n = (res.h.data_len - 4) / 4;
+        if (n <= 0) {
+            m_errorString = _user_strerror(EMSG_TOO_SHORT);
+            return false;
+        }
+
+        for (int i=0; i<n && addr < end; i++) {
+            uint32_t crc;
+            memcpy(&crc, res.data + 4*i, 4);
+            crcs->append(crc);
+
+            addr = qMin((addr / blockSize + 1) * blockSize, end);
+        }
+    }
+
+    return true;
+}
+
+
+/**
+ * Find the sectors that must be erased and the data that
+ * must be written to update the flash to the image.
+ *
+ * Blocks that match the image are skipped. Blocks that are
+ * still empty are written without an erase. Sectors with
+ * any other differences are erased and rewritten.
+ */
+bool BootProtocol::planDelta(
+    const IntelHexFile &ih, QList<int> *erase,
+    QList<IntelHexFile::Section> *write)
+{
+    const uint blockSize = 4096;
+
+    struct Block {
+        uint    addr;
+        QByteArray data;
+        bool    same, empty;
+    };
+
+    QList<Block> blocks;
+
+    for (auto s: ih.sections) {
+        showProgress(0, QString().sprintf("Comparing 0x%08x", s.offset));
+
+        QVector<uint32_t> crcs;
+        if (!bootChecksums(s.offset, s.data.length(), blockSize, &crcs))
+            return false;
+
+        uint addr = s.offset, end = s.offset + s.data.length();
+
+        for (auto remote_crc: crcs) {
+            uint next = qMin((addr / blockSize + 1) * blockSize, end);
+
+            Block b;
+            b.addr  = addr;
+            b.data  = s.data.mid(addr - s.offset, next - addr);
+            b.same  = remote_crc == crc32(b.data.constData(), b.data.length());
+            b.empty = remote_crc == crc32(QByteArray(b.data.length(), '\xFF').constData(), b.data.length());
+
+            blocks.append(b);
+            addr = next;
+        }
+    }
+
+    // Sector size is a multiple of the block size,
+    // so blocks never cross sector boundaries
+    //
+    erase->clear();
+    for (const auto &b: blocks) {
+        int sector = sectorOf(b.addr);
+        if (sector < firstAppSector) {
+            m_errorString = _user_strerror(EBOOT_RANGE);
+            return false;
+        }
+
+        if (!b.same && !b.empty && !erase->contains(sector))
+            erase->append(sector);
+    }
+
+    // Merge adjacent blocks to write
+    //
+    write->clear();
+    for (const auto &b: blocks) {
+        if (b.same && !erase->contains(sectorOf(b.addr)))
+            continue;
+
+        if (!write->isEmpty() &&
+            write->last().offset + write->last().data.length() == b.addr)
+        {
+            write->last().data.append(b.data);
+        }
+        else {
+            write->append(IntelHexFile::Section { b.addr, b.data });
+        }
+    }
+
+    return true;
+}
+
+
+/**
+ * Get the sectors the image covers, in ascending order.
+ *
+ */
+bool BootProtocol::coveredSectors(const IntelHexFile &ih, QList<int> *sectors)
+{
+    sectors->clear();
+
+    for (auto s: ih.sections) {
+        uint addr = s.offset, end = s.offset + s.data.length();
+
+        while (addr < end) {
+            int sector = sectorOf(addr);
+            if (sector < firstAppSector) {
+                m_errorString = _user_strerror(EBOOT_RANGE);
+                return false;
+            }
+
+            if (!sectors->contains(sector))
+                sectors->append(sector);
+
+            addr = flashSectors[sector].addr + flashSectors[sector].size;
+        }
+    }
+
+    std::sort(sectors->begin(), sectors->end());
+    return true;
+}
+
+
 /********** Firmware update functions **********/
 
 #define STEP(function)  do {            \
@@ -242,11 +773,19 @@ bool BootProtocol::bootVerifyData(uint addr, const QByteArray &data)
 } while(0);
 
 
-bool BootProtocol::sendHexFile(const QString &fileName)
+/**
+ * Flash a hex file.
+ *
+ * In delta mode, only the sectors that differ are erased and
+ * written. That falls back to a full update if the bootloader
+ * does not support MSG_ID_BOOT_CHECKSUMS.
+ */
+bool BootProtocol::sendHexFile(const QString &fileName, bool delta)
 {
     progressDialog.reset();
     progressDialog.show();
 
+    m_timings = Timings();
     showProgress(0, "Loading " + fileName);
 
     IntelHexFile ih;
@@ -263,26 +802,68 @@ bool BootProtocol::sendHexFile(const QString &fileName)
         STEP( (ok=bootEnter(), true) );
     }
 
+    if (bootLinkSetup())
+        qDebug("  Link:   %d bytes per message", linkDataSize);
+
+    // Older bootloaders don't know compressed writes. An
+    // empty stream is accepted and doesn't write anything.
+    //
+    bool compress =
+        bootWriteLzssAsync(flashSectors[firstAppSector].addr, 0, QByteArray()) &&
+        bootGetResponse(NULL, 500);
+
     auto t_enter = QTime::currentTime();
 
-    for (int i=4; i<12; i++) {
+    QList<int> erase;
+    QList<IntelHexFile::Section> write;
+
+    if (delta && !planDelta(ih, &erase, &write)) {
+        qDebug() << "  Delta:  " << m_errorString;
+        delta = false;
+    }
+
+    if (delta) {
+        int bytes = 0;
+        for (auto s: write)
+            bytes += s.data.length();
+
+        qDebug("  Delta:  %d bytes in %d sections, %d sectors to erase",
+            bytes, write.size(), erase.size()
+        );
+    }
+    else {
+        // Sectors outside the image keep their contents
+        //
+        if (!coveredSectors(ih, &erase))
+            return false;
+
+        write = ih.sections;
+    }
+
+    // Erases are interleaved with the writes
+    //
+    for (auto s: write)
+        STEP( bootWriteData(s.offset, s.data, &erase, compress) );
+
+    auto t_write = QTime::currentTime();
+
+    for (int i=0; i<erase.size(); i++) {
         showProgress(
-            100 * (i-4) / (12-4),
-            QString().sprintf("Erasing sector %d...", i)
+            80 * i / erase.size(),
+            QString().sprintf("Erasing sector %d...", erase[i])
         );
-        STEP( bootEraseSector(i) );
+        STEP( bootEraseSector(erase[i]) );
     }
 
     auto t_erase = QTime::currentTime();
 
-    for (auto s: ih.sections) {
-        STEP( bootWriteData(s.offset, s.data) );
-
-        showProgress(80, "Verifying");
+    // Verify the whole image, including unchanged parts
+    //
+    showProgress(80, "Verifying");
+    for (auto s: ih.sections)
         STEP( bootVerifyData(s.offset, s.data) );
-    }
 
-    auto t_write = QTime::currentTime();
+    auto t_verify = QTime::currentTime();
 
     showProgress(90, "Starting application");
     STEP( bootExit() );
@@ -291,15 +872,28 @@ bool BootProtocol::sendHexFile(const QString &fileName)
 
     auto t_total =  QTime::currentTime();
 
-    qDebug("  Enter:  %d ms", t0.msecsTo(t_enter));
-    qDebug("  Erase:  %d ms", t_enter.msecsTo(t_erase));
-    qDebug("  Write:  %d ms", t_erase.msecsTo(t_write));
-    qDebug("  Total:  %d ms", t0.msecsTo(t_total));
+    m_timings.enter  = t0.msecsTo(t_enter);
+    m_timings.write  = t_enter.msecsTo(t_write);
+    m_timings.erase  = t_write.msecsTo(t_erase);
+    m_timings.verify = t_erase.msecsTo(t_verify);
+    m_timings.total  = t0.msecsTo(t_total);
+
+    qDebug("  Enter:  %d ms", m_timings.enter);
+    qDebug("  Write:  %d ms, with erase", m_timings.write);
+    qDebug("  Erase:  %d ms, unused sectors", m_timings.erase);
+    qDebug("  Verify: %d ms", m_timings.verify);
+    qDebug("  Total:  %d ms", m_timings.total);
 
     return true;
 }
 
 
+BootProtocol::Timings BootProtocol::timings()
+{
+    return m_timings;
+}
+
+
 QString BootProtocol::errorString()
 {
     return m_errorString;
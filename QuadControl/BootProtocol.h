@@ -6,9 +6,12 @@
 #include <QString>
 #include <QTimer>
 #include <QQueue>
+#include <QElapsedTimer>
 
 #include "Connection.h"
+#include "IntelHexFile.h"
 #include "QProgressDialogEx.h"
+#include "Shared/rlink.h"
 
 class BootProtocol : public QObject
 {
@@ -18,27 +21,82 @@ public:
     BootProtocol(Connection &connection, QWidget *parent = 0);
     ~BootProtocol();
 
-    bool sendHexFile(const QString &fileName);
+    bool sendHexFile(const QString &fileName, bool delta = false);
 
+    // Phases of the last sendHexFile() [ms]
+    //
+    struct Timings {
+        int enter = 0;
+        int write = 0;          // with interleaved erases
+        int erase = 0;          // sectors without writes
+        int verify = 0;
+        int total = 0;
+    };
+
+    Timings timings();
     QString errorString();
 
 private:
     QString m_errorString;
+    Timings m_timings;
     QProgressDialogEx progressDialog;
-    QQueue<msg_generic> messageQueue;
+    QQueue<QByteArray> messageQueue;  // header and data
+    QQueue<qint64> messageTimes;    // arrival [us], see clock
+    QElapsedTimer clock;
     Connection &connection;   
+    int linkDataSize = MSG_MAX_DATA_SIZE;
+    int bootRxBufferSize = 4096;    // older bootloaders don't advertise it
+
+    // Write requests in flight, see bootWriteData()
+    //
+    struct Request {
+        bool    erase;          // an erase ends with this response
+        bool    delayed;        // sent while an erase was running
+        qint64  sent;           // [us]
+    };
+
+    struct WriteWindow {
+        double  size = 2;           // [messages]
+        double  threshold = 1e9;    // end of the slow start [messages]
+        qint64  rttMin = 0;         // [us], 0 until measured
+        qint64  lastDecrease = 0;   // [us]
+        uint32_t retransmits = 0;   // rlink stats at the last response
+    } window;
 
-    void connection_messageReceived(const msg_generic &msg);
+    // Reliable transport, if the bootloader supports it
+    //
+    bool reliable = false;
+    rlink link;
+    QByteArray linkTxBuf;
+    QByteArray linkRxBuf;
+    QElapsedTimer linkClock;
+
+    void connection_messageReceived(const msg_header &msg);
     void showProgress(int value, const QString &text);
 
-    bool bootGetResponse(msg_boot_response *response, int timeout = 2000);
+    bool sendRequest(msg_header *msg);
+    bool bootGetResponse(msg_boot_response *response, int timeout = 2000, qint64 *arrival = NULL);
     bool bootResetHack();
     bool bootEnter();
+    bool bootLinkSetup();
     bool bootExit();
+    bool bootEraseSectorAsync(uint sector);
     bool bootEraseSector(uint sector);
     bool bootWriteDataAsync(uint addr, const QByteArray &data);
-    bool bootWriteData(uint addr, const QByteArray &data, int ack_window = 10);
+    bool bootWriteLzssAsync(uint addr, uint offset, const QByteArray &data);
+    bool bootWriteData(
+        uint addr, const QByteArray &data, QList<int> *erase = NULL,
+        bool compress = false
+    );
+    void updateWindow(const Request &request, qint64 arrival, int max_window);
     bool bootVerifyData(uint addr, const QByteArray &data);
+    bool bootChecksums(uint addr, uint length, uint blockSize, QVector<uint32_t> *crcs);
+
+    bool planDelta(
+        const IntelHexFile &ih, QList<int> *erase,
+        QList<IntelHexFile::Section> *write
+    );
+    bool coveredSectors(const IntelHexFile &ih, QList<int> *sectors);
 };
 
 #endif // BOOTPROTOCOL_H
@@ -0,0 +1,162 @@
+/**
+ * Copyright (C)2015 Thomas Kindler <mail_drquad@t-kindler.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ClockSync.h"
+
+#include <QDateTime>
+#include <QElapsedTimer>
+
+
+void ClockSync::reset()
+{
+    minima.clear();
+    lastVehicleTime = 0;
+    valid = false;
+    t0 = 0;
+    a = b = 0;
+}
+
+
+/**
+ * Add a vehicle clock sample.
+ *
+ * \param   vehicleTime     from MSG_ID_NOP [us]
+ * \param   groundTime      arrival time, see now() [s]
+ */
+void ClockSync::addSample(quint64 vehicleTime, double groundTime)
+{
+    // The vehicle was reset
+    //
+    if (valid && vehicleTime < lastVehicleTime)
+        reset();
+
+    Sample s = { vehicleTime, groundTime - vehicleTime * 1e-6 };
+
+    if (!minima.isEmpty() &&
+        minima.last().vehicleTime / intervalUs == vehicleTime / intervalUs)
+    {
+        if (s.diff < minima.last().diff)
+            minima.last() = s;
+    }
+    else {
+        minima.append(s);
+        if (minima.size() > numIntervals)
+            minima.removeFirst();
+    }
+
+    lastVehicleTime = vehicleTime;
+    valid = true;
+
+    fit();
+}
+
+
+void ClockSync::fit()
+{
+    int n = minima.size();
+    t0 = minima.last().vehicleTime;
+
+    // Not enough intervals for a useful drift estimate,
+    // use the smallest difference so far
+    //
+    if (n < 4) {
+        a = minima.first().diff;
+        for (const auto &s: minima)
+            a = qMin(a, s.diff);
+
+        b = 0;
+        return;
+    }
+
+    // Least squares fit, relative to the first
+    // sample to keep the precision
+    //
+    double y0 = minima.first().diff;
+    double sx = 0, sy = 0, sxx = 0, sxy = 0;
+
+    for (const auto &s: minima) {
+        double x = (qint64)(s.vehicleTime - t0) * 1e-6;
+        double y = s.diff - y0;
+
+        sx  += x;
+        sy  += y;
+        sxx += x * x;
+        sxy += x * y;
+    }
+
+    b = (n * sxy - sx * sy) / (n * sxx - sx * sx);
+
+    // Delays are never below the minimum, so the line is moved
+    // down onto the lowest sample
+    //
+    a = y0 + (sy - b * sx) / n;
+    for (const auto &s: minima)
+        a = qMin(a, s.diff - b * (qint64)(s.vehicleTime - t0) * 1e-6);
+}
+
+
+bool ClockSync::isValid() const
+{
+    return valid;
+}
+
+
+/**
+ * Map a 32 bit timestamp, e.g. from struct msg_telemetry.
+ * The timestamp must be within 35 minutes of the last sample.
+ */
+double ClockSync::toGround(quint32 vehicleTime) const
+{
+    quint64 t = lastVehicleTime + (qint32)(vehicleTime - (quint32)lastVehicleTime);
+    return toGround64(t);
+}
+
+
+double ClockSync::toGround64(quint64 vehicleTime) const
+{
+    return vehicleTime * 1e-6 + a + b * (qint64)(vehicleTime - t0) * 1e-6;
+}
+
+
+double ClockSync::drift() const
+{
+    return b * 1e6;
+}
+
+
+double ClockSync::delay(quint64 vehicleTime, double groundTime) const
+{
+    return groundTime - toGround64(vehicleTime);
+}
+
+
+/**
+ * Current ground time with sub-millisecond resolution.
+ *
+ */
+double ClockSync::now()
+{
+    static QElapsedTimer timer;
+    static qint64 epoch;
+
+    if (!timer.isValid()) {
+        epoch = QDateTime::currentMSecsSinceEpoch();
+        timer.start();
+    }
+
+    return epoch * 1e-3 + timer.nsecsElapsed() * 1e-9;
+}
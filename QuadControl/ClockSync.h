@@ -0,0 +1,57 @@
+#ifndef CLOCKSYNC_H
+#define CLOCKSYNC_H
+
+#include <QtGlobal>
+#include <QVector>
+
+/**
+ * Maps vehicle time to ground time.
+ *
+ * The vehicle sends its clock in MSG_ID_NOP. Arrival time minus vehicle
+ * time is the clock offset plus the link delay. The delay varies with
+ * queueing, but never drops below the minimum of the link, so the lower
+ * envelope follows the clock: like NTP's clock filter, the sample with
+ * the smallest difference in each interval is kept. A line through the
+ * recent minima gives offset and drift.
+ *
+ * The vehicle can't receive a reply, so the minimum one-way delay can't
+ * be measured and becomes part of the offset. Mapped times are the
+ * earliest times a message sent at that moment could have arrived.
+ */
+class ClockSync
+{
+public:
+    void    reset();
+    void    addSample(quint64 vehicleTime, double groundTime);
+
+    bool    isValid() const;
+    double  toGround(quint32 vehicleTime) const;     // telemetry timestamps
+    double  toGround64(quint64 vehicleTime) const;
+
+    double  drift() const;                                      // [ppm]
+    double  delay(quint64 vehicleTime, double groundTime) const;    // above the minimum [s]
+
+    static double now();        // ground time [s since epoch]
+
+private:
+    static const qint64 intervalUs = 2000000;
+    static const int    numIntervals = 32;
+
+    struct Sample {
+        quint64 vehicleTime;    // [us]
+        double  diff;           // ground - vehicle [s]
+    };
+
+    QVector<Sample> minima;     // one per interval, oldest first
+    quint64 lastVehicleTime = 0;
+    bool    valid = false;
+
+    // ground = vehicle + a + b * (vehicle - t0)
+    //
+    quint64 t0 = 0;
+    double  a = 0, b = 0;
+
+    void fit();
+};
+
+#endif // CLOCKSYNC_H
@@ -20,6 +20,7 @@
 #include <QByteArray>
 #include <QTcpSocket>
 #include <QFile>
+#include <QUrlQuery>
 
 #include "Shared/cobsr.h"
 #include "Shared/crc16.h"
@@ -29,6 +30,10 @@
 Connection::Connection(QObject *parent)
     : QObject(parent)
 {
+    // Received packets are decoded in place into rx_msg
+    //
+    cobsr_decoder_init(&rx_decoder, &rx_msg.h.crc, 2 + 2 + sizeof(rx_msg.data));
+    fec_decoder_init(&rx_fec);
 }
 
 
@@ -41,14 +46,26 @@ bool Connection::openUrl(const QUrl &url)
 {
     bool res = false;
 
-    if (url.scheme() == "serial")
-        res = openSerial(url.path(), url.query().toInt());
-    else if (url.scheme() == "wifly")
+    // Serial ports default to the XBee frame size. Add "&mtu=<bytes>"
+    // to the URL for direct connections. TCP and files have no limit.
+    //
+    if (url.scheme() == "serial") {
+        res = openSerial(url.path(), url.query().section('&', 0, 0).toInt());
+        m_maxDataSize = QUrlQuery(url).queryItemValue("mtu").toInt();
+    }
+    else if (url.scheme() == "wifly") {
         res = openSocket(url.host(), url.port());
-    else if (url.scheme() == "file" || url.scheme() == "")
+        m_maxDataSize = MSG_MAX_LINK_DATA_SIZE;
+    }
+    else if (url.scheme() == "file" || url.scheme() == "") {
         res = openFile(url.path());
-    else
+        m_maxDataSize = MSG_MAX_LINK_DATA_SIZE;
+    }
+    else {
         m_errorString = "Unknown URL scheme";
+    }
+
+    m_maxDataSize = qBound(MSG_MAX_DATA_SIZE, m_maxDataSize, MSG_MAX_LINK_DATA_SIZE);
 
     if (res)
         m_url = url;
@@ -109,6 +126,9 @@ bool Connection::openFile(const QString &fileName)
 bool Connection::openIoDevice(QIODevice *ioDevice)
 {
     this->ioDevice = ioDevice;
+    cobsr_decoder_init(&rx_decoder, &rx_msg.h.crc, 2 + 2 + sizeof(rx_msg.data));
+    fec_decoder_init(&rx_fec);
+    clockSync.reset();
     connect(ioDevice, &QIODevice::readyRead, this, &Connection::ioDevice_readyRead);
 
     emit connectionChanged();
@@ -146,11 +166,27 @@ QString Connection::errorString()
 }
 
 
+/**
+ * Largest payload the link can carry.
+ * The remote side may accept less, see MSG_ID_LINK_SETUP.
+ */
+int Connection::maxDataSize()
+{
+    return m_maxDataSize;
+}
+
+
 bool Connection::sendMessage(msg_header *msg)
 {
     if (!isOpen())
         return false;
 
+    if (msg->data_len > m_maxDataSize) {
+        m_errorString = _user_strerror(EMSG_TOO_LONG);
+        stats.tx_errors++;
+        return false;
+    }
+
     QByteArray packet;
 
     encodeMessage(msg, &packet);
@@ -175,33 +211,59 @@ void Connection::ioDevice_readyRead()
     if (!isOpen())
         return;
 
+    rx_time = ClockSync::now();
+
     auto buf = ioDevice->readAll();
-    rx_buf.append(buf);
     stats.rx_bytes += buf.size();
 
-    parseMessages();
+    parseMessages(buf);
 }
 
 
-void Connection::parseMessages()
+void Connection::parseMessages(const QByteArray &buf)
 {
-    for (;;) {
-        int pos = rx_buf.indexOf('\0');
-        if (pos < 0)
-            return;
+    const char *ptr = buf.data();
+    size_t len = buf.size();
+
+    // The decoder stops after each complete packet. Empty frames,
+    // which are used to flush the receiver, are skipped.
+    //
+    while (len > 0) {
+        size_t consumed;
+        auto res = cobsr_decoder_feed(&rx_decoder, ptr, len, &consumed);
+
+        ptr += consumed;
+        len -= consumed;
 
-        msg_generic msg;
+        if (res == 0)
+            continue;
 
-        if (decodeMessage(rx_buf.left(pos), &msg)) {
+        if (res > 0 && checkMessage(res, &rx_msg.h)) {
             stats.rx_packets++;
-            emit messageReceived(msg);
+
+            if (rx_msg.h.id == MSG_ID_NOP && rx_msg.h.data_len >= 8) {
+                auto &nop = (const msg_nop&)rx_msg;
+                clockSync.addSample(nop.time, rx_time);
+            }
+
+            emit messageReceived(rx_msg.h);
+
+            // Messages that were lost and rebuilt from parity
+            // arrive late, after the rest of their group
+            //
+            auto n = fec_decoder_input(&rx_fec, &rx_msg.h);
+            for (int i=0; i<n; i++) {
+                stats.rx_recovered++;
+                emit messageReceived(rx_fec.out[i].h);
+            }
         }
         else {
+            if (res < 0)
+                m_errorString = _user_strerror(errno);
+
             qDebug() << m_errorString;
             stats.rx_errors++;
         }
-
-        rx_buf = rx_buf.mid(pos + 1);
     }
 }
 
@@ -232,33 +294,23 @@ bool Connection::encodeMessage(msg_header *msg, QByteArray *packet)
 }
 
 
-bool Connection::decodeMessage(const QByteArray &packet, msg_generic *msg)
+bool Connection::checkMessage(int len, msg_header *msg)
 {
-    auto res = cobsr_decode(
-        &msg->h.crc, 2 + 2 + sizeof(msg_generic::data),
-        packet.data(), packet.size()
-    );
-
-    if (res < 0) {
-        m_errorString = _user_strerror(errno);
-        return false;
-    }
-
-    if (res < 2 + 2) {
+    if (len < 2 + 2) {
         m_errorString = _user_strerror(EMSG_TOO_SHORT);
         return false;
     }
 
-    msg->h.data_len = res -2 -2;
+    msg->data_len = len -2 -2;
 
     uint16_t crc;
     crc = crc16_init();
-    crc = crc16_update(crc, (uchar*)&msg->h.id, 2 + msg->h.data_len);
+    crc = crc16_update(crc, (uchar*)&msg->id, 2 + msg->data_len);
     crc = crc16_finalize(crc);
 
-    if (crc != msg->h.crc) {
-        qDebug() << QByteArray((char*)&msg->h.crc, 2 + 2 + msg->h.data_len).toHex();
-        m_errorString = QString().sprintf("CRC expected 0x%04x, got 0x%04x", crc, msg->h.crc);
+    if (crc != msg->crc) {
+        qDebug() << QByteArray((char*)&msg->crc, 2 + 2 + msg->data_len).toHex();
+        m_errorString = QString().sprintf("CRC expected 0x%04x, got 0x%04x", crc, msg->crc);
         return false;
     }
 
@@ -7,6 +7,9 @@
 #include <QUrl>
 
 #include "Shared/msg_structs.h"
+#include "Shared/cobsr.h"
+#include "Shared/fec.h"
+#include "ClockSync.h"
 
 
 class Connection : public QObject
@@ -21,12 +24,14 @@ public:
         uint    rx_bytes;
         uint    rx_packets;
         uint    rx_errors;
+        uint    rx_recovered;   // rebuilt by FEC
         uint    tx_bytes;
         uint    tx_packets;
         uint    tx_errors;
     };
 
     Statistics stats = Statistics();
+    ClockSync  clockSync;       // from MSG_ID_NOP
 
     bool openUrl(const QUrl &url);
     QUrl getUrl();
@@ -36,17 +41,24 @@ public:
     void close();
     bool isOpen();
 
+    int maxDataSize();
+
     bool sendMessage(msg_header *msg);
 
 signals:
-    void messageReceived(const msg_generic &msg);
+    // msg.data_len bytes of data follow the header, up to maxDataSize()
+    void messageReceived(const msg_header &msg);
     void connectionChanged();
 
 private:
     QIODevice   *ioDevice = NULL;
     QUrl        m_url;
     QString     m_errorString;
-    QByteArray  rx_buf;
+    int         m_maxDataSize = MSG_MAX_DATA_SIZE;
+    cobsr_decoder rx_decoder;
+    msg_large   rx_msg;
+    fec_decoder rx_fec;
+    double      rx_time = 0;    // arrival of the current data, see ClockSync::now()
 
     bool openIoDevice(QIODevice *ioDevice);
     bool openSerial(const QString &getUrl, int baudRate);
@@ -54,10 +66,10 @@ private:
     bool openFile(const QString &fileName);
 
     void ioDevice_readyRead();
-    void parseMessages();
+    void parseMessages(const QByteArray &buf);
 
     bool encodeMessage(msg_header *msg, QByteArray *packet);
-    bool decodeMessage(const QByteArray &packet, msg_generic *msg);
+    bool checkMessage(int len, msg_header *msg);
 };
 
 
@@ -24,6 +24,7 @@
 #include <QSettings>
 
 #include "../PuTTYLauncher.h"
+#include "../LinkBenchmark.h"
 #include "../TryAction.h"
 #include "AddConnectionDialog.h"
 #include "MainWindow.h"
@@ -43,6 +44,7 @@ ConnectionWindow::ConnectionWindow(QWidget *parent)
     connect(ui->actionConnect, &QAction::triggered, this, &ConnectionWindow::actionConnect_triggered);
     connect(ui->actionDisconnect, &QAction::triggered, this, &ConnectionWindow::actionDisconnect_triggered);
     connect(ui->actionTerminal, &QAction::triggered, this, &ConnectionWindow::actionTerminal_triggered);
+    connect(ui->actionBenchmark, &QAction::triggered, this, &ConnectionWindow::actionBenchmark_triggered);
 
     connect(ui->treeWidget, &QTreeWidget::currentItemChanged, this, &ConnectionWindow::treewidget_currentItemChanged);
     connect(ui->treeWidget, &QTreeWidget::itemActivated, this, &ConnectionWindow::actionConnect_triggered);
@@ -308,6 +310,29 @@ void ConnectionWindow::actionTerminal_triggered()
 }
 
 
+void ConnectionWindow::actionBenchmark_triggered()
+{
+    LinkBenchmark bench(mainWindow->connection);
+    LinkBenchmark::Report report;
+
+    auto res = tryAction(
+        [&]() { return bench.run(&report); },
+        [&]() { return QString("Link benchmark failed\n%1")
+                    .arg(bench.errorString());
+        },
+        Qt::WaitCursor
+    );
+
+    if (!res)
+        return;
+
+    auto text = LinkBenchmark::formatReport(mainWindow->connection.getUrl(), report);
+    qDebug("%s", qPrintable(text));
+
+    QMessageBox::information(mainWindow, "Link Benchmark", text);
+}
+
+
 void ConnectionWindow::actionDisconnect_triggered()
 {
     mainWindow->connection.close();
@@ -331,5 +356,6 @@ void ConnectionWindow::treewidget_currentItemChanged()
 void ConnectionWindow::connectionChanged()
 {
     ui->actionDisconnect->setEnabled( mainWindow->connection.isOpen() );
+    ui->actionBenchmark->setEnabled( mainWindow->connection.isOpen() );
 }
 
@@ -52,6 +52,7 @@ private:
     void actionConnect_triggered();
     void actionDisconnect_triggered();
     void actionTerminal_triggered();
+    void actionBenchmark_triggered();
 
     void treewidget_currentItemChanged();
     void connectionChanged();
@@ -140,10 +140,10 @@ void ConsoleWindow::actionWrap_triggered()
 }
 
 
-void ConsoleWindow::connection_messageReceived(const msg_generic &msg)
+void ConsoleWindow::connection_messageReceived(const msg_header &msg)
 {
-    if (msg.h.id == MSG_ID_SHELL_TO_PC)
-        rx_buf.append( QByteArray((char*)msg.data, msg.h.data_len) );
+    if (msg.id == MSG_ID_SHELL_TO_PC)
+        rx_buf.append( QByteArray((char*)msg.data, msg.data_len) );
 }
 
 
@@ -29,7 +29,7 @@ private:
     void actionClear_triggered();
     void actionSave_triggered();
     void actionWrap_triggered();
-    void connection_messageReceived(const msg_generic &msg);
+    void connection_messageReceived(const msg_header &msg);
     void timer_timeout();
 
     void ansi_attributesChanged(const AnsiParser::Attributes &attr);
@@ -22,6 +22,7 @@
 
 #include <math.h>
 #include "../MainWindow.h"
+#include "Shared/tlm_codec.h"
 
 
 PlotWindow::PlotWindow(QWidget *parent)
@@ -55,6 +56,11 @@ PlotWindow::PlotWindow(QWidget *parent)
     for (int i=0; i<11; i++)
         ui->plot->addGraph();
 
+    // Scope channels
+    //
+    for (int i=0; i<4; i++)
+        ui->plot->addGraph();
+
     ui->plot->xAxis->setTickLabelType(QCPAxis::ltDateTime);
     ui->plot->xAxis->setDateTimeFormat("hh:mm:ss");
     ui->plot->xAxis->setAutoTickStep(false);
@@ -120,24 +126,106 @@ void PlotWindow::timer_timeout()
 }
 
 
-void PlotWindow::connection_messageReceived(const msg_generic &msg)
+void PlotWindow::connection_messageReceived(const msg_header &msg)
 {
     double key = QDateTime::currentDateTime().toMSecsSinceEpoch()/1000.0;
 
-    if (msg.h.id == MSG_ID_IMU_DATA) {
-        auto imu = (const msg_imu_data&)msg;
-
-        ui->plot->graph(4)->addData(key,  imu.acc_x);
-        ui->plot->graph(5)->addData(key,  imu.acc_y);
-        ui->plot->graph(6)->addData(key,  imu.acc_z);
-        ui->plot->graph(7)->addData(key,  imu.gyro_x);
-        ui->plot->graph(8)->addData(key,  imu.gyro_y);
-        ui->plot->graph(9)->addData(key,  imu.gyro_z);
-        ui->plot->graph(10)->addData(key, imu.mag_x);
-        ui->plot->graph(11)->addData(key, imu.mag_y);
-        ui->plot->graph(12)->addData(key, imu.mag_z);
-        ui->plot->graph(13)->addData(key, imu.baro_hpa);
-        ui->plot->graph(14)->addData(key, imu.baro_temp);
+    if (msg.id == MSG_ID_SCOPE_DATA) {
+        if (scopeCapture.addMessage((const msg_scope_data&)msg))
+            plotScopeCapture(key);
+
+        return;
+    }
+
+    if (msg.data_len < 8)
+        return;
+
+    QVector<msg_imu_sample> samples;
+    double interval = 0;
+    quint32 timestamp = ((const msg_telemetry&)msg).timestamp;
+
+    // Messages on large links can be longer than the structs,
+    // only the samples that fit are used
+    //
+    if (msg.id == MSG_ID_IMU_DATA) {
+        const auto &imu = (const msg_imu_data&)msg;
+
+        int n = qMin((size_t)msg.data_len - 8, sizeof(imu.samples)) / sizeof(msg_imu_sample);
+        for (int i=0; i<n; i++)
+            samples.append(imu.samples[i]);
+
+        interval = imu.interval / 1e6;
+    }
+    else if (msg.id == MSG_ID_IMU_DATA_DELTA) {
+        const auto &tlm = (const msg_telemetry&)msg;
+
+        static const float resolution[] = MSG_IMU_RESOLUTION;
+        tlm_codec codec;
+        tlm_codec_init(&codec, resolution, MSG_IMU_NUM_CHANNELS);
+
+        size_t pos = 0, len = qMin((size_t)msg.data_len - 8, sizeof(tlm.samples));
+        while (pos < len) {
+            msg_imu_sample s;
+            ssize_t n = tlm_decode(&codec, (float*)&s, &tlm.samples[pos], len - pos);
+            if (n < 0) {
+                qDebug("IMU_DATA_DELTA: %s", _user_strerror(errno));
+                break;
+            }
+            samples.append(s);
+            pos += n;
+        }
+
+        interval = tlm.interval / 1e6;
+    }
+
+    // Use the vehicle timestamps if the clocks are synchronized.
+    // Otherwise, the last sample in the message is the most recent one.
+    //
+    const auto &clockSync = mainWindow->connection.clockSync;
+    int n = samples.size();
+
+    double t0 = clockSync.isValid()
+            ? clockSync.toGround(timestamp)
+            : key - (n-1) * interval;
+
+    for (int i=0; i<n; i++) {
+        const auto &s = samples[i];
+        double t = t0 + i * interval;
+
+        ui->plot->graph(4)->addData(t,  s.acc_x);
+        ui->plot->graph(5)->addData(t,  s.acc_y);
+        ui->plot->graph(6)->addData(t,  s.acc_z);
+        ui->plot->graph(7)->addData(t,  s.gyro_x);
+        ui->plot->graph(8)->addData(t,  s.gyro_y);
+        ui->plot->graph(9)->addData(t,  s.gyro_z);
+        ui->plot->graph(10)->addData(t, s.mag_x);
+        ui->plot->graph(11)->addData(t, s.mag_y);
+        ui->plot->graph(12)->addData(t, s.mag_z);
+        ui->plot->graph(13)->addData(t, s.baro_hpa);
+        ui->plot->graph(14)->addData(t, s.baro_temp);
+    }
+}
+
+
+/**
+ * Plot a complete scope capture. Captures are dumped on
+ * request, so the last sample is placed at the arrival time.
+ */
+void PlotWindow::plotScopeCapture(double key)
+{
+    const auto &c = scopeCapture;
+    int n = c.numSamples();
+    double t0 = key - c.time(n-1);
+
+    for (int ch=0; ch<4; ch++) {
+        auto graph = ui->plot->graph(15 + ch);
+        graph->clearData();
+
+        if (ch >= c.numChannels())
+            continue;
+
+        for (int i=0; i<n; i++)
+            graph->addData(t0 + c.time(i), c.value(i, ch));
     }
 }
 
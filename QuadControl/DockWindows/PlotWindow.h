@@ -5,6 +5,7 @@
 #include <QTimer>
 
 #include "Shared/msg_structs.h"
+#include "ScopeCapture.h"
 
 namespace Ui {
 class PlotWindow;
@@ -24,9 +25,11 @@ private:
     Ui::PlotWindow *ui;
 
     QTimer timer;
+    ScopeCapture scopeCapture;
 
     void timer_timeout();
-    void connection_messageReceived(const msg_generic &msg);
+    void connection_messageReceived(const msg_header &msg);
+    void plotScopeCapture(double key);
 };
 
 #endif // PLOTWINDOW_H
@@ -40,10 +40,12 @@ UpdateWindow::UpdateWindow(QWidget *parent)
     ui->setupUi(this);
 
     ui->lineEdit->setText( QSettings().value("update_filename").toString() );
+    ui->deltaCheckBox->setChecked( QSettings().value("update_delta", true).toBool() );
 
     connect(ui->lineEdit, &QLineEdit::textChanged, this, &UpdateWindow::lineEdit_textChanged);
     connect(ui->browseButton, &QPushButton::clicked, this, &UpdateWindow::browseButton_clicked);
     connect(ui->updateButton, &QPushButton::clicked, this, &UpdateWindow::updateButton_clicked);
+    connect(ui->deltaCheckBox, &QCheckBox::toggled, this, &UpdateWindow::deltaCheckBox_toggled);
     connect(&mainWindow->connection, &Connection::connectionChanged, this, &UpdateWindow::connectionChanged);
 
     auto model = new QFileSystemModel(this);
@@ -97,15 +99,27 @@ void UpdateWindow::browseButton_clicked()
 void UpdateWindow::updateButton_clicked()
 {
     BootProtocol bp(mainWindow->connection, mainWindow);
+    ui->timingsLabel->clear();
 
-    tryAction(
-        [&]() { return bp.sendHexFile(ui->lineEdit->text()); },
+    bool ok = tryAction(
+        [&]() { return bp.sendHexFile(ui->lineEdit->text(), ui->deltaCheckBox->isChecked()); },
         [&]() { return QString("Firmware update failed\n%1\n%2")
                     .arg(ui->lineEdit->text())
                     .arg(bp.errorString());
         },
         Qt::ArrowCursor
     );
+
+    // Nothing is measured when canceled
+    //
+    auto t = bp.timings();
+    if (ok && t.total > 0) {
+        ui->timingsLabel->setText(QString().sprintf(
+            "Enter: %d ms, write: %d ms, erase: %d ms,\n"
+            "verify: %d ms, total: %d ms",
+            t.enter, t.write, t.erase, t.verify, t.total
+        ));
+    }
 }
 
 void UpdateWindow::lineEdit_textChanged()
@@ -113,6 +127,11 @@ void UpdateWindow::lineEdit_textChanged()
     QSettings().setValue("update_filename", ui->lineEdit->text());
 }
 
+void UpdateWindow::deltaCheckBox_toggled(bool checked)
+{
+    QSettings().setValue("update_delta", checked);
+}
+
 void UpdateWindow::connectionChanged()
 {
     auto c = (Connection*)sender();
@@ -24,6 +24,7 @@ private:
     Ui::UpdateWindow *ui;
 
     void lineEdit_textChanged();
+    void deltaCheckBox_toggled(bool checked);
     void browseButton_clicked();
     void updateButton_clicked();
     void connectionChanged();
@@ -0,0 +1,374 @@
+/**
+ * Copyright (C)2015 Thomas Kindler <mail_drquad@t-kindler.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "LinkBenchmark.h"
+#include "Shared/msg_structs.h"
+#include "Shared/errors.h"
+
+#include <QDebug>
+#include <QApplication>
+#include <QThread>
+#include <algorithm>
+
+
+LinkBenchmark::LinkBenchmark(Connection &connection, QObject *parent)
+    : QObject(parent)
+    , connection(connection)
+{
+    connect(&connection, &Connection::messageReceived, this, &LinkBenchmark::connection_messageReceived);
+    clock.start();
+}
+
+
+void LinkBenchmark::connection_messageReceived(const msg_header &msg)
+{
+    switch (msg.id) {
+    case MSG_ID_BOOT_RESPONSE:
+        response = msg_boot_response();
+        memcpy(&response, &msg, qMin(sizeof(msg_header) + msg.data_len, sizeof(response)));
+        response.h.data_len = qMin(msg.data_len, (int)(sizeof(response) - sizeof(msg_header)));
+        gotResponse = true;
+        break;
+
+    case MSG_ID_BENCH_PONG:
+        if (msg.data_len >= 20) {
+            pong = (const msg_bench_ping&)msg;
+            t_pong = now();
+            gotPong = true;
+        }
+        break;
+
+    case MSG_ID_BENCH_DATA:
+        if (msg.data_len >= 4) {
+            if (rxCount++ == 0)
+                t_rxFirst = now();
+
+            t_rxLast = now();
+            rxBytes += msg.data_len;
+        }
+        break;
+    }
+}
+
+
+/********** Low level functions **********/
+
+qint64 LinkBenchmark::now()
+{
+    return clock.nsecsElapsed() / 1000;
+}
+
+
+bool LinkBenchmark::waitFor(const std::function<bool()> &done, int timeout)
+{
+    QElapsedTimer t;
+    t.start();
+
+    while (!done()) {
+        if (t.hasExpired(timeout)) {
+            m_errorString = _user_strerror(EMSG_TIMEOUT);
+            return false;
+        }
+
+        QApplication::processEvents();
+        QThread::msleep(1);
+    }
+
+    return true;
+}
+
+
+bool LinkBenchmark::request(msg_header *msg, msg_boot_response *res)
+{
+    gotResponse = false;
+
+    if (!connection.sendMessage(msg)) {
+        m_errorString = connection.errorString();
+        return false;
+    }
+
+    if (!waitFor([&]() { return gotResponse; }, 500))
+        return false;
+
+    if (response.error != 0) {
+        m_errorString = _user_strerror(response.error);
+        return false;
+    }
+
+    if (res != NULL)
+        *res = response;
+
+    return true;
+}
+
+
+bool LinkBenchmark::ping(uint seq, int size, double *rtt, int timeout)
+{
+    // msg_bench_ping with up to maxDataSize() bytes
+    //
+    msg_large buf;
+    auto &msg = (msg_bench_ping&)buf;
+
+    msg.h.id = MSG_ID_BENCH_PING;
+    msg.h.data_len = qMax(size, 20);
+    msg.seq = seq;
+    msg.t_send = now();
+    msg.t_echo = 0;
+    msg.rx_packets = 0;
+    msg.rx_bytes = 0;
+
+    for (int i=20; i<msg.h.data_len; i++)
+        buf.data[i] = i;
+
+    auto t0 = now();
+    gotPong = false;
+
+    if (!connection.sendMessage(&msg.h)) {
+        m_errorString = connection.errorString();
+        return false;
+    }
+
+    if (!waitFor([&]() { return gotPong && pong.seq == seq; }, timeout))
+        return false;
+
+    if (rtt != NULL)
+        *rtt = (t_pong - t0) / 1000.0;
+
+    return true;
+}
+
+
+/********** Benchmarks **********/
+
+bool LinkBenchmark::runPing(Report *report, int count)
+{
+    QVector<double> rtts;
+
+    // Stop-and-wait, so each round trip is measured on an idle link
+    //
+    for (int seq=1; seq <= count; seq++) {
+        double rtt;
+
+        report->pingsSent++;
+        if (ping(seq, report->dataSize, &rtt))
+            rtts.append(rtt);
+    }
+
+    report->pingsReceived = rtts.size();
+
+    if (rtts.isEmpty()) {
+        m_errorString = "No answer to ping";
+        return false;
+    }
+
+    std::sort(rtts.begin(), rtts.end());
+
+    auto percentile = [&](double p) {
+        return rtts[qMin(rtts.size() - 1, int(p * rtts.size()))];
+    };
+
+    report->rttMin = rtts.first();
+    report->rttP50 = percentile(0.50);
+    report->rttP90 = percentile(0.90);
+    report->rttP99 = percentile(0.99);
+    report->rttMax = rtts.last();
+
+    return true;
+}
+
+
+bool LinkBenchmark::runSink(Report *report, int count)
+{
+    // Reset the counters on the other side
+    //
+    if (!ping(0, 20))
+        return false;
+
+    msg_large buf;
+    auto &msg = (msg_bench_data&)buf;
+
+    msg.h.id = MSG_ID_BENCH_DATA;
+    msg.h.data_len = report->dataSize;
+
+    for (int i=4; i<msg.h.data_len; i++)
+        buf.data[i] = i;
+
+    auto t0 = now();
+
+    for (int seq=0; seq < count; seq++) {
+        msg.seq = seq;
+        if (connection.sendMessage(&msg.h))
+            report->txSent++;
+    }
+
+    // The pings queue up behind the data. Poll the counters until
+    // everything has arrived or nothing changes for a second.
+    //
+    uint   received = 0, bytes = 0;
+    qint64 t_end = t0, t_change = now();
+
+    for (uint seq=1; received < (uint)report->txSent; seq++) {
+        double rtt;
+        if (ping(seq, 20, &rtt, 10000) && pong.rx_packets != received) {
+            received = pong.rx_packets;
+            bytes    = pong.rx_bytes;
+            t_end    = t_pong - rtt * 1000 / 2;
+            t_change = now();
+        }
+
+        if (now() - t_change > 1000000)
+            break;
+    }
+
+    report->txReceived = received;
+    if (t_end > t0)
+        report->txGoodput = bytes * 1e6 / (t_end - t0);
+
+    return true;
+}
+
+
+bool LinkBenchmark::runSource(Report *report, int count)
+{
+    rxCount = 0;
+    rxBytes = 0;
+
+    msg_bench_source msg;
+    msg.h.id = MSG_ID_BENCH_SOURCE;
+    msg.h.data_len = 8;
+    msg.count = count;
+    msg.size = report->dataSize;
+    msg.reserved = 0;
+
+    if (!connection.sendMessage(&msg.h)) {
+        m_errorString = connection.errorString();
+        return false;
+    }
+
+    report->rxRequested = count;
+
+    // Wait until all messages have arrived, or
+    // nothing has arrived for two seconds
+    //
+    auto t0 = now();
+    while (rxCount < count) {
+        if (now() - (rxCount ? t_rxLast : t0) > 2000000)
+            break;
+
+        QApplication::processEvents();
+        QThread::msleep(1);
+    }
+
+    report->rxReceived = rxCount;
+
+    // The first message marks the start of the measurement
+    //
+    if (rxCount > 1 && t_rxLast > t_rxFirst) {
+        report->rxGoodput =
+            rxBytes * (rxCount - 1) / rxCount * 1e6 / (t_rxLast - t_rxFirst);
+    }
+
+    return true;
+}
+
+
+/**
+ * Run all benchmarks.
+ *
+ * Enters the bootloader like BootProtocol and starts
+ * the application again when done.
+ */
+bool LinkBenchmark::run(Report *report, int pings, int messages)
+{
+    *report = Report();
+
+    // Hack: send ctrl-c + reset, see BootProtocol::bootResetHack()
+    //
+    const char *s = "\03\nreset\n";
+
+    msg_shell_from_pc shell;
+    shell.h.id = MSG_ID_SHELL_FROM_PC;
+    shell.h.data_len = strlen(s);
+    strcpy((char*)shell.data, s);
+
+    connection.sendMessage(&shell.h);
+    gotResponse = false;
+    waitFor([&]() { return gotResponse; }, 500);
+
+    msg_boot_enter enter;
+    enter.h.id = MSG_ID_BOOT_ENTER;
+    enter.h.data_len = 4;
+    enter.magic = BOOT_ENTER_MAGIC;
+
+    if (!request(&enter.h))
+        return false;
+
+    // Use the largest message size both sides support
+    //
+    msg_link_setup setup;
+    setup.h.id = MSG_ID_LINK_SETUP;
+    setup.h.data_len = 4;
+    setup.max_data_size = connection.maxDataSize();
+    setup.flags = 0;
+
+    msg_boot_response res;
+    report->dataSize = MSG_MAX_DATA_SIZE;
+
+    if (request(&setup.h, &res)) {
+        uint16_t size;
+        memcpy(&size, res.data, 2);
+        report->dataSize = qBound(MSG_MAX_DATA_SIZE, (int)size, connection.maxDataSize());
+    }
+
+    bool ok =
+        runPing(report, pings) &&
+        runSink(report, messages) &&
+        runSource(report, messages);
+
+    msg_boot_exit leave;
+    leave.h.id = MSG_IG_BOOT_EXIT;
+    leave.h.data_len = 0;
+    request(&leave.h);
+
+    return ok;
+}
+
+
+QString LinkBenchmark::formatReport(const QUrl &url, const Report &r)
+{
+    QString s;
+
+    s += url.toString() + "\n\n";
+    s += QString().sprintf("Message size:  %d bytes\n", r.dataSize);
+    s += QString().sprintf("Round trip:    %.1f / %.1f / %.1f / %.1f / %.1f ms\n",
+            r.rttMin, r.rttP50, r.rttP90, r.rttP99, r.rttMax);
+    s += QString().sprintf("               (min / 50%% / 90%% / 99%% / max)\n");
+    s += QString().sprintf("Ping loss:     %d of %d\n",
+            r.pingsSent - r.pingsReceived, r.pingsSent);
+    s += QString().sprintf("Upload:        %.0f bytes/s, %d of %d lost\n",
+            r.txGoodput, r.txSent - r.txReceived, r.txSent);
+    s += QString().sprintf("Download:      %.0f bytes/s, %d of %d lost\n",
+            r.rxGoodput, r.rxRequested - r.rxReceived, r.rxRequested);
+
+    return s;
+}
+
+
+QString LinkBenchmark::errorString()
+{
+    return m_errorString;
+}
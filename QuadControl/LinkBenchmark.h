@@ -0,0 +1,77 @@
+#ifndef LINKBENCHMARK_H
+#define LINKBENCHMARK_H
+
+#include <QObject>
+#include <QString>
+#include <QVector>
+#include <QElapsedTimer>
+#include <functional>
+
+#include "Connection.h"
+
+/**
+ * Measures round-trip time, goodput and packet loss of a connection.
+ *
+ * The other side must answer the MSG_ID_BENCH_* messages. That is the
+ * bootloader, or Tools/link_loopback.py as a local stand-in.
+ */
+class LinkBenchmark : public QObject
+{
+    Q_OBJECT
+
+public:
+    LinkBenchmark(Connection &connection, QObject *parent = 0);
+
+    struct Report {
+        int     dataSize = 0;           // payload per message
+
+        int     pingsSent = 0;
+        int     pingsReceived = 0;
+        double  rttMin = 0, rttP50 = 0, rttP90 = 0, rttP99 = 0, rttMax = 0;  // [ms]
+
+        int     txSent = 0;             // host to vehicle
+        int     txReceived = 0;
+        double  txGoodput = 0;          // [bytes/s]
+
+        int     rxRequested = 0;        // vehicle to host
+        int     rxReceived = 0;
+        double  rxGoodput = 0;          // [bytes/s]
+    };
+
+    bool run(Report *report, int pings = 100, int messages = 200);
+
+    QString errorString();
+    static QString formatReport(const QUrl &url, const Report &report);
+
+private:
+    Connection &connection;
+    QString m_errorString;
+    QElapsedTimer clock;
+
+    // Filled in by connection_messageReceived()
+    //
+    bool    gotResponse = false;
+    msg_boot_response response;
+
+    bool    gotPong = false;
+    msg_bench_ping pong;
+    qint64  t_pong = 0;             // [us]
+
+    int     rxCount = 0;
+    qint64  rxBytes = 0;
+    qint64  t_rxFirst = 0, t_rxLast = 0;    // [us]
+
+    void connection_messageReceived(const msg_header &msg);
+
+    qint64 now();
+    bool waitFor(const std::function<bool()> &done, int timeout);
+
+    bool request(msg_header *msg, msg_boot_response *res = NULL);
+    bool ping(uint seq, int size, double *rtt = NULL, int timeout = 1000);
+
+    bool runPing(Report *report, int count);
+    bool runSink(Report *report, int count);
+    bool runSource(Report *report, int count);
+};
+
+#endif // LINKBENCHMARK_H
@@ -34,6 +34,9 @@ SOURCES += main.cpp \
     IntelHexFile.cpp \
     DockWindows/MyGLWidget.cpp \
     BootProtocol.cpp \
+    LinkBenchmark.cpp \
+    ClockSync.cpp \
+    ScopeCapture.cpp \
     glut_teapot.cpp \
     WiFlyListener.cpp \
     GLTools.cpp \
@@ -43,7 +46,11 @@ SOURCES += main.cpp \
     ../Shared/cobsr.c \
     ../Shared/crc16.c \
     ../Shared/crc32.c \
-    ../Shared/errors.c
+    ../Shared/errors.c \
+    ../Shared/fec.c \
+    ../Shared/lzss.c \
+    ../Shared/rlink.c \
+    ../Shared/tlm_codec.c
 
 HEADERS  += MainWindow.h \
     AnsiParser.h \
@@ -57,6 +64,9 @@ HEADERS  += MainWindow.h \
     IntelHexFile.h \
     DockWindows/MyGLWidget.h \
     BootProtocol.h \
+    LinkBenchmark.h \
+    ClockSync.h \
+    ScopeCapture.h \
     glut_teapot.h \
     QProgressDialogEx.h \
     WiFlyListener.h \
@@ -69,7 +79,11 @@ HEADERS  += MainWindow.h \
     ../Shared/crc16.h \
     ../Shared/crc32.h \
     ../Shared/errors.h \
-    ../Shared/msg_structs.h
+    ../Shared/fec.h \
+    ../Shared/lzss.h \
+    ../Shared/msg_structs.h \
+    ../Shared/rlink.h \
+    ../Shared/tlm_codec.h
 
 FORMS    += MainWindow.ui \
     DockWindows/ConnectionWindow.ui \
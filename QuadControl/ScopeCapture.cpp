@@ -0,0 +1,88 @@
+/**
+ * Copyright (C)2015 Thomas Kindler <mail_drquad@t-kindler.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ScopeCapture.h"
+#include <stddef.h>
+
+
+void ScopeCapture::reset()
+{
+    channels = samples = received = 0;
+    data.clear();
+}
+
+
+/**
+ * Add the next message of a capture.
+ *
+ * \return  true if the capture is complete
+ */
+bool ScopeCapture::addMessage(const msg_scope_data &msg)
+{
+    const int header = offsetof(msg_scope_data, data) - sizeof(msg_header);
+    int values = (msg.h.data_len - header) / (int)sizeof(float);
+
+    if (msg.h.data_len < header || values > (int)(sizeof(msg.data) / sizeof(float))) {
+        reset();
+        return false;
+    }
+
+    if (msg.index == 0) {
+        reset();
+
+        if (msg.num_channels == 0 || msg.num_samples == 0)
+            return false;
+
+        channels   = msg.num_channels;
+        samples    = msg.num_samples;
+        trigOffset = msg.trig_offset;
+        interval   = msg.interval / 1e6;
+        data.reserve(channels * samples);
+    }
+
+    if (channels == 0 || msg.index != received
+        || msg.num_channels != channels || msg.num_samples != samples
+        || values % channels != 0 || received + values / channels > samples)
+    {
+        reset();
+        return false;
+    }
+
+    for (int i=0; i<values; i++)
+        data.append(msg.data[i]);
+
+    received += values / channels;
+    return isComplete();
+}
+
+
+bool ScopeCapture::isComplete() const
+{
+    return channels > 0 && received == samples;
+}
+
+
+float ScopeCapture::value(int sample, int channel) const
+{
+    return data[sample * channels + channel];
+}
+
+
+double ScopeCapture::time(int sample) const
+{
+    return (sample - trigOffset) * interval;
+}
@@ -0,0 +1,38 @@
+#ifndef SCOPECAPTURE_H
+#define SCOPECAPTURE_H
+
+#include <QVector>
+#include "Shared/msg_structs.h"
+
+/**
+ * Reassembles a scope capture from MSG_ID_SCOPE_DATA messages,
+ * see "scope dump" in Source/scope.c.
+ *
+ * The messages of a capture arrive in order. A message with
+ * index 0 starts a new capture, anything else that does not fit
+ * discards the partial one.
+ */
+class ScopeCapture
+{
+public:
+    void    reset();
+    bool    addMessage(const msg_scope_data &msg);  // true if complete
+
+    bool    isComplete() const;
+    int     numChannels() const { return channels; }
+    int     numSamples() const  { return samples; }
+
+    float   value(int sample, int channel) const;
+    double  time(int sample) const;     // relative to the trigger [s]
+
+private:
+    int     channels = 0;
+    int     samples = 0;
+    int     trigOffset = 0;     // [samples]
+    double  interval = 0;       // [s]
+    int     received = 0;       // [samples]
+
+    QVector<float> data;        // interleaved
+};
+
+#endif // SCOPECAPTURE_H
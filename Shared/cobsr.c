@@ -35,6 +35,92 @@
 #include <assert.h>
 #include <errno.h>
 #include <stdint.h>
+#include <string.h>
+
+/*****************************************************************************
+ * Helpers
+ ****************************************************************************/
+
+#define WORD_ONES   ((uintptr_t)-1 / 0xFF)      /* 0x01010101... */
+#define WORD_HIGHS  (WORD_ONES * 0x80)          /* 0x80808080... */
+
+
+/**
+ * Find the first zero byte.
+ *
+ * \return  index of the first zero byte, or len if there is none
+ */
+static size_t cobsr_find_zero(const uint8_t *ptr, size_t len)
+{
+    size_t i = 0;
+
+    if (len >= 2 * sizeof(uintptr_t)) {
+        while ((uintptr_t)(ptr + i) & (sizeof(uintptr_t) - 1)) {
+            if (ptr[i] == 0)
+                return i;
+            i++;
+        }
+
+        while (len - i >= sizeof(uintptr_t)) {
+            uintptr_t v;
+            memcpy(&v, ptr + i, sizeof(v));
+            if ((v - WORD_ONES) & ~v & WORD_HIGHS)
+                break;
+            i += sizeof(uintptr_t);
+        }
+    }
+
+    while (i < len) {
+        if (ptr[i] == 0)
+            return i;
+        i++;
+    }
+
+    return len;
+}
+
+
+/**
+ * Copy bytes up to the first zero byte.
+ *
+ * Long runs are copied a machine word at a time, and the zero check
+ * is done on the same loads. Short runs use a plain byte loop.
+ *
+ * \return  number of bytes copied, i.e. the index of the first zero
+ *          byte, or len if there is none
+ */
+static size_t cobsr_copy_run(uint8_t *dst, const uint8_t *src, size_t len)
+{
+    size_t i = 0;
+
+    if (len >= 2 * sizeof(uintptr_t)) {
+        while ((uintptr_t)(src + i) & (sizeof(uintptr_t) - 1)) {
+            if (src[i] == 0)
+                return i;
+            dst[i] = src[i];
+            i++;
+        }
+
+        while (len - i >= sizeof(uintptr_t)) {
+            uintptr_t v;
+            memcpy(&v, src + i, sizeof(v));
+            if ((v - WORD_ONES) & ~v & WORD_HIGHS)
+                break;
+            memcpy(dst + i, &v, sizeof(v));
+            i += sizeof(uintptr_t);
+        }
+    }
+
+    while (i < len) {
+        if (src[i] == 0)
+            return i;
+        dst[i] = src[i];
+        i++;
+    }
+
+    return len;
+}
+
 
 /*****************************************************************************
  * Functions
@@ -49,65 +135,62 @@ ssize_t cobsr_encode(void *dst_buf_ptr_v, size_t dst_buf_len, const void *src_pt
     uint8_t *           dst_buf_end_ptr     = dst_buf_ptr + dst_buf_len;
     uint8_t *           dst_code_write_ptr  = dst_buf_ptr;
     uint8_t *           dst_write_ptr       = dst_code_write_ptr + 1;
-    uint8_t             src_byte            = 0;
-    uint8_t             search_len          = 1;
 
     assert(dst_buf_ptr  && src_ptr);
 
-    if (src_len != 0)
+    /* Each iteration copies a run of up to 254 non-zero bytes */
+    for (;;)
     {
-        /* Iterate over the source bytes */
-        for (;;)
+        size_t remaining_input_bytes = src_end_ptr - src_ptr;
+        size_t max_run = remaining_input_bytes < 254 ? remaining_input_bytes : 254;
+        size_t avail, run;
+
+        if (dst_write_ptr > dst_buf_end_ptr)
         {
-            /* Check for running out of output buffer space */
-            if (dst_write_ptr >= dst_buf_end_ptr)
-            {
-                errno = ECOBSR_ENCODE_OUT_BUFFER_OVERFLOW;
-                return -1;
-            }
+            errno = ECOBSR_ENCODE_OUT_BUFFER_OVERFLOW;
+            return -1;
+        }
 
-            src_byte = *src_ptr++;
-            if (src_byte == 0)
-            {
-                /* We found a zero byte */
-                *dst_code_write_ptr = search_len;
-                dst_code_write_ptr = dst_write_ptr++;
-                search_len = 1;
-                if (src_ptr >= src_end_ptr)
-                {
-                    break;
-                }
-            }
-            else
-            {
-                /* Copy the non-zero byte to the destination buffer */
-                *dst_write_ptr++ = src_byte;
-                search_len++;
-                if (src_ptr >= src_end_ptr)
-                {
-                    break;
-                }
-                if (search_len == 0xFF)
-                {
-                    /* We have a long string of non-zero bytes, so we need
-                     * to write out a length code of 0xFF. */
-                    *dst_code_write_ptr = search_len;
-                    dst_code_write_ptr = dst_write_ptr++;
-                    search_len = 1;
-                }
-            }
+        avail = dst_buf_end_ptr - dst_write_ptr;
+        run = cobsr_copy_run(dst_write_ptr, src_ptr, max_run < avail ? max_run : avail);
+
+        /* Check for running out of output buffer space */
+        if (run == avail && run < max_run && src_ptr[run] != 0)
+        {
+            errno = ECOBSR_ENCODE_OUT_BUFFER_OVERFLOW;
+            return -1;
+        }
+
+        dst_write_ptr += run;
+        src_ptr += run;
+
+        if (run < max_run)
+        {
+            /* We found a zero byte */
+            *dst_code_write_ptr = run + 1;
+            dst_code_write_ptr = dst_write_ptr++;
+            src_ptr++;
+        }
+        else if (run < remaining_input_bytes)
+        {
+            /* We have a long string of non-zero bytes, so we need
+             * to write out a length code of 0xFF. */
+            *dst_code_write_ptr = 0xFF;
+            dst_code_write_ptr = dst_write_ptr++;
+        }
+        else
+        {
+            break;
         }
     }
 
-    /* We've reached the end of the source data (or possibly run out of output buffer)
-     * Finalise the remaining output. In particular, write the code (length) byte.
+    /* We've reached the end of the source data. Finalise the remaining
+     * output. In particular, write the code (length) byte.
      *
      * For COBS/R, the final code (length) byte is special: if the final data byte is
      * greater than or equal to what would normally be the final code (length) byte,
      * then replace the final code byte with the final data byte, and remove the final
      * data byte from the end of the sequence. This saves one byte in the output.
-     *
-     * Update the pointer to calculate the final output length.
      */
     if (dst_code_write_ptr >= dst_buf_end_ptr)
     {
@@ -117,6 +200,9 @@ ssize_t cobsr_encode(void *dst_buf_ptr_v, size_t dst_buf_len, const void *src_pt
     }
     else
     {
+        uint8_t search_len = dst_write_ptr - dst_code_write_ptr;
+        uint8_t src_byte = (search_len > 1) ? dst_write_ptr[-1] : 0;
+
         if (src_byte < search_len)
         {
             /* Encoding same as plain COBS */
@@ -145,108 +231,223 @@ ssize_t cobsr_decode(void *dst_buf_ptr_v, size_t dst_buf_len, const void *src_pt
     uint8_t *           dst_buf_end_ptr     = dst_buf_ptr + dst_buf_len;
     uint8_t *           dst_write_ptr       = dst_buf_ptr;
     size_t              remaining_input_bytes;
-    size_t              remaining_output_bytes;
     size_t              num_output_bytes;
-    uint8_t             src_byte;
-    uint8_t             i;
     uint8_t             len_code;
 
-
     assert(dst_buf_ptr  && src_ptr);
 
-    if (src_len != 0)
+    while (src_ptr < src_end_ptr)
     {
-        for (;;)
+        len_code = *src_ptr++;
+        if (len_code == 0)
         {
-            len_code = *src_ptr++;
-            if (len_code == 0)
-            {
-                errno = ECOBSR_DECODE_ZERO_BYTE_IN_INPUT;
-                return -1;
-            }
+            errno = ECOBSR_DECODE_ZERO_BYTE_IN_INPUT;
+            return -1;
+        }
 
-            /* Calculate remaining input bytes */
-            remaining_input_bytes = src_end_ptr - src_ptr;
+        /* Calculate remaining input bytes */
+        remaining_input_bytes = src_end_ptr - src_ptr;
 
-            if ((len_code - 1) < (int)remaining_input_bytes)
-            {
-                num_output_bytes = len_code - 1;
+        /* The last length code may point beyond the end of the input */
+        num_output_bytes = len_code - 1;
+        if (num_output_bytes > remaining_input_bytes)
+            num_output_bytes = remaining_input_bytes;
 
-                /* Check length code against remaining output buffer space */
-                remaining_output_bytes = dst_buf_end_ptr - dst_write_ptr;
-                if (num_output_bytes > remaining_output_bytes)
+        /* Check length code against remaining output buffer space */
+        if (num_output_bytes > (size_t)(dst_buf_end_ptr - dst_write_ptr))
+        {
+            errno = ECOBSR_DECODE_OUT_BUFFER_OVERFLOW;
+            return -1;
+        }
+
+        if (cobsr_copy_run(dst_write_ptr, src_ptr, num_output_bytes) != num_output_bytes)
+        {
+            errno = ECOBSR_DECODE_ZERO_BYTE_IN_INPUT;
+            return -1;
+        }
+
+        dst_write_ptr += num_output_bytes;
+        src_ptr += num_output_bytes;
+
+        if ((size_t)(len_code - 1) < remaining_input_bytes)
+        {
+            /* Add a zero to the end */
+            if (len_code != 0xFF)
+            {
+                if (dst_write_ptr >= dst_buf_end_ptr)
                 {
                     errno = ECOBSR_DECODE_OUT_BUFFER_OVERFLOW;
                     return -1;
                 }
-
-                for (i = num_output_bytes; i != 0; i--)
+                *dst_write_ptr++ = 0;
+            }
+        }
+        else
+        {
+            /* Write final data byte, if applicable for COBS/R encoding. */
+            if ((size_t)(len_code - 1) > remaining_input_bytes)
+            {
+                if (dst_write_ptr >= dst_buf_end_ptr)
                 {
-                    src_byte = *src_ptr++;
-                    if (src_byte == 0)
-                    {
-                        errno = ECOBSR_DECODE_ZERO_BYTE_IN_INPUT;
-                        return -1;
-                    }
-                    *dst_write_ptr++ = src_byte;
+                    errno = ECOBSR_DECODE_OUT_BUFFER_OVERFLOW;
+                    return -1;
                 }
+                *dst_write_ptr++ = len_code;
+            }
 
-                /* Add a zero to the end */
-                if (len_code != 0xFF)
-                {
-                    if (dst_write_ptr >= dst_buf_end_ptr)
-                    {
-                        errno = ECOBSR_DECODE_OUT_BUFFER_OVERFLOW;
-                        return -1;
-                    }
-                    *dst_write_ptr++ = 0;
-                }
+            /* We've reached the last length code */
+            break;
+        }
+    }
+
+    return dst_write_ptr - dst_buf_ptr;
+}
+
+
+/*****************************************************************************
+ * Streaming decoder
+ ****************************************************************************/
+
+static void cobsr_decoder_reset(struct cobsr_decoder *dec)
+{
+    dec->len          = 0;
+    dec->code         = 0;
+    dec->remaining    = 0;
+    dec->zero_pending = 0;
+    dec->discard      = 0;
+}
+
+
+/**
+ * Initialize a streaming decoder.
+ *
+ * \param dec       decoder state
+ * \param buf       buffer for the decoded frames
+ * \param buf_len   size of buf
+ */
+void cobsr_decoder_init(struct cobsr_decoder *dec, void *buf, size_t buf_len)
+{
+    assert(dec && buf);
+
+    dec->buf     = buf;
+    dec->buf_len = buf_len;
+    cobsr_decoder_reset(dec);
+}
+
+
+/**
+ * Feed input into a streaming decoder.
+ *
+ * The input is decoded directly into the decoder buffer. Processing
+ * stops after a complete frame, so the caller can use the frame in
+ * place before the next call. Frames that decode to zero bytes, e.g.
+ * consecutive zero delimiters, are skipped.
+ *
+ * After an error, the rest of the frame is discarded.
+ *
+ * \param dec       decoder state
+ * \param src_ptr   input data
+ * \param src_len   number of input bytes
+ * \param consumed  returns the number of input bytes used
+ *
+ * \return  length of a complete frame in the decoder buffer,
+ *          0 if all input was used without completing a frame,
+ *          -1 on error
+ */
+ssize_t cobsr_decoder_feed(struct cobsr_decoder *dec, const void *src_ptr_v, size_t src_len, size_t *consumed)
+{
+    const uint8_t *src_start_ptr = src_ptr_v;
+    const uint8_t *src_ptr       = src_start_ptr;
+    const uint8_t *src_end_ptr   = src_ptr + src_len;
+    ssize_t res = 0;
+
+    assert(dec && src_ptr && consumed);
+
+    while (src_ptr < src_end_ptr)
+    {
+        if (dec->discard)
+        {
+            /* Skip to the next delimiter */
+            src_ptr += cobsr_find_zero(src_ptr, src_end_ptr - src_ptr);
+            if (src_ptr == src_end_ptr)
+                break;
+
+            src_ptr++;
+            cobsr_decoder_reset(dec);
+        }
+        else if (dec->remaining == 0)
+        {
+            uint8_t len_code = *src_ptr++;
+
+            if (len_code == 0)
+            {
+                /* End of frame after a complete group. The pending zero
+                 * of the last group is not part of the data. */
+                res = dec->len;
+                cobsr_decoder_reset(dec);
+                if (res > 0)
+                    break;
+                continue;
             }
-            else
+
+            if (dec->zero_pending)
             {
-                /* We've reached the last length code, so write the remaining
-                 * bytes and then exit the loop. */
+                if (dec->len >= dec->buf_len)
+                    goto overflow;
+                dec->buf[dec->len++] = 0;
+            }
 
-                num_output_bytes = remaining_input_bytes;
+            dec->code         = len_code;
+            dec->remaining    = len_code - 1;
+            dec->zero_pending = len_code != 0xFF;
+        }
+        else
+        {
+            size_t n = src_end_ptr - src_ptr;
+            if (n > dec->remaining)
+                n = dec->remaining;
 
-                /* Check length code against remaining output buffer space */
-                remaining_output_bytes = dst_buf_end_ptr - dst_write_ptr;
-                if (num_output_bytes > remaining_output_bytes)
-                {
-                    errno = ECOBSR_DECODE_OUT_BUFFER_OVERFLOW;
-                    return -1;
-                }
+            size_t avail = dec->buf_len - dec->len;
+            size_t run = cobsr_copy_run(dec->buf + dec->len, src_ptr, n < avail ? n : avail);
 
-                for (i = num_output_bytes; i != 0; i--)
-                {
-                    src_byte = *src_ptr++;
-                    if (src_byte == 0)
-                    {
-                        errno = ECOBSR_DECODE_ZERO_BYTE_IN_INPUT;
-                        return -1;
-                    }
-                    *dst_write_ptr++ = src_byte;
-                }
+            if (run == avail && run < n && src_ptr[run] != 0)
+                goto overflow;
+
+            dec->len       += run;
+            dec->remaining -= run;
+            src_ptr        += run;
 
-                /* Write final data byte, if applicable for COBS/R encoding. */
-                if (len_code - 1 > (int)remaining_input_bytes)
+            if (run < n)
+            {
+                /* End of frame inside a group. For COBS/R, the
+                 * length code is the final data byte. */
+                src_ptr++;
+
+                if (dec->len >= dec->buf_len)
                 {
-                    if (dst_write_ptr >= dst_buf_end_ptr)
-                    {
-                        errno = ECOBSR_DECODE_OUT_BUFFER_OVERFLOW;
-                        return -1;
-                    }
-                    else
-                    {
-                        *dst_write_ptr++ = len_code;
-                    }
+                    /* The frame has already ended, nothing to discard */
+                    cobsr_decoder_reset(dec);
+                    res = -1;
+                    errno = ECOBSR_DECODE_OUT_BUFFER_OVERFLOW;
+                    break;
                 }
+                dec->buf[dec->len++] = dec->code;
 
-                /* Exit the loop */
+                res = dec->len;
+                cobsr_decoder_reset(dec);
                 break;
             }
         }
     }
 
-    return dst_write_ptr - dst_buf_ptr;
+    *consumed = src_ptr - src_start_ptr;
+    return res;
+
+overflow:
+    cobsr_decoder_reset(dec);
+    dec->discard = 1;
+
+    *consumed = src_ptr - src_start_ptr;
+    errno = ECOBSR_DECODE_OUT_BUFFER_OVERFLOW;
+    return -1;
 }
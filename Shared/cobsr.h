@@ -15,6 +15,7 @@
  ****************************************************************************/
 
 #include <stddef.h>
+#include <stdint.h>
 #include <sys/types.h>
 
 /*****************************************************************************
@@ -25,6 +26,23 @@
 #define COBSR_DECODE_DST_BUF_LEN_MAX(SRC_LEN)   (SRC_LEN)
 
 
+/*****************************************************************************
+ * Types
+ ****************************************************************************/
+
+/* Streaming decoder state, see cobsr_decoder_feed() */
+struct cobsr_decoder
+{
+    uint8_t    *buf;            /* buffer for the decoded frame */
+    size_t      buf_len;
+    size_t      len;            /* bytes decoded so far */
+    uint8_t     code;           /* length code of the current group */
+    uint8_t     remaining;      /* data bytes left in the current group */
+    uint8_t     zero_pending;   /* add a zero before the next group */
+    uint8_t     discard;        /* skip input up to the next delimiter */
+};
+
+
 /*****************************************************************************
  * Function prototypes
  ****************************************************************************/
@@ -36,6 +54,9 @@ extern "C" {
 ssize_t cobsr_encode(void *dst_buf_ptr, size_t dst_buf_len, const void *src_ptr, size_t src_len);
 ssize_t cobsr_decode(void *dst_buf_ptr, size_t dst_buf_len, const void *src_ptr, size_t src_len);
 
+void    cobsr_decoder_init(struct cobsr_decoder *dec, void *buf, size_t buf_len);
+ssize_t cobsr_decoder_feed(struct cobsr_decoder *dec, const void *src_ptr, size_t src_len, size_t *consumed);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
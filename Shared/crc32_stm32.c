@@ -0,0 +1,63 @@
+/**
+ * \file crc32_stm32.c
+ * CRC-32 using the STM32F4 CRC calculation unit
+ *
+ * The CRC unit processes 32 bit words MSB first and does not reflect
+ * its input or output. The reflected CRC-32 of crc32.c is obtained by
+ * bit-reversing the input words and the result.
+ *
+ * The unit always starts at 0xFFFFFFFF. To continue from an arbitrary
+ * crc value, the first word written is chosen so that the unit ends
+ * up in that state. Unaligned bytes are handled by crc32_update().
+ *
+ * The CRC unit must not be used by more than one task at a time.
+ *
+ */
+#include "crc32_stm32.h"
+#include "crc32.h"
+#include "stm32f4xx.h"
+
+#define CRC32_POLY  0x04C11DB7
+
+
+/**
+ * Run the CRC register backwards by 32 bits.
+ */
+static uint32_t crc32_unshift(uint32_t state)
+{
+    for (int i=0; i<32; i++) {
+        if (state & 1)
+            state = ((state ^ CRC32_POLY) >> 1) | 0x80000000;
+        else
+            state >>= 1;
+    }
+    return state;
+}
+
+
+uint32_t crc32_update_hw(uint32_t crc, const unsigned char *data, size_t data_len)
+{
+    while (data_len && ((uintptr_t)data & 3)) {
+        crc = crc32_update(crc, data++, 1);
+        data_len--;
+    }
+
+    if (data_len >= 4) {
+        const uint32_t *src = (const uint32_t *)data;
+        size_t n = data_len / 4;
+
+        RCC->AHB1ENR |= RCC_AHB1ENR_CRCEN;
+        CRC->CR = CRC_CR_RESET;
+        CRC->DR = ~crc32_unshift(__RBIT(crc));
+
+        while (n--)
+            CRC->DR = __RBIT(*src++);
+
+        crc = __RBIT(CRC->DR);
+
+        data     += data_len & ~3;
+        data_len &= 3;
+    }
+
+    return crc32_update(crc, data, data_len);
+}
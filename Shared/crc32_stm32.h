@@ -0,0 +1,27 @@
+#pragma once
+
+/**
+ * \file crc32_stm32.h
+ * CRC-32 using the STM32F4 CRC calculation unit
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Update the crc value with new data, see crc32_update().
+ *
+ * \param crc      The current crc value.
+ * \param data     Pointer to a buffer of \a data_len bytes.
+ * \param data_len Number of bytes in the \a data buffer.
+ * \return         The updated crc value.
+ */
+uint32_t crc32_update_hw(uint32_t crc, const unsigned char *data, size_t data_len);
+
+#ifdef __cplusplus
+}
+#endif
@@ -28,6 +28,12 @@ _ERR_NAME( EMSG_TOO_LONG,       "Message too long" )
 _ERR_NAME( EMSG_TOO_SHORT,      "Message too short" )
 _ERR_NAME( EMSG_CRC,            "Message checksum failure" )
 _ERR_NAME( EMSG_UNKNOWN,        "Unknown message" )
+_ERR_NAME( ETLM_ENCODE_OUT_BUFFER_OVERFLOW, "Telemetry encode buffer overflow" )
+_ERR_NAME( ETLM_DECODE_TRUNCATED, "Telemetry sample truncated" )
+_ERR_NAME( ETLM_DECODE_INVALID, "Invalid telemetry varint" )
+_ERR_NAME( EFEC_INVALID,        "Invalid parity message" )
+_ERR_NAME( ELZSS_ENCODE_OUT_BUFFER_OVERFLOW, "LZSS encode buffer overflow" )
+_ERR_NAME( ELZSS_DECODE_INVALID, "Invalid LZSS match" )
 
 _ERR_GROUP( EBOOT_BASE, EUSER_BASE + 0x100 )
 _ERR_NAME( EBOOT_INACTIVE,      "Bootloader not active" )
@@ -35,6 +41,7 @@ _ERR_NAME( EBOOT_FLASH,         "Flash error" )
 _ERR_NAME( EBOOT_RANGE,         "Invalid address range" )
 _ERR_NAME( EBOOT_CHECKSUM,      "Invalid checksum" )
 _ERR_NAME( EBOOT_MAGIC,         "Invalid magic" )
+_ERR_NAME( EBOOT_STREAM,        "Invalid write stream" )
 
 
 _ERR_GROUP( EFLASH_BASE, EUSER_BASE + 0x200 )
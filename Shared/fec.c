@@ -0,0 +1,428 @@
+/**
+ * \file
+ * Forward error correction for lossy links
+ *
+ * Copyright (c)2015 Thomas Kindler <mail_drquad@t-kindler.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Protected messages are sent unchanged. After every k of them, the
+ * sender adds m parity messages (MSG_ID_FEC_PARITY). Together they
+ * form a systematic Reed-Solomon erasure code over GF(2^8): any r <= m
+ * lost messages of a group can be rebuilt from r parity messages,
+ * without a round-trip to the sender.
+ *
+ * Each byte position is coded independently. A message is coded as
+ * the symbol (data_len, id, data), shorter symbols are padded with
+ * zeros. Parity symbol j is the sum of a(j,i) * symbol(i) with the
+ * Cauchy matrix a(j,i) = 1 / (x_j + y_i), x_j = FEC_MAX_K + j, y_i = i.
+ * All square submatrices of a Cauchy matrix are invertible, so any
+ * set of parity messages will do.
+ *
+ * The parity messages list the packet crcs of the group. The decoder
+ * keeps the last FEC_HISTORY received messages to find the members it
+ * already has, and checks the crc of the rebuilt ones.
+ *
+ */
+#include "fec.h"
+#include "crc16.h"
+#include "errors.h"
+#include <string.h>
+
+static uint8_t gf_exp[2 * 255];
+static uint8_t gf_log[256];
+static int     gf_ready;
+
+
+/**
+ * Set up log and antilog tables for GF(2^8), polynomial 0x11D.
+ *
+ */
+static void gf_init(void)
+{
+    if (gf_ready)
+        return;
+
+    unsigned x = 1;
+    for (int i=0; i<255; i++) {
+        gf_exp[i] = gf_exp[i + 255] = x;
+        gf_log[x] = i;
+
+        x <<= 1;
+        if (x & 0x100)
+            x ^= 0x11D;
+    }
+
+    gf_ready = 1;
+}
+
+
+static uint8_t gf_mul(uint8_t a, uint8_t b)
+{
+    if (!a || !b)
+        return 0;
+
+    return gf_exp[gf_log[a] + gf_log[b]];
+}
+
+
+static uint8_t gf_inv(uint8_t a)
+{
+    return gf_exp[255 - gf_log[a]];
+}
+
+
+/**
+ * dst += c * src
+ *
+ */
+static void gf_mul_add(uint8_t *dst, uint8_t c, const uint8_t *src, size_t len)
+{
+    if (!c)
+        return;
+
+    unsigned log_c = gf_log[c];
+
+    for (size_t i=0; i<len; i++) {
+        if (src[i])
+            dst[i] ^= gf_exp[gf_log[src[i]] + log_c];
+    }
+}
+
+
+/**
+ * Coefficient of data message i in parity message j
+ *
+ */
+static uint8_t fec_coef(int j, int i)
+{
+    return gf_inv((FEC_MAX_K + j) ^ i);
+}
+
+
+/**
+ * Invert an n x n matrix by Gauss-Jordan elimination.
+ *
+ * \return  0 on success, -1 if the matrix is singular
+ */
+static int gf_invert(uint8_t a[FEC_MAX_M][FEC_MAX_M], uint8_t inv[FEC_MAX_M][FEC_MAX_M], int n)
+{
+    for (int r=0; r<n; r++) {
+        for (int c=0; c<n; c++)
+            inv[r][c] = (r == c);
+    }
+
+    for (int c=0; c<n; c++) {
+        int p = c;
+        while (p < n && !a[p][c])
+            p++;
+
+        if (p == n)
+            return -1;
+
+        for (int i=0; i<n; i++) {
+            uint8_t t;
+            t = a[c][i];   a[c][i]   = a[p][i];   a[p][i]   = t;
+            t = inv[c][i]; inv[c][i] = inv[p][i]; inv[p][i] = t;
+        }
+
+        uint8_t f = gf_inv(a[c][c]);
+        for (int i=0; i<n; i++) {
+            a[c][i]   = gf_mul(a[c][i], f);
+            inv[c][i] = gf_mul(inv[c][i], f);
+        }
+
+        for (int r=0; r<n; r++) {
+            if (r != c && a[r][c]) {
+                uint8_t g = a[r][c];
+                gf_mul_add(a[r],   g, a[c],   n);
+                gf_mul_add(inv[r], g, inv[c], n);
+            }
+        }
+    }
+
+    return 0;
+}
+
+
+// -------------------- Encoder --------------------
+//
+/**
+ * Set up an encoder.
+ *
+ * \param   k   data messages per group (1..FEC_MAX_K), 0 to disable
+ * \param   m   parity messages per group (1..FEC_MAX_M)
+ */
+void fec_encoder_init(struct fec_encoder *e, int k, int m)
+{
+    gf_init();
+    memset(e, 0, sizeof(*e));
+
+    if (k > 0 && k <= FEC_MAX_K && m > 0 && m <= FEC_MAX_M) {
+        e->k = k;
+        e->m = m;
+    }
+}
+
+
+/**
+ * Add a sent message to the current group.
+ *
+ * msg->crc must already be set, i.e. the message has been encoded
+ * for sending. Send the parity messages from fec_get_parity() after
+ * the last message of a group.
+ *
+ * \return  number of parity messages if the group is complete, 0 if not,
+ *          -1 if the message is too long to be protected
+ */
+int fec_encode(struct fec_encoder *e, const struct msg_header *msg)
+{
+    if (!e->k)
+        return 0;
+
+    if (msg->data_len > FEC_MAX_DATA_SIZE(e->k)) {
+        errno = EMSG_TOO_LONG;
+        return -1;
+    }
+
+    if (e->n == e->k) {
+        memset(e->parity, 0, sizeof(e->parity));
+        e->n   = 0;
+        e->len = 0;
+    }
+
+    uint8_t data_len = msg->data_len;
+
+    for (int j=0; j<e->m; j++) {
+        uint8_t c = fec_coef(j, e->n);
+        gf_mul_add(&e->parity[j][0], c, &data_len, 1);
+        gf_mul_add(&e->parity[j][1], c, (const uint8_t*)&msg->id, 2 + msg->data_len);
+    }
+
+    if (FEC_SYMBOL_SIZE(msg->data_len) > e->len)
+        e->len = FEC_SYMBOL_SIZE(msg->data_len);
+
+    e->crc[e->n++] = msg->crc;
+
+    return e->n == e->k ? e->m : 0;
+}
+
+
+/**
+ * Build parity message j of the completed group.
+ *
+ */
+void fec_get_parity(const struct fec_encoder *e, int j, struct msg_fec_parity *msg)
+{
+    msg->h.id       = MSG_ID_FEC_PARITY;
+    msg->h.data_len = FEC_PARITY_HEADER_SIZE(e->k) + e->len;
+
+    msg->k          = e->k;
+    msg->index      = j;
+    msg->m          = e->m;
+    msg->symbol_len = e->len;
+
+    memcpy(&msg->data[0], e->crc, 2 * e->k);
+    memcpy(&msg->data[2 * e->k], e->parity[j], e->len);
+}
+
+
+// -------------------- Decoder --------------------
+//
+void fec_decoder_init(struct fec_decoder *d)
+{
+    gf_init();
+    memset(d, 0, sizeof(*d));
+    d->missing = -1;
+}
+
+
+/**
+ * Find a received message by its packet crc, newest first.
+ *
+ */
+static const uint8_t *fec_lookup(const struct fec_decoder *d, uint16_t crc)
+{
+    for (int n=0; n<d->hist_count; n++) {
+        int i = (d->hist_pos - 1 - n + FEC_HISTORY) % FEC_HISTORY;
+        if (d->hist[i].crc == crc)
+            return d->hist[i].sym;
+    }
+
+    return NULL;
+}
+
+
+static int fec_same_group(const struct msg_fec_parity *a, const struct msg_fec_parity *b)
+{
+    return a->k == b->k && a->symbol_len == b->symbol_len &&
+        !memcmp(a->data, b->data, 2 * a->k);
+}
+
+
+/**
+ * Rebuild the missing messages of the current group.
+ *
+ * \return  number of messages in d->out
+ */
+static int fec_repair(struct fec_decoder *d, const uint8_t *known[], const int *lost, int r)
+{
+    const struct msg_fec_parity *p0 = &d->parity[0];
+    int len = p0->symbol_len;
+
+    uint8_t a[FEC_MAX_M][FEC_MAX_M], inv[FEC_MAX_M][FEC_MAX_M];
+    uint8_t s[FEC_MAX_M][FEC_MAX_SYMBOL];
+
+    // Remove the known messages from r parity symbols, what is
+    // left is a system of r equations for the r missing ones.
+    //
+    for (int j=0; j<r; j++) {
+        const struct msg_fec_parity *p = &d->parity[j];
+        memcpy(s[j], &p->data[2 * p->k], len);
+
+        for (int i=0; i<p->k; i++) {
+            if (known[i]) {
+                int n = FEC_SYMBOL_SIZE(known[i][0]);
+                gf_mul_add(s[j], fec_coef(p->index, i), known[i], n < len ? n : len);
+            }
+        }
+
+        for (int t=0; t<r; t++)
+            a[j][t] = fec_coef(p->index, lost[t]);
+    }
+
+    if (gf_invert(a, inv, r) < 0)
+        return 0;
+
+    int n_out = 0;
+    for (int t=0; t<r; t++) {
+        uint8_t sym[FEC_MAX_SYMBOL];
+        memset(sym, 0, len);
+
+        for (int j=0; j<r; j++)
+            gf_mul_add(sym, inv[t][j], s[j], len);
+
+        // Check the rebuilt message against the crc from the group,
+        // this also catches messages that were wrongly matched in
+        // the history.
+        //
+        struct msg_generic *out = &d->out[n_out];
+        uint16_t crc;
+
+        memcpy(&crc, &p0->data[2 * lost[t]], 2);
+
+        if (FEC_SYMBOL_SIZE(sym[0]) > len) {
+            d->stats.lost++;
+            continue;
+        }
+
+        out->h.data_len = sym[0];
+        memcpy(&out->h.id, &sym[1], 2 + sym[0]);
+
+        crc16_t c = crc16_init();
+        c = crc16_update(c, (uint8_t*)&out->h.id, 2 + out->h.data_len);
+        c = crc16_finalize(c);
+
+        if (c != crc) {
+            d->stats.lost++;
+            continue;
+        }
+
+        out->h.crc = crc;
+        n_out++;
+    }
+
+    d->stats.recovered += n_out;
+    return n_out;
+}
+
+
+/**
+ * Pass a received message to the decoder.
+ *
+ * Call this for every correctly received message. If a parity message
+ * completes a group, the rebuilt messages are returned in d->out, in
+ * the order they were sent.
+ *
+ * \return  number of rebuilt messages, -1 on error
+ */
+int fec_decoder_input(struct fec_decoder *d, const struct msg_header *msg)
+{
+    if (msg->id != MSG_ID_FEC_PARITY) {
+        if (msg->data_len <= FEC_MAX_DATA_SIZE(1)) {
+            d->hist[d->hist_pos].crc = msg->crc;
+            d->hist[d->hist_pos].sym[0] = msg->data_len;
+            memcpy(&d->hist[d->hist_pos].sym[1], &msg->id, 2 + msg->data_len);
+
+            d->hist_pos = (d->hist_pos + 1) % FEC_HISTORY;
+            if (d->hist_count < FEC_HISTORY)
+                d->hist_count++;
+        }
+        return 0;
+    }
+
+    const struct msg_fec_parity *p = (const struct msg_fec_parity *)msg;
+
+    if (msg->data_len < FEC_PARITY_HEADER_SIZE(0) ||
+        p->k == 0 || p->k > FEC_MAX_K || p->index >= FEC_MAX_M ||
+        p->symbol_len > FEC_MAX_SYMBOL ||
+        msg->data_len != FEC_PARITY_HEADER_SIZE(p->k) + p->symbol_len)
+    {
+        errno = EFEC_INVALID;
+        return -1;
+    }
+
+    d->stats.rx_parity++;
+
+    // Start a new group
+    //
+    if (!d->num_parity || !fec_same_group(&d->parity[0], p)) {
+        if (d->missing > 0)
+            d->stats.lost += d->missing;
+
+        d->num_parity = 0;
+        d->missing = 0;
+    }
+    else if (d->missing < 0) {
+        return 0;   // already complete
+    }
+
+    for (int j=0; j<d->num_parity; j++) {
+        if (d->parity[j].index == p->index)
+            return 0;
+    }
+
+    memcpy(&d->parity[d->num_parity++], msg, sizeof(struct msg_header) + msg->data_len);
+
+    const uint8_t *known[FEC_MAX_K];
+    int lost[FEC_MAX_K];
+    int r = 0;
+
+    for (int i=0; i<p->k; i++) {
+        uint16_t crc;
+        memcpy(&crc, &p->data[2 * i], 2);
+
+        known[i] = fec_lookup(d, crc);
+        if (!known[i])
+            lost[r++] = i;
+    }
+
+    if (r > d->num_parity) {
+        d->missing = r;
+        return 0;
+    }
+
+    d->missing = -1;
+    return r ? fec_repair(d, known, lost, r) : 0;
+}
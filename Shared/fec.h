@@ -0,0 +1,96 @@
+/**
+ * \file
+ * Forward error correction for lossy links
+ *
+ * Copyright (c)2015 Thomas Kindler <mail_drquad@t-kindler.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef FEC_H_
+#define FEC_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "msg_structs.h"
+
+#define FEC_MAX_K           8       // data messages per group
+#define FEC_MAX_M           4       // parity messages per group
+#define FEC_HISTORY         32      // received messages kept by the decoder
+
+// Symbol: data_len + id + data
+//
+#define FEC_SYMBOL_SIZE(DATA_LEN)   (1 + 2 + (DATA_LEN))
+
+// Largest payload that can be protected with groups of k messages
+//
+#define FEC_MAX_DATA_SIZE(k) \
+    (MSG_MAX_DATA_SIZE - FEC_PARITY_HEADER_SIZE(k) - FEC_SYMBOL_SIZE(0))
+
+#define FEC_MAX_SYMBOL      FEC_SYMBOL_SIZE(FEC_MAX_DATA_SIZE(1))
+
+
+struct fec_encoder {
+    int         k, m;           // group size, 0 = disabled
+    int         n;              // messages in the current group
+    int         len;            // longest symbol in the current group
+    uint16_t    crc[FEC_MAX_K];
+    uint8_t     parity[FEC_MAX_M][FEC_MAX_SYMBOL];
+};
+
+
+struct fec_stats {
+    uint32_t    rx_parity;
+    uint32_t    recovered;
+    uint32_t    lost;           // missing from groups that couldn't be repaired
+};
+
+
+struct fec_decoder {
+    struct {
+        uint16_t    crc;
+        uint8_t     sym[FEC_MAX_SYMBOL];
+    } hist[FEC_HISTORY];
+    int         hist_pos;
+    int         hist_count;
+
+    // Parity messages of the current group
+    //
+    struct msg_fec_parity parity[FEC_MAX_M];
+    int         num_parity;
+    int         missing;        // of the current group, -1 if repaired
+
+    // Recovered messages, valid until the next fec_decoder_input()
+    //
+    struct msg_generic out[FEC_MAX_M];
+
+    struct fec_stats stats;
+};
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void    fec_encoder_init(struct fec_encoder *e, int k, int m);
+int     fec_encode(struct fec_encoder *e, const struct msg_header *msg);
+void    fec_get_parity(const struct fec_encoder *e, int j, struct msg_fec_parity *msg);
+
+void    fec_decoder_init(struct fec_decoder *d);
+int     fec_decoder_input(struct fec_decoder *d, const struct msg_header *msg);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* FEC_H_ */
@@ -0,0 +1,244 @@
+/**
+ * \file
+ * LZSS compression for firmware images
+ *
+ * The stream is a sequence of groups: one flag byte, followed by
+ * up to 8 tokens. Flag bits are used LSB first. A set bit is a
+ * literal byte, a cleared bit a 2 byte match:
+ *
+ *   byte 0: (distance - 1) & 0xFF
+ *   byte 1: (distance - 1) >> 8 << 4 | (length - LZSS_MIN_MATCH)
+ *
+ * The distance is 1..LZSS_WINDOW_SIZE bytes back into the output.
+ * The decoder only needs the window, so it fits into the bootloader
+ * with a few kilobytes of RAM. The encoder is meant for the PC and
+ * uses hash chains to find matches.
+ *
+ * Copyright (c)2015 Thomas Kindler <mail_drquad@t-kindler.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "lzss.h"
+#include "errors.h"
+#include <string.h>
+
+#define WINDOW_MASK     (LZSS_WINDOW_SIZE - 1)
+
+#define HASH_BITS       12
+#define HASH_SIZE       (1 << HASH_BITS)
+#define MAX_CHAIN       128
+
+
+static unsigned hash(const uint8_t *p)
+{
+    return ((p[0] << 8 ^ p[1] << 4 ^ p[2]) * 2654435761u) >> (32 - HASH_BITS);
+}
+
+
+/**
+ * Compress a buffer.
+ *
+ * \param  dst_buf_ptr  output buffer
+ * \param  dst_buf_len  see LZSS_ENCODE_DST_BUF_LEN_MAX()
+ * \param  src_ptr      data to compress
+ * \param  src_len      length of the data
+ *
+ * \return number of bytes written, -1 on error
+ */
+ssize_t lzss_encode(void *dst_buf_ptr, size_t dst_buf_len, const void *src_ptr, size_t src_len)
+{
+    const uint8_t *src = src_ptr;
+    uint8_t *dst = dst_buf_ptr;
+    uint8_t *dst_end = dst + dst_buf_len;
+
+    // Most recent position for each hash, and the previous
+    // position with the same hash for each window slot
+    //
+    int32_t head[HASH_SIZE];
+    int32_t prev[LZSS_WINDOW_SIZE];
+
+    for (int i=0; i<HASH_SIZE; i++)
+        head[i] = -1;
+
+    uint8_t *flags = NULL;
+    int      num_flags = 8;
+    size_t   pos = 0, inserted = 0;
+
+    while (pos < src_len) {
+        if (num_flags == 8) {
+            if (dst >= dst_end)
+                goto overflow;
+
+            flags = dst++;
+            *flags = 0;
+            num_flags = 0;
+        }
+
+        // Find the longest match
+        //
+        size_t best_len = 0, best_dist = 0;
+        size_t max_len = src_len - pos;
+        if (max_len > LZSS_MAX_MATCH)
+            max_len = LZSS_MAX_MATCH;
+
+        if (max_len >= LZSS_MIN_MATCH) {
+            int32_t cand = head[hash(&src[pos])];
+
+            for (int depth = MAX_CHAIN; cand >= 0 && depth > 0; depth--) {
+                if (pos - cand > LZSS_WINDOW_SIZE)
+                    break;
+
+                size_t n = 0;
+                while (n < max_len && src[cand + n] == src[pos + n])
+                    n++;
+
+                if (n > best_len) {
+                    best_len  = n;
+                    best_dist = pos - cand;
+                    if (n == max_len)
+                        break;
+                }
+
+                // Slots are reused, so the chain must go backwards
+                //
+                int32_t next = prev[cand & WINDOW_MASK];
+                if (next >= cand)
+                    break;
+                cand = next;
+            }
+        }
+
+        if (best_len >= LZSS_MIN_MATCH) {
+            if (dst + 2 > dst_end)
+                goto overflow;
+
+            *dst++ = (best_dist - 1) & 0xFF;
+            *dst++ = ((best_dist - 1) >> 8) << 4 | (best_len - LZSS_MIN_MATCH);
+        }
+        else {
+            if (dst >= dst_end)
+                goto overflow;
+
+            *flags |= 1 << num_flags;
+            *dst++ = src[pos];
+            best_len = 1;
+        }
+
+        num_flags++;
+        pos += best_len;
+
+        // Add the consumed positions to the hash chains
+        //
+        while (inserted < pos && inserted + LZSS_MIN_MATCH <= src_len) {
+            unsigned h = hash(&src[inserted]);
+            prev[inserted & WINDOW_MASK] = head[h];
+            head[h] = inserted++;
+        }
+    }
+
+    return dst - (uint8_t*)dst_buf_ptr;
+
+overflow:
+    errno = ELZSS_ENCODE_OUT_BUFFER_OVERFLOW;
+    return -1;
+}
+
+
+static inline uint8_t put(struct lzss_decoder *dec, uint8_t c)
+{
+    dec->window[dec->pos++ & WINDOW_MASK] = c;
+    if (dec->fill < LZSS_WINDOW_SIZE)
+        dec->fill++;
+
+    return c;
+}
+
+
+void lzss_decoder_init(struct lzss_decoder *dec)
+{
+    dec->pos   = 0;
+    dec->fill  = 0;
+    dec->flags = 1;
+    dec->match = 0x100;
+    dec->copy_len = 0;
+}
+
+
+/**
+ * Decompress part of a stream.
+ *
+ * Stops when the input is consumed or the output buffer is full.
+ * Call again with the rest of the input, or with more output space.
+ *
+ * \param  dec          decoder state
+ * \param  dst_buf_ptr  output buffer
+ * \param  dst_buf_len  size of the output buffer
+ * \param  src_ptr      compressed data
+ * \param  src_len      length of the compressed data
+ * \param  consumed     returns the number of input bytes used
+ *
+ * \return number of bytes written, -1 on error
+ */
+ssize_t lzss_decoder_feed(
+    struct lzss_decoder *dec, void *dst_buf_ptr, size_t dst_buf_len,
+    const void *src_ptr, size_t src_len, size_t *consumed)
+{
+    const uint8_t *src = src_ptr, *src_end = src + src_len;
+    uint8_t *dst = dst_buf_ptr, *dst_end = dst + dst_buf_len;
+
+    for (;;) {
+        // Finish the current match first
+        //
+        while (dec->copy_len > 0 && dst < dst_end) {
+            *dst++ = put(dec, dec->window[dec->copy_from++ & WINDOW_MASK]);
+            dec->copy_len--;
+        }
+
+        if (dec->copy_len > 0 || dst >= dst_end || src >= src_end)
+            break;
+
+        if (dec->flags == 1) {
+            dec->flags = 0x100 | *src++;
+            continue;
+        }
+
+        if (dec->flags & 1) {
+            *dst++ = put(dec, *src++);
+            dec->flags >>= 1;
+        }
+        else if (dec->match == 0x100) {
+            dec->match = *src++;
+        }
+        else {
+            uint8_t  b    = *src++;
+            uint16_t dist = (dec->match | (b >> 4) << 8) + 1;
+
+            dec->match = 0x100;
+            dec->flags >>= 1;
+
+            if (dist > dec->fill) {
+                *consumed = src - (const uint8_t*)src_ptr;
+                errno = ELZSS_DECODE_INVALID;
+                return -1;
+            }
+
+            dec->copy_from = dec->pos - dist;
+            dec->copy_len  = (b & 15) + LZSS_MIN_MATCH;
+        }
+
+    }
+
+    *consumed = src - (const uint8_t*)src_ptr;
+    return dst - (uint8_t*)dst_buf_ptr;
+}
@@ -0,0 +1,68 @@
+/**
+ * \file
+ * LZSS compression for firmware images
+ *
+ * Copyright (c)2015 Thomas Kindler <mail_drquad@t-kindler.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef LZSS_H_
+#define LZSS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define LZSS_WINDOW_BITS    12
+#define LZSS_WINDOW_SIZE    (1 << LZSS_WINDOW_BITS)
+
+#define LZSS_MIN_MATCH      3
+#define LZSS_MAX_MATCH      (LZSS_MIN_MATCH + 15)
+
+// Worst case: all literals, one flag byte per 8 of them
+//
+#define LZSS_ENCODE_DST_BUF_LEN_MAX(SRC_LEN)   ((SRC_LEN) + ((SRC_LEN)+7)/8)
+
+
+/**
+ * Streaming decoder state, see lzss_decoder_feed()
+ */
+struct lzss_decoder {
+    uint8_t     window[LZSS_WINDOW_SIZE];
+    uint16_t    pos;            // next write position in the window
+    uint16_t    fill;           // valid bytes in the window
+    uint16_t    flags;          // token flags, 1 if a new flag byte is due
+    uint16_t    match;          // first byte of a match, 0x100 if none
+    uint16_t    copy_from;      // match being copied
+    uint8_t     copy_len;
+};
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+ssize_t lzss_encode(void *dst_buf_ptr, size_t dst_buf_len, const void *src_ptr, size_t src_len);
+
+void    lzss_decoder_init(struct lzss_decoder *dec);
+ssize_t lzss_decoder_feed(
+    struct lzss_decoder *dec, void *dst_buf_ptr, size_t dst_buf_len,
+    const void *src_ptr, size_t src_len, size_t *consumed
+);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* LZSS_H_ */
@@ -64,3 +64,11 @@ $GEN	--model crc-32				\
 		--generate h				\
 		-o crc32.h
 
+
+
+# crc16_update() and crc32_update() in crc16.c and crc32.c were
+# changed to slicing-by-4 and slicing-by-8. Re-apply that change
+# after regenerating the files above.
+#
+python ../Tools/crc_tab.py 16 > crc16_tab.inc
+python ../Tools/crc_tab.py 32 > crc32_tab.inc
@@ -8,6 +8,7 @@
  */
 
 #include <stdint.h>
+#include <stddef.h>
 #include <assert.h>
 
 // XBee Series 1:           100 bytes
@@ -16,6 +17,14 @@
 //
 #define MSG_MAX_DATA_SIZE   (100 - 2 - 2)   // -crc -id
 
+// Largest payload on links without a frame limit (USB, TCP).
+// Must be negotiated with MSG_ID_LINK_SETUP, MSG_MAX_DATA_SIZE
+// is the default.
+//
+#define MSG_MAX_LINK_DATA_SIZE  (4 + 4 + 4096)  // rlink header + address + flash data
+
+#define MSG_TELEMETRY_DATA_SIZE (MSG_MAX_DATA_SIZE - 4 - 4)  // -timestamp -interval
+
 // TK TODO!
 #define CHECK_MSG_LEN(t, m) \
     (sizeof(struct t) == (m).h.len)
@@ -23,14 +32,30 @@
 
 enum msg_id {
     MSG_ID_NOP                  = 0x0000,
+    MSG_ID_LINK_SETUP           = 0x0001,
+    MSG_ID_RLINK_DATA           = 0x0002,
+    MSG_ID_RLINK_ACK            = 0x0003,
+    MSG_ID_FEC_PARITY           = 0x0004,
 
     MSG_ID_IMU_DATA             = 0x0010,
+    MSG_ID_IMU_DATA_DELTA       = 0x0011,
+
+    MSG_ID_SCOPE_DATA           = 0x0020,
+
+    MSG_ID_DLOG                 = 0x0030,
+
+    MSG_ID_BENCH_PING           = 0x0040,
+    MSG_ID_BENCH_PONG           = 0x0041,
+    MSG_ID_BENCH_DATA           = 0x0042,
+    MSG_ID_BENCH_SOURCE         = 0x0043,
 
     MSG_ID_BOOT_ENTER           = 0xB000,
     MSG_ID_BOOT_READ_DATA       = 0xB001,
     MSG_ID_BOOT_VERIFY          = 0xB002,
     MSG_ID_BOOT_WRITE_DATA      = 0xB003,
     MSG_ID_BOOT_ERASE_SECTOR    = 0xB004,
+    MSG_ID_BOOT_CHECKSUMS       = 0xB005,
+    MSG_ID_BOOT_WRITE_LZSS      = 0xB006,
     MSG_IG_BOOT_EXIT            = 0xB00F,
     MSG_ID_BOOT_RESPONSE        = 0xB010,
 
@@ -71,19 +96,118 @@ struct msg_generic {
 };
 
 
+/**
+ * Buffer for messages up to the largest negotiable size
+ */
+struct msg_large {
+    struct msg_header h;
+    uint8_t     data[MSG_MAX_LINK_DATA_SIZE];
+};
+
+
 /**
  * NOP packet (can be used as a keep-alive)
- * \todo -> Change to PING
+ *
+ * The application sends it periodically with its clock, so the ground
+ * station can map telemetry timestamps to its own time. The time is
+ * taken right before the packet is written to the link. time is only
+ * present if data_len >= 8.
  */
 struct msg_nop
 {
     struct msg_header h;
+    uint64_t    time;           // vehicle time [us], see ustime.h
 };
 
 
-struct msg_imu_data
+/**
+ * Link setup
+ *
+ * Sent by the host after connecting, with the largest payload its
+ * link can carry. The response holds the smaller of that and the
+ * receiver's own limit, which both sides use from then on.
+ *
+ * flags requests optional features, the response holds the
+ * requested features that the receiver supports.
+ *
+ * The response may also hold the size of the receiver's input buffer,
+ * if data_len >= 6. Requests without a response that fit into it
+ * can't overrun the receiver.
+ */
+#define LINK_FLAG_RLINK     0x0001      // reliable transport, see rlink.h
+
+struct msg_link_setup
 {
     struct msg_header h;
+    uint16_t    max_data_size;
+    uint16_t    flags;
+    uint16_t    rx_buffer_size;     // response only [bytes]
+};
+
+
+/**
+ * Reliable transport, see rlink.h
+ *
+ * MSG_ID_RLINK_DATA wraps another message with a sequence number.
+ * MSG_ID_RLINK_ACK acknowledges all messages before next, and the
+ * ones after it that are set in the sack bitmap.
+ */
+struct msg_rlink_data
+{
+    struct msg_header h;
+    uint16_t    seq;
+    uint16_t    id;             // id of the wrapped message
+    uint8_t     data[MSG_MAX_DATA_SIZE - 4];
+};
+
+
+struct msg_rlink_ack
+{
+    struct msg_header h;
+    uint16_t    next;           // next expected sequence number
+    uint16_t    window;         // messages accepted from next on
+    uint32_t    sack;           // bit n: next + 1 + n was received
+};
+
+
+/**
+ * Parity message, see fec.h
+ *
+ * Sent after each group of k protected messages. Holds the packet
+ * crcs of the group, so the receiver can tell which ones it missed,
+ * followed by the parity symbol with the given index.
+ */
+#define FEC_PARITY_HEADER_SIZE(k)   (4 + 2 * (k))
+
+struct msg_fec_parity
+{
+    struct msg_header h;
+    uint8_t     k;              // data messages in the group
+    uint8_t     index;          // 0 .. m-1
+    uint8_t     m;              // parity messages in the group
+    uint8_t     symbol_len;
+    uint8_t     data[MSG_MAX_DATA_SIZE - 4];    // uint16_t crc[k], symbol
+};
+
+
+/**
+ * Telemetry messages
+ *
+ * Several samples of one telemetry source are packed into a message.
+ * Sample n was taken at (timestamp + n * interval). The number of
+ * samples is derived from the message length.
+ */
+struct msg_telemetry
+{
+    struct msg_header h;
+    uint32_t    timestamp;      // time of first sample [us]
+    uint32_t    interval;       // sample interval [us]
+    uint8_t     samples[MSG_TELEMETRY_DATA_SIZE];
+};
+
+
+struct msg_imu_sample
+{
     float   acc_x, acc_y, acc_z;
     float   gyro_x, gyro_y, gyro_z;
     float   mag_x, mag_y, mag_z;
@@ -91,6 +215,114 @@ struct msg_imu_data
 };
 
 
+struct msg_imu_data
+{
+    struct msg_header h;
+    uint32_t    timestamp;
+    uint32_t    interval;
+    struct msg_imu_sample samples[
+        MSG_TELEMETRY_DATA_SIZE / sizeof(struct msg_imu_sample)
+    ];
+};
+
+
+/**
+ * Compressed IMU data
+ *
+ * MSG_ID_IMU_DATA_DELTA uses struct msg_telemetry. The payload holds
+ * msg_imu_sample values packed with tlm_codec (see tlm_codec.h). The
+ * first sample in each message is a keyframe. The quantization steps
+ * match the sensor resolution (MPU9150 at 8g/2000dps, AK8975, BMP180).
+ */
+#define MSG_IMU_NUM_CHANNELS \
+    (sizeof(struct msg_imu_sample) / sizeof(float))
+
+#define MSG_IMU_RESOLUTION {                            \
+    9.80665f / 4096, 9.80665f / 4096, 9.80665f / 4096,  \
+    1.0642e-3f, 1.0642e-3f, 1.0642e-3f,                 \
+    0.3e-6f, 0.3e-6f, 0.3e-6f,                          \
+    0.01f, 0.1f                                         \
+}
+
+
+
+/**
+ * Scope capture
+ *
+ * A capture is sent as a series of messages, oldest sample first.
+ * data[] holds the channel values of each sample, interleaved.
+ * Sample n was taken at (n - trig_offset) * interval relative
+ * to the trigger.
+ */
+struct msg_scope_data
+{
+    struct msg_header h;
+    uint32_t    interval;       // sample interval [us]
+    int32_t     trig_offset;    // trigger position [samples]
+    uint16_t    index;          // index of first sample in this message
+    uint16_t    num_samples;    // total number of samples in the capture
+    uint8_t     num_channels;
+    uint8_t     reserved[3];
+    float       data[(MSG_MAX_DATA_SIZE - 16) / sizeof(float)];
+};
+
+
+/**
+ * Deferred log records
+ *
+ * data[] holds complete records, see Source/dlog.c. Each record is
+ * an id word (format string offset << 4 | number of arguments),
+ * a timestamp in clock cycles and the argument words.
+ */
+struct msg_dlog
+{
+    struct msg_header h;
+    uint32_t    clock;          // timestamp clock [Hz]
+    uint32_t    dropped;        // records dropped since reset
+    uint32_t    data[(MSG_MAX_DATA_SIZE - 8) / sizeof(uint32_t)];
+};
+
+
+/**
+ * Link benchmark
+ *
+ * MSG_ID_BENCH_PING is sent back as MSG_ID_BENCH_PONG with the same
+ * length and payload. The echoing side fills in its own time and the
+ * number of MSG_ID_BENCH_DATA messages it has received. A ping with
+ * seq = 0 resets these counters.
+ *
+ * MSG_ID_BENCH_SOURCE requests a stream of MSG_ID_BENCH_DATA messages
+ * with consecutive sequence numbers, starting at 0. The bootloader
+ * stops the stream after 10 seconds.
+ */
+struct msg_bench_ping
+{
+    struct msg_header h;
+    uint32_t    seq;
+    uint32_t    t_send;         // sender time
+    uint32_t    t_echo;         // echoing side time [us], 0 if unknown
+    uint32_t    rx_packets;     // MSG_ID_BENCH_DATA received by the echoing side
+    uint32_t    rx_bytes;
+    uint8_t     data[MSG_MAX_DATA_SIZE - 20];
+};
+
+
+struct msg_bench_data
+{
+    struct msg_header h;
+    uint32_t    seq;
+    uint8_t     data[MSG_MAX_DATA_SIZE - 4];
+};
+
+
+struct msg_bench_source
+{
+    struct msg_header h;
+    uint32_t    count;          // number of messages
+    uint16_t    size;           // payload size, including seq
+    uint16_t    reserved;
+};
+
 
 /**
  * Enter bootloader
@@ -127,6 +359,24 @@ struct msg_boot_write_data
 };
 
 
+/**
+ * Write LZSS compressed data to flash memory
+ *
+ * The data is part of one compressed stream, see Shared/lzss.h, that
+ * is written to flash starting at address. offset is the position in
+ * the compressed stream. A message with offset 0 starts a new stream,
+ * all others must continue exactly where the last one ended. The
+ * uncompressed length must be a multiple of 4.
+ */
+struct msg_boot_write_lzss
+{
+    struct msg_header h;
+    uint32_t    address;
+    uint32_t    offset;
+    uint8_t     data[MSG_MAX_DATA_SIZE - 8];
+};
+
+
 /**
  * Verify flash memory
  */
@@ -148,6 +398,22 @@ struct msg_boot_erase_sector
 };
 
 
+/**
+ * Checksum flash memory in blocks
+ *
+ * Blocks are aligned to multiples of block_size, so the first and last
+ * block may be shorter. The response contains one crc32 per block, as
+ * many as fit into it. Request the rest starting at the next block.
+ */
+struct msg_boot_checksums
+{
+    struct msg_header h;
+    uint32_t    address;
+    uint32_t    length;
+    uint32_t    block_size;
+};
+
+
 /**
  * Exit bootloader
  */
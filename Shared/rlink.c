@@ -0,0 +1,425 @@
+/**
+ * \file
+ * Sliding-window reliable transport
+ *
+ * Messages are wrapped in MSG_ID_RLINK_DATA with a 16 bit sequence
+ * number and kept in a transmit slot until they are acknowledged.
+ * The receiver answers every data message with MSG_ID_RLINK_ACK,
+ * which holds the cumulative ack, a bitmap of the messages received
+ * out of order and the free space of its receive window.
+ *
+ * Lost messages are retransmitted individually: immediately, when
+ * RLINK_DUP_THRESH later messages have been acknowledged, or when
+ * their retransmit timer expires. The timeout doubles with every
+ * retry. After max_retries the link fails with EMSG_TIMEOUT.
+ *
+ * The receiver buffers out-of-order messages and hands them to the
+ * application in sequence via rlink_recv(). A message stays in its
+ * slot until the next rlink_recv() call, so the receive window only
+ * opens as fast as the application consumes messages. Once half of
+ * the window has opened since the last ack, a window update is sent.
+ * The sender starts with a window of one message.
+ *
+ * Slot counts must be powers of two, so the slot index stays
+ * consistent when the sequence number wraps.
+ *
+ * Copyright (c)2015 Thomas Kindler <mail_drquad@t-kindler.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "rlink.h"
+#include "errors.h"
+#include <assert.h>
+#include <errno.h>
+#include <stddef.h>
+#include <string.h>
+
+#define RLINK_DUP_THRESH    3       // acks above a hole before fast retransmit
+#define RLINK_MAX_BACKOFF   4       // timeout doubles at most this often
+
+#define SEQ_DIFF(a, b)      ((int16_t)((uint16_t)(a) - (uint16_t)(b)))
+
+
+static uint8_t *tx_slot(const struct rlink *l, uint16_t seq)
+{
+    return l->tx_buf + (seq & (l->tx_slots - 1)) * l->tx_slot_size;
+}
+
+
+static uint8_t *rx_slot(const struct rlink *l, uint16_t seq)
+{
+    return l->rx_buf + (seq & (l->rx_slots - 1)) * l->rx_slot_size;
+}
+
+
+static void transmit(struct rlink *l, uint16_t seq, uint32_t now)
+{
+    int i = seq & (l->tx_slots - 1);
+
+    l->tx_time[i] = now;
+    l->tx_tries[i]++;
+
+    // Failures are handled like lost messages
+    //
+    l->send(l->ctx, (struct msg_header *)tx_slot(l, seq));
+}
+
+
+static void send_ack(struct rlink *l)
+{
+    int used = SEQ_DIFF(l->rx_next, l->rx_read);
+
+    struct msg_rlink_ack ack = {
+        .h.id       = MSG_ID_RLINK_ACK,
+        .h.data_len = 8,
+        .next       = l->rx_next,
+        .window     = l->rx_slots - used,
+        .sack       = used + 1 < 32 ? l->rx_mask >> (used + 1) : 0
+    };
+
+    l->rx_adv_end = l->rx_next + ack.window;
+    l->stats.tx_acks++;
+
+    l->send(l->ctx, &ack.h);
+}
+
+
+static void handle_data(struct rlink *l, const struct msg_header *msg)
+{
+    const struct msg_rlink_data *d = (const void *)msg;
+
+    if (msg->data_len < RLINK_HEADER_SIZE) {
+        l->stats.rx_dropped++;
+        return;
+    }
+
+    int    off = SEQ_DIFF(d->seq, l->rx_read);
+    size_t len = msg->data_len - RLINK_HEADER_SIZE;
+
+    if (off < 0 || (off < l->rx_slots && (l->rx_mask & (1u << off)))) {
+        // Already received, the ack was probably lost
+        //
+        l->stats.rx_duplicates++;
+    }
+    else if (off >= l->rx_slots ||
+             sizeof(struct msg_header) + len > l->rx_slot_size)
+    {
+        l->stats.rx_dropped++;
+    }
+    else {
+        uint8_t *slot = rx_slot(l, d->seq);
+        struct msg_header *m = (struct msg_header *)slot;
+
+        m->id       = d->id;
+        m->data_len = len;
+        memcpy(
+            slot + sizeof(struct msg_header),
+            (const uint8_t *)msg + offsetof(struct msg_rlink_data, data),
+            len
+        );
+
+        l->rx_mask |= 1u << off;
+        l->stats.rx_data++;
+
+        for (;;) {
+            int next = SEQ_DIFF(l->rx_next, l->rx_read);
+            if (next >= l->rx_slots || !(l->rx_mask & (1u << next)))
+                break;
+            l->rx_next++;
+        }
+
+        l->rx_window_update = 0;
+    }
+
+    send_ack(l);
+}
+
+
+static void handle_ack(struct rlink *l, const struct msg_header *msg, uint32_t now)
+{
+    const struct msg_rlink_ack *a = (const void *)msg;
+
+    if (msg->data_len < 8)
+        return;
+
+    l->stats.rx_acks++;
+
+    int adv     = SEQ_DIFF(a->next, l->tx_base);
+    int pending = SEQ_DIFF(l->tx_next, l->tx_base);
+
+    // Ignore acks that are older than the last one
+    //
+    if (adv < 0 || adv > pending)
+        return;
+
+    // Reordered acks may carry an outdated window
+    //
+    uint16_t limit = a->next + a->window;
+    if (adv > 0 || SEQ_DIFF(limit, l->tx_limit) > 0)
+        l->tx_limit = limit;
+
+    l->tx_base   = a->next;
+    l->tx_acked  = adv < 32 ? l->tx_acked >> adv : 0;
+    l->tx_fast   = adv < 32 ? l->tx_fast  >> adv : 0;
+    pending     -= adv;
+
+    // Selective acks
+    //
+    for (int n = 0; n < 31 && n + 1 < pending; n++) {
+        if (a->sack & (1u << n))
+            l->tx_acked |= 1u << (n + 1);
+    }
+
+    // Fast retransmit for holes below enough acked messages
+    //
+    int acked_above = 0;
+
+    for (int off = pending - 1; off >= 0; off--) {
+        uint32_t bit = 1u << off;
+
+        if (l->tx_acked & bit) {
+            acked_above++;
+        }
+        else if (acked_above >= RLINK_DUP_THRESH && !(l->tx_fast & bit)) {
+            l->tx_fast |= bit;
+            l->stats.tx_retransmits++;
+            transmit(l, l->tx_base + off, now);
+        }
+    }
+}
+
+
+/**
+ * Initialize a link.
+ *
+ * \param l             link state
+ * \param send          function to send raw messages
+ * \param ctx           passed to send()
+ * \param tx_buf        tx_slots buffers of tx_slot_size bytes
+ * \param tx_slot_size  see RLINK_SLOT_SIZE()
+ * \param tx_slots      maximum number of unacknowledged messages
+ * \param rx_buf        rx_slots buffers of rx_slot_size bytes
+ * \param rx_slot_size  see RLINK_SLOT_SIZE()
+ * \param rx_slots      receive window
+ * \param rto           initial retransmit timeout [ms]
+ */
+void rlink_init(
+    struct rlink *l,
+    int (*send)(void *ctx, struct msg_header *msg), void *ctx,
+    void *tx_buf, size_t tx_slot_size, int tx_slots,
+    void *rx_buf, size_t rx_slot_size, int rx_slots,
+    uint32_t rto)
+{
+    assert(l && send && tx_buf && rx_buf);
+    assert(tx_slots > 0 && tx_slots <= RLINK_MAX_SLOTS && !(tx_slots & (tx_slots - 1)));
+    assert(rx_slots > 0 && rx_slots <= RLINK_MAX_SLOTS && !(rx_slots & (rx_slots - 1)));
+
+    memset(l, 0, sizeof(*l));
+
+    l->send         = send;
+    l->ctx          = ctx;
+    l->rto          = rto;
+    l->max_retries  = 8;
+
+    l->tx_buf       = tx_buf;
+    l->tx_slot_size = tx_slot_size;
+    l->tx_slots     = tx_slots;
+    l->tx_limit     = 1;
+
+    l->rx_buf       = rx_buf;
+    l->rx_slot_size = rx_slot_size;
+    l->rx_slots     = rx_slots;
+}
+
+
+/**
+ * Number of messages that can be sent right now.
+ * Limited by the free transmit slots and the peer's receive window.
+ */
+int rlink_tx_free(const struct rlink *l)
+{
+    int n = l->tx_slots - SEQ_DIFF(l->tx_next, l->tx_base);
+    int w = SEQ_DIFF(l->tx_limit, l->tx_next);
+
+    if (n > w)
+        n = w;
+
+    return n > 0 ? n : 0;
+}
+
+
+/**
+ * Number of messages that have not been acknowledged yet.
+ */
+int rlink_tx_pending(const struct rlink *l)
+{
+    return SEQ_DIFF(l->tx_next, l->tx_base);
+}
+
+
+/**
+ * Send a message.
+ *
+ * \return  msg->data_len, -1 on error
+ */
+int rlink_send(struct rlink *l, const struct msg_header *msg, uint32_t now)
+{
+    if (l->error) {
+        errno = l->error;
+        return -1;
+    }
+
+    if (rlink_tx_free(l) <= 0) {
+        errno = ENOBUFS;
+        return -1;
+    }
+
+    if (sizeof(struct msg_header) + RLINK_HEADER_SIZE + msg->data_len > l->tx_slot_size) {
+        errno = EMSG_TOO_LONG;
+        return -1;
+    }
+
+    uint8_t *slot = tx_slot(l, l->tx_next);
+    struct msg_rlink_data *d = (void *)slot;
+
+    d->h.id       = MSG_ID_RLINK_DATA;
+    d->h.data_len = RLINK_HEADER_SIZE + msg->data_len;
+    d->seq        = l->tx_next;
+    d->id         = msg->id;
+
+    memcpy(
+        slot + offsetof(struct msg_rlink_data, data),
+        (const uint8_t *)msg + sizeof(struct msg_header),
+        msg->data_len
+    );
+
+    uint32_t bit = 1u << SEQ_DIFF(l->tx_next, l->tx_base);
+    l->tx_acked &= ~bit;
+    l->tx_fast  &= ~bit;
+    l->tx_tries[l->tx_next & (l->tx_slots - 1)] = 0;
+
+    l->stats.tx_data++;
+    transmit(l, l->tx_next++, now);
+
+    return msg->data_len;
+}
+
+
+/**
+ * Process a received message.
+ *
+ * \return  1 if the message belongs to the link,
+ *          0 if it is a plain message for the application
+ */
+int rlink_input(struct rlink *l, const struct msg_header *msg, uint32_t now)
+{
+    switch (msg->id) {
+    case MSG_ID_RLINK_DATA:
+        handle_data(l, msg);
+        return 1;
+
+    case MSG_ID_RLINK_ACK:
+        handle_ack(l, msg, now);
+        return 1;
+
+    default:
+        return 0;
+    }
+}
+
+
+/**
+ * Get the next received message in sequence.
+ *
+ * The message stays valid until the next call, which
+ * releases its slot.
+ *
+ * \return  message, or NULL if there is none
+ */
+const struct msg_header *rlink_recv(struct rlink *l)
+{
+    if (l->rx_held) {
+        l->rx_read++;
+        l->rx_mask >>= 1;
+        l->rx_held = 0;
+
+        // Tell the peer, if it is short on window
+        //
+        uint16_t end = l->rx_read + l->rx_slots;
+        if (!l->rx_window_update && SEQ_DIFF(end, l->rx_adv_end) >= (l->rx_slots + 1) / 2)
+            l->rx_window_update = 1;
+    }
+
+    if (l->rx_read == l->rx_next)
+        return NULL;
+
+    l->rx_held = 1;
+    return (const struct msg_header *)rx_slot(l, l->rx_read);
+}
+
+
+/**
+ * Retransmit messages and send window updates.
+ * Call this regularly, e.g. every few milliseconds.
+ *
+ * \return  0 on success, -1 if the peer stopped responding
+ */
+int rlink_poll(struct rlink *l, uint32_t now)
+{
+    if (l->error) {
+        errno = l->error;
+        return -1;
+    }
+
+    // Window updates can get lost, so repeat them until
+    // the peer sends new data
+    //
+    if (l->rx_window_update == 1 ||
+        (l->rx_window_update && l->rx_window_update <= l->max_retries &&
+         now - l->rx_update_time >= l->rto))
+    {
+        send_ack(l);
+        l->rx_window_update++;
+        l->rx_update_time = now;
+    }
+
+    int pending = SEQ_DIFF(l->tx_next, l->tx_base);
+
+    for (int off = 0; off < pending; off++) {
+        if (l->tx_acked & (1u << off))
+            continue;
+
+        uint16_t seq   = l->tx_base + off;
+        int      i     = seq & (l->tx_slots - 1);
+        int      shift = l->tx_tries[i] - 1;
+
+        if (shift > RLINK_MAX_BACKOFF)
+            shift = RLINK_MAX_BACKOFF;
+
+        if (now - l->tx_time[i] < (l->rto << shift))
+            continue;
+
+        if (l->tx_tries[i] > l->max_retries) {
+            l->error = EMSG_TIMEOUT;
+            errno = l->error;
+            return -1;
+        }
+
+        l->tx_fast &= ~(1u << off);
+        l->stats.tx_retransmits++;
+        transmit(l, seq, now);
+    }
+
+    return 0;
+}
@@ -0,0 +1,119 @@
+/**
+ * \file
+ * Sliding-window reliable transport
+ *
+ * Copyright (c)2015 Thomas Kindler <mail_drquad@t-kindler.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef RLINK_H_
+#define RLINK_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "msg_structs.h"
+
+#define RLINK_MAX_SLOTS     32      // limited by the sack bitmap
+#define RLINK_HEADER_SIZE   4       // seq + id
+
+// Buffer size for one slot that holds messages with up to
+// DATA_SIZE payload bytes
+//
+#define RLINK_SLOT_SIZE(DATA_SIZE)  \
+    (sizeof(struct msg_header) + RLINK_HEADER_SIZE + (DATA_SIZE))
+
+
+struct rlink_stats {
+    uint32_t    tx_data;
+    uint32_t    tx_retransmits;
+    uint32_t    tx_acks;
+    uint32_t    rx_data;
+    uint32_t    rx_duplicates;
+    uint32_t    rx_dropped;     // outside of the receive window
+    uint32_t    rx_acks;
+};
+
+
+/**
+ * Link state
+ *
+ * Both ends must be initialized at the same point in the message
+ * stream, e.g. after MSG_ID_LINK_SETUP.
+ */
+struct rlink {
+    // Send a raw message, return < 0 on error
+    //
+    int         (*send)(void *ctx, struct msg_header *msg);
+    void        *ctx;
+
+    uint32_t    rto;            // retransmit timeout [ms]
+    int         max_retries;
+    int         error;          // errno, if the peer stopped responding
+
+    // Transmit side
+    //
+    uint8_t     *tx_buf;
+    size_t      tx_slot_size;
+    int         tx_slots;
+
+    uint16_t    tx_base;        // oldest unacknowledged message
+    uint16_t    tx_next;        // next sequence number
+    uint16_t    tx_limit;       // end of the peer's receive window
+    uint32_t    tx_acked;       // bit n: tx_base + n was acknowledged
+    uint32_t    tx_fast;        // bit n: tx_base + n was fast retransmitted
+    uint32_t    tx_time[RLINK_MAX_SLOTS];
+    uint8_t     tx_tries[RLINK_MAX_SLOTS];
+
+    // Receive side
+    //
+    uint8_t     *rx_buf;
+    size_t      rx_slot_size;
+    int         rx_slots;
+
+    uint16_t    rx_read;        // next message for rlink_recv()
+    uint16_t    rx_next;        // next message expected in sequence
+    uint32_t    rx_mask;        // bit n: rx_read + n was received
+    int         rx_held;        // rlink_recv() returned rx_read
+    uint16_t    rx_adv_end;         // window end in the last ack
+    int         rx_window_update;   // number of window updates sent + 1
+    uint32_t    rx_update_time;
+
+    struct rlink_stats stats;
+};
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void    rlink_init(
+            struct rlink *l,
+            int (*send)(void *ctx, struct msg_header *msg), void *ctx,
+            void *tx_buf, size_t tx_slot_size, int tx_slots,
+            void *rx_buf, size_t rx_slot_size, int rx_slots,
+            uint32_t rto);
+
+int     rlink_send(struct rlink *l, const struct msg_header *msg, uint32_t now);
+int     rlink_input(struct rlink *l, const struct msg_header *msg, uint32_t now);
+const struct msg_header *rlink_recv(struct rlink *l);
+int     rlink_poll(struct rlink *l, uint32_t now);
+
+int     rlink_tx_free(const struct rlink *l);
+int     rlink_tx_pending(const struct rlink *l);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* RLINK_H_ */
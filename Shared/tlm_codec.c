@@ -0,0 +1,187 @@
+/**
+ * \file
+ * Delta/varint telemetry compression
+ *
+ * Each channel is quantized to its sensor resolution and stored
+ * as the difference to the previous sample. The differences are
+ * zigzag-mapped and written as LEB128 varints, so small changes
+ * take a single byte instead of a 4 byte float.
+ *
+ * The first sample after tlm_codec_reset() is a keyframe: it is
+ * encoded against zero, so it needs no earlier samples. The telemetry streamer resets the codec
+ * for every message, so a lost packet never corrupts the next one.
+ *
+ * Copyright (c)2015 Thomas Kindler <mail_drquad@t-kindler.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "tlm_codec.h"
+#include "errors.h"
+#include <assert.h>
+#include <math.h>
+
+
+static int32_t quantize(float x, float resolution)
+{
+    float q = x / resolution;
+
+    // Saturate, so that NaN and huge values stay well-defined
+    //
+    if (q >= 2147483520.0f)
+        return INT32_MAX;
+    else if (q <= -2147483520.0f)
+        return INT32_MIN;
+    else if (q != q)
+        return 0;
+
+    return lrintf(q);
+}
+
+
+static uint32_t zigzag_encode(int32_t x)
+{
+    return ((uint32_t)x << 1) ^ (uint32_t)(x >> 31);
+}
+
+
+static int32_t zigzag_decode(uint32_t x)
+{
+    return (int32_t)(x >> 1) ^ -(int32_t)(x & 1);
+}
+
+
+/**
+ * Set up a codec.
+ *
+ * \param   resolution      quantization step for each channel
+ * \param   num_channels    number of channels per sample
+ */
+void tlm_codec_init(struct tlm_codec *c, const float *resolution, int num_channels)
+{
+    assert(c != NULL);
+    assert(resolution != NULL);
+    assert(num_channels > 0 && num_channels <= TLM_CODEC_MAX_CHANNELS);
+
+    c->num_channels = num_channels;
+    c->resolution   = resolution;
+    tlm_codec_reset(c);
+}
+
+
+/**
+ * Encode the next sample as a keyframe.
+ */
+void tlm_codec_reset(struct tlm_codec *c)
+{
+    assert(c != NULL);
+
+    for (int i=0; i<c->num_channels; i++)
+        c->prev[i] = 0;
+}
+
+
+/**
+ * Encode one sample.
+ *
+ * The codec state is only updated if the sample fits into
+ * the destination buffer.
+ *
+ * \param   sample  num_channels values
+ * \return  number of bytes written, -1 on error
+ */
+ssize_t tlm_encode(struct tlm_codec *c, void *dst_buf_ptr, size_t dst_buf_len, const float *sample)
+{
+    assert(c != NULL);
+    assert(dst_buf_ptr != NULL);
+    assert(sample != NULL);
+
+    uint8_t *dst = dst_buf_ptr;
+    uint8_t *dst_end = dst + dst_buf_len;
+    int32_t q[TLM_CODEC_MAX_CHANNELS];
+
+    for (int i=0; i<c->num_channels; i++) {
+        q[i] = quantize(sample[i], c->resolution[i]);
+
+        // wrap-around is fine, the decoder wraps back
+        //
+        uint32_t v = zigzag_encode((int32_t)((uint32_t)q[i] - (uint32_t)c->prev[i]));
+
+        do {
+            if (dst >= dst_end) {
+                errno = ETLM_ENCODE_OUT_BUFFER_OVERFLOW;
+                return -1;
+            }
+            *dst++ = (v & 0x7F) | (v > 0x7F ? 0x80 : 0);
+            v >>= 7;
+        } while (v);
+    }
+
+    for (int i=0; i<c->num_channels; i++)
+        c->prev[i] = q[i];
+
+    return dst - (uint8_t*)dst_buf_ptr;
+}
+
+
+/**
+ * Decode one sample.
+ *
+ * The codec state is only updated if the whole
+ * sample could be decoded.
+ *
+ * \param   sample  receives num_channels values
+ * \return  number of bytes consumed, -1 on error
+ */
+ssize_t tlm_decode(struct tlm_codec *c, float *sample, const void *src_ptr, size_t src_len)
+{
+    assert(c != NULL);
+    assert(sample != NULL);
+    assert(src_ptr != NULL);
+
+    const uint8_t *src = src_ptr;
+    const uint8_t *src_end = src + src_len;
+    int32_t q[TLM_CODEC_MAX_CHANNELS];
+
+    for (int i=0; i<c->num_channels; i++) {
+        uint32_t v = 0;
+        int shift = 0;
+        uint8_t b;
+
+        do {
+            if (src >= src_end) {
+                errno = ETLM_DECODE_TRUNCATED;
+                return -1;
+            }
+            b = *src++;
+
+            // The 5th byte holds the top 4 bits and ends the varint
+            //
+            if (shift == 28 && (b & 0xF0)) {
+                errno = ETLM_DECODE_INVALID;
+                return -1;
+            }
+            v |= (uint32_t)(b & 0x7F) << shift;
+            shift += 7;
+        } while (b & 0x80);
+
+        q[i] = (int32_t)((uint32_t)c->prev[i] + (uint32_t)zigzag_decode(v));
+    }
+
+    for (int i=0; i<c->num_channels; i++) {
+        c->prev[i] = q[i];
+        sample[i]  = q[i] * c->resolution[i];
+    }
+
+    return src - (const uint8_t*)src_ptr;
+}
@@ -0,0 +1,61 @@
+/**
+ * \file
+ * Delta/varint telemetry compression
+ *
+ * Copyright (c)2015 Thomas Kindler <mail_drquad@t-kindler.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef TLM_CODEC_H_
+#define TLM_CODEC_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define TLM_CODEC_MAX_CHANNELS  16
+
+// Worst case size of one encoded sample (5 bytes per varint)
+//
+#define TLM_ENCODE_DST_BUF_LEN_MAX(NUM_CHANNELS)  ((NUM_CHANNELS) * 5)
+
+
+/**
+ * Codec state
+ *
+ * Encoder and decoder must be set up with the same channel
+ * resolutions and reset at the same point in the stream.
+ */
+struct tlm_codec {
+    int         num_channels;
+    const float *resolution;    // quantization step per channel
+    int32_t     prev[TLM_CODEC_MAX_CHANNELS];   // all zero for a keyframe
+};
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void    tlm_codec_init(struct tlm_codec *c, const float *resolution, int num_channels);
+void    tlm_codec_reset(struct tlm_codec *c);
+
+ssize_t tlm_encode(struct tlm_codec *c, void *dst_buf_ptr, size_t dst_buf_len, const float *sample);
+ssize_t tlm_decode(struct tlm_codec *c, float *sample, const void *src_ptr, size_t src_len);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* TLM_CODEC_H_ */
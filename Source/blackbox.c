@@ -0,0 +1,470 @@
+/**
+ * \file
+ * Blackbox logger
+ *
+ * The flight control loop writes compact binary records into a
+ * lock-free ring buffer. The blackbox task runs at idle priority
+ * and writes full, sector-aligned blocks to a file on the FatFs
+ * volume, so the control loop never waits for the storage.
+ *
+ * blackbox_write() must only be called from a single task, and that
+ * task must have a higher priority than the blackbox task. Then a
+ * record is never half-written while the blackbox task runs.
+ *
+ */
+#include "blackbox.h"
+#include "sensors.h"
+#include "rc_input.h"
+#include "attitude.h"
+#include "bldc_task.h"
+#include "ringbuf.h"
+#include "ustime.h"
+#include "util.h"
+#include "ff.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include <stdio.h>
+#include <math.h>
+#include <errno.h>
+
+#define BB_BLOCK_SIZE       512                 // FatFs sector size
+#define BB_BUF_SIZE         (8 * BB_BLOCK_SIZE)
+#define BB_SYNC_INTERVAL    1000                // [ms]
+#define BB_SLOW_DIV         10                  // rc and motor decimation
+
+
+enum bb_state {
+    BB_IDLE,
+    BB_RUNNING
+};
+
+enum bb_request {
+    BB_REQ_NONE,
+    BB_REQ_START,
+    BB_REQ_STOP,
+    BB_REQ_BENCH
+};
+
+
+static struct ringbuf bb_buf = RINGBUF(BB_BUF_SIZE);
+
+static FATFS    fatfs;
+static FIL      bb_file;
+static char     bb_filename[13];
+
+static volatile enum bb_state   bb_state;
+static volatile enum bb_request bb_request;
+static volatile FRESULT         bb_result;
+static volatile FRESULT         bb_mount_result = FR_NOT_READY;
+
+static uint8_t  bb_seq;
+static unsigned bb_bench_kbytes;
+static unsigned bb_bench_us;
+
+static volatile struct blackbox_stats {
+    uint32_t    records;
+    uint32_t    bytes;
+    uint32_t    dropped;        // records dropped due to a full buffer
+    uint32_t    blocks;         // blocks written to the file
+    uint32_t    max_write_us;   // slowest f_write call
+} bb_stats;
+
+
+// -------------------- Producer --------------------
+//
+/**
+ * Write a record to the log.
+ *
+ * \return  0 on success, -1 if the record was dropped
+ */
+int blackbox_write(uint8_t type, const void *data, size_t len)
+{
+    if (bb_state != BB_RUNNING)
+        return 0;
+
+    struct bb_header hdr = {
+        .sync      = BB_SYNC,
+        .type      = type,
+        .len       = len,
+        .seq       = bb_seq++,
+        .timestamp = get_us_time32()
+    };
+
+    if (rb_bytes_free(&bb_buf) < sizeof(hdr) + len) {
+        bb_stats.dropped++;
+        return -1;
+    }
+
+    rb_write(&bb_buf, &hdr, sizeof(hdr));
+    rb_write(&bb_buf, data, len);
+
+    bb_stats.records++;
+    bb_stats.bytes += sizeof(hdr) + len;
+    return 0;
+}
+
+
+static int16_t sat16(float x)
+{
+    return clamp(lrintf(x), INT16_MIN, INT16_MAX);
+}
+
+
+/**
+ * Log the state of one flight control loop iteration.
+ *
+ * Sensors and attitude are logged every call, RC input
+ * and motor state only every BB_SLOW_DIV calls.
+ */
+void blackbox_log(const struct sensor_data *sensors, const struct rc_input *rc)
+{
+    static unsigned frame;
+
+    if (bb_state != BB_RUNNING)
+        return;
+
+    struct bb_sensors s = {
+        .acc  = { sat16(sensors->acc.x  * 100),  sat16(sensors->acc.y  * 100),  sat16(sensors->acc.z  * 100)  },
+        .gyro = { sat16(sensors->gyro.x * 1000), sat16(sensors->gyro.y * 1000), sat16(sensors->gyro.z * 1000) }
+    };
+    blackbox_write(BB_REC_SENSORS, &s, sizeof(s));
+
+    struct bb_attitude a = {
+        .euler = { sat16(dcm.euler.x * 10000), sat16(dcm.euler.y * 10000), sat16(dcm.euler.z * 10000) }
+    };
+    blackbox_write(BB_REC_ATTITUDE, &a, sizeof(a));
+
+    if (++frame < BB_SLOW_DIV)
+        return;
+
+    frame = 0;
+
+    struct {
+        struct bb_rc rc;
+        uint16_t     channels[RC_MAX_CHANNELS];
+    } r;
+
+    int n = clamp(rc->num_channels, 0, RC_MAX_CHANNELS);
+
+    r.rc.valid = rc->valid;
+    r.rc.rssi  = rc->rssi;
+    for (int i=0; i<n; i++)
+        r.rc.channels[i] = rc->channels[i];
+
+    blackbox_write(BB_REC_RC, &r, sizeof(struct bb_rc) + n * sizeof(uint16_t));
+
+    struct bb_motors m;
+    for (int i=0; i<4; i++) {
+        const struct motor_state *ms = &bldc_state.motors[i];
+
+        m.motors[i].state = ms->state;
+        m.motors[i].u_d   = sat16(ms->u_d * 1000);
+        m.motors[i].rpm   = sat16(ms->rpm_filter.y[0]);
+    }
+    blackbox_write(BB_REC_MOTORS, &m, sizeof(m));
+}
+
+
+// -------------------- Writer --------------------
+//
+static FRESULT write_chunk(const void *ptr, size_t len)
+{
+    UINT bw;
+
+    uint32_t t0 = get_us_time32();
+    FRESULT res = f_write(&bb_file, ptr, len, &bw);
+    uint32_t dt = get_us_time32() - t0;
+
+    if (dt > bb_stats.max_write_us)
+        bb_stats.max_write_us = dt;
+
+    if (res == FR_OK && bw != len)
+        res = FR_DENIED;    // volume full
+
+    return res;
+}
+
+
+/**
+ * Write all full blocks in the buffer.
+ *
+ * As the buffer size is a multiple of the block size and
+ * the read position only moves in whole blocks, a block
+ * never wraps around the end of the buffer.
+ */
+static FRESULT write_blocks(void)
+{
+    while (rb_bytes_used(&bb_buf) >= BB_BLOCK_SIZE) {
+        void   *ptr;
+        size_t len;
+
+        rb_get_pointers(&bb_buf, RB_READ, BB_BLOCK_SIZE, &ptr, &len, NULL, NULL);
+
+        FRESULT res = write_chunk(ptr, len);
+        if (res != FR_OK)
+            return res;
+
+        rb_commit(&bb_buf, RB_READ, len);
+        bb_stats.blocks++;
+    }
+
+    return FR_OK;
+}
+
+
+static FRESULT open_log(void)
+{
+    FILINFO fno;
+    FRESULT res;
+
+    if (bb_mount_result != FR_OK)
+        return bb_mount_result;
+
+    if (bb_state == BB_RUNNING)
+        return FR_OK;
+
+    // Find the next free file name
+    //
+    for (int i=0; ; i++) {
+        if (i > 999)
+            return FR_DENIED;
+
+        sprintf(bb_filename, "BB%03d.BIN", i);
+        if (f_stat(bb_filename, &fno) == FR_NO_FILE)
+            break;
+    }
+
+    res = f_open(&bb_file, bb_filename, FA_WRITE | FA_CREATE_NEW);
+    if (res != FR_OK)
+        return res;
+
+    // The producer is idle, so we may reset both positions
+    //
+    bb_buf.read_pos  = 0;
+    bb_buf.write_pos = 0;
+    bb_seq = 0;
+
+    bb_stats.records = 0;
+    bb_stats.bytes   = 0;
+    bb_stats.dropped = 0;
+    bb_stats.blocks  = 0;
+    bb_stats.max_write_us = 0;
+
+    bb_state = BB_RUNNING;
+    return FR_OK;
+}
+
+
+static FRESULT close_log(void)
+{
+    if (bb_state != BB_RUNNING)
+        return FR_OK;
+
+    bb_state = BB_IDLE;
+
+    // Write the remaining partial block
+    //
+    FRESULT res = write_blocks();
+
+    if (res == FR_OK) {
+        void   *ptr1, *ptr2;
+        size_t len1, len2;
+
+        rb_get_pointers(&bb_buf, RB_READ, BB_BUF_SIZE, &ptr1, &len1, &ptr2, &len2);
+
+        res = write_chunk(ptr1, len1);
+        if (res == FR_OK && len2)
+            res = write_chunk(ptr2, len2);
+    }
+
+    FRESULT res2 = f_close(&bb_file);
+    return res != FR_OK ? res : res2;
+}
+
+
+/**
+ * Measure the raw write throughput of the volume.
+ */
+static FRESULT run_bench(void)
+{
+    static uint8_t block[BB_BLOCK_SIZE] __attribute__((aligned(4)));
+    FIL *fp = &bb_file;
+    FRESULT res;
+
+    if (bb_mount_result != FR_OK)
+        return bb_mount_result;
+
+    if (bb_state == BB_RUNNING)
+        return FR_LOCKED;
+
+    res = f_open(fp, "BENCH.BIN", FA_WRITE | FA_CREATE_ALWAYS);
+    if (res != FR_OK)
+        return res;
+
+    uint64_t t0 = get_us_time64();
+
+    for (unsigned i=0; i < bb_bench_kbytes * 1024 / BB_BLOCK_SIZE; i++) {
+        UINT bw;
+
+        res = f_write(fp, block, sizeof(block), &bw);
+        if (res == FR_OK && bw != sizeof(block))
+            res = FR_DENIED;
+        if (res != FR_OK)
+            break;
+    }
+
+    if (res == FR_OK)
+        res = f_sync(fp);
+
+    bb_bench_us = get_us_time64() - t0;
+
+    f_close(fp);
+    f_unlink("BENCH.BIN");
+
+    return res;
+}
+
+
+static FRESULT mount(void)
+{
+    FRESULT res = f_mount(&fatfs, "", 1);
+
+    if (res == FR_NO_FILESYSTEM) {
+        printf("blackbox: formatting volume..\n");
+
+        res = f_mkfs("", 1, 0);
+        if (res == FR_OK)
+            res = f_mount(&fatfs, "", 1);
+    }
+
+    return res;
+}
+
+
+void blackbox_task(void *pvParameters)
+{
+    TickType_t t_sync = xTaskGetTickCount();
+
+    bb_mount_result = mount();
+
+    for (;;) {
+        switch (bb_request) {
+        case BB_REQ_START:  bb_result = open_log();   break;
+        case BB_REQ_STOP:   bb_result = close_log();  break;
+        case BB_REQ_BENCH:  bb_result = run_bench();  break;
+        case BB_REQ_NONE:   break;
+        }
+        bb_request = BB_REQ_NONE;
+
+        if (bb_state == BB_RUNNING) {
+            FRESULT res = write_blocks();
+
+            if (res == FR_OK && xTaskGetTickCount() - t_sync >= BB_SYNC_INTERVAL) {
+                res = f_sync(&bb_file);
+                t_sync = xTaskGetTickCount();
+            }
+
+            if (res != FR_OK) {
+                printf("blackbox: write error %d, logging stopped\n", res);
+                close_log();
+            }
+        }
+
+        vTaskDelay(10);
+    }
+}
+
+
+static int request(enum bb_request req)
+{
+    bb_request = req;
+    while (bb_request != BB_REQ_NONE)
+        vTaskDelay(10);
+
+    if (bb_result != FR_OK) {
+        errno = EIO;
+        return -1;
+    }
+    return 0;
+}
+
+
+/**
+ * Start logging to a new file.
+ *
+ * \return  0 on success, -1 on error
+ */
+int blackbox_start(void)
+{
+    return request(BB_REQ_START);
+}
+
+
+/**
+ * Stop logging and close the file.
+ *
+ * \return  0 on success, -1 on error
+ */
+int blackbox_stop(void)
+{
+    return request(BB_REQ_STOP);
+}
+
+
+// -------------------- Shell commands --------------------
+//
+#include "command.h"
+#include <stdlib.h>
+#include <string.h>
+
+static void cmd_blackbox(int argc, char *argv[])
+{
+    if (argc == 1) {
+        if (bb_mount_result != FR_OK)
+            printf("volume:         not mounted (%d)\n", bb_mount_result);
+        else
+            printf("volume:         %lu KB\n", (fatfs.n_fatent - 2) * fatfs.csize / 2);
+
+        printf("state:          %s %s\n",
+            bb_state == BB_RUNNING ? "running" : "idle", bb_filename);
+        printf("records:        %10lu\n", bb_stats.records);
+        printf("bytes:          %10lu\n", bb_stats.bytes);
+        printf("dropped:        %10lu\n", bb_stats.dropped);
+        printf("blocks:         %10lu\n", bb_stats.blocks);
+        printf("buffer used:    %10u\n",  rb_bytes_used(&bb_buf));
+        printf("max_write_us:   %10lu\n", bb_stats.max_write_us);
+        return;
+    }
+
+    if (!strcmp(argv[1], "start") && argc == 2) {
+        if (blackbox_start() < 0)
+            printf("start failed: %d\n", bb_result);
+    }
+    else if (!strcmp(argv[1], "stop") && argc == 2) {
+        if (blackbox_stop() < 0)
+            printf("stop failed: %d\n", bb_result);
+    }
+    else if (!strcmp(argv[1], "bench") && argc <= 3) {
+        bb_bench_kbytes = argc == 3 ? strtoul(argv[2], NULL, 0) : 32;
+
+        if (request(BB_REQ_BENCH) < 0) {
+            printf("bench failed: %d\n", bb_result);
+            return;
+        }
+
+        printf("%u KB in %u us, %u KB/s\n",
+            bb_bench_kbytes, bb_bench_us,
+            bb_bench_us ? (unsigned)(bb_bench_kbytes * 1000000ULL / bb_bench_us) : 0
+        );
+    }
+    else {
+        goto usage;
+    }
+    return;
+
+usage:
+    printf("usage: %s [start|stop|bench <kbytes>]\n", argv[0]);
+}
+
+
+SHELL_CMD(blackbox, (cmdfunc_t)cmd_blackbox, "Blackbox logger")
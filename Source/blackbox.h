@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+struct sensor_data;
+struct rc_input;
+
+// Log file format
+//
+// The file is a sequence of records. Each record starts with a
+// bb_header, followed by hdr.len bytes of payload. The sequence
+// number increments with every record, so the decoder can detect
+// records that were dropped because the buffer was full.
+//
+#define BB_SYNC     0xBB
+
+enum bb_record_type {
+    BB_REC_SENSORS  = 1,
+    BB_REC_ATTITUDE = 2,
+    BB_REC_RC       = 3,
+    BB_REC_MOTORS   = 4
+};
+
+#pragma pack(push, 1)
+
+struct bb_header {
+    uint8_t     sync;           // BB_SYNC
+    uint8_t     type;           // enum bb_record_type
+    uint8_t     len;            // payload length
+    uint8_t     seq;            // record sequence number
+    uint32_t    timestamp;      // [us]
+};
+
+struct bb_sensors {
+    int16_t     acc[3];         // [0.01 m/s^2]
+    int16_t     gyro[3];        // [0.001 rad/s]
+};
+
+struct bb_attitude {
+    int16_t     euler[3];       // [0.0001 rad]
+};
+
+struct bb_rc {
+    uint8_t     valid;
+    uint8_t     rssi;
+    uint16_t    channels[/* (len-2)/2 */];  // [us]
+};
+
+struct bb_motors {
+    struct {
+        uint8_t     state;
+        int16_t     u_d;        // [mV]
+        int16_t     rpm;
+    } motors[4];
+};
+
+#pragma pack(pop)
+
+
+int  blackbox_write(uint8_t type, const void *data, size_t len);
+void blackbox_log(const struct sensor_data *sensors, const struct rc_input *rc);
+
+int  blackbox_start(void);
+int  blackbox_stop(void);
+void blackbox_task(void *pvParameters);
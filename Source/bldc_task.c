@@ -1,6 +1,7 @@
 #include "bldc_task.h"
 #include "bldc_driver.h"
 #include "debug_dac.h"
+#include "scope.h"
 #include "util.h"
 #include "FreeRTOS.h"
 #include "task.h"
@@ -217,8 +218,7 @@ static void update_motor(struct motor_state *m)
         break;
 
     case STATE_RUNNING: {
-        const float dt = 1.0 / BLDC_IRQ_FREQ;
-        const float du_max = bldc_params.dudt_max * dt;
+        const float du_max = bldc_params.du_max;
 
         if (m->reverse)
             m->u_pwm = clamp(-m->u_d, m->u_pwm - du_max, m->u_pwm + du_max);
@@ -249,13 +249,14 @@ void bldc_irq_handler(void)
 
         update_motor(m);
 
-        if (m->pos % (6 * bldc_params.polepairs) == 0)
+        if (m->pos % bldc_params.steps_per_rev == 0)
             m->led = 255;
         else
             m->led = 0;
     }
 
     debug_dac_update();
+    scope_update(SCOPE_SOURCE_BLDC);
 }
 
 
@@ -265,8 +266,7 @@ static void rpm_update(void)
     for (int id=0; id<4; id++) {
         struct motor_state *m = &bldc_state.motors[id];
 
-        float f_el = configTICK_RATE_HZ * (m->pos - m->rpm_old_pos) / 6.0;
-        float rpm  = f_el * 60 / bldc_params.polepairs;
+        float rpm = (m->pos - m->rpm_old_pos) * bldc_params.rpm_scale;
 
         m->rpm_old_pos = m->pos;
 
@@ -275,6 +275,27 @@ static void rpm_update(void)
 }
 
 
+/**
+ * Recalculate derived values.
+ * Called by param_set() when dudt_max or polepairs change.
+ *
+ */
+void bldc_params_changed(const struct param_info *p)
+{
+    struct bldc_params *bp = &bldc_params;
+
+    int polepairs = bp->polepairs > 0 ? bp->polepairs : 1;
+
+    bp->du_max = bp->dudt_max * (1.0 / BLDC_IRQ_FREQ);
+
+    // f_el = configTICK_RATE_HZ * steps / 6
+    // rpm  = f_el * 60 / polepairs
+    //
+    bp->rpm_scale     = configTICK_RATE_HZ * 60.0 / (6 * polepairs);
+    bp->steps_per_rev = 6 * polepairs;
+}
+
+
 static void rpm_init(void)
 {
     float fc = 10.0 / configTICK_RATE_HZ;
@@ -87,6 +87,12 @@ struct bldc_params
     int     t_deadtime;
     int     t_emf_hold_off;
     float   u_emf_hyst;
+
+    // Derived values, updated by bldc_params_changed()
+    //
+    float   du_max;         // maximum voltage step per interrupt
+    float   rpm_scale;      // rpm per step and tick
+    int     steps_per_rev;  // commutation steps per mechanical revolution
 };
 
 
@@ -114,5 +120,8 @@ extern union  warning_flags warnings;
 extern struct bldc_state    bldc_state;
 extern struct bldc_params   bldc_params;
 
+struct param_info;
+
 void bldc_irq_handler(void);
 void bldc_task(void *pvParameters);
+void bldc_params_changed(const struct param_info *p);
@@ -4,48 +4,36 @@
 #include "stm32f4xx.h"
 
 
-static float  dummy_null;
-
-static struct param_cache {
-    int   id;
-    int   type;
-    void  *ptr;
-} dac1_cache, dac2_cache;
+static struct param_ref  dac1_ref, dac2_ref;
 
 struct dac_config  dac_config;
 
 
-static inline float get_value(struct param_cache *c, int id)
+/**
+ * Resolve the parameter ids and recalculate the DAC gains.
+ * Called by param_set() when the DAC configuration changes.
+ *
+ */
+void debug_dac_config_changed(const struct param_info *p)
 {
-    if (c->id != id) {
-        const struct param_info *p;
-        if ((p = param_get_info(id))) {
-            c->id   = p->id;
-            c->type = p->type;
-            c->ptr  = p->flt.ptr;
-        }
-        else {
-            c->id   = id;
-            c->type = PTYPE_FLOAT;
-            c->ptr  = &dummy_null;
-        }
-    }
-
-    if (c->type == PTYPE_FLOAT)
-        return *(float*)c->ptr;
-    else
-        return *(int*)c->ptr;
+    struct dac_config *c = &dac_config;
+
+    param_ref_init(&dac1_ref, c->dac1_id);
+    param_ref_init(&dac2_ref, c->dac2_id);
+
+    c->dac1_gain = (4096 / 3.3) / c->dac1_scale;
+    c->dac2_gain = (4096 / 3.3) / c->dac2_scale;
 }
 
 
 void debug_dac_update(void)
 {
     struct dac_config *c = &dac_config;
-    float f1 = (get_value(&dac1_cache, c->dac1_id) + c->dac1_offset) / c->dac1_scale;
-    float f2 = (get_value(&dac2_cache, c->dac2_id) + c->dac2_offset) / c->dac2_scale;
+    float f1 = (param_ref_get_float(&dac1_ref) + c->dac1_offset) * c->dac1_gain;
+    float f2 = (param_ref_get_float(&dac2_ref) + c->dac2_offset) * c->dac2_gain;
 
-    DAC->DHR12R1 = clamp(f1 * (4096 / 3.3) + 2048, 0, 4095);
-    DAC->DHR12R2 = clamp(f2 * (4096 / 3.3) + 2048, 0, 4095);
+    DAC->DHR12R1 = clamp(f1 + 2048, 0, 4095);
+    DAC->DHR12R2 = clamp(f2 + 2048, 0, 4095);
 }
 
 
@@ -77,7 +65,6 @@ void debug_dac_init(void)
         .GPIO_Mode = GPIO_Mode_AN
     });
 
-    dac1_cache.id = -1;
-    dac2_cache.id = -1;
+    debug_dac_config_changed(NULL);
 }
 
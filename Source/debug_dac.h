@@ -8,9 +8,17 @@ struct dac_config {
     int   dac2_id;
     float dac2_scale;
     float dac2_offset;
+
+    // Derived values, updated by debug_dac_config_changed()
+    //
+    float dac1_gain;
+    float dac2_gain;
 };
 
 extern struct dac_config dac_config;
 
+struct param_info;
+
+void debug_dac_config_changed(const struct param_info *p);
 void debug_dac_update(void);
 void debug_dac_init(void);
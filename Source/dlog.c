@@ -0,0 +1,180 @@
+/**
+ * \file
+ * Deferred binary logging
+ *
+ * Records are written into a word ring buffer. A record consists of
+ * the id word (format string offset << 4 | number of arguments), a
+ * timestamp from the DWT cycle counter and the argument words.
+ *
+ * The writer masks interrupts for the few instructions it takes to
+ * copy a record, so DLOG() may be used from any task and from any
+ * interrupt priority. The STM32F4 has only one core, so there is no
+ * need for per-core buffers. If the buffer is full, the record is
+ * dropped and counted.
+ *
+ * The dlog task collects the records and sends them to the host
+ * in MSG_ID_DLOG packets.
+ *
+ */
+#include "dlog.h"
+#include "msg_packet.h"
+#include "util.h"
+#include "Shared/msg_structs.h"
+#include "stm32f4xx.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include <stdio.h>
+#include <string.h>
+
+#define DLOG_BUF_WORDS      1024        // must be a power of 2
+#define DLOG_FLUSH_INTERVAL 20          // [ms]
+
+
+static uint32_t dlog_buf[DLOG_BUF_WORDS];
+
+static volatile unsigned dlog_read_pos;
+static volatile unsigned dlog_write_pos;
+
+static struct {
+    uint32_t    records;
+    uint32_t    dropped;
+    uint32_t    packets;
+    uint32_t    max_used;
+} dlog_stats;
+
+
+/**
+ * Write a record into the buffer.
+ * Use the DLOG() macro instead of calling this directly.
+ *
+ * \param id    format string offset << 4 | number of arguments
+ * \param args  argument words
+ */
+void dlog_write(uint32_t id, const uint32_t *args)
+{
+    unsigned len = 2 + (id & 0x0F);
+    uint32_t primask = __get_PRIMASK();
+
+    __disable_irq();
+
+    unsigned wpos = dlog_write_pos;
+    unsigned used = (wpos - dlog_read_pos) & (DLOG_BUF_WORDS - 1);
+
+    if (used + len >= DLOG_BUF_WORDS) {
+        dlog_stats.dropped++;
+        __set_PRIMASK(primask);
+        return;
+    }
+
+    dlog_buf[wpos] = id;
+    wpos = (wpos + 1) & (DLOG_BUF_WORDS - 1);
+
+    dlog_buf[wpos] = DWT->CYCCNT;
+    wpos = (wpos + 1) & (DLOG_BUF_WORDS - 1);
+
+    for (unsigned i = 2; i < len; i++) {
+        dlog_buf[wpos] = *args++;
+        wpos = (wpos + 1) & (DLOG_BUF_WORDS - 1);
+    }
+
+    dlog_write_pos = wpos;
+    dlog_stats.records++;
+
+    if (used + len > dlog_stats.max_used)
+        dlog_stats.max_used = used + len;
+
+    __set_PRIMASK(primask);
+}
+
+
+/**
+ * Start the cycle counter used for the timestamps.
+ * Records written before dlog_init() have a timestamp of 0.
+ */
+void dlog_init(void)
+{
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL  |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+
+/**
+ * Copy as many complete records as fit into a message.
+ *
+ * \return  number of words copied
+ */
+static unsigned dlog_fill(struct msg_dlog *msg)
+{
+    unsigned rpos = dlog_read_pos;
+    unsigned wpos = dlog_write_pos;
+    unsigned n = 0;
+
+    while (rpos != wpos) {
+        unsigned len = 2 + (dlog_buf[rpos] & 0x0F);
+
+        if (n + len > ARRAY_SIZE(msg->data))
+            break;
+
+        for (unsigned i = 0; i < len; i++) {
+            msg->data[n++] = dlog_buf[rpos];
+            rpos = (rpos + 1) & (DLOG_BUF_WORDS - 1);
+        }
+    }
+
+    dlog_read_pos = rpos;
+    return n;
+}
+
+
+void dlog_task(void *pvParameters)
+{
+    struct msg_dlog msg;
+
+    msg.h.id = MSG_ID_DLOG;
+
+    for (;;) {
+        vTaskDelay(DLOG_FLUSH_INTERVAL);
+
+        unsigned n;
+        while ((n = dlog_fill(&msg)) > 0) {
+            msg.clock   = SystemCoreClock;
+            msg.dropped = dlog_stats.dropped;
+            msg.h.data_len = 8 + n * sizeof(uint32_t);
+
+            if (msg_send(&msg.h) >= 0)
+                dlog_stats.packets++;
+        }
+    }
+}
+
+
+// -------------------- Shell commands --------------------
+//
+#include "command.h"
+
+static void cmd_dlog(int argc, char *argv[])
+{
+    if (argc == 2 && !strcmp(argv[1], "test")) {
+        uint32_t t0 = DWT->CYCCNT;
+        DLOG("dlog test: %d %u 0x%08lx %.3f %s", -1, 2u, 0xDEADBEEFul, 3.14159f, "flash");
+        uint32_t t1 = DWT->CYCCNT;
+
+        printf("DLOG() took %lu cycles\n", t1 - t0);
+        return;
+    }
+    else if (argc != 1) {
+        goto usage;
+    }
+
+    printf("records:    %10lu\n", dlog_stats.records);
+    printf("dropped:    %10lu\n", dlog_stats.dropped);
+    printf("packets:    %10lu\n", dlog_stats.packets);
+    printf("max_used:   %10lu of %d words\n", dlog_stats.max_used, DLOG_BUF_WORDS);
+    return;
+
+usage:
+    printf("usage: %s [test]\n", argv[0]);
+}
+
+SHELL_CMD(dlog, (cmdfunc_t)cmd_dlog, "Show deferred log statistics")
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stdint.h>
+
+// Deferred logging
+//
+// DLOG() records a format string id and the raw argument words into
+// a buffer. It does not format anything, so it is cheap enough for
+// the control loop and safe to call from interrupt handlers.
+//
+// The format strings are placed in the .dlog_fmt section, which is
+// not loaded into flash. The id of a format string is its offset in
+// that section. Tools/dlog_decode.py looks the strings up in the ELF
+// file and formats the records on the host.
+//
+// DLOG() takes up to DLOG_MAX_ARGS arguments.
+// Every argument is logged as one 32 bit word. Floating point values
+// are logged in single precision, 64 bit integers are not supported.
+// "%s" only works for strings in flash, e.g. string literals.
+//
+#define DLOG_MAX_ARGS   8
+
+#define DLOG(fmt, ...)                                                  \
+    do {                                                                \
+        static const char _dlog_fmt[]                                   \
+            __attribute__((section(".dlog_fmt"), used)) = fmt;          \
+        const uint32_t _dlog_args[] = {                                 \
+            _DLOG_MAP(__VA_ARGS__) 0                                    \
+        };                                                              \
+        dlog_write(                                                     \
+            ((uint32_t)_dlog_fmt << 4) | _DLOG_NARGS(__VA_ARGS__),      \
+            _dlog_args                                                  \
+        );                                                              \
+    } while (0)
+
+void dlog_write(uint32_t id, const uint32_t *args);
+void dlog_init(void);
+void dlog_task(void *pvParameters);
+
+
+// Argument conversion helpers
+//
+static inline uint32_t _dlog_float(float f)
+{
+    union { float f; uint32_t u; } u = { .f = f };
+    return u.u;
+}
+
+// The inner _Generic keeps the float branch valid for pointer arguments.
+//
+#define _DLOG_ARG(x)                                                    \
+    _Generic((x),                                                       \
+        float:   _dlog_float(_Generic((x), float: (x), default: 0)),   \
+        double:  _dlog_float(_Generic((x), double: (x), default: 0)),  \
+        default: (uint32_t)(x)                                          \
+    ),
+
+#define _DLOG_NARGS(...)    _DLOG_NARGS_(0, ##__VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define _DLOG_NARGS_(_0, _1, _2, _3, _4, _5, _6, _7, _8, n, ...)  n
+
+#define _DLOG_CAT(a, b)     _DLOG_CAT_(a, b)
+#define _DLOG_CAT_(a, b)    a ## b
+
+#define _DLOG_MAP(...)      _DLOG_CAT(_DLOG_MAP, _DLOG_NARGS(__VA_ARGS__))(__VA_ARGS__)
+#define _DLOG_MAP0()
+#define _DLOG_MAP1(a)       _DLOG_ARG(a)
+#define _DLOG_MAP2(a, ...)  _DLOG_ARG(a) _DLOG_MAP1(__VA_ARGS__)
+#define _DLOG_MAP3(a, ...)  _DLOG_ARG(a) _DLOG_MAP2(__VA_ARGS__)
+#define _DLOG_MAP4(a, ...)  _DLOG_ARG(a) _DLOG_MAP3(__VA_ARGS__)
+#define _DLOG_MAP5(a, ...)  _DLOG_ARG(a) _DLOG_MAP4(__VA_ARGS__)
+#define _DLOG_MAP6(a, ...)  _DLOG_ARG(a) _DLOG_MAP5(__VA_ARGS__)
+#define _DLOG_MAP7(a, ...)  _DLOG_ARG(a) _DLOG_MAP6(__VA_ARGS__)
+#define _DLOG_MAP8(a, ...)  _DLOG_ARG(a) _DLOG_MAP7(__VA_ARGS__)
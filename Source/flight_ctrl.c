@@ -4,6 +4,9 @@
 #include "rc_input.h"
 #include "util.h"
 #include "attitude.h"
+#include "blackbox.h"
+#include "scope.h"
+#include "dlog.h"
 
 #include "FreeRTOS.h"
 #include "task.h"
@@ -21,7 +24,32 @@ float rc_pitch, rc_roll, rc_yaw, rc_thrust;
 float pid_p = 1;
 float pid_i = 0;
 float pid_d = 0;
-uint8_t fc_state = 0;
+int fc_state = 0;
+
+
+/**
+ * Copy the common gains to all axes, if enabled in fc_state.
+ * Called by param_set() when pid_p, pid_i, pid_d or fc_state change.
+ *
+ */
+void flight_ctrl_gains_changed(const struct param_info *p)
+{
+    if (!(fc_state & 1))
+        return;
+
+    pid_pitch.kp = pid_p;
+    pid_roll .kp = pid_p;
+    pid_yaw  .kp = pid_p;
+
+    pid_pitch.ki = pid_i;
+    pid_roll .ki = pid_i;
+    pid_yaw  .ki = pid_i;
+
+    pid_pitch.kd = pid_d;
+    pid_roll .kd = pid_d;
+    pid_yaw  .kd = pid_d;
+}
+
 
 /*
 void systick_handler(void)
@@ -88,20 +116,6 @@ void flight_ctrl(void *pvParameters)
             ok = 0;
         }
 
-        if (fc_state & 1) {
-            pid_pitch.kp = pid_p;
-            pid_roll .kp = pid_p;
-            pid_yaw  .kp = pid_p;
-
-            pid_pitch.ki = pid_i;
-            pid_roll .ki = pid_i;
-            pid_yaw  .ki = pid_i;
-
-            pid_pitch.kd = pid_d;
-            pid_roll .kd = pid_d;
-            pid_yaw  .kd = pid_d;
-        }
-
         if (fc_state & 2 || !(rc_input.channels[5] < 1500)) {
                 dcm_update(&sensor_data, 1e-3);
 
@@ -133,8 +147,17 @@ void flight_ctrl(void *pvParameters)
             bldc_state.motors[ID_RR].state = STATE_STOP;
         }
 
+        if (ok != old_ok) {
+            DLOG("flight_ctrl: motors %s, rc_thrust %.2f, rssi %d",
+                ok ? "on" : "off", rc_thrust, rc_input.rssi
+            );
+        }
+
         old_ok = ok;
 
+        blackbox_log(&sensor_data, &rc_input);
+        scope_update(SCOPE_SOURCE_CONTROL);
+
         vTaskDelay(1);
     }
 }
@@ -1,8 +1,11 @@
 #pragma once
 
+struct param_info;
 
 void flight_ctrl(void *pvParameters);
+void flight_ctrl_gains_changed(const struct param_info *p);
 
 
 extern float pid_p, pid_i, pid_d;
+extern int   fc_state;
 extern struct pid_ctrl pid_pitch, pid_roll, pid_yaw;
@@ -1,6 +1,7 @@
 #include "i2c_ak8975.h"
 #include "i2c_driver.h"
 #include "sensors.h"
+#include "dlog.h"
 #include "FreeRTOS.h"
 #include "task.h"
 #include <stdio.h>
@@ -124,22 +125,22 @@ int ak8975_convert(struct ak8975_data *data, const struct ak8975_regs *regs)
 
 int ak8975_init(void)
 {
-    printf("Initializing AK8975..\n");
+    DLOG("Initializing AK8975..");
 
     struct { uint8_t wia, info; } regs;
 
     int res = i2c_read(I2C_ADDR, WIA,  &regs, sizeof(regs));
     if (res < 0) return res;
 
-    printf("  WIA : 0x%02x\n", regs.wia );
-    printf("  INFO: 0x%02x\n", regs.info);
+    DLOG("  WIA : 0x%02x", regs.wia );
+    DLOG("  INFO: 0x%02x", regs.info);
 
     res = read_calib();
     if (res < 0) return res;
 
-    printf("  ASAX: %.3f\n", calib.gain_x);
-    printf("  ASAY: %.3f\n", calib.gain_y);
-    printf("  ASAZ: %.3f\n", calib.gain_z);
+    DLOG("  ASAX: %.3f", calib.gain_x);
+    DLOG("  ASAY: %.3f", calib.gain_y);
+    DLOG("  ASAZ: %.3f", calib.gain_z);
 
     return 1;
 }
@@ -1,6 +1,7 @@
 #include "i2c_bmp180.h"
 #include "i2c_driver.h"
 #include "sensors.h"
+#include "dlog.h"
 #include <errno.h>
 
 #define I2C_ADDR            0xEE
@@ -173,28 +174,22 @@ int bmp180_convert(struct bmp180_data *data, const struct bmp180_regs *regs)
 
 int bmp180_init(void)
 {
-    printf("Initializing BMP180..\n");
+    DLOG("Initializing BMP180..");
 
     uint8_t chip_id;
 
     int res = i2c_read(I2C_ADDR, CHIP_ID, &chip_id, 1);
     if (res < 0) return res;
 
-    printf("  ID: 0x%02x\n", chip_id);
+    DLOG("  ID: 0x%02x", chip_id);
 
     res = read_calib();
     if (res < 0) return res;
 
-    printf(
-        "  AC1, AC2, AC3: %6d, %6d, %6d\n"
-        "  AC4, AC5, AC6: %6d, %6d, %6d\n"
-        "  B1, B2       : %6d, %6d\n"
-        "  MB, MC, MD   : %6d, %6d, %6d\n",
-        calib.ac1, calib.ac2, calib.ac3,
-        calib.ac4, calib.ac5, calib.ac6,
-        calib.b1,  calib.b2,
-        calib.mb,  calib.mc,  calib.md
-    );
+    DLOG("  AC1, AC2, AC3: %6d, %6d, %6d", calib.ac1, calib.ac2, calib.ac3);
+    DLOG("  AC4, AC5, AC6: %6u, %6u, %6u", calib.ac4, calib.ac5, calib.ac6);
+    DLOG("  B1, B2       : %6d, %6d",      calib.b1,  calib.b2);
+    DLOG("  MB, MC, MD   : %6d, %6d, %6d", calib.mb,  calib.mc,  calib.md);
 
     return res;
 }
@@ -1,6 +1,7 @@
 #include "i2c_mpu9150.h"
 #include "i2c_driver.h"
 #include "sensors.h"
+#include "dlog.h"
 #include "FreeRTOS.h"
 #include "task.h"
 #include <stdio.h>
@@ -154,11 +155,11 @@ int mpu9150_init(void)
 {
     // TODO: Error handling
     //
-    printf("Initializing MPU9150..\n");
+    DLOG("Initializing MPU9150..");
 
     uint8_t who_am_i;
     i2c_read(I2C_ADDR, WHO_AM_I, &who_am_i, 1);
-    printf("  WHO_AM_I: 0x%02x\n", who_am_i);
+    DLOG("  WHO_AM_I: 0x%02x", who_am_i);
 
     // Reset device
     //
@@ -20,8 +20,13 @@
 #include "dma_io_driver.h"
 #include "rc_input.h"
 #include "gpn_foo.h"
+#include "telemetry.h"
+#include "blackbox.h"
+#include "msg_packet.h"
+#include "dlog.h"
 #include <stdio.h>
 #include <unistd.h>
+#include <fcntl.h>
 
 #include "matrix3f.h"
 
@@ -32,6 +37,10 @@ static TaskHandle_t shell_handle;
 static TaskHandle_t usb_handle;
 static TaskHandle_t bldc_handle;
 static TaskHandle_t flight_handle;
+static TaskHandle_t telemetry_handle;
+static TaskHandle_t blackbox_handle;
+static TaskHandle_t msg_tx_handle;
+static TaskHandle_t dlog_handle;
 
 static void init_task(void *pvParameters)
 {
@@ -39,6 +48,21 @@ static void init_task(void *pvParameters)
     board_set_leds(LED_RED);
 
     xbee_init();
+    msg_init();
+
+    // Standard file descriptors for all tasks
+    //
+    int fd = open("/dev/xbee", O_RDWR);
+    dup2(fd, STDIN_FILENO);
+    dup2(fd, STDOUT_FILENO);
+    dup2(fd, STDERR_FILENO);
+    if (fd > STDERR_FILENO)
+        close(fd);
+
+    dlog_init();
+
+    xTaskCreate(msg_tx_task, "msg_tx", 512, NULL, 1, &msg_tx_handle);
+    xTaskCreate(dlog_task, "dlog", 256, NULL, 0, &dlog_handle);
 
     printf("\n");
     print_version_info(0);
@@ -75,22 +99,27 @@ static void init_task(void *pvParameters)
     xTaskCreate(flight_ctrl, "flight_ctrl", 1024, NULL, 1, &flight_handle);
     vTaskDelay(100);
 
+    printf("Starting telemetry task..\n");
+    xTaskCreate(telemetry_task, "telemetry", 512, NULL, 1, &telemetry_handle);
+    vTaskDelay(100);
+
+    printf("Starting blackbox task..\n");
+    xTaskCreate(blackbox_task, "blackbox", 512, NULL, 0, &blackbox_handle);
+    vTaskDelay(100);
+
     printf("Starting USB shell task..\n");
     term_usb_init();
 
 
     // passed by reference. must be static.
-    static struct shell_params shell_params = {
-        .fd_stdin  = FD_DEV_USB | STDIN_FILENO,
-        .fd_stdout = FD_DEV_USB | STDOUT_FILENO,
-        .fd_stderr = FD_DEV_USB | STDERR_FILENO
-    };
+    static struct shell_params usb_shell_params  = { .path = "/dev/usb"  };
+    static struct shell_params uart_shell_params = { .path = "/dev/xbee" };
 
-    xTaskCreate(shell_task, "usb_shell", 1024, &shell_params, 0, &usb_handle);
+    xTaskCreate(shell_task, "usb_shell", 1024, &usb_shell_params, 0, &usb_handle);
     vTaskDelay(100);
 
     printf("Starting serial shell task..\n");
-    xTaskCreate(shell_task, "uart_shell", 1024, NULL, 0, &shell_handle);
+    xTaskCreate(shell_task, "uart_shell", 1024, &uart_shell_params, 0, &shell_handle);
     vTaskDelay(100);
 
 //    printf("Starting GPN special blinky foo..\n");
@@ -0,0 +1,455 @@
+/**
+ * \file
+ * Outgoing message multiplexer
+ *
+ * All outgoing data, including shell text, is sent as packets. msg_send()
+ * puts a message into the queue of its class, and msg_tx_task() sends
+ * them in order of priority. Control messages always go first, telemetry
+ * and bulk data share the remaining bandwidth by weighted round-robin.
+ * A flood of shell output can therefore not delay time-critical messages.
+ *
+ * Each class can be protected by forward error correction (see fec.h).
+ * The parity messages are sent right after the last message of each
+ * group, so the ground station can rebuild lost messages without a
+ * retransmission. Messages that are too long for the selected group
+ * size are sent unprotected, see msg_max_data_size().
+ *
+ * Every MSG_SYNC_INTERVAL, a MSG_ID_NOP with the vehicle clock is
+ * written directly, bypassing the queues. The ground station uses it
+ * to map telemetry timestamps to its own clock.
+ *
+ */
+#include "msg_packet.h"
+#include "term_xbee.h"
+#include "ustime.h"
+#include "util.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+#include "semphr.h"
+#include <string.h>
+
+#include "Shared/crc16.h"
+#include "Shared/cobsr.h"
+#include "Shared/errors.h"
+#include "Shared/fec.h"
+
+// Start-of-packet + COBSR(CRC + ID + MSG_MAX_DATA_SIZE) + End-of-packet
+//
+#define MAX_BUF_LENGTH  \
+    ( 1 + COBSR_ENCODE_DST_BUF_LEN_MAX(2 + 2 + MSG_MAX_DATA_SIZE) + 1 )
+
+#define MSG_SYNC_INTERVAL   250     // [ms]
+
+
+static struct msg_queue {
+    const char  *name;
+    int         depth;          // queue length [messages]
+    TickType_t  timeout;        // how long msg_send() waits for space
+    int         weight;         // round-robin share, 0 = strict priority
+
+    // FEC group size, changed by the shell. Applied by
+    // msg_tx_task(), which owns the encoder.
+    //
+    volatile int fec_k, fec_m;
+    struct fec_encoder fec;
+
+    QueueHandle_t queue;
+    int         credit;
+
+    volatile uint32_t tx_packets;
+    volatile uint32_t tx_bytes;
+    volatile uint32_t tx_parity;
+    volatile uint32_t dropped;
+} queues[MSG_NUM_CLASSES] = {
+    [MSG_CLASS_CONTROL]   = { "control",   4, portMAX_DELAY, 0 },
+    [MSG_CLASS_TELEMETRY] = { "telemetry", 8, 0,             4 },
+    [MSG_CLASS_BULK]      = { "bulk",      8, portMAX_DELAY, 1 }
+};
+
+static SemaphoreHandle_t tx_pending;
+
+static volatile uint32_t link_rate;     // [bytes/s]
+
+
+/**
+ * Calculate CRC header field over ID and data
+ *
+ */
+static crc16_t msg_calc_crc(const struct msg_header *msg)
+{
+    crc16_t crc = crc16_init();
+    crc = crc16_update(crc, (uint8_t*)&msg->id, 2 + msg->data_len);
+    crc = crc16_finalize(crc);
+    return crc;
+}
+
+
+static enum msg_class msg_get_class(uint16_t id)
+{
+    switch (id) {
+    case MSG_ID_NOP:
+    case MSG_ID_BOOT_RESPONSE:
+        return MSG_CLASS_CONTROL;
+
+    case MSG_ID_IMU_DATA:
+    case MSG_ID_IMU_DATA_DELTA:
+        return MSG_CLASS_TELEMETRY;
+
+    default:
+        return MSG_CLASS_BULK;
+    }
+}
+
+
+/**
+ * Encode a message and write it to the XBee link.
+ *
+ * The packet is preceded by an additional end-of-packet marker, so
+ * the receiver discards any garbage that was sent before.
+ *
+ * \return  number of bytes written, -1 on error
+ */
+static int msg_write(struct msg_header *msg)
+{
+    uint8_t tx_buf[MAX_BUF_LENGTH];
+
+    msg->crc = msg_calc_crc(msg);
+
+    int res = cobsr_encode(
+        tx_buf + 1, sizeof(tx_buf) - 2,     // 2 bytes for packet markers
+        &msg->crc, 2 + 2 + msg->data_len    // +CRC +ID
+    );
+
+    if (res < 0)
+        return -1;
+
+    // add start- and end-of-packet markers
+    //
+    tx_buf[0] = 0;
+    tx_buf[1 + res] = 0;
+    xbee_write_raw(tx_buf, 1 + res + 1);
+
+    return 1 + res + 1;
+}
+
+
+/**
+ * Largest payload for a message id.
+ *
+ * This is less than MSG_MAX_DATA_SIZE if the message class is protected
+ * by FEC. Longer messages are still sent, but without protection.
+ *
+ */
+int msg_max_data_size(uint16_t id)
+{
+    int k = queues[msg_get_class(id)].fec_k;
+
+    return k ? FEC_MAX_DATA_SIZE(k) : MSG_MAX_DATA_SIZE;
+}
+
+
+/**
+ * Add a sent message to the FEC group of its class and
+ * send the parity messages when the group is complete.
+ *
+ * \return  number of bytes written
+ */
+static int msg_protect(struct msg_queue *q, const struct msg_header *msg)
+{
+    if (q->fec.k != q->fec_k || q->fec.m != q->fec_m)
+        fec_encoder_init(&q->fec, q->fec_k, q->fec_m);
+
+    int n = fec_encode(&q->fec, msg);
+    int bytes = 0;
+
+    for (int j=0; j<n; j++) {
+        struct msg_fec_parity p;
+        fec_get_parity(&q->fec, j, &p);
+
+        int len = msg_write(&p.h);
+        if (len >= 0) {
+            q->tx_parity++;
+            bytes += len;
+        }
+    }
+
+    return bytes;
+}
+
+
+/**
+ * Queue a message for sending.
+ *
+ * Telemetry messages are dropped if their queue is full,
+ * all other classes wait for space.
+ *
+ * \return  msg->data_len on success, -1 on error
+ */
+int msg_send(struct msg_header *msg)
+{
+    struct msg_generic m;
+
+    if (msg->data_len > MSG_MAX_DATA_SIZE) {
+        errno = EMSG_TOO_LONG;
+        return -1;
+    }
+
+    memcpy(&m, msg, sizeof(struct msg_header) + msg->data_len);
+
+    struct msg_queue *q = &queues[msg_get_class(msg->id)];
+
+    if (!xQueueSend(q->queue, &m, q->timeout)) {
+        q->dropped++;
+        errno = ENOBUFS;
+        return -1;
+    }
+
+    xSemaphoreGive(tx_pending);
+    return msg->data_len;
+}
+
+
+/**
+ * Select the queue to send from.
+ *
+ */
+static struct msg_queue *next_queue(void)
+{
+    static int rr;
+
+    // Strict priority classes
+    //
+    for (int i=0; i<MSG_NUM_CLASSES; i++) {
+        if (!queues[i].weight && uxQueueMessagesWaiting(queues[i].queue))
+            return &queues[i];
+    }
+
+    // Weighted round-robin for the rest
+    //
+    for (int n=0; n < 2*MSG_NUM_CLASSES; n++) {
+        struct msg_queue *q = &queues[rr];
+
+        if (q->weight && q->credit > 0 && uxQueueMessagesWaiting(q->queue)) {
+            q->credit--;
+            return q;
+        }
+
+        q->credit = q->weight;
+        rr = (rr + 1) % MSG_NUM_CLASSES;
+    }
+
+    return NULL;
+}
+
+
+/**
+ * Send the vehicle clock for time synchronization.
+ *
+ * \return  number of bytes written, -1 on error
+ */
+static int msg_write_sync(void)
+{
+    struct msg_nop msg;
+
+    msg.h.id       = MSG_ID_NOP;
+    msg.h.data_len = 8;
+    msg.time       = get_us_time64();
+
+    return msg_write(&msg.h);
+}
+
+
+void msg_tx_task(void *pvParameters)
+{
+    TickType_t t_rate = xTaskGetTickCount();
+    TickType_t t_sync = t_rate;
+    uint32_t   bytes = 0;
+
+    for (;;) {
+        if (xSemaphoreTake(tx_pending, 100)) {
+            struct msg_queue *q = next_queue();
+            struct msg_generic m;
+
+            if (q && xQueueReceive(q->queue, &m, 0)) {
+                int len = msg_write(&m.h);
+                if (len >= 0) {
+                    len += msg_protect(q, &m.h);
+                    q->tx_packets++;
+                    q->tx_bytes += len;
+                    bytes += len;
+                }
+            }
+        }
+
+        // Clock sync, at most 100 ticks late
+        //
+        if (xTaskGetTickCount() - t_sync >= MSG_SYNC_INTERVAL * configTICK_RATE_HZ / 1000) {
+            t_sync = xTaskGetTickCount();
+
+            struct msg_queue *q = &queues[MSG_CLASS_CONTROL];
+            int len = msg_write_sync();
+            if (len >= 0) {
+                q->tx_packets++;
+                q->tx_bytes += len;
+                bytes += len;
+            }
+        }
+
+        // Link utilization, averaged over one second
+        //
+        if (xTaskGetTickCount() - t_rate >= configTICK_RATE_HZ) {
+            t_rate += configTICK_RATE_HZ;
+            link_rate = bytes;
+            bytes = 0;
+        }
+    }
+}
+
+
+void msg_init(void)
+{
+    for (int i=0; i<MSG_NUM_CLASSES; i++) {
+        if (!queues[i].queue)
+            queues[i].queue = xQueueCreate(queues[i].depth, sizeof(struct msg_generic));
+    }
+
+    if (!tx_pending) {
+        int n = 0;
+        for (int i=0; i<MSG_NUM_CLASSES; i++)
+            n += queues[i].depth;
+
+        tx_pending = xSemaphoreCreateCounting(n, 0);
+    }
+}
+
+
+// -------------------- Shell commands --------------------
+//
+#include "command.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static void cmd_msg_stats(void)
+{
+    printf("class        packets      bytes    dropped  queued\n");
+
+    for (int i=0; i<MSG_NUM_CLASSES; i++) {
+        struct msg_queue *q = &queues[i];
+
+        printf("%-9s %10lu %10lu %10lu  %6lu\n",
+            q->name, q->tx_packets, q->tx_bytes, q->dropped,
+            uxQueueMessagesWaiting(q->queue)
+        );
+    }
+
+    // 10 bits per byte (8N1)
+    //
+    printf("\nlink: %lu bytes/s, %lu%% of %d baud\n",
+        link_rate, link_rate * 10 * 100 / XBEE_BAUDRATE, XBEE_BAUDRATE
+    );
+}
+
+SHELL_CMD(msg_stats, (cmdfunc_t)cmd_msg_stats, "show outgoing message statistics")
+
+
+static void cmd_msg_fec(int argc, char *argv[])
+{
+    if (argc == 1) {
+        printf("class      k  m   parity  max_data\n");
+
+        for (int i=0; i<MSG_NUM_CLASSES; i++) {
+            struct msg_queue *q = &queues[i];
+
+            printf("%-9s %2d %2d %8lu  %8d\n",
+                q->name, q->fec_k, q->fec_m, q->tx_parity,
+                q->fec_k ? FEC_MAX_DATA_SIZE(q->fec_k) : MSG_MAX_DATA_SIZE
+            );
+        }
+        return;
+    }
+
+    if (argc != 2 && argc != 4)
+        goto usage;
+
+    struct msg_queue *q = NULL;
+    for (int i=0; i<MSG_NUM_CLASSES; i++) {
+        if (!strcmp(argv[1], queues[i].name))
+            q = &queues[i];
+    }
+
+    if (!q)
+        goto usage;
+
+    if (argc == 2) {
+        q->fec_k = 0;
+        q->fec_m = 0;
+        return;
+    }
+
+    int k = atoi(argv[2]);
+    int m = atoi(argv[3]);
+
+    if (k < 1 || k > FEC_MAX_K || m < 1 || m > FEC_MAX_M) {
+        printf("k must be 1..%d, m must be 1..%d\n", FEC_MAX_K, FEC_MAX_M);
+        return;
+    }
+
+    q->fec_k = k;
+    q->fec_m = m;
+    return;
+
+usage:
+    printf("usage: %s [<class> [<k> <m>]]\n", argv[0]);
+    printf("  protect groups of k messages with m parity messages\n");
+    printf("  omit k and m to disable\n");
+}
+
+SHELL_CMD(msg_fec, (cmdfunc_t)cmd_msg_fec, "configure forward error correction")
+
+
+/**
+ * Send a stream of MSG_ID_BENCH_DATA through the bulk queue, so
+ * the ground station can measure the goodput of the whole path.
+ *
+ */
+static void cmd_msg_bench(int argc, char *argv[])
+{
+    if (argc != 2 && argc != 3)
+        goto usage;
+
+    struct msg_bench_data msg;
+
+    int count = atoi(argv[1]);
+    int size  = argc == 3 ? atoi(argv[2]) : MSG_MAX_DATA_SIZE;
+
+    if (count < 1 || size < 4 || size > MSG_MAX_DATA_SIZE)
+        goto usage;
+
+    msg.h.id       = MSG_ID_BENCH_DATA;
+    msg.h.data_len = size;
+
+    for (int i=0; i<size-4; i++)
+        msg.data[i] = i;
+
+    TickType_t t0 = xTaskGetTickCount();
+
+    for (int seq=0; seq<count; seq++) {
+        msg.seq = seq;
+        msg_send(&msg.h);
+    }
+
+    TickType_t dt = xTaskGetTickCount() - t0;
+
+    printf("%d messages queued in %lu ms, %lu bytes/s\n",
+        count, dt * 1000 / configTICK_RATE_HZ,
+        dt ? (uint32_t)count * size * configTICK_RATE_HZ / dt : 0
+    );
+    return;
+
+usage:
+    printf("usage: %s <count> [<size>]\n", argv[0]);
+    printf("  size is 4..%d bytes\n", MSG_MAX_DATA_SIZE);
+}
+
+SHELL_CMD(msg_bench, (cmdfunc_t)cmd_msg_bench, "send link benchmark data")
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <unistd.h>
+#include "Shared/msg_structs.h"
+
+// Outgoing message classes, highest priority first
+//
+enum msg_class {
+    MSG_CLASS_CONTROL,          // acks, keep-alive. Always sent first.
+    MSG_CLASS_TELEMETRY,        // dropped if the link can't keep up
+    MSG_CLASS_BULK,             // shell output, downloads. Blocks the sender.
+
+    MSG_NUM_CLASSES
+};
+
+void msg_init(void);
+int  msg_send(struct msg_header *msg);
+int  msg_max_data_size(uint16_t id);
+void msg_tx_task(void *pvParameters);
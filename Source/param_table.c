@@ -3,6 +3,7 @@
 #include "bldc_driver.h"
 #include "bldc_task.h"
 #include "debug_dac.h"
+#include "scope.h"
 #include "rc_input.h"
 #include "rc_ppm.h"
 #include "dma_io_driver.h"
@@ -19,7 +20,8 @@ const struct param_info  param_table[] = {
 
     {   32, P_INT32(&bldc_params.polepairs, 7, 1, 20 ),
             .name = "Polepairs",
-            .help = "Number of motor pole pairs"
+            .help = "Number of motor pole pairs",
+            .on_change = bldc_params_changed
     },
 
     {   38, P_FLOAT(&bldc_params.K_v, 700, 0,  10000 ),
@@ -44,7 +46,8 @@ const struct param_info  param_table[] = {
 
     {  100, P_FLOAT(&bldc_params.dudt_max, 25, 1, 1000),
             .name = "dudt_max", .unit = "V/s",
-            .help = "Maximum slew rate of the motor voltage"
+            .help = "Maximum slew rate of the motor voltage",
+            .on_change = bldc_params_changed
     },
 
     {  102, P_FLOAT(&bldc_params.u_bat_min,  9.0, 6, 18),
@@ -98,15 +101,25 @@ const struct param_info  param_table[] = {
 
     {  300, P_FLOAT(&pid_p, 1, 0 , 10),
        .name = "pid_p",
-       .help = "all gyro PID P Part"
+       .help = "all gyro PID P Part",
+       .on_change = flight_ctrl_gains_changed
     },
     {  301, P_FLOAT(&pid_i, 0, 0, 10),
        .name = "pid_i",
-       .help = "all gyro PID I Part"
+       .help = "all gyro PID I Part",
+       .on_change = flight_ctrl_gains_changed
     },
     {  302, P_FLOAT(&pid_d, 0, 0, 10),
        .name = "pid_d",
-       .help = "all gyro PID D Part"
+       .help = "all gyro PID D Part",
+       .on_change = flight_ctrl_gains_changed
+    },
+    {  303, P_INT32(&fc_state, 0, 0, 3), NOEEPROM,
+       .name = "fc_state",
+       .help = "Flight control mode\n"
+               "  bit 0: use pid_p, pid_i and pid_d for all axes\n"
+               "  bit 1: attitude control without RC switch\n",
+       .on_change = flight_ctrl_gains_changed
     },
 
 
@@ -163,12 +176,14 @@ const struct param_info  param_table[] = {
     //
     {  410, P_INT32(&dac_config.dac1_id, 1020),
             .name = "dac1_id",
-            .help = "Parameter ID for DAC channel 1"
+            .help = "Parameter ID for DAC channel 1",
+            .on_change = debug_dac_config_changed
     },
 
     {  411, P_FLOAT(&dac_config.dac1_scale, 5),
             .name = "dac1_scale" , .unit = "Units/V",
-            .help = "Scale factor for DAC channel 1"
+            .help = "Scale factor for DAC channel 1",
+            .on_change = debug_dac_config_changed
     },
 
     {  412, P_FLOAT(&dac_config.dac1_offset, 0),
@@ -178,12 +193,14 @@ const struct param_info  param_table[] = {
 
     {  420, P_INT32(&dac_config.dac2_id, 1021),
             .name = "dac2_id",
-            .help = "Parameter ID for DAC channel 2"
+            .help = "Parameter ID for DAC channel 2",
+            .on_change = debug_dac_config_changed
     },
 
     {  421, P_FLOAT(&dac_config.dac2_scale, 5),
             .name = "dac2_scale" , .unit = "Units/V",
-            .help = "Scale factor for DAC channel 1"
+            .help = "Scale factor for DAC channel 1",
+            .on_change = debug_dac_config_changed
     },
 
     {  422, P_FLOAT(&dac_config.dac2_offset, 0),
@@ -191,6 +208,66 @@ const struct param_info  param_table[] = {
             .help = "Offset for DAC channel 1"
     },
 
+    {  430, P_INT32(&scope_config.ch_id[0], 1020),
+            .name = "scope.ch1_id",
+            .help = "Parameter ID for scope channel 1"
+    },
+
+    {  431, P_INT32(&scope_config.ch_id[1], 1021),
+            .name = "scope.ch2_id",
+            .help = "Parameter ID for scope channel 2 (0 = off)"
+    },
+
+    {  432, P_INT32(&scope_config.ch_id[2], 1022),
+            .name = "scope.ch3_id",
+            .help = "Parameter ID for scope channel 3 (0 = off)"
+    },
+
+    {  433, P_INT32(&scope_config.ch_id[3], 0),
+            .name = "scope.ch4_id",
+            .help = "Parameter ID for scope channel 4 (0 = off)"
+    },
+
+    {  434, P_INT32(&scope_config.source, SCOPE_SOURCE_BLDC, 0, 1),
+            .name = "scope.source",
+            .help = "Sample source: 0 = control loop (1 kHz), 1 = BLDC interrupt (20 kHz)"
+    },
+
+    {  435, P_INT32(&scope_config.interval, 0, 0, 100000),
+            .name = "scope.interval",
+            .help = "Number of skipped samples between two recorded samples"
+    },
+
+    {  436, P_INT32(&scope_config.num_samples, 1024, 1, 8192),
+            .name = "scope.num_samples",
+            .help = "Number of samples per capture"
+    },
+
+    {  440, P_INT32(&scope_config.trig_mode, TRIG_MODE_RISE, 0, 3),
+            .name = "scope.trig_mode",
+            .help = "Trigger mode: 0 = manual, 1 = rising, 2 = falling, 3 = both edges"
+    },
+
+    {  441, P_INT32(&scope_config.trig_channel, 0, 0, SCOPE_MAX_CHANNELS-1),
+            .name = "scope.trig_channel",
+            .help = "Trigger channel (0 = ch1)"
+    },
+
+    {  442, P_FLOAT(&scope_config.trig_level, 0),
+            .name = "scope.trig_level", .unit = "Units",
+            .help = "Trigger level"
+    },
+
+    {  443, P_INT32(&scope_config.trig_auto, 0, 0, INT_MAX),
+            .name = "scope.trig_auto",
+            .help = "Auto trigger timeout in samples (0 = off)"
+    },
+
+    {  444, P_INT32(&scope_config.trig_offset, 100, -100000, 8192),
+            .name = "scope.trig_offset",
+            .help = "Number of samples recorded before the trigger"
+    },
+
     {  500, P_INT32(&ws2812_brightness, 128, 0, 255),
             .name = "ws2812_brightness",
             .help = "Overall brightness for WS2128 leds. Adjust this parameter "
@@ -3,6 +3,7 @@
 #include "stm32f4xx.h"
 #include "watchdog.h"
 #include <stdio.h>
+#include <stdbool.h>
 #include <string.h>
 #include <math.h>
 #include <assert.h>
@@ -50,6 +51,34 @@ const struct param_info *param_get_info(int id)
 }
 
 
+/**
+ * Resolve a parameter reference.
+ *
+ * Unknown ids are mapped to a dummy value of 0, so
+ * param_ref_get_*() can always be used without checks.
+ *
+ */
+param_error param_ref_init(struct param_ref *r, int id)
+{
+    static int32_t dummy_null;
+
+    const struct param_info *p = param_get_info(id);
+
+    r->id = id;
+
+    if (!p) {
+        r->type = PTYPE_INT32;
+        r->ptr  = &dummy_null;
+        return PERR_UNKNOWN_ID;
+    }
+
+    r->type = p->type;
+    r->ptr  = (p->type == PTYPE_FLOAT) ? (void*)p->flt.ptr : (void*)p->i32.ptr;
+
+    return PERR_OK;
+}
+
+
 /**
  * Get parameter value by id.
  *
@@ -73,35 +102,125 @@ param_error param_get(int id, double *value)
 
 
 /**
- * Set parameter value by id.
+ * Check and store a new value.
+ *
+ * The range checks are done in the parameter's own type. Float
+ * values that can't be represented as int32 are rejected.
  *
- * \note  double is used here because it can represent
- *        the full range of float and int32_t values.
  */
-param_error param_set(int id, double value)
+static param_error param_store(const struct param_info *p, float f, int32_t i, bool is_float)
 {
-    const struct param_info *p = param_get_info(id);
-
-    if (!p)
-        return PERR_UNKNOWN_ID;
-
     if (p->readonly)
         return PERR_READONLY;
 
     if (p->type == PTYPE_FLOAT) {
-        if (value < p->flt.min || value > p->flt.max)
+        if (!is_float)
+            f = i;
+
+        if (f < p->flt.min || f > p->flt.max)
             return PERR_INVALID_VALUE;
-        *p->flt.ptr = value;
+
+        *p->flt.ptr = f;
     }
     else {
-        if (value < p->i32.min || value > p->i32.max)
+        if (is_float) {
+            if (!(f >= -2147483648.0f && f < 2147483648.0f))
+                return PERR_INVALID_VALUE;
+            i = f;
+        }
+
+        if (i < p->i32.min || i > p->i32.max)
             return PERR_INVALID_VALUE;
-        *p->i32.ptr = value;
+
+        *p->i32.ptr = i;
     }
+
+    if (p->on_change)
+        p->on_change(p);
+
     return PERR_OK;
 }
 
 
+/**
+ * Typed get and set functions.
+ *
+ * These work without double arithmetic, which is emulated
+ * in software on the Cortex-M4F.
+ *
+ */
+param_error param_get_float(int id, float *value)
+{
+    struct param_ref r;
+    param_error err = param_ref_init(&r, id);
+
+    if (err == PERR_OK)
+        *value = param_ref_get_float(&r);
+
+    return err;
+}
+
+
+param_error param_get_int32(int id, int32_t *value)
+{
+    struct param_ref r;
+    param_error err = param_ref_init(&r, id);
+
+    if (err == PERR_OK)
+        *value = param_ref_get_int32(&r);
+
+    return err;
+}
+
+
+param_error param_set_float(int id, float value)
+{
+    const struct param_info *p = param_get_info(id);
+
+    if (!p)
+        return PERR_UNKNOWN_ID;
+
+    return param_store(p, value, 0, true);
+}
+
+
+param_error param_set_int32(int id, int32_t value)
+{
+    const struct param_info *p = param_get_info(id);
+
+    if (!p)
+        return PERR_UNKNOWN_ID;
+
+    return param_store(p, 0, value, false);
+}
+
+
+/**
+ * Set parameter value by id.
+ * The on_change callback is called if the value was stored successfully.
+ *
+ * \note  double is used here because it can represent
+ *        the full range of float and int32_t values.
+ */
+param_error param_set(int id, double value)
+{
+    const struct param_info *p = param_get_info(id);
+
+    if (!p)
+        return PERR_UNKNOWN_ID;
+
+    if (p->type == PTYPE_FLOAT)
+        return param_store(p, value, 0, true);
+
+    // A float would lose the low bits of large values
+    //
+    if (!(value >= INT32_MIN && value <= INT32_MAX))
+        return p->readonly ? PERR_READONLY : PERR_INVALID_VALUE;
+
+    return param_store(p, 0, value, false);
+}
+
+
 void param_set_defaults(void)
 {
     for (int i=0; i<param_count; i++) {
@@ -110,9 +229,9 @@ void param_set_defaults(void)
             continue;
 
         if (p->type == PTYPE_FLOAT)
-            param_set(p->id, p->flt.def);
+            param_set_float(p->id, p->flt.def);
         else
-            param_set(p->id, p->i32.def);
+            param_set_int32(p->id, p->i32.def);
     }
 }
 
@@ -164,9 +283,9 @@ void param_load(void)
 
         if (p != NULL) {
             if (p->type == PTYPE_FLOAT)
-                err = param_set(p->id, *(float*)(addr + 4));
+                err = param_set_float(p->id, *(float*)(addr + 4));
             else
-                err = param_set(p->id, *(int32_t*)(addr + 4));
+                err = param_set_int32(p->id, *(int32_t*)(addr + 4));
         }
 
         if (err != PERR_OK)
@@ -341,9 +460,73 @@ usage:
 }
 
 
+static void cmd_param_bench(int argc, char *argv[])
+{
+    enum { N = 1000 };
+
+    int id = 1040;
+
+    if (argc > 2)
+        goto usage;
+
+    if (argc == 2) {
+        char *endp;
+        id = strtol(argv[1], &endp, 0);
+        if (*endp)
+            goto usage;
+    }
+
+    struct param_ref r;
+    if (param_ref_init(&r, id) != PERR_OK) {
+        printf("%d: %s\n", id, param_strerr(PERR_UNKNOWN_ID));
+        return;
+    }
+
+    volatile double d_sink;
+    volatile float  f_sink;
+    uint16_t t0, t1, t2, t3;
+
+    // TIM7 is a 16 bit microsecond timer, so each
+    // measurement must not take longer than 65 ms.
+    //
+    t0 = TIM7->CNT;
+    for (int i=0; i<N; i++) {
+        double d;
+        param_get(id, &d);
+        d_sink = d;
+    }
+
+    t1 = TIM7->CNT;
+    for (int i=0; i<N; i++) {
+        float f;
+        param_get_float(id, &f);
+        f_sink = f;
+    }
+
+    t2 = TIM7->CNT;
+    for (int i=0; i<N; i++)
+        f_sink = param_ref_get_float(&r);
+
+    t3 = TIM7->CNT;
+
+    (void)d_sink;
+    (void)f_sink;
+
+    printf("param %d, %d reads:\n", id, N);
+    printf("  param_get()            %6u us\n", (uint16_t)(t1 - t0));
+    printf("  param_get_float()      %6u us\n", (uint16_t)(t2 - t1));
+    printf("  param_ref_get_float()  %6u us\n", (uint16_t)(t3 - t2));
+    return;
+
+usage:
+    printf("usage: %s [id]\n", argv[0]);
+}
+
+
 SHELL_CMD(gp,           (cmdfunc_t)cmd_gp,              "Get parameter"   )
 SHELL_CMD(sp,           (cmdfunc_t)cmd_sp,              "Set parameter"   )
 SHELL_CMD(param_reset,  (cmdfunc_t)param_set_defaults,  "Reset to defaults" )
 SHELL_CMD(param_load,   (cmdfunc_t)param_load,          "Load parameters" )
 SHELL_CMD(param_save,   (cmdfunc_t)param_save,          "Save parameters" )
 SHELL_CMD(param_clear,  (cmdfunc_t)param_clear,         "Clear parameters")
+SHELL_CMD(param_bench,  (cmdfunc_t)cmd_param_bench,     "Benchmark parameter access")
@@ -50,6 +50,18 @@ typedef enum {
 } param_type;
 
 
+struct param_info;
+
+/**
+ * Change notification, called by param_set() after a new value
+ * has been stored. Use this to recalculate derived values (filter
+ * coefficients, reciprocals, ..) instead of polling the parameter.
+ *
+ * \note  The callback runs in the context of the caller of param_set().
+ */
+typedef void (*param_cb)(const struct param_info *p);
+
+
 struct param_info {
     int         id;
 
@@ -71,14 +83,56 @@ struct param_info {
     const char *name;
     const char *unit;
     const char *help;
+
+    param_cb    on_change;
+};
+
+
+/**
+ * Pre-resolved parameter reference.
+ *
+ * Resolve the id once with param_ref_init(), then use param_ref_get_*()
+ * on hot paths (ISRs, telemetry samplers). This avoids the table lookup
+ * and the soft-float double conversion of param_get().
+ *
+ */
+struct param_ref {
+    int         id;
+    param_type  type;
+    void        *ptr;
 };
 
 
+static inline float param_ref_get_float(const struct param_ref *r)
+{
+    if (r->type == PTYPE_FLOAT)
+        return *(volatile float*)r->ptr;
+    else
+        return *(volatile int32_t*)r->ptr;
+}
+
+
+static inline int32_t param_ref_get_int32(const struct param_ref *r)
+{
+    if (r->type == PTYPE_FLOAT)
+        return *(volatile float*)r->ptr;
+    else
+        return *(volatile int32_t*)r->ptr;
+}
+
+
 const struct param_info *param_get_info(int id);
 
+param_error param_ref_init(struct param_ref *r, int id);
+
 param_error param_get(int id, double *value);
 param_error param_set(int id, double  value);
 
+param_error param_get_float(int id, float   *value);
+param_error param_get_int32(int id, int32_t *value);
+param_error param_set_float(int id, float   value);
+param_error param_set_int32(int id, int32_t value);
+
 void param_set_defaults(void);
 
 const char *param_strerr(param_error error);
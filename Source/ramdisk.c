@@ -0,0 +1,79 @@
+/**
+ * \file
+ * FatFs disk driver for a RAM disk in the CCM RAM
+ *
+ * The board has no permanent storage yet. The otherwise unused
+ * CCM RAM is used as drive 0, so the blackbox logger can be run
+ * and benchmarked. Replace this file with an SD card driver once
+ * one is fitted.
+ *
+ */
+#include "diskio.h"
+#include <stdint.h>
+#include <string.h>
+
+#define SECTOR_SIZE     512
+
+// Defined in the linker script (rest of CCMRAM)
+//
+extern uint8_t _ramdisk_start[], _ramdisk_end[];
+
+#define RAMDISK_SECTORS  ((DWORD)(_ramdisk_end - _ramdisk_start) / SECTOR_SIZE)
+
+
+DSTATUS disk_initialize(BYTE pdrv)
+{
+    return disk_status(pdrv);
+}
+
+
+DSTATUS disk_status(BYTE pdrv)
+{
+    return pdrv == 0 ? 0 : STA_NOINIT;
+}
+
+
+DRESULT disk_read(BYTE pdrv, BYTE *buff, DWORD sector, UINT count)
+{
+    if (pdrv != 0 || sector + count > RAMDISK_SECTORS)
+        return RES_PARERR;
+
+    memcpy(buff, &_ramdisk_start[sector * SECTOR_SIZE], count * SECTOR_SIZE);
+    return RES_OK;
+}
+
+
+DRESULT disk_write(BYTE pdrv, const BYTE *buff, DWORD sector, UINT count)
+{
+    if (pdrv != 0 || sector + count > RAMDISK_SECTORS)
+        return RES_PARERR;
+
+    memcpy(&_ramdisk_start[sector * SECTOR_SIZE], buff, count * SECTOR_SIZE);
+    return RES_OK;
+}
+
+
+DRESULT disk_ioctl(BYTE pdrv, BYTE cmd, void *buff)
+{
+    if (pdrv != 0)
+        return RES_PARERR;
+
+    switch (cmd) {
+    case CTRL_SYNC:
+        return RES_OK;
+
+    case GET_SECTOR_COUNT:
+        *(DWORD*)buff = RAMDISK_SECTORS;
+        return RES_OK;
+
+    case GET_SECTOR_SIZE:
+        *(WORD*)buff = SECTOR_SIZE;
+        return RES_OK;
+
+    case GET_BLOCK_SIZE:
+        *(DWORD*)buff = 1;
+        return RES_OK;
+    }
+
+    return RES_PARERR;
+}
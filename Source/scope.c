@@ -0,0 +1,383 @@
+/**
+ * \file
+ * Software oscilloscope
+ *
+ * Records up to SCOPE_MAX_CHANNELS parameters into a RAM buffer,
+ * with pre-trigger, edge and auto triggering. Sampling is done by
+ * scope_update(), called from the BLDC interrupt (20 kHz) or the
+ * flight control loop (1 kHz).
+ *
+ * The channels, trigger and timebase are set up with the scope.*
+ * parameters and applied by "scope arm". The capture can be shown
+ * as text or downloaded as MSG_ID_SCOPE_DATA packets.
+ *
+ */
+#include "scope.h"
+#include "bldc_driver.h"
+#include "util.h"
+#include "FreeRTOS.h"
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <errno.h>
+
+struct scope_config scope_config;
+
+static struct scope scope;
+
+
+static void update_channel(struct scope *s, int i)
+{
+    struct scope_channel *c = &s->channels[i];
+
+    c->value = param_ref_get_float(&c->ref);
+}
+
+
+static void update_trigger(struct scope *s)
+{
+    float trig_value = s->channels[s->trig_channel].value;
+
+    if (s->trig_state == TRIG_STATE_PRE && !s->_interval_delay) {
+        if (s->_pre_delay)
+            s->_pre_delay--;
+        else
+            s->trig_state = TRIG_STATE_WAIT;
+    }
+
+    if (s->trig_state == TRIG_STATE_WAIT) {
+        // Manual trigger
+        //
+        bool trigged = s->_trig_manual;
+
+        // Edge trigger
+        //
+        bool rise = (s->_trig_value_old < s->trig_level) && (trig_value >= s->trig_level);
+        bool fall = (s->_trig_value_old > s->trig_level) && (trig_value <= s->trig_level);
+
+        switch (s->trig_mode) {
+        case TRIG_MODE_RISE:  trigged |= rise;           break;
+        case TRIG_MODE_FALL:  trigged |= fall;           break;
+        case TRIG_MODE_BOTH:  trigged |= rise || fall;   break;
+        default: break;
+        }
+
+        // Auto trigger
+        //
+        if (s->trig_auto && !s->_interval_delay) {
+            if (s->_auto_delay)
+                s->_auto_delay--;
+            else
+                trigged = 1;
+        }
+
+        if (trigged)
+            s->trig_state = TRIG_STATE_POST;
+    }
+
+    s->_trig_value_old = trig_value;
+
+    if (s->trig_state == TRIG_STATE_POST && !s->_interval_delay) {
+        if (s->_post_delay)
+            s->_post_delay--;
+        else
+            s->trig_state = TRIG_STATE_STOP;
+    }
+}
+
+
+void scope_exec(struct scope *s)
+{
+    // Update channels
+    //
+    for (int i=0; i < s->num_channels; i++)
+        update_channel(s, i);
+
+    // Check trigger condition
+    //
+    update_trigger(s);
+
+    // Record samples
+    //
+    if (s->trig_state != TRIG_STATE_STOP && !s->_interval_delay) {
+        for (int i=0; i < s->num_channels; i++)
+            s->buffer[s->trig_index * s->num_channels + i] = s->channels[i].value;
+
+        s->trig_index++;
+        if (s->trig_index >= s->num_samples)
+            s->trig_index = 0;
+    }
+
+    // Update timebase
+    //
+    if (s->trig_state != TRIG_STATE_STOP) {
+        if (s->_interval_delay)
+            s->_interval_delay--;
+        else
+            s->_interval_delay = s->interval;
+    }
+}
+
+
+/**
+ * Sample the scope channels.
+ * Called from the BLDC interrupt and the flight control loop.
+ *
+ * \param   source  calling context
+ */
+void scope_update(enum scope_source source)
+{
+    struct scope *s = &scope;
+
+    if (s->source == source && s->trig_state != TRIG_STATE_STOP)
+        scope_exec(s);
+}
+
+
+void scope_trig(struct scope *s)
+{
+    s->_trig_manual = 1;
+}
+
+
+void scope_start(struct scope *s)
+{
+    // Initialize state machine
+    //
+    s->trig_state = TRIG_STATE_STOP;
+
+    s->_trig_manual = 0;
+    s->_auto_delay = s->trig_auto;
+    s->_interval_delay = 0;
+    s->trig_index = 0;
+
+    // Calculate pre- and post-delay values
+    //
+    // trig_offset >= 0: The trigger point lies within the window
+    // trig_offset <  0: The trigger point lies to the left of the window
+    //
+    assert(s->trig_offset <= s->num_samples);
+
+    if (s->trig_offset > 0)
+        s->_pre_delay = s->trig_offset;
+    else
+        s->_pre_delay = 0;
+
+    s->_post_delay = s->num_samples - s->trig_offset;
+
+    s->trig_state = TRIG_STATE_PRE;
+}
+
+
+/**
+ * Apply scope_config and start a new capture.
+ *
+ * \return  0 on success, -1 on error
+ */
+int scope_arm(void)
+{
+    struct scope *s = &scope;
+    const struct scope_config *c = &scope_config;
+
+    // Stop sampling first, so the interrupt
+    // never sees a half-configured scope
+    //
+    s->trig_state = TRIG_STATE_STOP;
+
+    int n = 0;
+    while (n < SCOPE_MAX_CHANNELS && c->ch_id[n]) {
+        if (param_ref_init(&s->channels[n].ref, c->ch_id[n]) != PERR_OK) {
+            errno = EINVAL;
+            return -1;
+        }
+        s->channels[n].id = c->ch_id[n];
+        n++;
+    }
+
+    if (n == 0 || c->trig_channel >= n || c->trig_offset > c->num_samples) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    free(s->buffer);
+    s->num_channels = 0;
+    s->buffer = malloc(c->num_samples * n * sizeof(float));
+    if (!s->buffer) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    s->num_channels = n;
+    s->num_samples  = c->num_samples;
+    s->source       = c->source;
+    s->interval     = c->interval;
+    s->trig_mode    = c->trig_mode;
+    s->trig_channel = c->trig_channel;
+    s->trig_level   = c->trig_level;
+    s->trig_auto    = c->trig_auto;
+    s->trig_offset  = c->trig_offset;
+
+    scope_start(s);
+    return 0;
+}
+
+
+/**
+ * Time between two recorded samples [us]
+ */
+static uint32_t scope_interval_us(const struct scope *s)
+{
+    uint32_t base = (s->source == SCOPE_SOURCE_BLDC)
+        ? 1000000 / BLDC_IRQ_FREQ
+        : 1000000 / configTICK_RATE_HZ;
+
+    return base * (s->interval + 1);
+}
+
+
+// -------------------- Shell commands --------------------
+//
+#include "command.h"
+#include "msg_packet.h"
+#include <stdio.h>
+#include <string.h>
+
+
+static const char *trig_state_names[] = {
+    [TRIG_STATE_STOP] = "stopped",
+    [TRIG_STATE_PRE]  = "pre-trigger",
+    [TRIG_STATE_WAIT] = "waiting for trigger",
+    [TRIG_STATE_POST] = "post-trigger"
+};
+
+
+static void scope_status(struct scope *s)
+{
+    printf("state:    %s\n", trig_state_names[s->trig_state]);
+    printf("samples:  %d @ %lu us\n", s->num_samples, scope_interval_us(s));
+
+    for (int j=0; j < s->num_channels; j++) {
+        const struct param_info *p = param_get_info(s->channels[j].id);
+        printf("ch%d:      %5d %s\n", j+1, s->channels[j].id, p ? p->name : "");
+    }
+}
+
+
+static void scope_show(struct scope *s)
+{
+    printf("\t");
+    for (int j=0; j < s->num_channels; j++) {
+        printf( "%d%s", s->channels[j].id,
+            j < s->num_channels - 1 ? "\t" : "\n"
+        );
+    }
+
+    int index = s->trig_index;
+
+    for (int i=0; i < s->num_samples; i++) {
+        printf("%d\t", i - s->trig_offset);
+
+        for (int j=0; j < s->num_channels; j++) {
+            printf( "%f%s", s->buffer[index * s->num_channels + j],
+                j < s->num_channels - 1 ? "\t" : "\n"
+            );
+        }
+
+        index++;
+        if (index >= s->num_samples)
+            index = 0;
+    }
+}
+
+
+/**
+ * Send the capture as MSG_ID_SCOPE_DATA packets,
+ * oldest sample first.
+ */
+static int scope_dump(struct scope *s)
+{
+    struct msg_scope_data msg;
+
+    const int per_msg = ARRAY_SIZE(msg.data) / s->num_channels;
+    int index = s->trig_index;
+
+    msg.h.id         = MSG_ID_SCOPE_DATA;
+    msg.num_samples  = s->num_samples;
+    msg.num_channels = s->num_channels;
+    msg.trig_offset  = s->trig_offset;
+    msg.interval     = scope_interval_us(s);
+
+    for (int i=0; i < s->num_samples; i += per_msg) {
+        int n = s->num_samples - i;
+        if (n > per_msg)
+            n = per_msg;
+
+        msg.index = i;
+
+        for (int k=0; k < n; k++) {
+            memcpy(&msg.data[k * s->num_channels],
+                &s->buffer[index * s->num_channels],
+                s->num_channels * sizeof(float)
+            );
+
+            index++;
+            if (index >= s->num_samples)
+                index = 0;
+        }
+
+        msg.h.data_len = offsetof(struct msg_scope_data, data) - sizeof(msg.h)
+                       + n * s->num_channels * sizeof(float);
+
+        if (msg_send(&msg.h) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+static void cmd_scope(int argc, char *argv[])
+{
+    struct scope *s = &scope;
+
+    if (argc == 1) {
+        scope_status(s);
+        return;
+    }
+
+    if (argc != 2)
+        goto usage;
+
+    if (!strcmp(argv[1], "arm")) {
+        if (scope_arm() < 0)
+            printf("%s\n", strerror(errno));
+    }
+    else if (!strcmp(argv[1], "trig")) {
+        scope_trig(s);
+    }
+    else if (!strcmp(argv[1], "stop")) {
+        s->trig_state = TRIG_STATE_STOP;
+    }
+    else if (!strcmp(argv[1], "show") || !strcmp(argv[1], "dump")) {
+        if (!s->buffer || s->trig_state != TRIG_STATE_STOP) {
+            printf("no capture\n");
+            return;
+        }
+
+        if (argv[1][0] == 's')
+            scope_show(s);
+        else if (scope_dump(s) < 0)
+            printf("%s\n", strerror(errno));
+    }
+    else {
+        goto usage;
+    }
+    return;
+
+usage:
+    printf("usage: %s [arm|trig|stop|show|dump]\n", argv[0]);
+}
+
+
+SHELL_CMD(scope, (cmdfunc_t)cmd_scope, "Software oscilloscope")
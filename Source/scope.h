@@ -1,34 +1,13 @@
 #pragma once
 
+#include "parameter.h"
 #include <stdbool.h>
 
-// TODO
-//
-// enum sample_mode {
-//     SAMPLE_MODE_NORMAL,
-//     SAMPLE_MODE_AVG,
-//     SAMPLE_MODE_MIN_MAX,
-// };
-//
-// enum sample_mode  mode;
-// float value, min, max;
-//
-// TODO
-//
-// uint32_t  trig_holdoff
-//
+#define SCOPE_MAX_CHANNELS  4
 
-enum data_type {
-    DATA_TYPE_NONE,
-    DATA_TYPE_FLOAT,
-    DATA_TYPE_DOUBLE,
-    DATA_TYPE_INT8,
-    DATA_TYPE_UINT8,
-    DATA_TYPE_INT16,
-    DATA_TYPE_UINT16,
-    DATA_TYPE_INT32,
-    DATA_TYPE_UINT32,
-    DATA_TYPE_CALLBACK
+enum scope_source {
+    SCOPE_SOURCE_CONTROL,       // flight control loop, 1 kHz
+    SCOPE_SOURCE_BLDC           // BLDC interrupt, 20 kHz
 };
 
 
@@ -49,10 +28,8 @@ enum trig_state {
 
 
 struct scope_channel {
-    const char *name;
-    enum data_type  type;
-    void    *data;
-    void    *state;
+    int     id;                 // parameter id
+    struct param_ref ref;
     float   value;
 };
 
@@ -61,16 +38,17 @@ struct scope {
     // Channel config
     //
     int         num_channels;
-    struct scope_channel *channels;
+    struct scope_channel channels[SCOPE_MAX_CHANNELS];
 
     // Sample buffer
-    // At least (num_samples * num_channels * sizeof(float)) bytes
+    // (num_samples * num_channels) floats, allocated by scope_arm()
     //
     int         num_samples;
     float       *buffer;
 
     // Timebase
     //
+    enum scope_source source;
     int         interval;
 
     // Trigger
@@ -83,12 +61,12 @@ struct scope {
 
     // Output data
     //
-    enum trig_state trig_state;
+    volatile enum trig_state trig_state;
     int         trig_index;
 
     // Internal state
     //
-    bool        _trig_manual;
+    volatile bool _trig_manual;
     float       _trig_value_old;
 
     int         _interval_delay;
@@ -98,12 +76,27 @@ struct scope {
 };
 
 
-// Function prototype for DATA_TYPE_CALLBACK
+// Configuration, applied by scope_arm()
 //
-typedef void (*scope_channel_cb)(struct scope*, int);
+struct scope_config {
+    int     ch_id[SCOPE_MAX_CHANNELS];  // 0 = unused
+    int     source;
+    int     interval;
+    int     num_samples;
+
+    int     trig_mode;
+    int     trig_channel;
+    float   trig_level;
+    int     trig_auto;
+    int     trig_offset;
+};
+
+extern struct scope_config scope_config;
 
+
+void scope_update(enum scope_source source);
 void scope_exec(struct scope *s);
 void scope_trig(struct scope *s);
 
 void scope_start(struct scope *s);
-
+int  scope_arm(void);
@@ -3,6 +3,7 @@
 #include "readline.h"
 #include "ansi.h"
 #include "board.h"
+#include "syscalls.h"
 #include <stdbool.h>
 #include <string.h>
 #include <stdio.h>
@@ -10,25 +11,13 @@
 #include "FreeRTOS.h"
 #include "task.h"
 
-/* following is copied from libc/stdio/local.h to check std streams */
-extern void   _EXFUN(__sinit,(struct _reent *));
-#define CHECK_INIT(ptr) \
-    if ((ptr) && !(ptr)->__sdidinit) __sinit (ptr);
-
-
 void shell_task(void *pvParameters)
 {
     struct shell_params *params = pvParameters;
 
-    if (params) {
-        // Hack to redirect stdin/stdout
-        // \todo replace by fdopen()
-        //
-        CHECK_INIT(_impure_ptr);
-        stdin->_file  = params->fd_stdin;
-        stdout->_file = params->fd_stdout;
-        stderr->_file = params->fd_stderr;
-        fflush(NULL);
+    if (params && stdio_redirect(params->path) < 0) {
+        perror(params->path);
+        vTaskDelete(NULL);
     }
 
     struct rl_history  history = { 0 };
@@ -1,9 +1,7 @@
 #pragma once
 
 struct shell_params {
-    int fd_stdin;
-    int fd_stdout;
-    int fd_stderr;
+    const char *path;       // device for stdin, stdout and stderr
 };
 
 void shell_task(void *pvParameters);
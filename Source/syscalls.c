@@ -1,6 +1,5 @@
 #include "syscalls.h"
 #include "term_xbee.h"
-#include "term_usb.h"
 #include "board.h"
 #include "util.h"
 #include "stm32f4xx.h"
@@ -10,7 +9,9 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <string.h>
+#include <unistd.h>
 #include <sys/stat.h>
 #include <sys/time.h>
 #include "stm32f4xx.h"
@@ -19,14 +20,63 @@ size_t   __malloc_margin = 256;
 char    *__brkval;
 
 
+/* following is copied from libc/stdio/local.h to check std streams */
+extern void   _EXFUN(__sinit,(struct _reent *));
+#define CHECK_INIT(ptr) \
+    if ((ptr) && !(ptr)->__sdidinit) __sinit (ptr);
+
+
 struct device_info {
     const char *name;
     const struct file_ops *ops;
 };
 
-struct device_info  device_table[16];
+struct file_info {
+    const struct device_info *dev;     // NULL if unused
+    int flags;                         // O_RDONLY, O_WRONLY or O_RDWR
+};
+
+
+// The null device discards all output and counts the write calls
+//
+static unsigned null_writes;
+
+static ssize_t null_read_r(struct _reent *r, int fd, void *ptr, size_t len)
+{
+    return 0;
+}
+
+static ssize_t null_write_r(struct _reent *r, int fd, const void *ptr, size_t len)
+{
+    null_writes++;
+    return len;
+}
+
+static ssize_t null_chars_avail_r(struct _reent *r, int fd)
+{
+    return 0;
+}
+
+static const struct file_ops null_ops = {
+    .read_r        = null_read_r,
+    .write_r       = null_write_r,
+    .chars_avail_r = null_chars_avail_r
+};
+
 
+static struct device_info  device_table[MAX_DEVICES] = {
+    { "null", &null_ops }
+};
+
+static struct file_info    file_table[MAX_FILES];
 
+
+/**
+ * Register a device.
+ * The device can then be opened as "/dev/<name>".
+ *
+ * \return  device index, -1 on error
+ */
 int dev_register(const char *name, const struct file_ops *ops)
 {
     for (unsigned int i=0; i<ARRAY_SIZE(device_table); i++) {
@@ -48,78 +98,227 @@ void _exit(int code)
     for(;;);
 }
 
-// Das hier ist alles ein ziemlicher Hack..
-//
-// TODO: Richtiges open() inkl. file-descriptor-table in
-//   syscalls.c implementieren (siehe z.B. eLUA).
-//
-// TODO: freopen() bzw. dup2() verwenden, um streams zu redirecten
-//
+static const struct device_info *dev_find(const char *path)
+{
+    if (!strncmp(path, "/dev/", 5))
+        path += 5;
+
+    for (unsigned int i=0; i<ARRAY_SIZE(device_table); i++) {
+        if (device_table[i].name && !strcmp(device_table[i].name, path))
+            return &device_table[i];
+    }
+
+    return NULL;
+}
+
+
+static struct file_info *file_get(struct _reent *r, int fd)
+{
+    if (fd < 0 || fd >= MAX_FILES || !file_table[fd].dev) {
+        r->_errno = EBADF;
+        return NULL;
+    }
+
+    return &file_table[fd];
+}
+
+
+/**
+ * Allocate the lowest free file descriptor.
+ *
+ * \return  file descriptor, -1 on error
+ */
+static int file_alloc(struct _reent *r, const struct device_info *dev, int flags)
+{
+    vTaskSuspendAll();
+
+    for (int fd=0; fd<MAX_FILES; fd++) {
+        if (!file_table[fd].dev) {
+            file_table[fd].dev   = dev;
+            file_table[fd].flags = flags & O_ACCMODE;
+            xTaskResumeAll();
+            return fd;
+        }
+    }
+
+    xTaskResumeAll();
+
+    r->_errno = EMFILE;
+    return -1;
+}
+
+
+int _open_r(struct _reent *r, const char *path, int flags, int mode)
+{
+    const struct device_info *dev = dev_find(path);
+    if (!dev) {
+        r->_errno = ENOENT;
+        return -1;
+    }
+
+    return file_alloc(r, dev, flags);
+}
+
+
+int _close_r(struct _reent *r, int fd)
+{
+    if (!file_get(r, fd))
+        return -1;
+
+    file_table[fd].dev = NULL;
+    return 0;
+}
+
+
+int dup(int fd)
+{
+    struct file_info *f = file_get(_impure_ptr, fd);
+    if (!f)
+        return -1;
+
+    return file_alloc(_impure_ptr, f->dev, f->flags);
+}
+
+
+int dup2(int oldfd, int newfd)
+{
+    struct file_info *f = file_get(_impure_ptr, oldfd);
+    if (!f)
+        return -1;
+
+    if (newfd < 0 || newfd >= MAX_FILES) {
+        errno = EBADF;
+        return -1;
+    }
+
+    // An open newfd is closed silently
+    //
+    vTaskSuspendAll();
+    file_table[newfd] = *f;
+    xTaskResumeAll();
+
+    return newfd;
+}
+
+
 ssize_t _read_r(struct _reent *r, int fd, void *ptr, size_t len)
 {
-    int device = fd & 0xF000;
-    switch (device) {
-    case FD_DEV_XBEE:   return term_xbee_ops.read_r(r, fd, ptr, len);
-    case FD_DEV_USB:    return term_usb_ops.read_r(r, fd, ptr, len);
-    default:  r->_errno = ENOSYS;  return -1;
+    struct file_info *f = file_get(r, fd);
+    if (!f)
+        return -1;
+
+    if (f->flags == O_WRONLY) {
+        r->_errno = EBADF;
+        return -1;
     }
+
+    return f->dev->ops->read_r(r, fd, ptr, len);
 }
 
 
 ssize_t _write_r(struct _reent *r, int fd, const void *ptr, size_t len)
 {
-    int device = fd & 0xF000;
-    switch (device) {
-    case FD_DEV_XBEE:   return term_xbee_ops.write_r(r, fd, ptr, len);
-    case FD_DEV_USB:    return term_usb_ops.write_r(r, fd, ptr, len);
-    default: r->_errno = ENOSYS;  return -1;
+    struct file_info *f = file_get(r, fd);
+    if (!f)
+        return -1;
+
+    if (f->flags == O_RDONLY) {
+        r->_errno = EBADF;
+        return -1;
     }
+
+    return f->dev->ops->write_r(r, fd, ptr, len);
 }
 
 
-ssize_t stdin_chars_avail(void)
+/**
+ * Redirect the standard streams of the calling task to a device.
+ *
+ * With configUSE_NEWLIB_REENTRANT, every task has its own stdin,
+ * stdout and stderr. They are replaced by new streams on the device.
+ * stdin reads blocks, stdout is line buffered and stderr unbuffered.
+ *
+ * \return  0 on success, -1 on error
+ */
+int stdio_redirect(const char *path)
 {
-    int fd = stdin->_file;
-    int device = fd & 0xF000;
-    switch (device) {
-    case FD_DEV_XBEE:  return term_xbee_ops.chars_avail_r(_impure_ptr, fd);
-    case FD_DEV_USB:   return term_usb_ops.chars_avail_r(_impure_ptr, fd);
-    default: errno = ENOSYS;  return -1;
+    // __sinit() would overwrite the new streams later on
+    //
+    CHECK_INIT(_impure_ptr);
+
+    int fd = open(path, O_RDWR);
+    if (fd < 0)
+        return -1;
+
+    FILE *in  = fdopen(fd, "r");
+    FILE *out = fdopen(fd, "w");
+    FILE *err = fdopen(fd, "w");
+
+    if (!in || !out || !err) {
+        close(fd);
+        return -1;
     }
+
+    setvbuf(in,  NULL, _IOFBF, STDIO_BUF_SIZE);
+    setvbuf(out, NULL, _IOLBF, STDIO_BUF_SIZE);
+    setvbuf(err, NULL, _IONBF, 0);
+
+    stdin  = in;
+    stdout = out;
+    stderr = err;
+
+    return 0;
 }
 
 
-off_t _lseek_r(struct _reent *r, int fd, _off_t ptr, int dir)
+/**
+ * Get the number of characters that can be read from stdin
+ * without blocking. Any pending output is flushed first, as the
+ * caller is usually waiting for an answer to it.
+ *
+ */
+ssize_t stdin_chars_avail(void)
 {
-    fd  = fd;
-    ptr = ptr;
-    dir = dir;
-    r->_errno = ENOSYS;
-    return -1;
+    fflush(stdout);
+
+    int fd = fileno(stdin);
+    struct file_info *f = file_get(_impure_ptr, fd);
+    if (!f)
+        return -1;
+
+    ssize_t n = f->dev->ops->chars_avail_r(_impure_ptr, fd);
+    if (n < 0)
+        return n;
+
+    return n + stdin->_r;
 }
 
 
-int _close_r(struct _reent *r, int fd)
+off_t _lseek_r(struct _reent *r, int fd, _off_t ptr, int dir)
 {
-    fd = fd;
-    r->_errno = ENOSYS;
+    fd  = fd;
+    ptr = ptr;
+    dir = dir;
+    r->_errno = ESPIPE;
     return -1;
 }
 
 
 int _fstat_r(struct _reent *r, int fd, struct stat *st)
 {
-    st->st_mode = S_IFCHR;   // Always pretend to be a tty
-    st->st_blksize = 0;
+    if (!file_get(r, fd))
+        return -1;
+
+    memset(st, 0, sizeof(*st));
+    st->st_mode = S_IFCHR;   // All devices are terminals
+    st->st_blksize = STDIO_BUF_SIZE;
     return 0;
 }
 
 
 int _isatty_r(struct _reent *r, int fd)
 {
-    r  = r;
-    fd = fd;
-    return 1;
+    return file_get(r, fd) != NULL;
 }
 
 
@@ -205,3 +404,62 @@ void vApplicationStackOverflowHook(TaskHandle_t *pxTask, char *pcTaskName)
     __BKPT(2);
     for(;;);
 }
+
+
+// -------------------- Shell commands --------------------
+//
+#include "command.h"
+#include "ustime.h"
+
+static void cmd_stdio_bench(int argc, char *argv[])
+{
+    static const struct {
+        const char *name;
+        int mode;
+    } modes[] = {
+        { "unbuffered", _IONBF },
+        { "line",       _IOLBF },
+        { "full",       _IOFBF }
+    };
+
+    if (argc > 2)
+        goto usage;
+
+    int lines = argc == 2 ? strtol(argv[1], NULL, 0) : 200;
+
+    int fd = open("/dev/null", O_WRONLY);
+    if (fd < 0) {
+        perror("open");
+        return;
+    }
+
+    FILE *f = fdopen(fd, "w");
+    if (!f) {
+        perror("fdopen");
+        close(fd);
+        return;
+    }
+
+    printf("%d lines to /dev/null:\n", lines);
+
+    for (unsigned i=0; i<ARRAY_SIZE(modes); i++) {
+        setvbuf(f, NULL, modes[i].mode, STDIO_BUF_SIZE);
+        null_writes = 0;
+
+        uint32_t t0 = get_us_time32();
+        for (int n=0; n<lines; n++)
+            fprintf(f, "%4d: %8.3f %8.3f %8.3f\n", n, n * 0.1, n * 0.2, n * 0.3);
+        fflush(f);
+        uint32_t t1 = get_us_time32();
+
+        printf("%-10s %8lu us %8u writes\n", modes[i].name, t1 - t0, null_writes);
+    }
+
+    fclose(f);
+    return;
+
+usage:
+    printf("usage: %s [lines]\n", argv[0]);
+}
+
+SHELL_CMD(stdio_bench, (cmdfunc_t)cmd_stdio_bench, "Benchmark stdio buffering")
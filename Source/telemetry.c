@@ -0,0 +1,319 @@
+/**
+ * \file
+ * Binary telemetry streamer
+ *
+ * The ground station subscribes to telemetry sources at a chosen
+ * sample rate. Samples are collected until a message is full (or
+ * TELEMETRY_MAX_LATENCY has elapsed) and then sent as one packet.
+ *
+ * Sources with a resolution table are packed with tlm_codec. The
+ * codec is reset for every message, so each packet starts with a
+ * keyframe and can be decoded on its own.
+ *
+ */
+#include "telemetry.h"
+#include "msg_packet.h"
+#include "Shared/tlm_codec.h"
+#include "sensors.h"
+#include "ustime.h"
+#include "util.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include <string.h>
+#include <errno.h>
+
+#define TELEMETRY_MAX_LATENCY   100     // [ms]
+#define TELEMETRY_MAX_SAMPLE    64      // [bytes]
+
+
+struct telemetry_source {
+    const char  *name;
+    uint16_t    msg_id;
+    uint16_t    sample_size;
+    void        (*sample)(void *dst);
+    const float *resolution;    // NULL for raw samples
+};
+
+
+struct telemetry_stream {
+    const struct telemetry_source *source;
+
+    unsigned    interval;       // sample interval [ticks], 0 = off
+    TickType_t  t_next;         // time of next sample
+    TickType_t  t_first;        // time of first sample in msg
+
+    int         num_samples;
+    size_t      data_len;       // bytes used in msg.samples
+    struct tlm_codec codec;
+    struct msg_telemetry msg;
+};
+
+
+static volatile struct telemetry_stats {
+    uint32_t    tx_packets;
+    uint32_t    tx_bytes;
+    uint32_t    tx_samples;
+    uint32_t    raw_bytes;      // sample bytes before compression
+    uint32_t    missed_samples;
+} telemetry_stats;
+
+
+// -------------------- Telemetry sources --------------------
+//
+static void sample_imu(void *dst)
+{
+    struct msg_imu_sample *s = dst;
+    struct sensor_data d;
+
+    sensor_read(&d);
+
+    s->acc_x     = d.acc.x;
+    s->acc_y     = d.acc.y;
+    s->acc_z     = d.acc.z;
+    s->gyro_x    = d.gyro.x;
+    s->gyro_y    = d.gyro.y;
+    s->gyro_z    = d.gyro.z;
+    s->mag_x     = d.mag.x;
+    s->mag_y     = d.mag.y;
+    s->mag_z     = d.mag.z;
+    s->baro_hpa  = d.pressure;
+    s->baro_temp = d.baro_temp;
+}
+
+
+static const float imu_resolution[] = MSG_IMU_RESOLUTION;
+
+static const struct telemetry_source sources[] = {
+    { "imu",   MSG_ID_IMU_DATA,       sizeof(struct msg_imu_sample), sample_imu, NULL },
+    { "imu_z", MSG_ID_IMU_DATA_DELTA, sizeof(struct msg_imu_sample), sample_imu, imu_resolution }
+};
+
+static struct telemetry_stream streams[ARRAY_SIZE(sources)];
+
+
+// -------------------- Streamer --------------------
+//
+static void stream_flush(struct telemetry_stream *s)
+{
+    if (s->num_samples == 0)
+        return;
+
+    s->msg.h.id       = s->source->msg_id;
+    s->msg.h.data_len = 4 + 4 + s->data_len;
+    s->msg.interval   = s->interval * (1000000 / configTICK_RATE_HZ);
+
+    if (msg_send(&s->msg.h) >= 0) {
+        telemetry_stats.tx_packets++;
+        telemetry_stats.tx_bytes += s->msg.h.data_len;
+    }
+
+    s->num_samples = 0;
+    s->data_len    = 0;
+    tlm_codec_reset(&s->codec);
+}
+
+
+/**
+ * Room for samples in a message. Less than the buffer if
+ * the telemetry class is protected by FEC.
+ */
+static size_t stream_capacity(const struct telemetry_stream *s)
+{
+    size_t len = msg_max_data_size(s->source->msg_id) - 4 - 4;
+
+    return len < sizeof(s->msg.samples) ? len : sizeof(s->msg.samples);
+}
+
+
+/**
+ * Append a sample to the current message.
+ *
+ * \return  0 on success, -1 if the message is full
+ */
+static int stream_append(struct telemetry_stream *s, const void *sample, TickType_t t)
+{
+    const struct telemetry_source *src = s->source;
+    size_t capacity = stream_capacity(s);
+    size_t space = capacity > s->data_len ? capacity - s->data_len : 0;
+
+    if (s->num_samples == 0) {
+        s->msg.timestamp = get_us_time32();
+        s->t_first = t;
+    }
+
+    if (src->resolution) {
+        ssize_t len = tlm_encode(&s->codec, &s->msg.samples[s->data_len], space, sample);
+        if (len < 0)
+            return -1;
+        s->data_len += len;
+    }
+    else {
+        if (space < src->sample_size)
+            return -1;
+        memcpy(&s->msg.samples[s->data_len], sample, src->sample_size);
+        s->data_len += src->sample_size;
+    }
+
+    s->num_samples++;
+    return 0;
+}
+
+
+static void stream_update(struct telemetry_stream *s, TickType_t t)
+{
+    if (!s->interval || (int)(t - s->t_next) < 0)
+        return;
+
+    // Samples that were skipped because the
+    // link (or the task) couldn't keep up
+    //
+    unsigned missed = (t - s->t_next) / s->interval;
+    telemetry_stats.missed_samples += missed;
+
+    s->t_next += (missed + 1) * s->interval;
+
+    // Receivers time the samples as timestamp + n * interval,
+    // so a gap has to start a new message
+    //
+    if (missed && s->num_samples)
+        stream_flush(s);
+
+    uint8_t sample[TELEMETRY_MAX_SAMPLE] __attribute__((aligned(4)));
+    s->source->sample(sample);
+
+    // Flush if the sample doesn't fit any more and
+    // start the next message with it
+    //
+    if (stream_append(s, sample, t) < 0) {
+        stream_flush(s);
+        stream_append(s, sample, t);
+    }
+
+    telemetry_stats.tx_samples++;
+    telemetry_stats.raw_bytes += s->source->sample_size;
+
+    // Flush if not even the smallest sample would fit
+    // (one byte per channel for compressed sources)
+    //
+    size_t min_len = s->source->resolution
+        ? s->source->sample_size / sizeof(float)
+        : s->source->sample_size;
+
+    if (s->data_len + min_len > stream_capacity(s) ||
+        t - s->t_first >= TELEMETRY_MAX_LATENCY)
+        stream_flush(s);
+}
+
+
+/**
+ * Subscribe to a telemetry source.
+ *
+ * \param   msg_id  message id of the telemetry source
+ * \param   rate    sample rate [Hz], 0 to unsubscribe
+ * \return  0 on success, -1 on error
+ */
+int telemetry_subscribe(uint16_t msg_id, unsigned rate)
+{
+    if (rate > configTICK_RATE_HZ) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    for (unsigned i=0; i<ARRAY_SIZE(sources); i++) {
+        if (sources[i].msg_id != msg_id)
+            continue;
+
+        struct telemetry_stream *s = &streams[i];
+
+        vTaskSuspendAll();
+        s->source      = &sources[i];
+        s->interval    = rate ? configTICK_RATE_HZ / rate : 0;
+        s->t_next      = xTaskGetTickCount();
+        s->num_samples = 0;
+        s->data_len    = 0;
+
+        if (sources[i].resolution) {
+            tlm_codec_init(&s->codec, sources[i].resolution,
+                sources[i].sample_size / sizeof(float));
+        }
+        xTaskResumeAll();
+
+        return 0;
+    }
+
+    errno = ENOENT;
+    return -1;
+}
+
+
+void telemetry_task(void *pvParameters)
+{
+    TickType_t t = xTaskGetTickCount();
+
+    for (;;) {
+        vTaskDelayUntil(&t, 1);
+
+        for (unsigned i=0; i<ARRAY_SIZE(streams); i++)
+            stream_update(&streams[i], xTaskGetTickCount());
+    }
+}
+
+
+// -------------------- Shell commands --------------------
+//
+#include "command.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static void cmd_telemetry(int argc, char *argv[])
+{
+    if (argc == 1) {
+        for (unsigned i=0; i<ARRAY_SIZE(sources); i++) {
+            unsigned interval = streams[i].interval;
+            printf("%-8s 0x%04x  %4u Hz\n",
+                sources[i].name, sources[i].msg_id,
+                interval ? configTICK_RATE_HZ / interval : 0
+            );
+        }
+
+        printf("\n");
+        printf("tx_packets:     %10lu\n", telemetry_stats.tx_packets);
+        printf("tx_bytes:       %10lu\n", telemetry_stats.tx_bytes);
+        printf("tx_samples:     %10lu\n", telemetry_stats.tx_samples);
+        printf("raw_bytes:      %10lu\n", telemetry_stats.raw_bytes);
+        printf("missed_samples: %10lu\n", telemetry_stats.missed_samples);
+
+        // payload bytes incl. timestamp/interval vs. raw floats
+        //
+        if (telemetry_stats.tx_bytes) {
+            printf("compression:    %10.2f\n",
+                (double)telemetry_stats.raw_bytes / telemetry_stats.tx_bytes);
+        }
+        return;
+    }
+
+    if (argc != 3)
+        goto usage;
+
+    char *endp;
+    unsigned rate = strtoul(argv[2], &endp, 0);
+    if (*endp)
+        goto usage;
+
+    for (unsigned i=0; i<ARRAY_SIZE(sources); i++) {
+        if (!strcmp(argv[1], sources[i].name)) {
+            if (telemetry_subscribe(sources[i].msg_id, rate) < 0)
+                printf("%s: %s\n", argv[1], strerror(errno));
+            return;
+        }
+    }
+
+    printf("%s: unknown telemetry source\n", argv[1]);
+    return;
+
+usage:
+    printf("usage: %s [<source> <rate>]\n", argv[0]);
+}
+
+
+SHELL_CMD(telemetry, (cmdfunc_t)cmd_telemetry, "Subscribe to binary telemetry")
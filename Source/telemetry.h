@@ -0,0 +1,6 @@
+#pragma once
+
+#include <stdint.h>
+
+int  telemetry_subscribe(uint16_t msg_id, unsigned rate);
+void telemetry_task(void *pvParameters);
@@ -4,25 +4,35 @@
 #include "usbd_desc.h"
 #include "ustime.h"
 #include "stm32f4xx.h"
+#include "ringbuf.h"
 #include "FreeRTOS.h"
 #include "task.h"
 #include "queue.h"
+#include "semphr.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #define RX_QUEUE_SIZE  1024
-#define TX_QUEUE_SIZE  1024
+#define TX_BUF_SIZE    4096
 
 static volatile struct usb_stats {
     uint32_t    irq_count;
     uint32_t    rx_bytes;
     uint32_t    tx_bytes;
     uint32_t    rx_overrun;
-    uint32_t    tx_overrun;
+    uint32_t    tx_full;        // writer had to wait for buffer space
 } usb_stats;
 
 static QueueHandle_t rx_queue;
-static QueueHandle_t tx_queue;
+
+// Written in blocks by usb_write_*, copied in blocks
+// into the CDC IN buffer by VCP_DataTx().
+//
+static struct ringbuf tx_buf = RINGBUF(TX_BUF_SIZE);
+
+static SemaphoreHandle_t tx_sem;
+static SemaphoreHandle_t tx_mutex;
 
 
 // -------------------- USB CDC Functions --------------------
@@ -31,6 +41,7 @@ static USB_OTG_CORE_HANDLE  USB_OTG_dev;
 
 extern uint8_t  APP_Rx_Buffer[APP_RX_DATA_SIZE];
 extern uint32_t APP_Rx_ptr_in;
+extern uint32_t APP_Rx_ptr_out;
 
 static uint16_t VCP_Init(void)
 {
@@ -48,22 +59,61 @@ static uint16_t VCP_Ctrl(uint32_t Cmd, uint8_t *Buf, uint32_t Len)
 }
 
 
+/**
+ * Move data from tx_buf to the CDC IN buffer.
+ * Called from the USB interrupt.
+ *
+ */
 static uint16_t VCP_DataTx(uint8_t *buf, uint32_t len)
 {
     portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
 
-    for (uint32_t i=0; i<uxQueueMessagesWaitingFromISR(tx_queue); i++)
-    {
-        char c;
-        xQueueReceiveFromISR(tx_queue, &c, &xHigherPriorityTaskWoken);
+    // APP_Rx_Buffer is a ring buffer, too. It is empty
+    // if APP_Rx_ptr_in == APP_Rx_ptr_out, so one byte is
+    // left unused. APP_Rx_ptr_out may equal the buffer
+    // size until the next transfer wraps it around.
+    //
+    // The CDC class advances APP_Rx_ptr_out when it starts
+    // a transfer, but the packet is copied into the TX FIFO
+    // later. Keep that packet free until it has been sent.
+    //
+    uint32_t in  = APP_Rx_ptr_in;
+    uint32_t out = APP_Rx_ptr_out % APP_RX_DATA_SIZE;
+    uint32_t space = (out + APP_RX_DATA_SIZE - in - 1) % APP_RX_DATA_SIZE;
+    uint32_t copied = 0;
 
-        APP_Rx_Buffer[APP_Rx_ptr_in] = c;
-        APP_Rx_ptr_in++;
+    if (space > CDC_DATA_IN_PACKET_SIZE)
+        space -= CDC_DATA_IN_PACKET_SIZE;
+    else
+        space = 0;
+
+    while (space) {
+        void   *ptr;
+        size_t n = space;
+
+        // Up to the end of APP_Rx_Buffer
+        //
+        if (n > APP_RX_DATA_SIZE - in)
+            n = APP_RX_DATA_SIZE - in;
+
+        if (!rb_get_pointers(&tx_buf, RB_READ, n, &ptr, &n, NULL, NULL))
+            break;
 
-        if (APP_Rx_ptr_in == APP_RX_DATA_SIZE)
-            APP_Rx_ptr_in = 0;
+        memcpy(&APP_Rx_Buffer[in], ptr, n);
+        rb_commit(&tx_buf, RB_READ, n);
 
-        usb_stats.tx_bytes++;
+        in += n;
+        if (in == APP_RX_DATA_SIZE)
+            in = 0;
+
+        space  -= n;
+        copied += n;
+    }
+
+    if (copied) {
+        APP_Rx_ptr_in = in;
+        usb_stats.tx_bytes += copied;
+        xSemaphoreGiveFromISR(tx_sem, &xHigherPriorityTaskWoken);
     }
 
     portEND_SWITCHING_ISR(xHigherPriorityTaskWoken);
@@ -99,22 +149,72 @@ const CDC_IF_Prop_TypeDef VCP_fops = {
 
 // -------------------- Character Device Functions --------------------
 //
+static void usb_write_block(const void *ptr, size_t len)
+{
+    const char *src = ptr;
+
+    while (len) {
+        void   *ptr1, *ptr2;
+        size_t len1, len2;
+
+        size_t n = rb_get_pointers(&tx_buf, RB_WRITE, len, &ptr1, &len1, &ptr2, &len2);
+        if (!n) {
+            // Wait for the USB interrupt to make room
+            //
+            usb_stats.tx_full++;
+            xSemaphoreTake(tx_sem, portMAX_DELAY);
+            continue;
+        }
+
+        memcpy(ptr1, src, len1);
+        memcpy(ptr2, src + len1, len2);
+        rb_commit(&tx_buf, RB_WRITE, n);
+
+        src += n;
+        len -= n;
+    }
+}
+
+
+/**
+ * Write binary data without newline conversion.
+ *
+ */
+ssize_t usb_write_raw(const void *ptr, size_t len)
+{
+    xSemaphoreTake(tx_mutex, portMAX_DELAY);
+    usb_write_block(ptr, len);
+    xSemaphoreGive(tx_mutex);
+
+    return len;
+}
+
+
 static ssize_t usb_write_r(struct _reent *r, int fd, const void *ptr, size_t len)
 {
     const char *src = ptr;
-    ssize_t sent = 0;
+    char   buf[64];
+    size_t n = 0;
 
-    while (len--) {
+    xSemaphoreTake(tx_mutex, portMAX_DELAY);
+
+    for (size_t i=0; i<len; i++) {
         // Convert c-newlines to terminal CRLF
         //
-        if (*src == '\n')
-            xQueueSend(tx_queue, "\r", portMAX_DELAY);
+        if (src[i] == '\n')
+            buf[n++] = '\r';
+
+        buf[n++] = src[i];
 
-        xQueueSend(tx_queue, src++, portMAX_DELAY);
-        sent++;
+        if (n >= sizeof(buf) - 1) {
+            usb_write_block(buf, n);
+            n = 0;
+        }
     }
+    usb_write_block(buf, n);
 
-    return sent;
+    xSemaphoreGive(tx_mutex);
+    return len;
 }
 
 static ssize_t usb_read_r(struct _reent *r, int fd, void *ptr, size_t len)
@@ -167,7 +267,8 @@ struct  file_ops  term_usb_ops = {
 void term_usb_init(void)
 {
     rx_queue = xQueueCreate(RX_QUEUE_SIZE, 1);
-    tx_queue = xQueueCreate(TX_QUEUE_SIZE, 1);
+    tx_sem   = xSemaphoreCreateBinary();
+    tx_mutex = xSemaphoreCreateMutex();
 
     USBD_Init(&USB_OTG_dev, USB_OTG_FS_CORE_ID, &USR_desc, &USBD_CDC_cb, &USR_cb);
 
@@ -241,7 +342,36 @@ static void cmd_usb_stats(void)
     printf("rx_bytes:   %10lu\n", usb_stats.rx_bytes   );
     printf("rx_overrun: %10lu\n", usb_stats.rx_overrun );
     printf("tx_bytes:   %10lu\n", usb_stats.tx_bytes   );
-    printf("tx_overrun: %10lu\n", usb_stats.tx_overrun );
+    printf("tx_full:    %10lu\n", usb_stats.tx_full    );
 }
 
+
+static void cmd_usb_bench(int argc, char *argv[])
+{
+    static const char line[] =
+        "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXY\r\n";
+
+    const unsigned len = sizeof(line) - 1;  // without the NUL
+
+    unsigned kbytes = (argc > 1) ? strtoul(argv[1], NULL, 0) : 256;
+
+    uint64_t t0 = get_us_time64();
+
+    for (unsigned i=0; i < kbytes * 1024 / len; i++)
+        usb_write_raw(line, len);
+
+    // Wait until the USB stack has taken all data
+    //
+    while (rb_bytes_used(&tx_buf))
+        vTaskDelay(1);
+
+    unsigned dt = get_us_time64() - t0;
+
+    printf("\n%u KB in %u us, %u KB/s\n",
+        kbytes, dt, dt ? (unsigned)(kbytes * 1000000ULL / dt) : 0
+    );
+}
+
+
 SHELL_CMD(usb_stats, (cmdfunc_t)cmd_usb_stats, "show USB statistics")
+SHELL_CMD(usb_bench, (cmdfunc_t)cmd_usb_bench, "measure USB transmit throughput")
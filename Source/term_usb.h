@@ -4,5 +4,6 @@
 
 extern struct file_ops  term_usb_ops;
 
+ssize_t usb_write_raw(const void *ptr, size_t len);
 void term_usb_init(void);
 
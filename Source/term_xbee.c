@@ -1,111 +1,289 @@
 #include "term_xbee.h"
+#include "msg_packet.h"
 #include "command.h"
 #include "stm32f4xx.h"
 #include "FreeRTOS.h"
-#include "queue.h"
+#include "task.h"
+#include "semphr.h"
+#include "ringbuf.h"
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
-#define XBEE_BAUDRATE  115200
+#define RX_BUF_SIZE  1024
+#define TX_BUF_SIZE  2048
 
-#define RX_QUEUE_SIZE  1024
-#define TX_QUEUE_SIZE  1024
+// USART3_RX: DMA1 Stream 1, Channel 4
+// USART3_TX: DMA1 Stream 3, Channel 4
+//
+#define RX_STREAM   DMA1_Stream1
+#define TX_STREAM   DMA1_Stream3
 
 static volatile struct xbee_stats {
     uint32_t    rx_bytes;
     uint32_t    tx_bytes;
     uint32_t    rx_overrun;
-    uint32_t    tx_overrun;
+    uint32_t    tx_full;        // writer had to wait for buffer space
+    uint32_t    rx_bursts;      // RX ring updates (idle line, half/full transfer)
+    uint32_t    tx_bursts;      // TX DMA transfers
 } xbee_stats;
 
 
-static QueueHandle_t rx_queue = NULL;
-static QueueHandle_t tx_queue = NULL;
+// The RX DMA writes directly into rx_buf in circular mode, the
+// TX DMA reads directly from tx_buf. The interrupt handlers only
+// move the write and read positions of the ring buffers.
+//
+static struct ringbuf rx_buf = RINGBUF(RX_BUF_SIZE);
+static struct ringbuf tx_buf = RINGBUF(TX_BUF_SIZE);
+
+static volatile size_t tx_len;  // length of the running TX transfer
+static volatile bool rx_overrun; // set by rx_update(), cleared by the reader
+
+static SemaphoreHandle_t rx_sem = NULL;
+static SemaphoreHandle_t tx_sem = NULL;
+
+// Keeps packets from being interleaved
+//
+static SemaphoreHandle_t tx_mutex = NULL;
+
+
+/**
+ * Move the rx_buf write position to the DMA position.
+ * Called with the XBee interrupts masked.
+ */
+static void rx_update(void)
+{
+    unsigned pos = rx_buf.buf_size - RX_STREAM->NDTR;
+    if (pos >= rx_buf.buf_size)
+        pos = 0;
+
+    unsigned n = pos - rx_buf.write_pos;
+    if (pos < rx_buf.write_pos)
+        n += rx_buf.buf_size;
+
+    if (n == 0)
+        return;
+
+    // The DMA has overwritten unread data. Only the reader
+    // may move read_pos, so it drops the data, see rx_drop_overrun().
+    //
+    if (n > rb_bytes_free(&rx_buf)) {
+        xbee_stats.rx_overrun++;
+        rx_overrun = true;
+    }
+
+    rx_buf.write_pos = pos;
+    xbee_stats.rx_bytes += n;
+    xbee_stats.rx_bursts++;
+}
+
+
+/**
+ * Start a TX transfer, if the DMA is idle.
+ * Called with the XBee interrupts masked.
+ */
+static void tx_start(void)
+{
+    void   *ptr;
+    size_t len;
+
+    if (TX_STREAM->CR & DMA_SxCR_EN)
+        return;
+
+    // Send the contiguous part, the wrap-around
+    // is sent by the next transfer
+    //
+    if (!rb_get_pointers(&tx_buf, RB_READ, TX_BUF_SIZE, &ptr, &len, NULL, NULL))
+        return;
+
+    tx_len = len;
+
+    DMA1->LIFCR = DMA_LIFCR_CTCIF3 | DMA_LIFCR_CHTIF3  |
+                  DMA_LIFCR_CTEIF3 | DMA_LIFCR_CDMEIF3 |
+                  DMA_LIFCR_CFEIF3;
+
+    TX_STREAM->M0AR = (uint32_t)ptr;
+    TX_STREAM->NDTR = len;
+    TX_STREAM->CR  |= DMA_SxCR_EN;
+
+    xbee_stats.tx_bursts++;
+}
 
 
 void USART3_IRQHandler(void)
 {
     portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
 
-    if (USART3->SR & USART_SR_RXNE) {
-        char  c = USART3->DR;
+    if (USART3->SR & USART_SR_IDLE) {
+        // Cleared by reading SR, then DR
+        //
+        (void)USART3->DR;
 
-        if (xQueueSendFromISR(rx_queue, &c, &xHigherPriorityTaskWoken))
-            xbee_stats.rx_bytes++;
-        else
-            xbee_stats.rx_overrun++;
+        rx_update();
+        xSemaphoreGiveFromISR(rx_sem, &xHigherPriorityTaskWoken);
     }
 
-    if (USART3->SR & USART_SR_TXE) {
-        char c;
-        if (xQueueReceiveFromISR(tx_queue, &c, &xHigherPriorityTaskWoken)) {
-            // send a queued byte
-            //
-            USART3->DR = c;
-            xbee_stats.tx_bytes++;
-        }
-        else {
-            // nothing to send, disable interrupt
-            //
-            USART3->CR1 &= ~USART_CR1_TXEIE;
-        }
-    }
+    portEND_SWITCHING_ISR(xHigherPriorityTaskWoken);
+}
+
+
+void DMA1_Stream1_IRQHandler(void)
+{
+    portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
+
+    DMA1->LIFCR = DMA_LIFCR_CTCIF1 | DMA_LIFCR_CHTIF1;
+    DMA1->LIFCR; // dummy read to prevent IRQ glitches
+
+    rx_update();
+    xSemaphoreGiveFromISR(rx_sem, &xHigherPriorityTaskWoken);
 
     portEND_SWITCHING_ISR(xHigherPriorityTaskWoken);
 }
 
 
+void DMA1_Stream3_IRQHandler(void)
+{
+    portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
+
+    DMA1->LIFCR = DMA_LIFCR_CTCIF3;
+    DMA1->LIFCR; // dummy read to prevent IRQ glitches
+
+    rb_commit(&tx_buf, RB_READ, tx_len);
+    xbee_stats.tx_bytes += tx_len;
+
+    tx_start();
+    xSemaphoreGiveFromISR(tx_sem, &xHigherPriorityTaskWoken);
+
+    portEND_SWITCHING_ISR(xHigherPriorityTaskWoken);
+}
+
+
+/**
+ * Send shell output as MSG_ID_SHELL_TO_PC packets.
+ *
+ */
 static ssize_t xbee_write_r(struct _reent *r, int fd, const void *ptr, size_t len)
 {
     const char *src = ptr;
-    int sent = 0;
+    struct msg_shell_to_pc msg;
+    int n = 0;
 
-    while (len--) {
+    msg.h.id = MSG_ID_SHELL_TO_PC;
+
+    for (size_t i=0; i<len; i++) {
         // Convert c-newlines to terminal CRLF
         //
-        if (*src == '\n') {
-            xQueueSend(tx_queue, "\r", portMAX_DELAY);
-            USART3->CR1 |= USART_CR1_TXEIE;
+        if (src[i] == '\n')
+            msg.data[n++] = '\r';
+
+        msg.data[n++] = src[i];
+
+        // Leave room for a CRLF pair
+        //
+        if (n >= (int)sizeof(msg.data) - 1 || i == len-1) {
+            msg.h.data_len = n;
+            if (msg_send(&msg.h) < 0)
+                return i ? (ssize_t)i : -1;
+            n = 0;
+        }
+    }
+
+    return len;
+}
+
+
+/**
+ * Write binary data without newline conversion.
+ *
+ */
+ssize_t xbee_write_raw(const void *ptr, size_t len)
+{
+    const char *src = ptr;
+    size_t left = len;
+
+    xSemaphoreTake(tx_mutex, portMAX_DELAY);
+
+    while (left) {
+        void   *ptr1, *ptr2;
+        size_t len1, len2;
+
+        size_t n = rb_get_pointers(&tx_buf, RB_WRITE, left, &ptr1, &len1, &ptr2, &len2);
+        if (!n) {
+            // Wait for the running transfer to complete
+            //
+            xbee_stats.tx_full++;
+            xSemaphoreTake(tx_sem, portMAX_DELAY);
+            continue;
         }
 
-        xQueueSend(tx_queue, src++, portMAX_DELAY);
-        USART3->CR1 |= USART_CR1_TXEIE;
+        memcpy(ptr1, src, len1);
+        memcpy(ptr2, src + len1, len2);
+        rb_commit(&tx_buf, RB_WRITE, n);
 
-        sent++;
+        src  += n;
+        left -= n;
+
+        taskENTER_CRITICAL();
+        tx_start();
+        taskEXIT_CRITICAL();
     }
-    return sent;
+
+    xSemaphoreGive(tx_mutex);
+    return len;
 }
 
 
-static ssize_t xbee_read_r(struct _reent *r, int fd, void *ptr, size_t len)
+/**
+ * Drop the rx_buf contents after an overrun.
+ * The packet decoder resyncs on the next frame.
+ */
+static void rx_drop_overrun(void)
 {
-    // Blocking wait for the first char
-    //
-    unsigned timeout = portMAX_DELAY;
+    if (rx_overrun) {
+        rx_overrun = false;
+        rb_commit(&rx_buf, RB_READ, rb_bytes_used(&rx_buf));
+    }
+}
 
+
+static ssize_t xbee_read_r(struct _reent *r, int fd, void *ptr, size_t len)
+{
     char *dest = ptr;
     int  received = 0;
     static char last_c;
 
-    while (len--) {
-        char c;
-        if (!xQueueReceive(rx_queue, &c, timeout))
-            break;
+    // Blocking wait for the first char
+    //
+    while (!received) {
+        rx_drop_overrun();
 
-        // Convert terminal CRLF to c-newline
-        //
-        if (c == '\n' && last_c == '\r')
-            if (!xQueueReceive(rx_queue, &c, timeout))
-                break;
+        while (!rb_bytes_used(&rx_buf)) {
+            xSemaphoreTake(rx_sem, portMAX_DELAY);
+            rx_drop_overrun();
+        }
 
-        if (c == '\r')
-            *dest++ = '\n';
-        else
-            *dest++ = c;
+        while (len) {
+            int c = rb_getchar(&rx_buf);
+            if (c < 0)
+                break;
 
-        last_c  = c;
-        timeout = 0;
-        received++;
+            // Convert terminal CRLF to c-newline
+            //
+            if (c == '\n' && last_c == '\r') {
+                last_c = 0;
+                continue;
+            }
+
+            if (c == '\r')
+                *dest++ = '\n';
+            else
+                *dest++ = c;
+
+            last_c = c;
+            received++;
+            len--;
+        }
     }
 
     return received;
@@ -114,7 +292,8 @@ static ssize_t xbee_read_r(struct _reent *r, int fd, void *ptr, size_t len)
 
 static ssize_t xbee_chars_avail_r(struct _reent *r, int fd)
 {
-    return uxQueueMessagesWaiting(rx_queue);
+    rx_drop_overrun();
+    return rb_bytes_used(&rx_buf);
 }
 
 
@@ -200,18 +379,57 @@ void xbee_init(void)
 {
     xbee_init_uart();
 
-    if (!rx_queue) rx_queue = xQueueCreate(RX_QUEUE_SIZE, 1);
-    if (!tx_queue) tx_queue = xQueueCreate(TX_QUEUE_SIZE, 1);
+    if (!rx_sem)   rx_sem   = xSemaphoreCreateBinary();
+    if (!tx_sem)   tx_sem   = xSemaphoreCreateBinary();
+    if (!tx_mutex) tx_mutex = xSemaphoreCreateMutex();
+
+    RCC->AHB1ENR |= RCC_AHB1Periph_DMA1;
+
+    // RX: circular transfer into rx_buf, with interrupts
+    // at half and full buffer and on idle line
+    //
+    RX_STREAM->CR &= ~DMA_SxCR_EN;
+    while (RX_STREAM->CR & DMA_SxCR_EN);
+
+    DMA1->LIFCR = DMA_LIFCR_CTCIF1 | DMA_LIFCR_CHTIF1  |
+                  DMA_LIFCR_CTEIF1 | DMA_LIFCR_CDMEIF1 |
+                  DMA_LIFCR_CFEIF1;
+
+    RX_STREAM->PAR  = (uint32_t)&USART3->DR;
+    RX_STREAM->M0AR = (uint32_t)rx_buf.buf;
+    RX_STREAM->NDTR = rx_buf.buf_size;
+    RX_STREAM->CR   = DMA_Channel_4 | DMA_SxCR_MINC | DMA_SxCR_CIRC |
+                      DMA_SxCR_HTIE | DMA_SxCR_TCIE;
+    RX_STREAM->CR  |= DMA_SxCR_EN;
+
+    // TX: started by tx_start()
+    //
+    TX_STREAM->CR &= ~DMA_SxCR_EN;
+    while (TX_STREAM->CR & DMA_SxCR_EN);
+
+    TX_STREAM->PAR  = (uint32_t)&USART3->DR;
+    TX_STREAM->CR   = DMA_Channel_4 | DMA_SxCR_MINC | DMA_DIR_MemoryToPeripheral |
+                      DMA_SxCR_TCIE;
 
-    NVIC_Init(&(NVIC_InitTypeDef) {
-        .NVIC_IRQChannel = USART3_IRQn,
+    USART3->CR3 |= USART_CR3_DMAR | USART_CR3_DMAT;
+
+    NVIC_InitTypeDef nvic = {
         .NVIC_IRQChannelPreemptionPriority =
                 configLIBRARY_LOWEST_INTERRUPT_PRIORITY,
         .NVIC_IRQChannelSubPriority = 0,
         .NVIC_IRQChannelCmd = ENABLE
-    });
+    };
+
+    nvic.NVIC_IRQChannel = USART3_IRQn;
+    NVIC_Init(&nvic);
+
+    nvic.NVIC_IRQChannel = DMA1_Stream1_IRQn;
+    NVIC_Init(&nvic);
+
+    nvic.NVIC_IRQChannel = DMA1_Stream3_IRQn;
+    NVIC_Init(&nvic);
 
-    USART_ITConfig(USART3, USART_IT_RXNE, ENABLE);
+    USART_ITConfig(USART3, USART_IT_IDLE, ENABLE);
 
     dev_register("xbee", &term_xbee_ops);
 }
@@ -228,10 +446,16 @@ struct file_ops term_xbee_ops = {
 //
 static void cmd_xbee_stats(void)
 {
-    printf("rx_bytes:   %10lu\n", xbee_stats.rx_bytes);
-    printf("rx_overrun: %10lu\n", xbee_stats.rx_overrun);
-    printf("tx_bytes:   %10lu\n", xbee_stats.tx_bytes);
-    printf("tx_overrun: %10lu\n", xbee_stats.tx_overrun);
+    const struct xbee_stats s = xbee_stats;
+
+    printf("rx_bytes:   %10lu\n", s.rx_bytes);
+    printf("rx_overrun: %10lu\n", s.rx_overrun);
+    printf("rx_bursts:  %10lu  (%lu bytes/burst)\n", s.rx_bursts,
+        s.rx_bursts ? s.rx_bytes / s.rx_bursts : 0);
+    printf("tx_bytes:   %10lu\n", s.tx_bytes);
+    printf("tx_full:    %10lu\n", s.tx_full);
+    printf("tx_bursts:  %10lu  (%lu bytes/burst)\n", s.tx_bursts,
+        s.tx_bursts ? s.tx_bytes / s.tx_bursts : 0);
 }
 
 SHELL_CMD(xbee_stats, (cmdfunc_t)cmd_xbee_stats, "show XBee statistics")
@@ -2,8 +2,11 @@
 
 #include "syscalls.h"
 
+#define XBEE_BAUDRATE  115200
+
 extern struct file_ops term_xbee_ops;
 
 void xbee_poll_send(const char *s);
+ssize_t xbee_write_raw(const void *ptr, size_t len);
 void xbee_init(void);
 
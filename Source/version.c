@@ -5,6 +5,9 @@
 #include "stm32f4xx.h"
 #include "util.h"
 #include "ff.h"
+#include "ustime.h"
+#include "Shared/crc32.h"
+#include "Shared/crc32_stm32.h"
 #include <stdio.h>
 
 
@@ -73,4 +76,39 @@ void cmd_about(void)
     print_version_info(1);
 }
 
-SHELL_CMD(about, (cmdfunc_t)cmd_about, "about")
+/**
+ * Check the application image with the software and the hardware
+ * CRC. The image CRC is forged by add_version_info.py, so the CRC
+ * over the whole image is 0 if it is intact.
+ */
+void cmd_crc_bench(void)
+{
+    extern const unsigned char g_pfnVectors[];
+    static const struct {
+        const char *name;
+        crc32_t (*update)(crc32_t crc, const unsigned char *data, size_t data_len);
+    } impl[] = {
+        { "slicing-by-8", crc32_update    },
+        { "hardware",     crc32_update_hw }
+    };
+
+    printf("image: %lu bytes\n", version_info.image_size);
+
+    for (unsigned i=0; i<ARRAY_SIZE(impl); i++) {
+        uint32_t t0 = get_us_time32();
+
+        crc32_t crc = crc32_init();
+        crc = impl[i].update(crc, g_pfnVectors, version_info.image_size);
+        crc = crc32_finalize(crc);
+
+        uint32_t t = get_us_time32() - t0;
+
+        printf("%-12s 0x%08lx %s %6lu us, %5lu KB/s\n",
+            impl[i].name, crc, crc ? "BAD" : "ok ", t,
+            t ? (uint32_t)(version_info.image_size * 1000ULL / t) : 0
+        );
+    }
+}
+
+SHELL_CMD(about,     (cmdfunc_t)cmd_about,     "about")
+SHELL_CMD(crc_bench, (cmdfunc_t)cmd_crc_bench, "Check image CRC in software and hardware")
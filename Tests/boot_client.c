@@ -0,0 +1,461 @@
+/**
+ * \file
+ * Bootloader client for host tests
+ *
+ * Copyright (c)2015 Thomas Kindler <mail_drquad@t-kindler.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "boot_client.h"
+#include "test.h"
+#include "Shared/crc16.h"
+#include "Shared/crc32.h"
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+// Built by Bootloader/host/Makefile
+//
+#ifndef BOOT_EMU
+#define BOOT_EMU    "obj_boot_host/f00b00t_emu"
+#endif
+
+
+const struct boot_sector boot_sectors[BOOT_NUM_SECTORS] = {
+    { 0x08000000, 0x4000  }, { 0x08004000, 0x4000  },
+    { 0x08008000, 0x4000  }, { 0x0800C000, 0x4000  },
+    { 0x08010000, 0x10000 }, { 0x08020000, 0x20000 },
+    { 0x08040000, 0x20000 }, { 0x08060000, 0x20000 },
+    { 0x08080000, 0x20000 }, { 0x080A0000, 0x20000 },
+    { 0x080C0000, 0x20000 }, { 0x080E0000, 0x20000 }
+};
+
+
+/**
+ * Find a free TCP port.
+ *
+ * \return  port number, -1 on error
+ */
+static int free_port(void)
+{
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_addr   = { .s_addr = htonl(INADDR_LOOPBACK) }
+    };
+    socklen_t len = sizeof(addr);
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+
+    if (bind(fd, (void*)&addr, sizeof(addr)) < 0 ||
+        getsockname(fd, (void*)&addr, &len) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    close(fd);
+    return ntohs(addr.sin_port);
+}
+
+
+/**
+ * Start the emulator and connect to it.
+ *
+ * \param   options     additional emulator options, e.g. "-b 0 -e 0"
+ * \return  0 on success, -1 on error
+ */
+int boot_emu_start(struct boot_client *c, const char *flash_file, const char *options)
+{
+    memset(c, 0, sizeof(*c));
+    c->fd = -1;
+    c->max_data_size  = MSG_MAX_DATA_SIZE;
+    c->rx_buffer_size = 0;
+
+    cobsr_decoder_init(&c->dec, c->frame, sizeof(c->frame));
+
+    int port = free_port();
+    if (port < 0)
+        return -1;
+
+    char cmd[512];
+    snprintf(cmd, sizeof(cmd), "exec %s -p %d -f %s %s >/dev/null",
+        BOOT_EMU, port, flash_file, options ? options : "");
+
+    c->pid = fork();
+    if (c->pid < 0)
+        return -1;
+
+    if (c->pid == 0) {
+        execl("/bin/sh", "sh", "-c", cmd, (char*)NULL);
+        _exit(127);
+    }
+
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port   = htons(port),
+        .sin_addr   = { .s_addr = htonl(INADDR_LOOPBACK) }
+    };
+
+    for (int tries = 0; tries < 200; tries++) {
+        c->fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (c->fd < 0)
+            break;
+
+        if (connect(c->fd, (void*)&addr, sizeof(addr)) == 0) {
+            int one = 1;
+            setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            return 0;
+        }
+
+        close(c->fd);
+        c->fd = -1;
+        usleep(10000);
+    }
+
+    boot_emu_stop(c);
+    return -1;
+}
+
+
+void boot_emu_stop(struct boot_client *c)
+{
+    if (c->fd >= 0)
+        close(c->fd);
+
+    if (c->pid > 0) {
+        kill(c->pid, SIGTERM);
+        waitpid(c->pid, NULL, 0);
+    }
+
+    c->fd  = -1;
+    c->pid = 0;
+}
+
+
+/**
+ * Send a message.
+ *
+ * \return  0 on success, -1 on error
+ */
+int boot_send(struct boot_client *c, uint16_t id, const void *data, size_t len)
+{
+    uint8_t msg[2 + 2 + MSG_MAX_LINK_DATA_SIZE];
+    uint8_t buf[1 + COBSR_ENCODE_DST_BUF_LEN_MAX(sizeof(msg)) + 1];
+
+    if (len > (size_t)c->max_data_size) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+
+    memcpy(&msg[2], &id, 2);
+    memcpy(&msg[4], data, len);
+
+    crc16_t crc = crc16_init();
+    crc = crc16_update(crc, &msg[2], 2 + len);
+    crc = crc16_finalize(crc);
+    memcpy(&msg[0], &crc, 2);
+
+    ssize_t n = cobsr_encode(&buf[1], sizeof(buf) - 2, msg, 2 + 2 + len);
+    if (n < 0)
+        return -1;
+
+    buf[0] = 0;
+    buf[1 + n] = 0;
+
+    for (size_t pos = 0; pos < (size_t)n + 2; ) {
+        ssize_t res = write(c->fd, &buf[pos], n + 2 - pos);
+        if (res < 0)
+            return -1;
+        pos += res;
+    }
+
+    return 0;
+}
+
+
+/**
+ * Receive a message. Packets with a wrong crc are skipped.
+ *
+ * \return  1 if a message was received, 0 on timeout, -1 on error
+ */
+int boot_recv(struct boot_client *c, struct msg_large *msg, int timeout_ms)
+{
+    double t_end = test_time() + timeout_ms / 1000.0;
+
+    for (;;) {
+        while (c->rx_pos < c->rx_len) {
+            size_t consumed;
+            ssize_t len = cobsr_decoder_feed(&c->dec,
+                &c->rx_buf[c->rx_pos], c->rx_len - c->rx_pos, &consumed);
+
+            c->rx_pos += consumed;
+
+            if (len < 4)
+                continue;
+
+            crc16_t crc = crc16_init();
+            crc = crc16_update(crc, &c->frame[2], len - 2);
+            crc = crc16_finalize(crc);
+
+            if (memcmp(&crc, &c->frame[0], 2))
+                continue;
+
+            msg->h.data_len = len - 4;
+            memcpy(&msg->h.crc, c->frame, len);
+            return 1;
+        }
+
+        int wait_ms = (t_end - test_time()) * 1000;
+        if (wait_ms < 0)
+            return 0;
+
+        struct pollfd pfd = { .fd = c->fd, .events = POLLIN };
+        int res = poll(&pfd, 1, wait_ms);
+        if (res < 0)
+            return -1;
+        if (res == 0)
+            return 0;
+
+        ssize_t n = read(c->fd, c->rx_buf, sizeof(c->rx_buf));
+        if (n <= 0) {
+            errno = ECONNRESET;
+            return -1;
+        }
+
+        c->rx_pos = 0;
+        c->rx_len = n;
+    }
+}
+
+
+/**
+ * Wait for a MSG_ID_BOOT_RESPONSE. Other messages, e.g. the
+ * shell output of the bootloader, are skipped.
+ *
+ * \param   data    receives the response data, if not NULL
+ * \param   len     size of data, returns the data length
+ * \return  error code of the response, -1 on timeout
+ */
+int boot_response(struct boot_client *c, void *data, size_t *len, int timeout_ms)
+{
+    static struct msg_large msg;
+
+    for (;;) {
+        int res = boot_recv(c, &msg, timeout_ms);
+        if (res <= 0) {
+            if (res == 0)
+                errno = ETIMEDOUT;
+            return -1;
+        }
+
+        if (msg.h.id != MSG_ID_BOOT_RESPONSE || msg.h.data_len < 4)
+            continue;
+
+        int error;
+        memcpy(&error, msg.data, 4);
+
+        if (data && len) {
+            size_t n = msg.h.data_len - 4;
+            if (n > *len)
+                n = *len;
+            memcpy(data, &msg.data[4], n);
+            *len = n;
+        }
+
+        return error;
+    }
+}
+
+
+/**
+ * Send a request and wait for the response.
+ *
+ * \return  error code of the response, -1 on timeout
+ */
+int boot_request(struct boot_client *c, uint16_t id, const void *req, size_t req_len, void *data, size_t *len)
+{
+    if (boot_send(c, id, req, req_len) < 0)
+        return -1;
+
+    return boot_response(c, data, len, 5000);
+}
+
+
+/**
+ * Wait for the response to the oldest pending request.
+ *
+ * \return  0 on success, -1 on timeout
+ */
+static int boot_wait_pending(struct boot_client *c)
+{
+    int res = boot_response(c, NULL, NULL, 5000);
+    if (res < 0)
+        return -1;
+
+    if (res && !c->error)
+        c->error = res;
+
+    c->pending_bytes -= c->pending_len[c->pending_head];
+    c->pending_head = (c->pending_head + 1) % 1024;
+    c->pending--;
+    return 0;
+}
+
+
+/**
+ * Send a request without waiting for the response. Waits for
+ * earlier responses while more than window bytes are in flight.
+ *
+ * \return  0 on success, -1 on error
+ */
+int boot_async(struct boot_client *c, uint16_t id, const void *req, size_t req_len, size_t window)
+{
+    // Bytes on the link: crc, id, data, COBS/R and packet markers
+    //
+    size_t bytes = COBSR_ENCODE_DST_BUF_LEN_MAX(2 + 2 + req_len) + 2;
+
+    while (c->pending > 0 && (c->pending >= 1024 || c->pending_bytes + bytes > window)) {
+        if (boot_wait_pending(c) < 0)
+            return -1;
+    }
+
+    if (boot_send(c, id, req, req_len) < 0)
+        return -1;
+
+    c->pending_len[(c->pending_head + c->pending) % 1024] = bytes;
+    c->pending_bytes += bytes;
+    c->pending++;
+    return 0;
+}
+
+
+/**
+ * Wait for all pending requests.
+ *
+ * \return  first error response, 0 if none, -1 on timeout
+ */
+int boot_sync(struct boot_client *c)
+{
+    while (c->pending > 0) {
+        if (boot_wait_pending(c) < 0)
+            return -1;
+    }
+
+    int error = c->error;
+    c->error = 0;
+    return error;
+}
+
+
+/**
+ * Enter the bootloader and set up the link.
+ *
+ * \param   max_data_size   requested message size
+ * \return  0 on success, -1 on error
+ */
+int boot_enter(struct boot_client *c, int max_data_size)
+{
+    uint32_t magic = BOOT_ENTER_MAGIC;
+
+    if (boot_request(c, MSG_ID_BOOT_ENTER, &magic, sizeof(magic), NULL, NULL) != 0)
+        return -1;
+
+    uint16_t setup[2] = { max_data_size, 0 };
+    uint16_t res[3];
+    size_t len = sizeof(res);
+
+    if (boot_request(c, MSG_ID_LINK_SETUP, setup, sizeof(setup), res, &len) != 0 || len < 6)
+        return -1;
+
+    c->max_data_size  = res[0];
+    c->rx_buffer_size = res[2];
+    return 0;
+}
+
+
+/**
+ * Write data in messages of the negotiated size, with
+ * up to window bytes in flight. Call boot_sync() to wait
+ * for the last responses.
+ *
+ * \return  0 on success, -1 on error
+ */
+int boot_write(struct boot_client *c, uint32_t addr, const void *data, size_t len, size_t window)
+{
+    // Addresses and lengths must be word aligned
+    //
+    size_t chunk = (c->max_data_size - 4) & ~3;
+
+    for (size_t pos = 0; pos < len; pos += chunk) {
+        static uint8_t buf[4 + MSG_MAX_LINK_DATA_SIZE];
+        size_t n = len - pos < chunk ? len - pos : chunk;
+        uint32_t a = addr + pos;
+
+        memcpy(&buf[0], &a, 4);
+        memcpy(&buf[4], (const uint8_t *)data + pos, n);
+
+        if (boot_async(c, MSG_ID_BOOT_WRITE_DATA, buf, 4 + n, window) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * Check the flash contents with MSG_ID_BOOT_VERIFY.
+ *
+ * \return  0 if they match data, -1 if not
+ */
+int boot_verify(struct boot_client *c, uint32_t addr, const void *data, size_t len)
+{
+    uint32_t req[2] = { addr, len };
+    uint32_t crc;
+    size_t crc_len = sizeof(crc);
+
+    if (boot_request(c, MSG_ID_BOOT_VERIFY, req, sizeof(req), &crc, &crc_len) != 0 || crc_len != 4)
+        return -1;
+
+    return crc == boot_crc32(data, len) ? 0 : -1;
+}
+
+
+/**
+ * \return  sector index of a flash address, -1 if none
+ */
+int boot_sector_of(uint32_t addr)
+{
+    for (int i=0; i<BOOT_NUM_SECTORS; i++) {
+        if (addr >= boot_sectors[i].addr && addr < boot_sectors[i].addr + boot_sectors[i].size)
+            return i;
+    }
+
+    return -1;
+}
+
+
+uint32_t boot_crc32(const void *data, size_t len)
+{
+    crc32_t crc = crc32_init();
+    crc = crc32_update(crc, data, len);
+    return crc32_finalize(crc);
+}
@@ -0,0 +1,87 @@
+/**
+ * \file
+ * Bootloader client for host tests
+ *
+ * Starts the bootloader emulator (Bootloader/host) with a flash
+ * image file and talks to it over TCP with the plain message
+ * protocol, like QuadControl's BootProtocol does.
+ *
+ * Copyright (c)2015 Thomas Kindler <mail_drquad@t-kindler.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef BOOT_CLIENT_H_
+#define BOOT_CLIENT_H_
+
+#include "Shared/msg_structs.h"
+#include "Shared/cobsr.h"
+#include <stdint.h>
+#include <sys/types.h>
+
+#define BOOT_EMU_FLASH_BASE     0x08000000
+#define BOOT_EMU_FLASH_SIZE     0x100000
+#define BOOT_EMU_APP_START      0x08010000
+
+// Sector map of the STM32F405, see Bootloader/main.c
+//
+#define BOOT_NUM_SECTORS        12
+#define BOOT_FIRST_APP_SECTOR   4
+
+extern const struct boot_sector {
+    uint32_t    addr;
+    uint32_t    size;
+} boot_sectors[BOOT_NUM_SECTORS];
+
+
+struct boot_client {
+    pid_t       pid;            // emulator process
+    int         fd;
+
+    int         max_data_size;  // negotiated with MSG_ID_LINK_SETUP
+    int         rx_buffer_size; // bootloader receive buffer [bytes]
+
+    // Requests sent with boot_async(), oldest first
+    //
+    int         pending;
+    int         pending_head;
+    size_t      pending_bytes;
+    uint16_t    pending_len[1024];
+    int         error;          // first error response
+
+    struct cobsr_decoder dec;
+    uint8_t     frame[2 + 2 + MSG_MAX_LINK_DATA_SIZE];
+    uint8_t     rx_buf[4096];
+    size_t      rx_pos, rx_len;
+};
+
+
+int     boot_emu_start(struct boot_client *c, const char *flash_file, const char *options);
+void    boot_emu_stop(struct boot_client *c);
+
+int     boot_send(struct boot_client *c, uint16_t id, const void *data, size_t len);
+int     boot_recv(struct boot_client *c, struct msg_large *msg, int timeout_ms);
+int     boot_response(struct boot_client *c, void *data, size_t *len, int timeout_ms);
+int     boot_request(struct boot_client *c, uint16_t id, const void *req, size_t req_len, void *data, size_t *len);
+
+int     boot_async(struct boot_client *c, uint16_t id, const void *req, size_t req_len, size_t window);
+int     boot_sync(struct boot_client *c);
+
+int     boot_enter(struct boot_client *c, int max_data_size);
+int     boot_write(struct boot_client *c, uint32_t addr, const void *data, size_t len, size_t window);
+int     boot_verify(struct boot_client *c, uint32_t addr, const void *data, size_t len);
+int     boot_sector_of(uint32_t addr);
+
+uint32_t boot_crc32(const void *data, size_t len);
+
+#endif /* BOOT_CLIENT_H_ */
@@ -0,0 +1,18 @@
+/**
+ * \file
+ * FreeRTOS stand-in for host tests
+ *
+ * Tasks are threads, and the tick count comes from the host clock.
+ * Only what the code under test uses is provided.
+ */
+#ifndef INC_FREERTOS_H
+#define INC_FREERTOS_H
+
+#include <stdint.h>
+
+#define configTICK_RATE_HZ  1000
+
+typedef uint32_t TickType_t;
+typedef long     BaseType_t;
+
+#endif /* INC_FREERTOS_H */
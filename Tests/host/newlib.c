@@ -0,0 +1,92 @@
+/**
+ * \file
+ * newlib stand-ins for Source/syscalls.c, see newlib.h
+ */
+#include "reent.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+ssize_t _read_r(struct _reent *r, int fd, void *ptr, size_t len);
+ssize_t _write_r(struct _reent *r, int fd, const void *ptr, size_t len);
+int     _open_r(struct _reent *r, const char *path, int flags, int mode);
+int     _close_r(struct _reent *r, int fd);
+
+static struct _reent host_reent;
+struct _reent *_impure_ptr = &host_reent;
+
+
+void __sinit(struct _reent *r)
+{
+    r->__sdidinit = 1;
+}
+
+
+int host_open(const char *path, int flags, ...)
+{
+    int fd = _open_r(_impure_ptr, path, flags, 0);
+    if (fd < 0)
+        errno = _impure_ptr->_errno;
+
+    return fd;
+}
+
+
+int host_close(int fd)
+{
+    int res = _close_r(_impure_ptr, fd);
+    if (res < 0)
+        errno = _impure_ptr->_errno;
+
+    return res;
+}
+
+
+static ssize_t cookie_read(void *cookie, char *buf, size_t len)
+{
+    return _read_r(_impure_ptr, (int)(intptr_t)cookie, buf, len);
+}
+
+
+static ssize_t cookie_write(void *cookie, const char *buf, size_t len)
+{
+    ssize_t n = _write_r(_impure_ptr, (int)(intptr_t)cookie, buf, len);
+
+    // glibc treats 0 as an error
+    //
+    return n < 0 ? 0 : n;
+}
+
+
+/**
+ * Set the buffering of a stream.
+ *
+ * Without a buffer, newlib allocates one of the given size,
+ * while glibc keeps its own. The buffers are never freed.
+ */
+int host_setvbuf(FILE *f, char *buf, int mode, size_t size)
+{
+    if (!buf && mode != _IONBF && size > 0) {
+        buf = malloc(size);
+        if (!buf)
+            return -1;
+    }
+
+    return setvbuf(f, buf, mode, size);
+}
+
+
+/**
+ * Open a stream on a file descriptor of Source/syscalls.c.
+ * Closing the stream does not close the descriptor.
+ */
+FILE *host_fdopen(int fd, const char *mode)
+{
+    cookie_io_functions_t io = {
+        .read  = cookie_read,
+        .write = cookie_write
+    };
+
+    return fopencookie((void*)(intptr_t)fd, mode, io);
+}
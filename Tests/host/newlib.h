@@ -0,0 +1,31 @@
+/**
+ * \file
+ * Builds Source/syscalls.c against glibc
+ *
+ * Included before anything else. The POSIX functions that syscalls.c
+ * defines or calls get host_ names, so they don't replace the C
+ * library's own. The streams from host_fdopen() read and write
+ * through _read_r() and _write_r(), and host_setvbuf() honours the
+ * buffer size, like newlib's, see newlib.c.
+ */
+#ifndef HOST_NEWLIB_H
+#define HOST_NEWLIB_H
+
+// Uses _r as a macro argument, so it must come first
+//
+#include <math.h>
+
+#define open        host_open
+#define close       host_close
+#define dup         host_dup
+#define dup2        host_dup2
+#define fdopen      host_fdopen
+#define _exit       host_exit
+#define setvbuf     host_setvbuf
+
+// Characters left in the read buffer, newlib's FILE::_r.
+// syscalls.c only uses it as stdin->_r.
+//
+#define _r          _IO_read_end - stdin->_IO_read_ptr
+
+#endif /* HOST_NEWLIB_H */
@@ -0,0 +1,24 @@
+/**
+ * \file
+ * newlib reentrancy stand-in for host tests
+ *
+ * Only errno and the stdio init flag are used, see Tests/host/newlib.h.
+ */
+#ifndef HOST_REENT_H
+#define HOST_REENT_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+struct _reent {
+    int     _errno;
+    int     __sdidinit;
+};
+
+extern struct _reent *_impure_ptr;
+
+typedef off_t _off_t;
+
+#define _EXFUN(name, proto)     name proto
+
+#endif /* HOST_REENT_H */
@@ -0,0 +1,100 @@
+/**
+ * \file
+ * FreeRTOS and ustime stand-ins for host tests
+ */
+#include "FreeRTOS.h"
+#include "task.h"
+#include "ustime.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+
+struct task_start {
+    TaskFunction_t  func;
+    void            *param;
+};
+
+
+uint64_t get_us_time64(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+
+uint32_t get_us_time32(void)
+{
+    return get_us_time64();
+}
+
+
+TickType_t xTaskGetTickCount(void)
+{
+    return get_us_time64() / (1000000 / configTICK_RATE_HZ);
+}
+
+
+void vTaskDelay(TickType_t ticks)
+{
+    struct timespec ts = {
+        .tv_sec  = ticks / configTICK_RATE_HZ,
+        .tv_nsec = ticks % configTICK_RATE_HZ * (1000000000 / configTICK_RATE_HZ)
+    };
+    nanosleep(&ts, NULL);
+}
+
+
+// Keeps the other tasks out, like the scheduler lock does
+//
+static pthread_mutex_t suspend_lock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+
+void vTaskSuspendAll(void)
+{
+    pthread_mutex_lock(&suspend_lock);
+}
+
+
+BaseType_t xTaskResumeAll(void)
+{
+    pthread_mutex_unlock(&suspend_lock);
+    return 0;
+}
+
+
+static void *task_thread(void *arg)
+{
+    struct task_start start = *(struct task_start *)arg;
+
+    free(arg);
+    start.func(start.param);
+    return NULL;
+}
+
+
+/**
+ * Run a task in its own thread.
+ *
+ * \return  0 on success, -1 on error
+ */
+int host_task_create(TaskFunction_t func, void *param)
+{
+    struct task_start *start = malloc(sizeof(*start));
+    pthread_t thread;
+
+    if (!start)
+        return -1;
+
+    start->func  = func;
+    start->param = param;
+
+    if (pthread_create(&thread, NULL, task_thread, start)) {
+        free(start);
+        return -1;
+    }
+
+    pthread_detach(thread);
+    return 0;
+}
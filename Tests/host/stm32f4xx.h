@@ -0,0 +1,14 @@
+/**
+ * \file
+ * CMSIS stand-in for host tests
+ */
+#ifndef HOST_STM32F4XX_H
+#define HOST_STM32F4XX_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#define __BKPT(n)       abort()
+#define __get_MSP()     ((uintptr_t)0)
+
+#endif /* HOST_STM32F4XX_H */
@@ -0,0 +1,23 @@
+/**
+ * \file
+ * FreeRTOS task API stand-in for host tests
+ */
+#ifndef INC_TASK_H
+#define INC_TASK_H
+
+#include "FreeRTOS.h"
+
+typedef void (*TaskFunction_t)(void *);
+typedef void *TaskHandle_t;
+
+#define taskDISABLE_INTERRUPTS()
+
+TickType_t xTaskGetTickCount(void);
+void vTaskDelay(TickType_t ticks);
+
+void vTaskSuspendAll(void);
+BaseType_t xTaskResumeAll(void);
+
+int host_task_create(TaskFunction_t func, void *param);
+
+#endif /* INC_TASK_H */
@@ -0,0 +1,211 @@
+/**
+ * \file
+ * Blackbox logger on a FatFs RAM disk
+ *
+ * Runs Source/blackbox.c and Source/ramdisk.c with FatFs on the host.
+ * The blackbox task runs in its own thread. The test logs at the
+ * flight control rate, then as fast as possible, parses the files
+ * back and checks that every accepted record is in the file, and
+ * measures the write throughput with "blackbox bench".
+ *
+ * Copyright (c)2015 Thomas Kindler <mail_drquad@t-kindler.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "test.h"
+#include "blackbox.h"
+#include "sensors.h"
+#include "rc_input.h"
+#include "attitude.h"
+#include "bldc_task.h"
+#include "command.h"
+#include "ff.h"
+#include "task.h"
+#include <string.h>
+
+#define RAMDISK_SIZE    (1024 * 1024)
+
+// The RAM disk, placed like the linker script does on the target
+//
+#define STR(x)  #x
+#define XSTR(x) STR(x)
+
+__asm__(
+    ".bss\n"
+    ".global _ramdisk_start, _ramdisk_end\n"
+    ".balign 4\n"
+    "_ramdisk_start: .space " XSTR(RAMDISK_SIZE) "\n"
+    "_ramdisk_end:\n"
+    ".previous\n"
+);
+
+// Flight controller state logged by blackbox_log()
+//
+struct dcm dcm;
+struct bldc_state bldc_state;
+
+extern const struct cmd_info __shell_cmd_blackbox;
+
+
+/**
+ * Read a log file and check the records.
+ *
+ * \param   payload     if not NULL, check each record against the
+ *                      expected 32 bit payloads, in order
+ * \param   count       receives the number of records per type
+ * \return  number of records
+ */
+static int check_log(const char *name, const uint32_t *payload, int count[5])
+{
+    static uint8_t buf[RAMDISK_SIZE];
+    FIL  fil;
+    UINT len;
+
+    CHECK(f_open(&fil, name, FA_READ) == FR_OK);
+    CHECK(f_read(&fil, buf, sizeof(buf), &len) == FR_OK);
+    CHECK(f_close(&fil) == FR_OK);
+
+    memset(count, 0, 5 * sizeof(int));
+
+    int      records = 0;
+    uint8_t  seq = 0;
+    uint32_t prev_time = 0;
+
+    for (UINT pos = 0; pos < len; records++) {
+        struct bb_header hdr;
+
+        CHECK(pos + sizeof(hdr) <= len);
+        memcpy(&hdr, &buf[pos], sizeof(hdr));
+        pos += sizeof(hdr);
+
+        CHECK(hdr.sync == BB_SYNC);
+        CHECK(hdr.type <= BB_REC_MOTORS);
+        CHECK(pos + hdr.len <= len);
+        CHECK(records == 0 || hdr.timestamp - prev_time < 1000000);
+
+        if (payload) {
+            // Dropped records leave a gap in the sequence numbers
+            //
+            uint32_t expected = payload[records];
+            uint32_t data;
+
+            CHECK(hdr.len == sizeof(data));
+            memcpy(&data, &buf[pos], sizeof(data));
+            CHECK(data == expected);
+            CHECK(hdr.seq == (uint8_t)expected);
+        }
+        else {
+            CHECK(hdr.seq == seq);
+        }
+
+        count[hdr.type]++;
+        seq = hdr.seq + 1;
+        prev_time = hdr.timestamp;
+        pos += hdr.len;
+    }
+
+    return records;
+}
+
+
+/**
+ * Log at the flight control rate. Nothing may be dropped.
+ */
+static void test_flight_rate(void)
+{
+    struct sensor_data sensors = { };
+    struct rc_input rc = {
+        .valid = true,
+        .rssi = 100,
+        .num_channels = 8
+    };
+    int count[5];
+
+    CHECK(blackbox_start() == 0);
+
+    for (int i=0; i<2000; i++) {
+        sensors.acc.x  = i * 0.01f;
+        sensors.gyro.z = -i * 0.001f;
+        for (int ch=0; ch<rc.num_channels; ch++)
+            rc.channels[ch] = 1000 + i;
+
+        blackbox_log(&sensors, &rc);
+        vTaskDelay(1);
+    }
+
+    CHECK(blackbox_stop() == 0);
+
+    int records = check_log("BB000.BIN", NULL, count);
+    printf("flight rate:  %d records, %d sensors, %d attitude, %d rc, %d motors\n",
+        records, count[BB_REC_SENSORS], count[BB_REC_ATTITUDE],
+        count[BB_REC_RC], count[BB_REC_MOTORS]);
+
+    CHECK(count[BB_REC_SENSORS]  == 2000);
+    CHECK(count[BB_REC_ATTITUDE] == 2000);
+    CHECK(count[BB_REC_RC]       == 200);
+    CHECK(count[BB_REC_MOTORS]   == 200);
+}
+
+
+/**
+ * Log as fast as possible. Records may be dropped, but every
+ * accepted record must be in the file, in order.
+ */
+static void test_overload(void)
+{
+    enum { NUM_RECORDS = 100000 };
+    static uint32_t accepted[NUM_RECORDS];
+    int num_accepted = 0;
+    int count[5];
+
+    CHECK(blackbox_start() == 0);
+
+    // 200 records per tick is about three times
+    // what the writer drains with its 10 ms period
+    //
+    double t0 = test_time();
+    for (uint32_t i=0; i<NUM_RECORDS; i++) {
+        // The payload carries the sequence number in the low byte
+        //
+        if (blackbox_write(BB_REC_SENSORS, &i, sizeof(i)) == 0)
+            accepted[num_accepted++] = i;
+
+        if (i % 200 == 199)
+            vTaskDelay(1);
+    }
+    double dt = test_time() - t0;
+
+    CHECK(blackbox_stop() == 0);
+
+    int records = check_log("BB001.BIN", accepted, count);
+    printf("overload:     %d of %d records in %.3f s, %d dropped\n",
+        records, NUM_RECORDS, dt, NUM_RECORDS - num_accepted);
+
+    CHECK(records == num_accepted);
+    CHECK(num_accepted > 0 && num_accepted < NUM_RECORDS);
+}
+
+
+int main(void)
+{
+    CHECK(host_task_create(blackbox_task, NULL) == 0);
+
+    test_flight_rate();
+    test_overload();
+
+    char *argv[] = { "blackbox", "bench", "512", NULL };
+    __shell_cmd_blackbox.func(3, argv);
+
+    return 0;
+}
@@ -0,0 +1,258 @@
+/**
+ * \file
+ * Delta flashing against the bootloader emulator
+ *
+ * Updates the emulated flash with a series of images, using the
+ * same plan as BootProtocol::planDelta(). The flash image file is
+ * compared with each image afterwards.
+ *
+ * Copyright (c)2015 Thomas Kindler <mail_drquad@t-kindler.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "test.h"
+#include "boot_client.h"
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#define BLOCK_SIZE      4096
+#define MAX_IMAGE       (BOOT_EMU_FLASH_BASE + BOOT_EMU_FLASH_SIZE - BOOT_EMU_APP_START)
+#define NUM_RANDOM      30
+#define WINDOW          4096    // bytes in flight
+
+static uint32_t seed = 1;
+static char flash_file[] = "/tmp/test_boot_delta.XXXXXX";
+
+
+struct plan {
+    int         erase[BOOT_NUM_SECTORS];
+    int         num_erase;
+    uint8_t     write[MAX_IMAGE / BLOCK_SIZE];  // block n must be written
+    size_t      bytes;
+};
+
+
+/**
+ * Get the flash checksums of the blocks covering the image,
+ * see BootProtocol::bootChecksums().
+ */
+static int get_checksums(struct boot_client *c, uint32_t addr, size_t len, uint32_t *crcs)
+{
+    uint32_t end = addr + len;
+    int n = 0;
+
+    while (addr < end) {
+        uint32_t req[3] = { addr, end - addr, BLOCK_SIZE };
+        uint32_t res[MSG_MAX_DATA_SIZE / 4];
+        size_t res_len = sizeof(res);
+
+        CHECK(boot_request(c, MSG_ID_BOOT_CHECKSUMS, req, sizeof(req), res, &res_len) == 0);
+        CHECK(res_len >= 4);
+
+        for (size_t i=0; i < res_len / 4 && addr < end; i++) {
+            crcs[n++] = res[i];
+            addr = (addr / BLOCK_SIZE + 1) * BLOCK_SIZE;
+            if (addr > end)
+                addr = end;
+        }
+    }
+
+    return n;
+}
+
+
+/**
+ * See BootProtocol::planDelta()
+ */
+static void plan_delta(struct boot_client *c, const uint8_t *img, size_t len, struct plan *p)
+{
+    static uint32_t crcs[MAX_IMAGE / BLOCK_SIZE];
+    static uint8_t  empty[BLOCK_SIZE];
+    int same[MAX_IMAGE / BLOCK_SIZE], is_empty[MAX_IMAGE / BLOCK_SIZE];
+
+    memset(empty, 0xFF, sizeof(empty));
+    memset(p, 0, sizeof(*p));
+
+    int n = get_checksums(c, BOOT_EMU_APP_START, len, crcs);
+    CHECK(n == (int)((len + BLOCK_SIZE - 1) / BLOCK_SIZE));
+
+    for (int b=0; b<n; b++) {
+        size_t off = b * BLOCK_SIZE;
+        size_t blen = len - off < BLOCK_SIZE ? len - off : BLOCK_SIZE;
+
+        same[b]     = crcs[b] == boot_crc32(&img[off], blen);
+        is_empty[b] = crcs[b] == boot_crc32(empty, blen);
+
+        int sector = boot_sector_of(BOOT_EMU_APP_START + off);
+        CHECK(sector >= BOOT_FIRST_APP_SECTOR);
+
+        if (!same[b] && !is_empty[b]) {
+            int known = 0;
+            for (int i=0; i<p->num_erase; i++)
+                known |= p->erase[i] == sector;
+            if (!known)
+                p->erase[p->num_erase++] = sector;
+        }
+    }
+
+    for (int b=0; b<n; b++) {
+        int sector = boot_sector_of(BOOT_EMU_APP_START + b * BLOCK_SIZE);
+        int erased = 0;
+
+        for (int i=0; i<p->num_erase; i++)
+            erased |= p->erase[i] == sector;
+
+        if (!same[b] || erased) {
+            size_t off = b * BLOCK_SIZE;
+            p->write[b] = 1;
+            p->bytes += len - off < BLOCK_SIZE ? len - off : BLOCK_SIZE;
+        }
+    }
+}
+
+
+/**
+ * Update the flash to an image in delta mode. Each erase is
+ * sent right before the first write into its sector.
+ */
+static void flash_delta(struct boot_client *c, const uint8_t *img, size_t len, struct plan *p)
+{
+    int erased[BOOT_NUM_SECTORS] = { };
+
+    plan_delta(c, img, len, p);
+
+    for (size_t b=0; b * BLOCK_SIZE < len; b++) {
+        if (!p->write[b])
+            continue;
+
+        uint32_t addr = BOOT_EMU_APP_START + b * BLOCK_SIZE;
+        int sector = boot_sector_of(addr);
+
+        for (int i=0; i<p->num_erase; i++) {
+            if (p->erase[i] == sector && !erased[sector]) {
+                uint8_t s = sector;
+                CHECK(boot_async(c, MSG_ID_BOOT_ERASE_SECTOR, &s, 1, WINDOW) == 0);
+                erased[sector] = 1;
+            }
+        }
+
+        size_t n = len - b * BLOCK_SIZE < BLOCK_SIZE ? len - b * BLOCK_SIZE : BLOCK_SIZE;
+        CHECK(boot_write(c, addr, &img[b * BLOCK_SIZE], n, WINDOW) == 0);
+    }
+
+    CHECK(boot_sync(c) == 0);
+    CHECK(boot_verify(c, BOOT_EMU_APP_START, img, len) == 0);
+}
+
+
+/**
+ * Compare the flash image file with an image.
+ */
+static void check_flash(const uint8_t *img, size_t len)
+{
+    static uint8_t buf[MAX_IMAGE];
+
+    int fd = open(flash_file, O_RDONLY);
+    CHECK(fd >= 0);
+    CHECK(pread(fd, buf, len, BOOT_EMU_APP_START - BOOT_EMU_FLASH_BASE) == (ssize_t)len);
+    close(fd);
+
+    CHECK(!memcmp(buf, img, len));
+}
+
+
+static void update(struct boot_client *c, const char *name, const uint8_t *img, size_t len, struct plan *p)
+{
+    double t0 = test_time();
+    flash_delta(c, img, len, p);
+    double dt = test_time() - t0;
+
+    check_flash(img, len);
+
+    if (name) {
+        printf("%-22s %6zu bytes, %6zu written, %d sectors erased, %4.0f ms\n",
+            name, len, p->bytes, p->num_erase, dt * 1000);
+    }
+}
+
+
+int main(void)
+{
+    static uint8_t img[MAX_IMAGE];
+    struct boot_client c;
+    struct plan p;
+
+    // Fill the application flash with garbage, so the
+    // first update has to erase every sector it covers
+    //
+    int fd = mkstemp(flash_file);
+    CHECK(fd >= 0);
+
+    static uint8_t flash[BOOT_EMU_FLASH_SIZE];
+    for (size_t i=0; i<sizeof(flash); i++)
+        flash[i] = test_rand(&seed);
+    CHECK(write(fd, flash, sizeof(flash)) == sizeof(flash));
+    close(fd);
+
+    CHECK(boot_emu_start(&c, flash_file, "-b 0 -e 0 -w 0") == 0);
+    CHECK(boot_enter(&c, 1024) == 0);
+
+    size_t len = 300 * 1024;
+    for (size_t i=0; i<len; i++)
+        img[i] = test_rand(&seed);
+
+    update(&c, "first image", img, len, &p);
+    CHECK(p.num_erase == 3 && p.bytes == len);
+
+    update(&c, "unchanged", img, len, &p);
+    CHECK(p.num_erase == 0 && p.bytes == 0);
+
+    img[100000] ^= 0x55;
+    update(&c, "one byte changed", img, len, &p);
+    CHECK(p.num_erase == 1 && p.bytes == 128 * 1024);
+
+    // Sector 6 was erased when the first image was written
+    //
+    for (size_t i=len; i<len + 20 * 1024; i++)
+        img[i] = test_rand(&seed);
+    len += 20 * 1024;
+    update(&c, "grown by 20 KB", img, len, &p);
+    CHECK(p.num_erase == 0 && p.bytes == 20 * 1024);
+
+    // Random byte changes, growth and shrinkage
+    //
+    size_t written = 0;
+    for (int n=0; n<NUM_RANDOM; n++) {
+        int flips = test_rand(&seed) % 8;
+        for (int i=0; i<flips; i++)
+            img[test_rand(&seed) % len] = test_rand(&seed);
+
+        size_t new_len = (len + (int)(test_rand(&seed) % 65536) - 32768) & ~3;
+        if (new_len < 4096 || new_len > MAX_IMAGE - 4096)
+            new_len = len;
+
+        for (size_t i=len; i<new_len; i++)
+            img[i] = test_rand(&seed);
+        len = new_len;
+
+        update(&c, NULL, img, len, &p);
+        written += p.bytes;
+    }
+    printf("%d random updates:     %zu KB written in total\n", NUM_RANDOM, written / 1024);
+
+    boot_emu_stop(&c);
+    unlink(flash_file);
+    return 0;
+}
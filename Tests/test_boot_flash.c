@@ -0,0 +1,164 @@
+/**
+ * \file
+ * Flashing time with and without overlapped erases
+ *
+ * Writes an image to the bootloader emulator with realistic link and
+ * flash timing, once the old way and once the way BootProtocol does
+ * it now, and checks the flash contents afterwards.
+ *
+ * Copyright (c)2015 Thomas Kindler <mail_drquad@t-kindler.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "test.h"
+#include "boot_client.h"
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#define EMU_OPTIONS     "-b 115200 -l 8 -e 1000 -w 16"
+#define IMAGE_SIZE      (80 * 1024)
+#define MAX_DATA_SIZE   1024
+
+static uint32_t seed = 1;
+static char flash_file[] = "/tmp/test_boot_flash.XXXXXX";
+static uint8_t img[IMAGE_SIZE];
+
+
+/**
+ * Fill the flash with data, so every sector has to be erased.
+ */
+static void fill_flash(void)
+{
+    static uint8_t flash[BOOT_EMU_FLASH_SIZE];
+
+    for (size_t i=0; i<sizeof(flash); i++)
+        flash[i] = i;
+
+    int fd = open(flash_file, O_WRONLY | O_TRUNC);
+    CHECK(fd >= 0);
+    CHECK(write(fd, flash, sizeof(flash)) == sizeof(flash));
+    close(fd);
+}
+
+
+static void check_flash(void)
+{
+    static uint8_t buf[IMAGE_SIZE];
+
+    int fd = open(flash_file, O_RDONLY);
+    CHECK(fd >= 0);
+    CHECK(pread(fd, buf, sizeof(buf), BOOT_EMU_APP_START - BOOT_EMU_FLASH_BASE) == sizeof(buf));
+    close(fd);
+
+    CHECK(!memcmp(buf, img, sizeof(buf)));
+}
+
+
+/**
+ * Erase all sectors first, waiting for each erase to finish,
+ * then write with two messages in flight.
+ *
+ * The bootloader used to answer an erase request when the erase was
+ * done. It now answers first, so a checksum request that has to wait
+ * for the flash stands in for the old response.
+ */
+static void flash_old(struct boot_client *c)
+{
+    int first = boot_sector_of(BOOT_EMU_APP_START);
+    int last  = boot_sector_of(BOOT_EMU_APP_START + IMAGE_SIZE - 1);
+
+    for (int s=first; s<=last; s++) {
+        uint8_t sector = s;
+        CHECK(boot_request(c, MSG_ID_BOOT_ERASE_SECTOR, &sector, 1, NULL, NULL) == 0);
+
+        uint32_t req[3] = { boot_sectors[s].addr, 4, 4 };
+        uint32_t crc;
+        size_t len = sizeof(crc);
+        CHECK(boot_request(c, MSG_ID_BOOT_CHECKSUMS, req, sizeof(req), &crc, &len) == 0);
+    }
+
+    size_t window = 2 * COBSR_ENCODE_DST_BUF_LEN_MAX(2 + 2 + c->max_data_size) + 4;
+    CHECK(boot_write(c, BOOT_EMU_APP_START, img, IMAGE_SIZE, window) == 0);
+    CHECK(boot_sync(c) == 0);
+}
+
+
+/**
+ * Queue each erase right before the first write into its sector,
+ * with up to a receive buffer of data in flight.
+ */
+static void flash_new(struct boot_client *c)
+{
+    size_t window = c->rx_buffer_size;
+    uint32_t addr = BOOT_EMU_APP_START;
+
+    while (addr < BOOT_EMU_APP_START + IMAGE_SIZE) {
+        int s = boot_sector_of(addr);
+        uint32_t end = boot_sectors[s].addr + boot_sectors[s].size;
+
+        if (end > BOOT_EMU_APP_START + IMAGE_SIZE)
+            end = BOOT_EMU_APP_START + IMAGE_SIZE;
+
+        uint8_t sector = s;
+        CHECK(boot_async(c, MSG_ID_BOOT_ERASE_SECTOR, &sector, 1, window) == 0);
+        CHECK(boot_write(c, addr, &img[addr - BOOT_EMU_APP_START], end - addr, window) == 0);
+        addr = end;
+    }
+
+    CHECK(boot_sync(c) == 0);
+}
+
+
+static double run(const char *name, void (*flash)(struct boot_client *c))
+{
+    struct boot_client c;
+
+    fill_flash();
+    CHECK(boot_emu_start(&c, flash_file, EMU_OPTIONS) == 0);
+    CHECK(boot_enter(&c, MAX_DATA_SIZE) == 0);
+
+    double t0 = test_time();
+    flash(&c);
+    double dt = test_time() - t0;
+
+    CHECK(boot_verify(&c, BOOT_EMU_APP_START, img, IMAGE_SIZE) == 0);
+    boot_emu_stop(&c);
+    check_flash();
+
+    printf("%-36s %5.2f s, %4.1f KB/s\n", name, dt, IMAGE_SIZE / 1024.0 / dt);
+    return dt;
+}
+
+
+int main(void)
+{
+    int fd = mkstemp(flash_file);
+    CHECK(fd >= 0);
+    close(fd);
+
+    for (size_t i=0; i<sizeof(img); i++)
+        img[i] = test_rand(&seed);
+
+    printf("%d KB image, emulator options %s\n", IMAGE_SIZE / 1024, EMU_OPTIONS);
+
+    double t_old = run("erase first, 2 messages in flight", flash_old);
+    double t_new = run("erase on demand, 16 KB in flight", flash_new);
+
+    printf("%.2f s saved\n", t_old - t_new);
+    CHECK(t_new < t_old);
+
+    unlink(flash_file);
+    return 0;
+}
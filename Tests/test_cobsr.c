@@ -0,0 +1,210 @@
+/**
+ * \file
+ * COBS/R encoder and decoders
+ *
+ * Copyright (c)2015 Thomas Kindler <mail_drquad@t-kindler.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "test.h"
+#include "Shared/cobsr.h"
+#include "Shared/errors.h"
+#include <errno.h>
+#include <string.h>
+
+#define NUM_FRAMES      100000
+#define MAX_LEN         1100
+#define STREAM_LEN      (4 * 1024 * 1024)
+
+static uint32_t seed = 1;
+
+
+/**
+ * Random data with runs of zeros and of non-zero bytes,
+ * so that all group lengths up to 0xFF are used.
+ */
+static size_t make_frame(uint8_t *buf)
+{
+    size_t len = test_rand(&seed) % MAX_LEN;
+    int zeros = test_rand(&seed) % 4;
+
+    for (size_t i=0; i<len; i++) {
+        uint8_t b = test_rand(&seed);
+
+        if (zeros == 0)
+            b |= 1;
+        else if (zeros == 1 && (b & 7) == 0)
+            b = 0;
+
+        buf[i] = b;
+    }
+
+    return len;
+}
+
+
+static void test_round_trip(void)
+{
+    static uint8_t src[MAX_LEN], enc[COBSR_ENCODE_DST_BUF_LEN_MAX(MAX_LEN)], dec[MAX_LEN];
+
+    for (int n=0; n<NUM_FRAMES; n++) {
+        size_t len = make_frame(src);
+
+        ssize_t enc_len = cobsr_encode(enc, sizeof(enc), src, len);
+        CHECK(enc_len >= 0);
+        CHECK((size_t)enc_len <= COBSR_ENCODE_DST_BUF_LEN_MAX(len));
+        CHECK(memchr(enc, 0, enc_len) == NULL);
+
+        ssize_t dec_len = cobsr_decode(dec, sizeof(dec), enc, enc_len);
+        CHECK(dec_len == (ssize_t)len);
+        CHECK(!memcmp(src, dec, len));
+
+        // Too small output buffers are detected
+        //
+        if (len > 0) {
+            CHECK(cobsr_decode(dec, len - 1, enc, enc_len) < 0);
+            CHECK(errno == ECOBSR_DECODE_OUT_BUFFER_OVERFLOW);
+        }
+        if (enc_len > 0) {
+            CHECK(cobsr_encode(enc, enc_len - 1, src, len) < 0);
+            CHECK(errno == ECOBSR_ENCODE_OUT_BUFFER_OVERFLOW);
+        }
+    }
+
+    printf("%d frames round-trip\n", NUM_FRAMES);
+}
+
+
+/**
+ * Feed a stream of frames to the streaming decoder in random
+ * chunks, and compare the result with cobsr_decode() of each
+ * zero-delimited part. With corrupt set, bytes of the stream
+ * are changed at random, which also splits and merges frames.
+ */
+static void test_stream(int corrupt, size_t buf_len)
+{
+    static uint8_t stream[STREAM_LEN];
+    static uint8_t src[MAX_LEN], buf[MAX_LEN], ref[MAX_LEN];
+    size_t stream_len = 0;
+
+    // Build the stream. Empty frames and double delimiters
+    // must be skipped by the decoder.
+    //
+    while (stream_len + COBSR_ENCODE_DST_BUF_LEN_MAX(MAX_LEN) + 2 <= sizeof(stream)) {
+        size_t len = make_frame(src);
+
+        ssize_t enc_len = cobsr_encode(&stream[stream_len], sizeof(stream) - stream_len, src, len);
+        CHECK(enc_len >= 0);
+
+        stream_len += enc_len;
+        stream[stream_len++] = 0;
+
+        if (test_rand(&seed) % 8 == 0)
+            stream[stream_len++] = 0;
+    }
+
+    if (corrupt) {
+        for (size_t i=0; i<stream_len / 100; i++)
+            stream[test_rand(&seed) % stream_len] = test_rand(&seed) % 3 ? test_rand(&seed) : 0;
+    }
+
+    struct cobsr_decoder dec;
+    cobsr_decoder_init(&dec, buf, buf_len);
+
+    size_t pos = 0, ref_pos = 0;
+    int frames = 0, errors = 0;
+
+    while (pos < stream_len) {
+        size_t chunk = 1 + test_rand(&seed) % 300;
+        if (chunk > stream_len - pos)
+            chunk = stream_len - pos;
+
+        size_t consumed;
+        ssize_t res = cobsr_decoder_feed(&dec, &stream[pos], chunk, &consumed);
+        CHECK(consumed <= chunk);
+        pos += consumed;
+
+        if (res == 0) {
+            CHECK(consumed == chunk);
+            continue;
+        }
+
+        // Next non-empty frame of the reference
+        //
+        ssize_t ref_len;
+        for (;;) {
+            CHECK(ref_pos < stream_len);
+
+            uint8_t *end = memchr(&stream[ref_pos], 0, stream_len - ref_pos);
+            size_t  part = end ? (size_t)(end - &stream[ref_pos]) : stream_len - ref_pos;
+
+            ref_len = cobsr_decode(ref, buf_len, &stream[ref_pos], part);
+            ref_pos += part + 1;
+
+            if (ref_len != 0)
+                break;
+        }
+
+        if (res < 0) {
+            CHECK(ref_len < 0);
+            CHECK(errno == ECOBSR_DECODE_OUT_BUFFER_OVERFLOW);
+            errors++;
+        }
+        else {
+            CHECK(res == ref_len);
+            CHECK(!memcmp(buf, ref, res));
+            frames++;
+        }
+    }
+
+    printf("stream%s, %4zu byte buffer: %d frames, %d overflows\n",
+        corrupt ? " with errors" : "", buf_len, frames, errors);
+}
+
+
+static void bench(void)
+{
+    static uint8_t src[64 * 1024], enc[COBSR_ENCODE_DST_BUF_LEN_MAX(sizeof(src))];
+
+    for (size_t i=0; i<sizeof(src); i++)
+        src[i] = test_rand(&seed);
+
+    ssize_t enc_len = 0;
+    double t0 = test_time();
+    for (int i=0; i<1000; i++)
+        enc_len = cobsr_encode(enc, sizeof(enc), src, sizeof(src));
+    double t1 = test_time();
+    for (int i=0; i<1000; i++)
+        CHECK(cobsr_decode(src, sizeof(src), enc, enc_len) == sizeof(src));
+    double t2 = test_time();
+
+    printf("encode %5.0f MB/s, decode %5.0f MB/s\n",
+        sizeof(src) * 1000 / (t1 - t0) / 1e6,
+        sizeof(src) * 1000 / (t2 - t1) / 1e6);
+}
+
+
+int main(void)
+{
+    test_round_trip();
+
+    test_stream(0, MAX_LEN);
+    test_stream(0, 600);
+    test_stream(1, MAX_LEN);
+    test_stream(1, 600);
+
+    bench();
+
+    return 0;
+}
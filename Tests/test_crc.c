@@ -0,0 +1,113 @@
+/**
+ * \file
+ * Slicing-by-N CRCs against the pycrc versions
+ *
+ * crc16.c and crc32.c must give the same results as the bit-compatible
+ * but slower crc16_sm.c and crc32_sm.c, for any alignment, length
+ * and split of the input. The _sm versions are built with their
+ * functions renamed, see Tests/Makefile.
+ *
+ * Copyright (c)2015 Thomas Kindler <mail_drquad@t-kindler.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "test.h"
+#include "Shared/crc16.h"
+#include "Shared/crc32.h"
+
+crc16_t crc16_sm_update(crc16_t crc, const unsigned char *data, size_t data_len);
+crc32_t crc32_sm_update(crc32_t crc, const unsigned char *data, size_t data_len);
+
+#define NUM_BUFFERS     20000
+#define MAX_LEN         1024
+#define BENCH_LEN       (64 * 1024 * 1024)
+
+static uint32_t seed = 1;
+
+
+static void test_check_values(void)
+{
+    const unsigned char check[] = "123456789";
+
+    CHECK(crc32_finalize(crc32_update(crc32_init(), check, 9)) == 0xCBF43926);
+    CHECK(crc32_finalize(crc32_sm_update(crc32_init(), check, 9)) == 0xCBF43926);
+
+    CHECK(crc16_update(crc16_init(), check, 9) == crc16_sm_update(crc16_init(), check, 9));
+}
+
+
+/**
+ * Random offsets, lengths and split points
+ */
+static void test_random(void)
+{
+    static unsigned char buf[MAX_LEN + 8];
+
+    for (int n=0; n<NUM_BUFFERS; n++) {
+        for (unsigned i=0; i<sizeof(buf); i++)
+            buf[i] = test_rand(&seed);
+
+        size_t offset = test_rand(&seed) % 8;
+        size_t len    = test_rand(&seed) % (MAX_LEN + 1);
+        size_t split  = len ? test_rand(&seed) % len : 0;
+        const unsigned char *p = buf + offset;
+
+        crc32_t c32 = crc32_sm_update(crc32_init(), p, len);
+        crc16_t c16 = crc16_sm_update(crc16_init(), p, len);
+
+        CHECK(crc32_update(crc32_init(), p, len) == c32);
+        CHECK(crc16_update(crc16_init(), p, len) == c16);
+
+        CHECK(crc32_update(crc32_update(crc32_init(), p, split), p + split, len - split) == c32);
+        CHECK(crc16_update(crc16_update(crc16_init(), p, split), p + split, len - split) == c16);
+    }
+
+    printf("%d random buffers match\n", NUM_BUFFERS);
+}
+
+
+static void bench(const char *name, void (*func)(const unsigned char *, size_t))
+{
+    static unsigned char buf[BENCH_LEN];
+
+    double t0 = test_time();
+    func(buf, sizeof(buf));
+    double dt = test_time() - t0;
+
+    printf("%-10s %7.0f MB/s\n", name, sizeof(buf) / dt / 1e6);
+}
+
+
+// The results go to a volatile, so the calls are not optimized away
+//
+static volatile uint32_t sink;
+
+static void bench_crc32(const unsigned char *p, size_t len)    { sink = crc32_update(crc32_init(), p, len); }
+static void bench_crc32_sm(const unsigned char *p, size_t len) { sink = crc32_sm_update(crc32_init(), p, len); }
+static void bench_crc16(const unsigned char *p, size_t len)    { sink = crc16_update(crc16_init(), p, len); }
+static void bench_crc16_sm(const unsigned char *p, size_t len) { sink = crc16_sm_update(crc16_init(), p, len); }
+
+
+int main(void)
+{
+    test_check_values();
+    test_random();
+
+    bench("crc32",    bench_crc32);
+    bench("crc32_sm", bench_crc32_sm);
+    bench("crc16",    bench_crc16);
+    bench("crc16_sm", bench_crc16_sm);
+
+    return 0;
+}
@@ -0,0 +1,176 @@
+/**
+ * \file
+ * FEC throughput under packet loss
+ *
+ * Sends telemetry-sized messages with and without FEC over a link
+ * with independent packet loss, and feeds the received ones to the
+ * decoder like QuadControl does. Rebuilt messages must match the
+ * originals. Goodput is the delivered payload at 115200 baud, with
+ * COBS/R framing and packet markers as sent by the firmware.
+ *
+ * Copyright (c)2015 Thomas Kindler <mail_drquad@t-kindler.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "test.h"
+#include "Shared/fec.h"
+#include "Shared/cobsr.h"
+#include "Shared/crc16.h"
+#include <string.h>
+
+#define NUM_MESSAGES    200000
+#define LINK_RATE       11520.0     // 115200 baud, 8N1 [bytes/s]
+#define MSG_ID_TEST     0x1234
+
+static uint32_t seed = 1;
+
+
+static void calc_crc(struct msg_header *msg)
+{
+    crc16_t crc = crc16_init();
+    crc = crc16_update(crc, (uint8_t*)&msg->id, 2 + msg->data_len);
+    msg->crc = crc16_finalize(crc);
+}
+
+
+/**
+ * Bytes on the wire: COBS/R(crc + id + data) and two packet markers
+ */
+static size_t wire_size(const struct msg_header *msg)
+{
+    uint8_t buf[COBSR_ENCODE_DST_BUF_LEN_MAX(2 + 2 + MSG_MAX_DATA_SIZE)];
+
+    ssize_t len = cobsr_encode(buf, sizeof(buf), &msg->crc, 2 + 2 + msg->data_len);
+    CHECK(len > 0);
+
+    return 1 + len + 1;
+}
+
+
+static int lost(float loss)
+{
+    return test_rand(&seed) < loss * 4294967296.0;
+}
+
+
+/**
+ * Check a received or rebuilt message, and count it.
+ */
+static void receive(const struct msg_header *msg, uint8_t *seen, int *delivered, size_t *payload)
+{
+    const struct msg_generic *m = (const void *)msg;
+    uint32_t n;
+
+    CHECK(msg->id == MSG_ID_TEST);
+    CHECK(msg->data_len >= 4);
+
+    memcpy(&n, m->data, 4);
+    CHECK(n < NUM_MESSAGES);
+
+    for (int i=4; i<msg->data_len; i++)
+        CHECK(m->data[i] == (uint8_t)(n * 7 + i));
+
+    if (seen[n])
+        return;
+
+    seen[n] = 1;
+    (*delivered)++;
+    *payload += msg->data_len;
+}
+
+
+static void run(int k, int m, float loss)
+{
+    static uint8_t seen[NUM_MESSAGES];
+    static struct fec_encoder enc;
+    static struct fec_decoder dec;
+
+    memset(seen, 0, sizeof(seen));
+    fec_encoder_init(&enc, k, m);
+    fec_decoder_init(&dec);
+
+    int     data_len  = k ? FEC_MAX_DATA_SIZE(k) : MSG_MAX_DATA_SIZE;
+    size_t  wire      = 0;
+    size_t  payload   = 0;
+    int     delivered = 0;
+    int     received  = 0;
+
+    for (uint32_t n=0; n<NUM_MESSAGES; n++) {
+        struct msg_generic msg;
+
+        msg.h.id       = MSG_ID_TEST;
+        msg.h.data_len = data_len;
+        memcpy(msg.data, &n, 4);
+        for (int i=4; i<data_len; i++)
+            msg.data[i] = n * 7 + i;
+
+        calc_crc(&msg.h);
+        wire += wire_size(&msg.h);
+
+        if (!lost(loss)) {
+            received++;
+            receive(&msg.h, seen, &delivered, &payload);
+            CHECK(fec_decoder_input(&dec, &msg.h) == 0);
+        }
+
+        int num_parity = fec_encode(&enc, &msg.h);
+        CHECK(num_parity >= 0);
+
+        for (int j=0; j<num_parity; j++) {
+            struct msg_fec_parity p;
+            fec_get_parity(&enc, j, &p);
+            calc_crc(&p.h);
+            wire += wire_size(&p.h);
+
+            if (lost(loss))
+                continue;
+
+            int r = fec_decoder_input(&dec, &p.h);
+            CHECK(r >= 0);
+
+            for (int i=0; i<r; i++)
+                receive(&dec.out[i].h, seen, &delivered, &payload);
+        }
+    }
+
+    char fec[8] = "- -";
+    if (k)
+        snprintf(fec, sizeof(fec), "%d %d", k, m);
+
+    printf("%s   %3.0f%%   %5.1f%%      %5.0f\n",
+        fec, loss * 100, delivered * 100.0 / NUM_MESSAGES,
+        payload * LINK_RATE / wire);
+
+    // Only missing messages are rebuilt
+    //
+    CHECK(delivered == received + (int)dec.stats.recovered);
+    if (loss == 0)
+        CHECK(delivered == NUM_MESSAGES);
+}
+
+
+int main(void)
+{
+    static const float losses[] = { 0, 0.05, 0.10, 0.20 };
+    static const int   groups[][2] = { {0,0}, {4,1}, {8,1}, {4,2}, {8,2} };
+
+    printf("k m   loss   delivered  goodput [B/s]\n");
+
+    for (unsigned g=0; g<sizeof(groups)/sizeof(groups[0]); g++) {
+        for (unsigned l=0; l<sizeof(losses)/sizeof(losses[0]); l++)
+            run(groups[g][0], groups[g][1], losses[l]);
+    }
+
+    return 0;
+}
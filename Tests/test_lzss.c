@@ -0,0 +1,244 @@
+/**
+ * \file
+ * LZSS correctness and speed
+ *
+ * Compressed streams are decoded in random input and output chunks,
+ * like the bootloader gets them from MSG_ID_BOOT_WRITE_LZSS messages.
+ * The ratio and speed are measured on the test executable, as a
+ * stand-in for a firmware image.
+ *
+ * Copyright (c)2015 Thomas Kindler <mail_drquad@t-kindler.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "test.h"
+#include "Shared/lzss.h"
+#include "Shared/errors.h"
+#include <errno.h>
+#include <string.h>
+
+#define NUM_BUFFERS     2000
+#define MAX_LEN         (64 * 1024)
+
+static uint32_t seed = 1;
+
+
+/**
+ * Data with literal runs, repeats at all distances,
+ * and long runs of the same byte
+ */
+static size_t make_data(uint8_t *buf)
+{
+    size_t len = test_rand(&seed) % MAX_LEN;
+    size_t pos = 0;
+
+    while (pos < len) {
+        size_t n = 1 + test_rand(&seed) % 64;
+        if (n > len - pos)
+            n = len - pos;
+
+        switch (test_rand(&seed) % 3) {
+        case 0:
+            for (size_t i=0; i<n; i++)
+                buf[pos + i] = test_rand(&seed);
+            break;
+
+        case 1:
+            if (pos > 0) {
+                size_t dist = 1 + test_rand(&seed) % (pos < LZSS_WINDOW_SIZE + 16 ? pos : LZSS_WINDOW_SIZE + 16);
+                for (size_t i=0; i<n; i++)
+                    buf[pos + i] = buf[pos + i - dist];
+                break;
+            }
+            // fall through
+
+        case 2:
+            memset(&buf[pos], test_rand(&seed), n);
+            break;
+        }
+        pos += n;
+    }
+
+    return len;
+}
+
+
+/**
+ * Decode in random chunks.
+ *
+ * \return  decoded length, -1 on error
+ */
+static ssize_t decode_chunked(uint8_t *dst, size_t dst_len, const uint8_t *src, size_t src_len)
+{
+    static struct lzss_decoder dec;
+    size_t in = 0, out = 0;
+
+    lzss_decoder_init(&dec);
+
+    while (in < src_len) {
+        size_t n_in  = 1 + test_rand(&seed) % 100;
+        size_t n_out = 1 + test_rand(&seed) % 100;
+
+        if (n_in > src_len - in)
+            n_in = src_len - in;
+        if (n_out > dst_len - out)
+            n_out = dst_len - out;
+
+        size_t consumed;
+        ssize_t res = lzss_decoder_feed(&dec, &dst[out], n_out, &src[in], n_in, &consumed);
+        if (res < 0)
+            return -1;
+
+        CHECK((size_t)res <= n_out);
+        CHECK(consumed <= n_in);
+        CHECK(res > 0 || consumed > 0 || n_out == 0);
+
+        if (n_out == 0 && consumed == 0)
+            return -1;  // more output than expected
+
+        in  += consumed;
+        out += res;
+    }
+
+    // Flush a pending match
+    //
+    for (;;) {
+        size_t consumed;
+        ssize_t res = lzss_decoder_feed(&dec, &dst[out], dst_len - out, src, 0, &consumed);
+        CHECK(res >= 0);
+        if (res == 0)
+            break;
+        out += res;
+    }
+
+    return out;
+}
+
+
+static void test_round_trip(void)
+{
+    static uint8_t src[MAX_LEN], enc[LZSS_ENCODE_DST_BUF_LEN_MAX(MAX_LEN)], dec[MAX_LEN];
+    size_t total_src = 0, total_enc = 0;
+
+    for (int n=0; n<NUM_BUFFERS; n++) {
+        size_t len = make_data(src);
+
+        ssize_t enc_len = lzss_encode(enc, sizeof(enc), src, len);
+        CHECK(enc_len >= 0);
+        CHECK((size_t)enc_len <= LZSS_ENCODE_DST_BUF_LEN_MAX(len));
+
+        CHECK(decode_chunked(dec, sizeof(dec), enc, enc_len) == (ssize_t)len);
+        CHECK(!memcmp(src, dec, len));
+
+        if (enc_len > 0) {
+            CHECK(lzss_encode(enc, enc_len - 1, src, len) < 0);
+            CHECK(errno == ELZSS_ENCODE_OUT_BUFFER_OVERFLOW);
+        }
+
+        total_src += len;
+        total_enc += enc_len;
+    }
+
+    printf("%d buffers round-trip, %.1f%% of original size\n",
+        NUM_BUFFERS, total_enc * 100.0 / total_src);
+}
+
+
+/**
+ * Matches before the start of the stream must be rejected,
+ * and corrupt streams must not crash the decoder.
+ */
+static void test_invalid(void)
+{
+    static uint8_t src[MAX_LEN], enc[LZSS_ENCODE_DST_BUF_LEN_MAX(MAX_LEN)], dec[MAX_LEN];
+    struct lzss_decoder d;
+    size_t consumed;
+
+    // Flag byte with a match first (flag bits are 1 for
+    // literals), distance 1
+    //
+    const uint8_t bad[] = { 0x00, 0x00, 0x00 };
+
+    lzss_decoder_init(&d);
+    CHECK(lzss_decoder_feed(&d, dec, sizeof(dec), bad, sizeof(bad), &consumed) < 0);
+    CHECK(errno == ELZSS_DECODE_INVALID);
+
+    int errors = 0;
+    for (int n=0; n<NUM_BUFFERS; n++) {
+        size_t len = make_data(src);
+        ssize_t enc_len = lzss_encode(enc, sizeof(enc), src, len);
+        CHECK(enc_len >= 0);
+
+        if (enc_len == 0)
+            continue;
+
+        for (int i=0; i<4; i++)
+            enc[test_rand(&seed) % enc_len] = test_rand(&seed);
+
+        if (decode_chunked(dec, sizeof(dec), enc, enc_len) < 0)
+            errors++;
+    }
+
+    printf("corrupt streams: %d of %d rejected, none crashed\n", errors, NUM_BUFFERS);
+}
+
+
+static void test_speed(void)
+{
+    static uint8_t src[4 * 1024 * 1024], enc[LZSS_ENCODE_DST_BUF_LEN_MAX(sizeof(src))], dec[sizeof(src)];
+
+    FILE *f = fopen("/proc/self/exe", "rb");
+    CHECK(f != NULL);
+    size_t len = fread(src, 1, sizeof(src), f);
+    fclose(f);
+
+    double t0 = test_time();
+    ssize_t enc_len = lzss_encode(enc, sizeof(enc), src, len);
+    double t1 = test_time();
+    CHECK(enc_len > 0);
+
+    // Decode in message sized pieces
+    //
+    struct lzss_decoder d;
+    size_t in = 0, out = 0;
+
+    lzss_decoder_init(&d);
+    while (in < (size_t)enc_len) {
+        size_t n = (size_t)enc_len - in < 88 ? (size_t)enc_len - in : 88;
+        size_t consumed;
+
+        ssize_t res = lzss_decoder_feed(&d, &dec[out], sizeof(dec) - out, &enc[in], n, &consumed);
+        CHECK(res >= 0);
+        in  += consumed;
+        out += res;
+    }
+    double t2 = test_time();
+
+    CHECK(out == len);
+    CHECK(!memcmp(src, dec, len));
+
+    printf("executable: %zu -> %zd bytes (%.0f%%), encode %.1f MB/s, decode %.0f MB/s\n",
+        len, enc_len, enc_len * 100.0 / len,
+        len / (t1 - t0) / 1e6, len / (t2 - t1) / 1e6);
+}
+
+
+int main(void)
+{
+    test_round_trip();
+    test_invalid();
+    test_speed();
+
+    return 0;
+}
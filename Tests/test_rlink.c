@@ -0,0 +1,235 @@
+/**
+ * \file
+ * rlink over a lossy loopback
+ *
+ * Two rlink instances exchange requests and responses over a simulated
+ * link that drops messages at random and delays them by a latency
+ * with jitter. Like a serial link, it keeps the message order, unless
+ * reordering is enabled. The time is simulated in 1 ms steps.
+ *
+ * The host side sends numbered requests, the vehicle side answers
+ * each of them, like the bootloader does. Both sides must see every
+ * message exactly once and in order.
+ *
+ * Copyright (c)2015 Thomas Kindler <mail_drquad@t-kindler.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "test.h"
+#include "Shared/rlink.h"
+#include "Shared/errors.h"
+#include <errno.h>
+#include <string.h>
+
+#define SLOT_SIZE       RLINK_SLOT_SIZE(MSG_MAX_DATA_SIZE)
+#define HOST_TX_SLOTS   16
+#define HOST_RX_SLOTS   8
+#define VEH_TX_SLOTS    8
+#define VEH_RX_SLOTS    8
+#define RTO             50      // [ms]
+#define MAX_IN_FLIGHT   256
+
+#define MSG_ID_TEST     0x1234
+
+static uint32_t seed = 1;
+
+
+// One direction of the loopback
+//
+struct channel {
+    float       loss;           // probability
+    uint32_t    latency;        // [ms]
+    uint32_t    jitter;         // [ms]
+    int         reorder;        // jitter may reorder messages
+    uint32_t    *now;
+
+    int         count;
+    struct {
+        uint32_t    time;       // delivery time
+        union {
+            struct msg_header h;
+            uint8_t     buf[SLOT_SIZE];
+        } msg;
+    } queue[MAX_IN_FLIGHT];
+};
+
+
+static int channel_send(void *ctx, struct msg_header *msg)
+{
+    struct channel *c = ctx;
+
+    if (test_rand(&seed) < c->loss * 4294967296.0)
+        return 0;
+
+    CHECK(c->count < MAX_IN_FLIGHT);
+    CHECK(sizeof(*msg) + msg->data_len <= SLOT_SIZE);
+
+    uint32_t time = *c->now + c->latency +
+        (c->jitter ? test_rand(&seed) % (c->jitter + 1) : 0);
+
+    if (!c->reorder && c->count && time < c->queue[c->count - 1].time)
+        time = c->queue[c->count - 1].time;
+
+    c->queue[c->count].time = time;
+    memcpy(&c->queue[c->count].msg, msg, sizeof(*msg) + msg->data_len);
+    c->count++;
+
+    return 0;
+}
+
+
+/**
+ * Deliver all messages that are due, in the order
+ * they were sent if they are due at the same time.
+ */
+static void channel_deliver(struct channel *c, struct rlink *dst, uint32_t now)
+{
+    for (int i=0; i<c->count; ) {
+        if (c->queue[i].time > now) {
+            i++;
+            continue;
+        }
+
+        CHECK(rlink_input(dst, &c->queue[i].msg.h, now) == 1);
+
+        c->count--;
+        memmove(&c->queue[i], &c->queue[i+1], (c->count - i) * sizeof(c->queue[0]));
+    }
+}
+
+
+struct test_msg {
+    struct msg_header h;
+    uint32_t    n;
+    uint8_t     data[MSG_MAX_DATA_SIZE - 4];
+};
+
+
+/**
+ * Run num_requests requests through the loopback.
+ *
+ * \return  0 on success, -1 if a link failed
+ */
+static int run(int num_requests, float loss, uint32_t latency, uint32_t jitter, int reorder)
+{
+    static uint8_t host_tx[HOST_TX_SLOTS][SLOT_SIZE], host_rx[HOST_RX_SLOTS][SLOT_SIZE];
+    static uint8_t veh_tx[VEH_TX_SLOTS][SLOT_SIZE],   veh_rx[VEH_RX_SLOTS][SLOT_SIZE];
+    static uint32_t sent_time[100000];
+
+    struct rlink host, veh;
+    uint32_t now = 0;
+
+    struct channel up   = { .loss = loss, .latency = latency, .jitter = jitter, .reorder = reorder, .now = &now };
+    struct channel down = { .loss = loss, .latency = latency, .jitter = jitter, .reorder = reorder, .now = &now };
+
+    rlink_init(&host, channel_send, &up,
+        host_tx, SLOT_SIZE, HOST_TX_SLOTS, host_rx, SLOT_SIZE, HOST_RX_SLOTS, RTO);
+    rlink_init(&veh, channel_send, &down,
+        veh_tx, SLOT_SIZE, VEH_TX_SLOTS, veh_rx, SLOT_SIZE, VEH_RX_SLOTS, RTO);
+
+    CHECK(num_requests <= (int)(sizeof(sent_time) / sizeof(sent_time[0])));
+
+    int requests = 0, handled = 0, responses = 0;
+    double latency_sum = 0;
+    uint32_t latency_max = 0;
+
+    while (responses < num_requests) {
+        now++;
+
+        // Host: send requests while the window allows
+        //
+        while (requests < num_requests && rlink_tx_free(&host) > 0) {
+            struct test_msg m = { .h.id = MSG_ID_TEST, .n = requests };
+
+            m.h.data_len = 4 + requests % sizeof(m.data);
+            memset(m.data, requests, sizeof(m.data));
+
+            CHECK(rlink_send(&host, &m.h, now) == m.h.data_len);
+            sent_time[requests++] = now;
+        }
+
+        channel_deliver(&up, &veh, now);
+        channel_deliver(&down, &host, now);
+
+        // Vehicle: take the next request only if the
+        // response can be sent right away
+        //
+        const struct msg_header *msg;
+
+        while (rlink_tx_free(&veh) > 0 && (msg = rlink_recv(&veh))) {
+            const struct test_msg *m = (const void *)msg;
+
+            CHECK(m->h.id == MSG_ID_TEST);
+            CHECK(m->n == (uint32_t)handled);
+            CHECK(m->h.data_len == 4 + (int)(m->n % sizeof(m->data)));
+            for (int i=0; i<m->h.data_len - 4; i++)
+                CHECK(m->data[i] == (uint8_t)m->n);
+
+            struct test_msg r = { .h.id = MSG_ID_TEST, .h.data_len = 4, .n = m->n };
+            CHECK(rlink_send(&veh, &r.h, now) == 4);
+            handled++;
+        }
+
+        // Host: responses
+        //
+        while ((msg = rlink_recv(&host))) {
+            const struct test_msg *m = (const void *)msg;
+
+            CHECK(m->n == (uint32_t)responses);
+
+            uint32_t dt = now - sent_time[responses];
+            latency_sum += dt;
+            if (dt > latency_max)
+                latency_max = dt;
+
+            responses++;
+        }
+
+        if (rlink_poll(&host, now) < 0 || rlink_poll(&veh, now) < 0) {
+            CHECK(errno == EMSG_TIMEOUT);
+            printf("%3.0f%%  %2u-%2u ms %c  %6d  link failed after %u ms\n",
+                loss * 100, latency, latency + jitter, reorder ? 'r' : ' ', num_requests, now);
+            return -1;
+        }
+    }
+
+    printf("%3.0f%%  %2u-%2u ms %c  %6d  %6.0f/s  %5.1f  %4u ms  %6u  %6u\n",
+        loss * 100, latency, latency + jitter, reorder ? 'r' : ' ', num_requests,
+        num_requests * 1000.0 / now,
+        latency_sum / num_requests, latency_max,
+        host.stats.tx_retransmits, veh.stats.tx_retransmits);
+
+    CHECK(handled == num_requests);
+    return 0;
+}
+
+
+int main(void)
+{
+    printf("loss latency      msgs     rate    avg     max     retransmits\n");
+    printf("                                    latency [ms]   host  vehicle\n");
+
+    // 70000 messages wrap the 16 bit sequence numbers
+    //
+    CHECK(run(70000, 0,    5,  0,  0) == 0);
+    CHECK(run(5000,  0.05, 10, 10, 0) == 0);
+    CHECK(run(5000,  0.20, 20, 40, 0) == 0);
+    CHECK(run(5000,  0.05, 10, 10, 1) == 0);
+
+    // A dead link must fail, not hang
+    //
+    CHECK(run(100,   1.0,  5,  0,  0) < 0);
+
+    return 0;
+}
@@ -0,0 +1,238 @@
+/**
+ * \file
+ * File descriptor table and stdio buffering
+ *
+ * Runs Source/syscalls.c on the host, with glibc streams in place of
+ * newlib's, see Tests/host/newlib.h. A mock device records every write
+ * call. The test checks open/dup/dup2/close and the stream setup of
+ * stdio_redirect(), then compares write calls and throughput of
+ * unbuffered, line buffered and fully buffered output.
+ *
+ * Copyright (c)2015 Thomas Kindler <mail_drquad@t-kindler.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "test.h"
+#include "syscalls.h"
+#include "command.h"
+#include "util.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+
+#define NUM_LINES   20000
+
+int     host_open(const char *path, int flags, ...);
+int     host_close(int fd);
+int     host_dup(int fd);
+int     host_dup2(int oldfd, int newfd);
+FILE   *host_fdopen(int fd, const char *mode);
+int     host_setvbuf(FILE *f, char *buf, int mode, size_t size);
+
+ssize_t _write_r(struct _reent *r, int fd, const void *ptr, size_t len);
+
+extern const struct cmd_info __shell_cmd_stdio_bench;
+
+
+// Used by the fault handlers in syscalls.c
+//
+void board_set_leds(int leds)
+{
+}
+
+void xbee_poll_send(const char *s)
+{
+    fputs(s, stderr);
+}
+
+
+// The mock device keeps everything written to it
+//
+static struct {
+    char        data[2 * 1024 * 1024];
+    size_t      len;
+    unsigned    writes;
+} mock;
+
+static ssize_t mock_read_r(struct _reent *r, int fd, void *ptr, size_t len)
+{
+    return 0;
+}
+
+static ssize_t mock_write_r(struct _reent *r, int fd, const void *ptr, size_t len)
+{
+    CHECK(mock.len + len <= sizeof(mock.data));
+
+    memcpy(&mock.data[mock.len], ptr, len);
+    mock.len += len;
+    mock.writes++;
+    return len;
+}
+
+static ssize_t mock_chars_avail_r(struct _reent *r, int fd)
+{
+    return 0;
+}
+
+static const struct file_ops mock_ops = {
+    .read_r        = mock_read_r,
+    .write_r       = mock_write_r,
+    .chars_avail_r = mock_chars_avail_r
+};
+
+
+static void mock_reset(void)
+{
+    mock.len = 0;
+    mock.writes = 0;
+}
+
+
+static void test_fd_table(void)
+{
+    CHECK(host_open("/dev/nonexistent", O_RDWR) == -1 && errno == ENOENT);
+
+    int fd = host_open("/dev/mock", O_WRONLY);
+    CHECK(fd == 0);
+
+    int ro = host_open("/dev/mock", O_RDONLY);
+    CHECK(ro == 1);
+    CHECK(_write_r(_impure_ptr, ro, "x", 1) == -1 && _impure_ptr->_errno == EBADF);
+
+    // dup() takes the lowest free descriptor, dup2() the given one
+    //
+    CHECK(host_close(ro) == 0);
+    CHECK(host_dup(fd) == 1);
+    CHECK(host_dup2(fd, 5) == 5);
+    CHECK(host_dup2(fd, MAX_FILES) == -1);
+
+    mock_reset();
+    CHECK(_write_r(_impure_ptr, 5, "abc", 3) == 3);
+    CHECK(mock.writes == 1 && mock.len == 3 && !memcmp(mock.data, "abc", 3));
+
+    for (int i=0; i<MAX_FILES; i++)
+        host_close(i);
+
+    CHECK(_write_r(_impure_ptr, 5, "abc", 3) == -1 && _impure_ptr->_errno == EBADF);
+    CHECK(host_close(5) == -1);
+
+    // The table holds MAX_FILES descriptors
+    //
+    for (int i=0; i<MAX_FILES; i++)
+        CHECK(host_open("/dev/mock", O_RDWR) == i);
+
+    CHECK(host_open("/dev/mock", O_RDWR) == -1 && errno == EMFILE);
+
+    for (int i=0; i<MAX_FILES; i++)
+        CHECK(host_close(i) == 0);
+}
+
+
+static void test_redirect(void)
+{
+    FILE *host_in = stdin, *host_out = stdout, *host_err = stderr;
+
+    CHECK(stdio_redirect("/dev/mock") == 0);
+    mock_reset();
+
+    // stdout is line buffered
+    //
+    printf("abc");
+    CHECK(mock.writes == 0);
+    printf("def\nghi");
+    CHECK(mock.writes == 1 && mock.len == 7);
+
+    // stderr is unbuffered, and doesn't flush stdout
+    //
+    fputs("err", stderr);
+    CHECK(mock.writes == 2 && mock.len == 10);
+
+    fflush(stdout);
+    CHECK(mock.len == 13 && !memcmp(mock.data, "abcdef\nerrghi", 13));
+
+    fclose(stdin);
+    fclose(stdout);
+    fclose(stderr);
+    stdin  = host_in;
+    stdout = host_out;
+    stderr = host_err;
+
+    for (int i=0; i<MAX_FILES; i++)
+        host_close(i);
+}
+
+
+static void test_buffering(void)
+{
+    static const struct {
+        const char *name;
+        int mode;
+    } modes[] = {
+        { "unbuffered", _IONBF },
+        { "line",       _IOLBF },
+        { "full",       _IOFBF }
+    };
+
+    static char expected[sizeof(mock.data)];
+    size_t expected_len = 0;
+
+    for (int n=0; n<NUM_LINES; n++) {
+        expected_len += sprintf(&expected[expected_len],
+            "%4d: %8.3f %8.3f %8.3f\n", n, n * 0.1, n * 0.2, n * 0.3);
+    }
+
+    printf("%d lines, %zu bytes, %d byte buffer:\n", NUM_LINES, expected_len, STDIO_BUF_SIZE);
+
+    for (unsigned i=0; i<ARRAY_SIZE(modes); i++) {
+        int fd = host_open("/dev/mock", O_WRONLY);
+        FILE *f = host_fdopen(fd, "w");
+        CHECK(f != NULL);
+        CHECK(host_setvbuf(f, NULL, modes[i].mode, STDIO_BUF_SIZE) == 0);
+
+        mock_reset();
+
+        double t0 = test_time();
+        for (int n=0; n<NUM_LINES; n++)
+            fprintf(f, "%4d: %8.3f %8.3f %8.3f\n", n, n * 0.1, n * 0.2, n * 0.3);
+        fflush(f);
+        double dt = test_time() - t0;
+
+        CHECK(mock.len == expected_len && !memcmp(mock.data, expected, expected_len));
+
+        printf("%-10s %7u writes, %6.1f bytes/write, %6.1f MB/s\n",
+            modes[i].name, mock.writes, (double)mock.len / mock.writes,
+            mock.len / dt / 1e6);
+
+        fclose(f);
+        host_close(fd);
+    }
+}
+
+
+int main(void)
+{
+    CHECK(dev_register("mock", &mock_ops) >= 0);
+
+    test_fd_table();
+    test_redirect();
+    test_buffering();
+
+    // The shell command writes to /dev/null
+    //
+    printf("\nstdio_bench 1000:\n");
+    char *argv[] = { "stdio_bench", "1000", NULL };
+    __shell_cmd_stdio_bench.func(2, argv);
+
+    return 0;
+}
@@ -0,0 +1,227 @@
+/**
+ * \file
+ * tlm_codec round-trip and compression ratio
+ *
+ * Packs simulated IMU samples into telemetry messages like
+ * Source/telemetry.c does, decodes them like QuadControl does,
+ * and compares the result with the input.
+ *
+ * Copyright (c)2015 Thomas Kindler <mail_drquad@t-kindler.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "test.h"
+#include "Shared/tlm_codec.h"
+#include "Shared/msg_structs.h"
+#include "Shared/errors.h"
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+
+#define NUM_SAMPLES     100000
+#define NUM_CHANNELS    MSG_IMU_NUM_CHANNELS
+
+static const float resolution[] = MSG_IMU_RESOLUTION;
+
+static uint32_t seed = 1;
+
+
+/**
+ * Approximately normal distributed noise [LSB]
+ */
+static float noise(float sigma)
+{
+    float sum = 0;
+    for (int i=0; i<4; i++)
+        sum += (test_rand(&seed) / 4294967296.0f) - 0.5f;
+
+    return sum * sigma * 1.732f;
+}
+
+
+/**
+ * Hovering vehicle: gravity, a slow rotation, and sensor noise
+ * of a few LSB, like the MPU9150 shows with motors running.
+ */
+static void make_sample(float *s, int n, float lsb_noise)
+{
+    float t = n * 0.001f;
+
+    s[0] = 0.5f * sinf(t);
+    s[1] = 0.3f * cosf(t * 0.7f);
+    s[2] = -9.80665f;
+    s[3] = 0.2f * cosf(t);
+    s[4] = 0.1f * sinf(t * 0.7f);
+    s[5] = 0.05f;
+    s[6] = 20e-6f * cosf(t * 0.1f);
+    s[7] = 20e-6f * sinf(t * 0.1f);
+    s[8] = -40e-6f;
+    s[9] = 1013.25f - t * 0.01f;
+    s[10] = 25.0f;
+
+    for (int i=0; i<NUM_CHANNELS; i++)
+        s[i] += noise(lsb_noise) * resolution[i];
+}
+
+
+/**
+ * Encode NUM_SAMPLES samples into messages, decode them,
+ * and return the compression ratio.
+ */
+static double round_trip(float lsb_noise)
+{
+    struct tlm_codec enc, dec;
+    tlm_codec_init(&enc, resolution, NUM_CHANNELS);
+    tlm_codec_init(&dec, resolution, NUM_CHANNELS);
+
+    static float input[NUM_SAMPLES][NUM_CHANNELS];
+    float output[NUM_CHANNELS];
+
+    uint8_t payload[MSG_TELEMETRY_DATA_SIZE];
+    size_t  payload_len = 0;
+    int     first = 0;          // index of the first sample in payload
+    size_t  tx_bytes = 0;
+    int     tx_packets = 0;
+
+    for (int n=0; n<=NUM_SAMPLES; n++) {
+        ssize_t len = -1;
+
+        if (n < NUM_SAMPLES) {
+            make_sample(input[n], n, lsb_noise);
+            len = tlm_encode(&enc, &payload[payload_len],
+                sizeof(payload) - payload_len, input[n]);
+        }
+
+        if (len >= 0) {
+            payload_len += len;
+            continue;
+        }
+
+        CHECK(errno == ETLM_ENCODE_OUT_BUFFER_OVERFLOW || n == NUM_SAMPLES);
+        CHECK(payload_len > 0);
+
+        // Decode the full message, each one starts with a keyframe
+        //
+        tlm_codec_reset(&dec);
+
+        size_t pos = 0;
+        for (int i=first; i<n; i++) {
+            ssize_t used = tlm_decode(&dec, output, &payload[pos], payload_len - pos);
+            CHECK(used > 0);
+            pos += used;
+
+            for (int ch=0; ch<NUM_CHANNELS; ch++)
+                CHECK(fabsf(output[ch] - input[i][ch]) <= resolution[ch] * 0.51f);
+        }
+        CHECK(pos == payload_len);
+
+        tx_bytes += 4 + 4 + payload_len;    // timestamp, interval, samples
+        tx_packets++;
+
+        if (n == NUM_SAMPLES)
+            break;
+
+        // Start the next message with this sample
+        //
+        tlm_codec_reset(&enc);
+        payload_len = 0;
+        first = n;
+        n--;
+    }
+
+    double ratio = (double)NUM_SAMPLES * sizeof(struct msg_imu_sample) / tx_bytes;
+
+    printf("noise %5.1f LSB: %6d packets, %5.2f samples/packet, ratio %.2f\n",
+        lsb_noise, tx_packets, (double)NUM_SAMPLES / tx_packets, ratio);
+
+    return ratio;
+}
+
+
+/**
+ * Truncated and malformed input must be rejected.
+ */
+static void test_errors(void)
+{
+    struct tlm_codec c;
+    float sample[NUM_CHANNELS];
+    uint8_t buf[TLM_ENCODE_DST_BUF_LEN_MAX(NUM_CHANNELS)];
+
+    tlm_codec_init(&c, resolution, NUM_CHANNELS);
+    make_sample(sample, 0, 0);
+
+    ssize_t len = tlm_encode(&c, buf, sizeof(buf), sample);
+    CHECK(len > 0);
+
+    // The codec state must not change if the sample doesn't fit
+    //
+    tlm_codec_reset(&c);
+    struct tlm_codec saved = c;
+    CHECK(tlm_encode(&c, buf, len - 1, sample) < 0);
+    CHECK(errno == ETLM_ENCODE_OUT_BUFFER_OVERFLOW);
+    CHECK(!memcmp(&saved, &c, sizeof(c)));
+
+    // Neither must the decoder's, if the sample is cut short
+    //
+    for (ssize_t i=0; i<len; i++) {
+        tlm_codec_reset(&c);
+        c.prev[0] = 12345;
+        saved = c;
+        CHECK(tlm_decode(&c, sample, buf, i) < 0);
+        CHECK(errno == ETLM_DECODE_TRUNCATED);
+        CHECK(!memcmp(&saved, &c, sizeof(c)));
+    }
+
+    memset(buf, 0xFF, sizeof(buf));
+    tlm_codec_reset(&c);
+    CHECK(tlm_decode(&c, sample, buf, sizeof(buf)) < 0);
+    CHECK(errno == ETLM_DECODE_INVALID);
+
+    // A 5th varint byte has room for 4 bits only
+    //
+    static const uint8_t max_varint[] = { 0xFF, 0xFF, 0xFF, 0xFF, 0x0F };
+    static const uint8_t too_big[]    = { 0xFF, 0xFF, 0xFF, 0xFF, 0x1F };
+
+    memset(buf, 0, sizeof(buf));
+    memcpy(buf, max_varint, sizeof(max_varint));
+    tlm_codec_reset(&c);
+    CHECK(tlm_decode(&c, sample, buf, sizeof(buf)) == 5 + NUM_CHANNELS - 1);
+    CHECK(c.prev[0] == INT32_MIN);
+
+    memcpy(buf, too_big, sizeof(too_big));
+    tlm_codec_reset(&c);
+    CHECK(tlm_decode(&c, sample, buf, sizeof(buf)) < 0);
+    CHECK(errno == ETLM_DECODE_INVALID);
+
+    // Out of range values saturate
+    //
+    sample[0] = 1e30f;
+    sample[1] = -1e30f;
+    sample[2] = NAN;
+    tlm_codec_reset(&c);
+    CHECK(tlm_encode(&c, buf, sizeof(buf), sample) > 0);
+}
+
+
+int main(void)
+{
+    test_errors();
+
+    CHECK(round_trip(0) > 3);
+    CHECK(round_trip(4) > 3);
+    round_trip(32);
+    round_trip(256);
+
+    return 0;
+}
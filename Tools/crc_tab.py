@@ -0,0 +1,57 @@
+#!/usr/bin/env python
+#
+# Generate slicing-by-N tables for the reflected CRCs in Shared/
+#
+# Usage: crc_tab.py 16 > Shared/crc16_tab.inc
+#        crc_tab.py 32 > Shared/crc32_tab.inc
+#
+import sys
+
+models = {
+    #      poly (reflected), slices, C type
+    16: ( 0xA001,     4, "crc16_t" ),    # crc-16
+    32: ( 0xEDB88320, 8, "crc32_t" )     # crc-32
+}
+
+width = int(sys.argv[1])
+poly, slices, ctype = models[width]
+
+tab = [[0] * 256 for n in range(slices)]
+
+for i in range(256):
+    crc = i
+    for bit in range(8):
+        crc = (crc >> 1) ^ poly if crc & 1 else crc >> 1
+    tab[0][i] = crc
+
+# tab[n][i] is the CRC of byte i followed by n zero bytes
+#
+for n in range(1, slices):
+    for i in range(256):
+        crc = tab[n-1][i]
+        tab[n][i] = (crc >> 8) ^ tab[0][crc & 0xFF]
+
+digits = width / 4
+per_line = 8 if width == 16 else 4
+
+print "// Generated by crc_tab.py %d, slicing-by-%d" % (width, slices)
+print "//"
+print "static const %s crc_table[%d][256] = {" % (ctype, slices)
+
+for n in range(slices):
+    print "    {"
+    for i in range(256):
+        if (i % per_line == 0):
+            print "       ",
+
+        if (i != 255):
+            print "0x%0*x," % (digits, tab[n][i]),
+        else:
+            print "0x%0*x" % (digits, tab[n][i]),
+
+        if (i % per_line == per_line - 1):
+            print
+
+    print "    }," if n != slices - 1 else "    }"
+
+print "};"
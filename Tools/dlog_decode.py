@@ -0,0 +1,260 @@
+#!/usr/bin/env python
+#
+# Decode deferred log records (MSG_ID_DLOG) from a DrQuad link
+# Copyright (C)2015 Thomas Kindler <mail@t-kindler.de>
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+import os, re, sys, struct
+import argparse
+
+from elf import ELFObject, ELFSection
+
+
+MSG_ID_DLOG = 0x0030
+
+# printf conversion, see dlog.h for the supported subset
+#
+FORMAT_RE = re.compile(
+    r"%([-+ #0]*)(\d+|\*)?(\.\d+)?(hh|h|ll|l|j|z|t|L)?([diouxXeEfFgGcsp%])"
+)
+
+
+def crc16(data):
+    """CRC-16 (poly 0x8005, reflected), see Shared/crc16.c"""
+    crc = 0x0000
+    for b in bytearray(data):
+        crc ^= b
+        for i in range(8):
+            crc = (crc >> 1) ^ 0xA001 if crc & 1 else crc >> 1
+    return crc
+
+
+def cobsr_decode(src):
+    """COBS/R decoder, see Shared/cobsr.c"""
+    src = bytearray(src)
+    dst = bytearray()
+    i = 0
+
+    while i < len(src):
+        code = src[i]
+        i += 1
+        remaining = len(src) - i
+
+        if code == 0:
+            raise ValueError("zero byte in input")
+
+        if code - 1 < remaining:
+            dst += src[i : i + code - 1]
+            i += code - 1
+            if code != 0xFF:
+                dst.append(0)
+        else:
+            dst += src[i:]
+            if code - 1 > remaining:
+                dst.append(code)
+            break
+
+    return dst
+
+
+class FormatTable:
+    def __init__(self, filename):
+        elf = ELFObject()
+        with open(filename, "rb") as file:
+            elf.fromFile(file)
+
+        section = elf.getSection(".dlog_fmt")
+        if section == None:
+            raise Exception("No .dlog_fmt section in %s" % filename)
+
+        self.fmt = section.data
+        self.sections = [
+            s for s in elf.sections
+            if s.sh_flags & ELFSection.SHF_ALLOC and
+               s.sh_type != ELFSection.SHT_NOBITS
+        ]
+
+    def get_format(self, offset):
+        end = self.fmt.find("\0", offset)
+        if offset >= len(self.fmt) or end < 0:
+            return None
+        return self.fmt[offset:end]
+
+    def get_string(self, addr):
+        for s in self.sections:
+            if s.sh_addr <= addr < s.sh_addr + s.sh_size:
+                data = s.data[addr - s.sh_addr:]
+                return data[:data.find("\0")]
+        return "<0x%08x>" % addr
+
+    def format(self, offset, args):
+        fmt = self.get_format(offset)
+        if fmt == None:
+            return "<unknown format 0x%x> %s" % (
+                offset, " ".join("%08x" % a for a in args)
+            )
+
+        out = []
+        pos = 0
+        args = list(args)
+
+        for m in FORMAT_RE.finditer(fmt):
+            out.append(fmt[pos:m.start()])
+            pos = m.end()
+
+            flags, width, prec, length, conv = m.groups()
+            if conv == "%":
+                out.append("%")
+                continue
+
+            if width == "*":
+                width = str(struct.unpack("<i", struct.pack("<I", args.pop(0)))[0])
+
+            if conv == "p":
+                flags, conv = flags + "#", "x"
+
+            spec = "%" + flags + (width or "") + (prec or "")
+            word = args.pop(0) if args else 0
+
+            if conv in "di":
+                value = struct.unpack("<i", struct.pack("<I", word))[0]
+            elif conv in "eEfFgG":
+                value = struct.unpack("<f", struct.pack("<I", word))[0]
+            elif conv == "s":
+                value = self.get_string(word)
+            else:
+                value = word
+
+            out.append((spec + conv) % value)
+
+        out.append(fmt[pos:])
+        return "".join(out)
+
+
+class Decoder:
+    def __init__(self, table):
+        self.table = table
+        self.packet = bytearray()
+        self.t_last = None
+        self.t_high = 0
+        self.dropped = 0
+
+    def feed(self, data):
+        for b in bytearray(data):
+            if b == 0:
+                if self.packet:
+                    self.handle_packet(self.packet)
+                self.packet = bytearray()
+            else:
+                self.packet.append(b)
+
+    def handle_packet(self, packet):
+        try:
+            data = cobsr_decode(packet)
+        except ValueError:
+            return
+
+        if len(data) < 4:
+            return
+
+        crc, id = struct.unpack_from("<HH", data)
+        if crc != crc16(data[2:]) or id != MSG_ID_DLOG:
+            return
+
+        clock, dropped = struct.unpack_from("<II", data, 4)
+        words = struct.unpack_from("<%dI" % ((len(data) - 12) / 4), data, 12)
+
+        if dropped != self.dropped:
+            print "*** %d records dropped" % (dropped - self.dropped)
+            self.dropped = dropped
+
+        i = 0
+        while i + 2 <= len(words):
+            nargs = words[i] & 0x0F
+            offset = words[i] >> 4
+            t = self.unwrap(words[i+1])
+            args = words[i+2 : i+2+nargs]
+            i += 2 + nargs
+
+            text = self.table.format(offset, args).rstrip("\n")
+            print "%12.6f  %s" % (float(t) / clock, text)
+
+        sys.stdout.flush()
+
+    def unwrap(self, t):
+        # The cycle counter wraps every 25s at 168 MHz.
+        # Records arrive in order, so a decrease means a wrap.
+        #
+        if self.t_last != None and t < self.t_last:
+            self.t_high += 1 << 32
+        self.t_last = t
+        return self.t_high + t
+
+
+def parse_args():
+    global args
+
+    parser = argparse.ArgumentParser(
+        description="Decode deferred log records from a DrQuad link"
+    )
+
+    parser.add_argument(
+        "--version", action="version",
+        version="%(prog)s 1.0.0"
+    )
+
+    parser.add_argument(
+        "-b", "--baudrate", dest="baudrate", type=int,
+        help="serial port baud rate",
+        default=115200
+    )
+
+    parser.add_argument(
+        "elf", help = "ELF file of the running firmware"
+    )
+
+    parser.add_argument(
+        "source", help = "serial port or captured data file"
+    )
+
+    args = parser.parse_args()
+
+
+def open_source(name):
+    if os.path.isfile(name):
+        return open(name, "rb")
+
+    import serial
+    return serial.Serial(name, args.baudrate, timeout=0.1)
+
+
+if __name__ == '__main__':
+    try:
+        parse_args()
+        decoder = Decoder(FormatTable(args.elf))
+        source = open_source(args.source)
+
+        while True:
+            data = source.read(4096)
+            if not data and os.path.isfile(args.source):
+                break
+            decoder.feed(data)
+
+    except KeyboardInterrupt:
+        pass
+
+    except Exception as e:
+        print e
+        exit(1)
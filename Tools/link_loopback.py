@@ -0,0 +1,224 @@
+#!/usr/bin/env python
+#
+# Local stand-in for the link benchmark of the DrQuad bootloader
+# Copyright (C)2015 Thomas Kindler <mail@t-kindler.de>
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Answers the MSG_ID_BENCH_* messages like Bootloader/main.c, so the
+# link benchmark in QuadControl can be tested without hardware.
+# Connect QuadControl to wifly://localhost:<port>.
+#
+import sys, time, random, socket, struct
+import argparse
+
+from dlog_decode import crc16, cobsr_decode
+
+
+MSG_MAX_DATA_SIZE       = 96
+MSG_MAX_LINK_DATA_SIZE  = 4 + 4 + 4096
+
+MSG_ID_LINK_SETUP       = 0x0001
+MSG_ID_BENCH_PING       = 0x0040
+MSG_ID_BENCH_PONG       = 0x0041
+MSG_ID_BENCH_DATA       = 0x0042
+MSG_ID_BENCH_SOURCE     = 0x0043
+MSG_ID_BOOT_ENTER       = 0xB000
+MSG_IG_BOOT_EXIT        = 0xB00F
+MSG_ID_BOOT_RESPONSE    = 0xB010
+
+
+def cobsr_encode(src):
+    """COBS/R encoder, see Shared/cobsr.c"""
+    src = bytearray(src)
+    dst = bytearray()
+    start = 0
+
+    for i, b in enumerate(src):
+        if b == 0:
+            dst.append(i - start + 1)
+            dst += src[start:i]
+            start = i + 1
+        elif i - start == 0xFD and i + 1 < len(src):
+            dst.append(0xFF)
+            dst += src[start:i+1]
+            start = i + 1
+
+    # The last code byte is replaced by the last data
+    # byte, if that is not smaller than the code
+    #
+    code = len(src) - start + 1
+    if start < len(src) and src[-1] >= code:
+        dst.append(src[-1])
+        dst += src[start:-1]
+    else:
+        dst.append(code)
+        dst += src[start:]
+
+    return dst
+
+
+class Loopback:
+    def __init__(self, sock):
+        self.sock = sock
+        self.packet = bytearray()
+        self.max_data_size = MSG_MAX_DATA_SIZE
+        self.rx_packets = 0
+        self.rx_bytes = 0
+        self.t0 = time.time()
+
+    def feed(self, data):
+        for b in bytearray(data):
+            if b == 0:
+                if self.packet:
+                    self.handle_packet(self.packet)
+                self.packet = bytearray()
+            else:
+                self.packet.append(b)
+
+    def send(self, id, data=""):
+        body = struct.pack("<H", id) + bytes(data)
+        frame = cobsr_encode(struct.pack("<H", crc16(body)) + body)
+
+        if random.random() < args.loss / 100.0:
+            return
+
+        if args.baudrate:
+            time.sleep(len(frame) * 10.0 / args.baudrate)
+
+        self.sock.sendall(bytes(frame + "\0"))
+
+    def respond(self, error, data=""):
+        self.send(MSG_ID_BOOT_RESPONSE, struct.pack("<i", error) + data)
+
+    def handle_packet(self, packet):
+        try:
+            data = cobsr_decode(packet)
+        except ValueError:
+            return
+
+        if len(data) < 4 or random.random() < args.loss / 100.0:
+            return
+
+        crc, id = struct.unpack_from("<HH", data)
+        if crc != crc16(data[2:]):
+            return
+
+        data = bytes(data[4:])
+
+        if args.delay:
+            time.sleep(args.delay / 1000.0)
+
+        if id == MSG_ID_BOOT_ENTER or id == MSG_IG_BOOT_EXIT:
+            self.respond(0)
+
+        elif id == MSG_ID_LINK_SETUP:
+            size, flags = struct.unpack_from("<HH", data)
+            self.max_data_size = max(MSG_MAX_DATA_SIZE, min(size, MSG_MAX_LINK_DATA_SIZE))
+            self.respond(0, struct.pack("<HH", self.max_data_size, 0))
+
+        elif id == MSG_ID_BENCH_PING and len(data) >= 20:
+            seq, t_send = struct.unpack_from("<II", data)
+            if seq == 0:
+                self.rx_packets = self.rx_bytes = 0
+
+            t_echo = int((time.time() - self.t0) * 1e6) & 0xFFFFFFFF
+            self.send(MSG_ID_BENCH_PONG,
+                data[:8] +
+                struct.pack("<III", t_echo, self.rx_packets, self.rx_bytes) +
+                data[20:]
+            )
+
+        elif id == MSG_ID_BENCH_DATA:
+            self.rx_packets += 1
+            self.rx_bytes += len(data)
+
+        elif id == MSG_ID_BENCH_SOURCE:
+            count, size = struct.unpack_from("<IH", data)
+            size = max(4, min(size, self.max_data_size))
+            payload = bytes(bytearray(i & 0xFF for i in range(4, size)))
+
+            for seq in range(count):
+                self.send(MSG_ID_BENCH_DATA, struct.pack("<I", seq) + payload)
+
+
+def parse_args():
+    global args
+
+    parser = argparse.ArgumentParser(
+        description="Answer link benchmark messages like the DrQuad bootloader"
+    )
+
+    parser.add_argument(
+        "--version", action="version",
+        version="%(prog)s 1.0.0"
+    )
+
+    parser.add_argument(
+        "-p", "--port", dest="port", type=int,
+        help="TCP port to listen on",
+        default=2000
+    )
+
+    parser.add_argument(
+        "-b", "--baudrate", dest="baudrate", type=int,
+        help="simulated link speed, 0 for unlimited",
+        default=0
+    )
+
+    parser.add_argument(
+        "-d", "--delay", dest="delay", type=float,
+        help="processing delay per message [ms]",
+        default=0
+    )
+
+    parser.add_argument(
+        "-l", "--loss", dest="loss", type=float,
+        help="packet loss in each direction [%%]",
+        default=0
+    )
+
+    args = parser.parse_args()
+
+
+if __name__ == '__main__':
+    try:
+        parse_args()
+
+        server = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        server.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        server.bind(("", args.port))
+        server.listen(1)
+
+        while True:
+            print "Listening on port %d" % args.port
+            sock, addr = server.accept()
+            sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+            print "Connection from %s:%d" % addr
+
+            loopback = Loopback(sock)
+            while True:
+                data = sock.recv(4096)
+                if not data:
+                    break
+                loopback.feed(data)
+
+            sock.close()
+
+    except KeyboardInterrupt:
+        pass
+
+    except Exception as e:
+        print e
+        exit(1)